@@ -36,6 +36,7 @@
 #include <upipe/uprobe_upump_mgr.h>
 #include <upipe/uprobe_uclock.h>
 #include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uprobe_trace.h>
 #include <upipe/uclock.h>
 #include <upipe/uclock_std.h>
 #include <upipe/umem.h>
@@ -86,6 +87,7 @@
 #define UPUMP_BLOCKER_POOL  5
 #define READ_SIZE           4096
 #define UPROBE_LOG_LEVEL UPROBE_LOG_NOTICE
+#define TRACE_SAMPLING      16
 
 struct es_conf {
     struct uchain uchain;
@@ -107,7 +109,10 @@ static struct upipe *avfsink;
 struct uchain eslist;
 
 static void usage(const char *argv0) {
-    fprintf(stderr, "Usage: %s [-d] [-m <mime>] [-f <format>] [-p <id> -c <codec> [-o <option=value>] ...] ... <source file> <sink file>\n", argv0);
+    fprintf(stderr, "Usage: %s [-d] [-t <trace file>] [-T <sampling>] [-m <mime>] [-f <format>] [-p <id> -c <codec> [-o <option=value>] ...] ... <source file> <sink file>\n", argv0);
+    fprintf(stderr, "   -t: write a trace of sampled urefs (Chrome trace format)\n");
+    fprintf(stderr, "   -T: trace one uref out of <sampling> (default %u)\n",
+            TRACE_SAMPLING);
     fprintf(stderr, "   -f: output format name\n");
     fprintf(stderr, "   -m: output mime type\n");
     fprintf(stderr, "   -p: add stream with id\n");
@@ -340,6 +345,8 @@ int main(int argc, char *argv[])
     int opt;
     const char *src_url, *sink_url;
     const char *mime = NULL, *format = NULL;
+    const char *trace_file = NULL;
+    unsigned int trace_sampling = TRACE_SAMPLING;
     struct es_conf *es_cur = NULL;
 
     /* upipe env (udict, umem) */
@@ -351,11 +358,17 @@ int main(int argc, char *argv[])
     ulist_init(&eslist);
 
     /* parse options */
-    while ((opt = getopt(argc, argv, "dm:f:p:c:o:")) != -1) {
+    while ((opt = getopt(argc, argv, "dt:T:m:f:p:c:o:")) != -1) {
         switch(opt) {
             case 'd':
                 if (loglevel > 0) loglevel--;
                 break;
+            case 't':
+                trace_file = optarg;
+                break;
+            case 'T':
+                trace_sampling = strtoul(optarg, NULL, 0);
+                break;
             case 'm':
                 mime = optarg;
                 break;
@@ -409,6 +422,12 @@ int main(int argc, char *argv[])
     logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
                                    UBUF_POOL_DEPTH);
     assert(logger != NULL);
+    struct uprobe *uprobe_trace = NULL;
+    if (trace_file != NULL) {
+        logger = uprobe_trace_alloc(logger, uclock, trace_sampling, NULL);
+        assert(logger != NULL);
+        uprobe_trace = logger;
+    }
     uprobe_init(&uprobe_demux_s, catch_demux, uprobe_use(logger));
 
     upipe_av_init(false, uprobe_use(logger));
@@ -464,6 +483,15 @@ int main(int argc, char *argv[])
 
     es_conf_clean(&eslist);
 
+    if (uprobe_trace != NULL) {
+        FILE *file = fopen(trace_file, "w");
+        if (file == NULL ||
+            !ubase_check(uprobe_trace_write(uprobe_trace, file)))
+            fprintf(stderr, "error: could not write trace\n");
+        if (file != NULL)
+            fclose(file);
+    }
+
     upump_mgr_release(upump_mgr);
     uref_mgr_release(uref_mgr);
     udict_mgr_release(udict_mgr);
@@ -44,6 +44,61 @@ UREF_ATTR_FLOAT(ebur128, global, "ebur128.global", global integrated loudness)
 
 #define UPIPE_EBUR128_SIGNATURE UBASE_FOURCC('r', '1', '2', '8')
 
+/** @This extends upipe_command with specific commands for ebur128 pipes. */
+enum upipe_ebur128_command {
+    UPIPE_EBUR128_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the reporting interval (uint64_t) */
+    UPIPE_EBUR128_SET_INTERVAL,
+    /** returns the reporting interval (uint64_t *) */
+    UPIPE_EBUR128_GET_INTERVAL,
+    /** restarts the integrated and range measurements (void) */
+    UPIPE_EBUR128_RESET
+};
+
+/** @This sets the reporting interval of the loudness range and integrated
+ * loudness. Both values scan the whole gating histogram, so they are only
+ * computed once per interval of audio and the cached values are attached to
+ * the buffers in between. The momentary loudness is computed for every
+ * buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval interval in units of the 27 MHz clock (0 computes the values
+ * for every buffer)
+ * @return an error code
+ */
+static inline int upipe_ebur128_set_interval(struct upipe *upipe,
+                                             uint64_t interval)
+{
+    return upipe_control(upipe, UPIPE_EBUR128_SET_INTERVAL,
+                         UPIPE_EBUR128_SIGNATURE, interval);
+}
+
+/** @This returns the reporting interval.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval_p filled in with the interval in units of the 27 MHz clock
+ * @return an error code
+ */
+static inline int upipe_ebur128_get_interval(struct upipe *upipe,
+                                             uint64_t *interval_p)
+{
+    return upipe_control(upipe, UPIPE_EBUR128_GET_INTERVAL,
+                         UPIPE_EBUR128_SIGNATURE, interval_p);
+}
+
+/** @This restarts the integrated loudness and loudness range measurements,
+ * for instance at a program boundary.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static inline int upipe_ebur128_reset(struct upipe *upipe)
+{
+    return upipe_control(upipe, UPIPE_EBUR128_RESET,
+                         UPIPE_EBUR128_SIGNATURE);
+}
+
 /** @This returns the management structure for all avformat sources.
  *
  * @return pointer to manager
@@ -37,9 +37,34 @@ extern "C" {
 
 UREF_ATTR_FLOAT_VA(amax, amplitude, "amax.amp[%" PRIu8"]", max amplitude,
         uint8_t plane, plane)
+UREF_ATTR_FLOAT_VA(amax, rms, "amax.rms[%" PRIu8"]", RMS amplitude,
+        uint8_t plane, plane)
+UREF_ATTR_FLOAT_VA(amax, true_peak, "amax.tp[%" PRIu8"]", true peak amplitude,
+        uint8_t plane, plane)
 
 #define UPIPE_AUDIO_MAX_SIGNATURE UBASE_FOURCC('a', 'm', 'a', 'x')
 
+/** @This extends upipe_command with specific commands for amax pipes. */
+enum upipe_amax_command {
+    UPIPE_AMAX_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** enables or disables true peak metering (int) */
+    UPIPE_AMAX_SET_TRUE_PEAK
+};
+
+/** @This enables or disables true peak metering (4 times oversampling).
+ * Peak and RMS amplitudes are always computed.
+ *
+ * @param upipe description structure of the pipe
+ * @param enable true to compute the true peak amplitude
+ * @return an error code
+ */
+static inline int upipe_amax_set_true_peak(struct upipe *upipe, bool enable)
+{
+    return upipe_control(upipe, UPIPE_AMAX_SET_TRUE_PEAK,
+                         UPIPE_AUDIO_MAX_SIGNATURE, enable ? 1 : 0);
+}
+
 /** @This returns the management structure for all amax sources.
  *
  * @return pointer to manager
@@ -36,9 +36,101 @@ extern "C" {
 
 #include <upipe/upipe.h>
 
+#include <stdint.h>
+
 #define UPIPE_RTCPFB_SIGNATURE UBASE_FOURCC('r','t','c','f')
 #define UPIPE_RTCPFB_INPUT_SIGNATURE UBASE_FOURCC('r','t','c','i')
 
+/** @This is the description of the retransmission counters. */
+struct upipe_rtcpfb_stats {
+    /** number of packets currently buffered */
+    uint64_t buffered;
+    /** number of packets requested by NACKs */
+    uint64_t nacks;
+    /** number of packets retransmitted */
+    uint64_t retransmitted;
+    /** number of requests coalesced with a recent retransmission */
+    uint64_t coalesced;
+    /** number of requests for packets no longer (or never) buffered */
+    uint64_t missing;
+    /** number of packets expired from the buffer */
+    uint64_t expired;
+    /** number of requests dropped because of a receiver rate cap */
+    uint64_t capped;
+};
+
+/** @This is the description of the counters of a receiver, that is an
+ * input subpipe. */
+struct upipe_rtcpfb_receiver_stats {
+    /** SSRC of the last RTCP packet of the receiver */
+    uint32_t ssrc;
+    /** smoothed round-trip time (in 27 MHz units), or 0 if unknown */
+    uint64_t rtt;
+    /** number of packets requested by NACKs */
+    uint64_t nacks;
+    /** number of packets retransmitted */
+    uint64_t retransmitted;
+    /** number of requests coalesced with a recent retransmission */
+    uint64_t coalesced;
+    /** number of requests for packets no longer (or never) buffered */
+    uint64_t missing;
+    /** number of requests dropped because of the rate cap */
+    uint64_t capped;
+};
+
+/** @This extends uprobe_event with specific events for rtcpfb. */
+enum uprobe_rtcpfb_event {
+    UPROBE_RTCPFB_SENTINEL = UPROBE_LOCAL,
+
+    /** counters changed since the last event
+     * (const struct upipe_rtcpfb_stats *) */
+    UPROBE_RTCPFB_STATS
+};
+
+/** @This extends upipe_command with specific commands for rtcpfb. */
+enum upipe_rtcpfb_command {
+    UPIPE_RTCPFB_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the retransmission counters (struct upipe_rtcpfb_stats *) */
+    UPIPE_RTCPFB_GET_STATS
+};
+
+/** @This returns the retransmission counters.
+ *
+ * @param upipe description structure of the pipe
+ * @param stats filled in with the counters
+ * @return an error code
+ */
+static inline int upipe_rtcpfb_get_stats(struct upipe *upipe,
+                                         struct upipe_rtcpfb_stats *stats)
+{
+    return upipe_control(upipe, UPIPE_RTCPFB_GET_STATS,
+                         UPIPE_RTCPFB_SIGNATURE, stats);
+}
+
+/** @This extends upipe_command with specific commands for rtcpfb input
+ * subpipes. */
+enum upipe_rtcpfb_input_command {
+    UPIPE_RTCPFB_INPUT_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the counters of the receiver
+     * (struct upipe_rtcpfb_receiver_stats *) */
+    UPIPE_RTCPFB_INPUT_GET_STATS
+};
+
+/** @This returns the counters of a receiver.
+ *
+ * @param upipe description structure of the input subpipe
+ * @param stats filled in with the counters
+ * @return an error code
+ */
+static inline int upipe_rtcpfb_input_get_stats(struct upipe *upipe,
+        struct upipe_rtcpfb_receiver_stats *stats)
+{
+    return upipe_control(upipe, UPIPE_RTCPFB_INPUT_GET_STATS,
+                         UPIPE_RTCPFB_INPUT_SIGNATURE, stats);
+}
+
 /** @This returns the management structure for rtcpfb pipes.
  *
  * @return pointer to manager
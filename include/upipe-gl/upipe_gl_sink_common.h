@@ -78,6 +78,82 @@ enum upipe_gl_sink_command {
  */
 bool upipe_gl_texture_load_uref(struct uref *uref, unsigned int texture);
 
+/** number of pixel buffer objects used to stream uploads */
+#define UPIPE_GL_TEXTURE_PBOS 3
+
+/** @This describes the layout of the pictures loaded into a texture. */
+enum upipe_gl_texture_format {
+    /** no storage allocated */
+    UPIPE_GL_TEXTURE_NONE,
+    /** packed r8g8b8 */
+    UPIPE_GL_TEXTURE_RGB,
+    /** packed r5g6b5 */
+    UPIPE_GL_TEXTURE_RGB565,
+    /** planar y8 u8 v8, 4:2:0 */
+    UPIPE_GL_TEXTURE_YUV420P,
+    /** planar y8 u8 v8, 4:2:2 */
+    UPIPE_GL_TEXTURE_YUV422P
+};
+
+/** @This holds the GL objects used to stream pictures to a texture.
+ * Texture storage is allocated once per picture size and format, and
+ * updated in place. Uploads go through a ring of pixel buffer objects
+ * when available, and planar YUV is converted to RGB by a shader. */
+struct upipe_gl_texture {
+    /** textures, one per plane */
+    unsigned int textures[3];
+    /** pixel buffer objects, or 0 if unsupported */
+    unsigned int pbos[UPIPE_GL_TEXTURE_PBOS];
+    /** index of the next pixel buffer object to fill */
+    unsigned int pbo;
+    /** YUV to RGB program, or 0 if unsupported */
+    unsigned int program;
+    /** layout of the allocated storage */
+    enum upipe_gl_texture_format format;
+    /** width of the allocated storage */
+    size_t width;
+    /** height of the allocated storage */
+    size_t height;
+};
+
+/** @This allocates the GL objects of a texture. It must be called with the
+ * GL context current.
+ *
+ * @param texture pointer to texture structure
+ * @return false in case of error
+ */
+bool upipe_gl_texture_init(struct upipe_gl_texture *texture);
+
+/** @This releases the GL objects of a texture. It must be called with the
+ * GL context current.
+ *
+ * @param texture pointer to texture structure
+ */
+void upipe_gl_texture_clean(struct upipe_gl_texture *texture);
+
+/** @This uploads a uref picture (r8g8b8, r5g6b5, or planar y8 u8 v8 in
+ * 4:2:0 or 4:2:2) into a texture.
+ *
+ * @param texture pointer to texture structure
+ * @param uref uref structure describing the picture
+ * @return false in case of error
+ */
+bool upipe_gl_texture_load(struct upipe_gl_texture *texture,
+                           struct uref *uref);
+
+/** @This binds a texture to GL_TEXTURE_2D, together with the YUV to RGB
+ * program if needed.
+ *
+ * @param texture pointer to texture structure
+ */
+void upipe_gl_texture_bind(struct upipe_gl_texture *texture);
+
+/** @This unbinds a texture bound with @ref upipe_gl_texture_bind.
+ *
+ * @param texture pointer to texture structure
+ */
+void upipe_gl_texture_unbind(struct upipe_gl_texture *texture);
+
 #ifdef __cplusplus
 }
 #endif
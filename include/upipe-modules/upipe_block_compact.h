@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module coalescing segmented blocks
+ * This pipe copies blocks made of many small segments, such as access units
+ * reassembled from TS packets, into a single aligned linear buffer, so that
+ * downstream pipes see one segment per block.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_BLOCK_COMPACT_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_BLOCK_COMPACT_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_BLOCK_COMPACT_SIGNATURE UBASE_FOURCC('b','c','m','p')
+
+/** @This extends upipe_command with specific commands for block_compact
+ * pipes. */
+enum upipe_block_compact_command {
+    UPIPE_BLOCK_COMPACT_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the segment threshold (unsigned int *) */
+    UPIPE_BLOCK_COMPACT_GET_THRESHOLD,
+    /** sets the segment threshold (unsigned int) */
+    UPIPE_BLOCK_COMPACT_SET_THRESHOLD,
+};
+
+/** @This returns the maximum number of segments a block may have before it
+ * is compacted.
+ *
+ * @param upipe description structure of the pipe
+ * @param threshold_p filled in with the threshold
+ * @return an error code
+ */
+static inline int upipe_block_compact_get_threshold(struct upipe *upipe,
+                                                    unsigned int *threshold_p)
+{
+    return upipe_control(upipe, UPIPE_BLOCK_COMPACT_GET_THRESHOLD,
+                         UPIPE_BLOCK_COMPACT_SIGNATURE, threshold_p);
+}
+
+/** @This sets the maximum number of segments a block may have before it
+ * is compacted.
+ *
+ * @param upipe description structure of the pipe
+ * @param threshold number of segments
+ * @return an error code
+ */
+static inline int upipe_block_compact_set_threshold(struct upipe *upipe,
+                                                    unsigned int threshold)
+{
+    return upipe_control(upipe, UPIPE_BLOCK_COMPACT_SET_THRESHOLD,
+                         UPIPE_BLOCK_COMPACT_SIGNATURE, threshold);
+}
+
+/** @This returns the management structure for block_compact pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_block_compact_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
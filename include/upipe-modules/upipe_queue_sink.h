@@ -55,12 +55,37 @@ extern "C" {
 
 #define UPIPE_QSINK_SIGNATURE UBASE_FOURCC('q','s','n','k')
 
+/** @This extends upipe_command with specific commands for queue sink. */
+enum upipe_qsink_command {
+    UPIPE_QSINK_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the number of urefs not yet popped by the queue source
+     * (unsigned int *) */
+    UPIPE_QSINK_GET_LENGTH
+};
+
 /** @This returns the management structure for all queue sinks.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_qsink_mgr_alloc(void);
 
+/** @This returns the number of urefs which have not been popped yet by the
+ * queue source, including urefs held in the sink while the queue is full.
+ * The queue source may run in another thread, so the value is only a
+ * snapshot.
+ *
+ * @param upipe description structure of the pipe
+ * @param length_p filled in with the number of pending urefs
+ * @return an error code
+ */
+static inline int upipe_qsink_get_length(struct upipe *upipe,
+                                         unsigned int *length_p)
+{
+    return upipe_control(upipe, UPIPE_QSINK_GET_LENGTH,
+                         UPIPE_QSINK_SIGNATURE, length_p);
+}
+
 /** @hidden */
 #define ARGS_DECL , struct upipe *qsrc
 /** @hidden */
@@ -49,7 +49,15 @@ enum upipe_sws_thumbs_command {
     /** get size (int*, int*, int*, int*) */
     UPIPE_SWS_THUMBS_GET_SIZE,
     /** flush before next uref */
-    UPIPE_SWS_THUMBS_FLUSH_NEXT
+    UPIPE_SWS_THUMBS_FLUSH_NEXT,
+    /** set selection interval (unsigned int) */
+    UPIPE_SWS_THUMBS_SET_INTERVAL,
+    /** get selection interval (unsigned int *) */
+    UPIPE_SWS_THUMBS_GET_INTERVAL,
+    /** set persistent gallery mode (int) */
+    UPIPE_SWS_THUMBS_SET_PERSISTENT,
+    /** set fast (reduced resolution) scaling (int) */
+    UPIPE_SWS_THUMBS_SET_FAST
 };
 
 /** @This sets the thumbnail gallery dimensions.
@@ -88,6 +96,65 @@ static inline bool upipe_sws_thumbs_flush_next(struct upipe *upipe)
     return upipe_control(upipe, UPIPE_SWS_THUMBS_FLUSH_NEXT, UPIPE_SWS_THUMBS_SIGNATURE);
 }
 
+/** @This sets the selection interval. Only one out of interval incoming
+ * pictures is scaled into the gallery, the others are dropped before being
+ * mapped.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval selection interval (1 selects every picture)
+ * @return an error code
+ */
+static inline int upipe_sws_thumbs_set_interval(struct upipe *upipe,
+                                                unsigned int interval)
+{
+    return upipe_control(upipe, UPIPE_SWS_THUMBS_SET_INTERVAL,
+                         UPIPE_SWS_THUMBS_SIGNATURE, interval);
+}
+
+/** @This gets the selection interval.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval_p filled in with the selection interval
+ * @return an error code
+ */
+static inline int upipe_sws_thumbs_get_interval(struct upipe *upipe,
+                                                unsigned int *interval_p)
+{
+    return upipe_control(upipe, UPIPE_SWS_THUMBS_GET_INTERVAL,
+                         UPIPE_SWS_THUMBS_SIGNATURE, interval_p);
+}
+
+/** @This enables or disables the persistent gallery mode. In this mode the
+ * gallery is kept across outputs and is output each time a tile is updated;
+ * tiles which did not receive a new picture keep their previous contents and
+ * are neither cleared nor scaled again.
+ *
+ * @param upipe description structure of the pipe
+ * @param persistent true to enable persistent mode
+ * @return an error code
+ */
+static inline int upipe_sws_thumbs_set_persistent(struct upipe *upipe,
+                                                  bool persistent)
+{
+    return upipe_control(upipe, UPIPE_SWS_THUMBS_SET_PERSISTENT,
+                         UPIPE_SWS_THUMBS_SIGNATURE, persistent ? 1 : 0);
+}
+
+/** @This enables or disables fast scaling. In this mode, input lines are
+ * decimated before scaling when the picture is at least twice as high as the
+ * tile, and a cheaper scaling algorithm is used. To also decode at reduced
+ * resolution, set the "lowres" option on the decoder.
+ *
+ * @param upipe description structure of the pipe
+ * @param fast true to enable fast scaling
+ * @return an error code
+ */
+static inline int upipe_sws_thumbs_set_fast(struct upipe *upipe, bool fast)
+{
+    return upipe_control(upipe, UPIPE_SWS_THUMBS_SET_FAST,
+                         UPIPE_SWS_THUMBS_SIGNATURE, fast ? 1 : 0);
+}
+
 /** @This returns the management structure for sws thmub pipes.
  *
  * @return pointer to manager
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/** @file
+ * @short Upipe sink module analyzing a transport stream
+ *
+ * This module consumes aligned TS packets and computes ETSI TR 101 290
+ * priority 1 and 2 indicators, for the whole stream and for each PID.
+ * It also accepts @ref upipe_set_output_size for 196 and 204-octet
+ * packets.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_ANALYZER_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_ANALYZER_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#include <stdint.h>
+
+#define UPIPE_TS_ANALYZER_SIGNATURE UBASE_FOURCC('t','s','a','n')
+
+/** @This lists the indicators counted by the analyzer. */
+enum upipe_ts_analyzer_indicator {
+    /** 1.1 two or more consecutive corrupted sync bytes */
+    UPIPE_TS_ANALYZER_SYNC_LOSS,
+    /** 1.2 corrupted sync byte */
+    UPIPE_TS_ANALYZER_SYNC_BYTE,
+    /** 1.3 PAT missing for more than 500 ms, wrong table ID or scrambled */
+    UPIPE_TS_ANALYZER_PAT,
+    /** 1.4 continuity counter error */
+    UPIPE_TS_ANALYZER_CC,
+    /** 1.5 PMT missing for more than 500 ms or scrambled */
+    UPIPE_TS_ANALYZER_PMT,
+    /** 2.1 transport error indicator set */
+    UPIPE_TS_ANALYZER_TRANSPORT,
+    /** 2.3 PCR interval above 100 ms or backwards, without discontinuity */
+    UPIPE_TS_ANALYZER_PCR_DISCONTINUITY,
+    /** 2.3a PCR interval above 40 ms */
+    UPIPE_TS_ANALYZER_PCR_REPETITION,
+    /** 2.4 PCR jitter above 500 ns */
+    UPIPE_TS_ANALYZER_PCR_ACCURACY,
+    /** scrambled packet (not an error) */
+    UPIPE_TS_ANALYZER_SCRAMBLED,
+
+    /** number of indicators */
+    UPIPE_TS_ANALYZER_INDICATORS
+};
+
+/** @This returns a string describing an indicator.
+ *
+ * @param indicator indicator
+ * @return a constant string describing the indicator
+ */
+static inline const char *
+    upipe_ts_analyzer_indicator_print(enum upipe_ts_analyzer_indicator indicator)
+{
+    switch (indicator) {
+        case UPIPE_TS_ANALYZER_SYNC_LOSS: return "TS_sync_loss";
+        case UPIPE_TS_ANALYZER_SYNC_BYTE: return "Sync_byte_error";
+        case UPIPE_TS_ANALYZER_PAT: return "PAT_error";
+        case UPIPE_TS_ANALYZER_CC: return "Continuity_count_error";
+        case UPIPE_TS_ANALYZER_PMT: return "PMT_error";
+        case UPIPE_TS_ANALYZER_TRANSPORT: return "Transport_error";
+        case UPIPE_TS_ANALYZER_PCR_DISCONTINUITY:
+            return "PCR_discontinuity_indicator_error";
+        case UPIPE_TS_ANALYZER_PCR_REPETITION: return "PCR_repetition_error";
+        case UPIPE_TS_ANALYZER_PCR_ACCURACY: return "PCR_accuracy_error";
+        case UPIPE_TS_ANALYZER_SCRAMBLED: return "scrambled";
+        default: return "unknown";
+    }
+}
+
+/** @This is the description of the counters of a stream or a PID. */
+struct upipe_ts_analyzer_stats {
+    /** number of packets */
+    uint64_t packets;
+    /** number of occurrences of each indicator */
+    uint64_t indicators[UPIPE_TS_ANALYZER_INDICATORS];
+};
+
+/** @This extends uprobe_event with specific events for ts_analyzer. */
+enum uprobe_ts_analyzer_event {
+    UPROBE_TS_ANALYZER_SENTINEL = UPROBE_LOCAL,
+
+    /** periodic report of the counters of the stream, every second of
+     * stream time (const struct upipe_ts_analyzer_stats *) */
+    UPROBE_TS_ANALYZER_STATS
+};
+
+/** @This extends upipe_command with specific commands for ts_analyzer. */
+enum upipe_ts_analyzer_command {
+    UPIPE_TS_ANALYZER_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the counters of the stream
+     * (struct upipe_ts_analyzer_stats *) */
+    UPIPE_TS_ANALYZER_GET_STATS,
+    /** returns the counters of a PID
+     * (unsigned int, struct upipe_ts_analyzer_stats *) */
+    UPIPE_TS_ANALYZER_GET_PID_STATS
+};
+
+/** @This returns the counters of the stream.
+ *
+ * @param upipe description structure of the pipe
+ * @param stats filled in with the counters
+ * @return an error code
+ */
+static inline int upipe_ts_analyzer_get_stats(struct upipe *upipe,
+        struct upipe_ts_analyzer_stats *stats)
+{
+    return upipe_control(upipe, UPIPE_TS_ANALYZER_GET_STATS,
+                         UPIPE_TS_ANALYZER_SIGNATURE, stats);
+}
+
+/** @This returns the counters of a PID.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID
+ * @param stats filled in with the counters
+ * @return an error code
+ */
+static inline int upipe_ts_analyzer_get_pid_stats(struct upipe *upipe,
+        unsigned int pid, struct upipe_ts_analyzer_stats *stats)
+{
+    return upipe_control(upipe, UPIPE_TS_ANALYZER_GET_PID_STATS,
+                         UPIPE_TS_ANALYZER_SIGNATURE, pid, stats);
+}
+
+/** @This returns the management structure for all ts_analyzer pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_analyzer_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
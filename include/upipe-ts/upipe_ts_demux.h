@@ -51,7 +51,20 @@ enum upipe_ts_demux_command {
     /** returns the currently detected conformance (int *) */
     UPIPE_TS_DEMUX_GET_CONFORMANCE,
     /** sets the conformance (int) */
-    UPIPE_TS_DEMUX_SET_CONFORMANCE
+    UPIPE_TS_DEMUX_SET_CONFORMANCE,
+    /** adds a worker to run program framers (struct upipe_mgr *,
+     * struct uprobe *, unsigned int, unsigned int) */
+    UPIPE_TS_DEMUX_ADD_WORKER
+};
+
+/** @This extends upipe_command with specific commands for ts demux
+ * programs. */
+enum upipe_ts_demux_program_command {
+    UPIPE_TS_DEMUX_PROGRAM_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the number of urefs queued to and from the worker
+     * (unsigned int *, unsigned int *) */
+    UPIPE_TS_DEMUX_PROGRAM_GET_QUEUE_LENGTHS
 };
 
 /** @This returns the currently detected conformance mode. It cannot return
@@ -83,6 +96,53 @@ static inline int
                          UPIPE_TS_DEMUX_SIGNATURE, conformance);
 }
 
+/** @This adds a worker to the demux. Once at least one worker is declared,
+ * and provided an autof manager is set on the demux manager, each new
+ * program is bound to the worker running the fewest programs, and
+ * the framers of its elementary streams are moved to the remote thread of the
+ * worker with a upipe_wlin pipe, while ts_sync, ts_split and the PSI, PES
+ * and clock handling stay in the thread of the demux.
+ *
+ * @param upipe description structure of the pipe
+ * @param wlin_mgr manager of upipe_wlin pipes transferring to the worker
+ * thread
+ * @param uprobe_remote probe hierarchy to use on the worker thread
+ * (belongs to the callee)
+ * @param input_queue_length number of packets in the queue between the demux
+ * and the worker thread
+ * @param output_queue_length number of packets in the queue between the
+ * worker thread and the demux
+ * @return an error code
+ */
+static inline int upipe_ts_demux_add_worker(struct upipe *upipe,
+                                            struct upipe_mgr *wlin_mgr,
+                                            struct uprobe *uprobe_remote,
+                                            unsigned int input_queue_length,
+                                            unsigned int output_queue_length)
+{
+    return upipe_control(upipe, UPIPE_TS_DEMUX_ADD_WORKER,
+                         UPIPE_TS_DEMUX_SIGNATURE, wlin_mgr, uprobe_remote,
+                         input_queue_length, output_queue_length);
+}
+
+/** @This returns the number of urefs of a program waiting in the queues of
+ * its worker, summed over all elementary streams. The values are only
+ * snapshots as the worker thread runs concurrently.
+ *
+ * @param upipe description structure of the program pipe
+ * @param input_p filled in with the number of urefs not yet framed
+ * @param output_p filled in with the number of framed urefs not yet output
+ * @return an error code
+ */
+static inline int
+    upipe_ts_demux_program_get_queue_lengths(struct upipe *upipe,
+                                             unsigned int *input_p,
+                                             unsigned int *output_p)
+{
+    return upipe_control(upipe, UPIPE_TS_DEMUX_PROGRAM_GET_QUEUE_LENGTHS,
+                         UPIPE_TS_DEMUX_PROGRAM_SIGNATURE, input_p, output_p);
+}
+
 /** @This returns the management structure for all ts_demux pipes.
  *
  * @return pointer to manager
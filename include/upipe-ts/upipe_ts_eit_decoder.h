@@ -31,9 +31,93 @@ extern "C" {
 
 #include <upipe/upipe.h>
 #include <upipe-ts/upipe_ts_demux.h>
+#include <upipe-ts/upipe_ts_epg.h>
 
 #define UPIPE_TS_EITD_SIGNATURE UBASE_FOURCC('t','s',0x4e,'d')
 
+/** @This extends uprobe_event with specific events for ts eitd. */
+enum uprobe_ts_eitd_event {
+    UPROBE_TS_EITD_SENTINEL = UPROBE_LOCAL,
+
+    /** events of the store were inserted, updated or removed
+     * (struct upipe_ts_epg *, const struct upipe_ts_epg_change *) */
+    UPROBE_TS_EITD_EPG_CHANGE
+};
+
+/** @This extends upipe_command with specific commands for ts eitd. */
+enum upipe_ts_eitd_command {
+    UPIPE_TS_EITD_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the number of unchanged sections skipped (uint64_t *) */
+    UPIPE_TS_EITD_GET_SKIPPED,
+    /** returns the store of events (struct upipe_ts_epg **) */
+    UPIPE_TS_EITD_GET_EPG,
+    /** returns true if events are exported as flow definition attributes
+     * (int *) */
+    UPIPE_TS_EITD_GET_EVENT_ATTRS,
+    /** sets whether events are exported as flow definition attributes
+     * (int) */
+    UPIPE_TS_EITD_SET_EVENT_ATTRS
+};
+
+/** @This returns the number of sections that were recognized as unchanged
+ * from their header and CRC, and dropped without further processing.
+ *
+ * @param upipe description structure of the pipe
+ * @param skipped_p filled in with the number of skipped sections
+ * @return an error code
+ */
+static inline int upipe_ts_eitd_get_skipped(struct upipe *upipe,
+                                            uint64_t *skipped_p)
+{
+    return upipe_control(upipe, UPIPE_TS_EITD_GET_SKIPPED,
+                         UPIPE_TS_EITD_SIGNATURE, skipped_p);
+}
+
+/** @This returns the store of events updated by the pipe. The store is
+ * owned by the pipe; use @ref upipe_ts_epg_use to keep it.
+ *
+ * @param upipe description structure of the pipe
+ * @param epg_p filled in with a pointer to the store
+ * @return an error code
+ */
+static inline int upipe_ts_eitd_get_epg(struct upipe *upipe,
+                                        struct upipe_ts_epg **epg_p)
+{
+    return upipe_control(upipe, UPIPE_TS_EITD_GET_EPG,
+                         UPIPE_TS_EITD_SIGNATURE, epg_p);
+}
+
+/** @This returns whether the events are also exported as numbered
+ * attributes (te.*) of the output flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param enabled_p filled in with true if the attributes are exported
+ * @return an error code
+ */
+static inline int upipe_ts_eitd_get_event_attrs(struct upipe *upipe,
+                                                int *enabled_p)
+{
+    return upipe_control(upipe, UPIPE_TS_EITD_GET_EVENT_ATTRS,
+                         UPIPE_TS_EITD_SIGNATURE, enabled_p);
+}
+
+/** @This sets whether the events are also exported as numbered attributes
+ * (te.*) of the output flow definition. This is enabled by default; it may
+ * be disabled when the store returned by @ref upipe_ts_eitd_get_epg is used
+ * instead, as it is much cheaper to maintain for large schedule tables.
+ *
+ * @param upipe description structure of the pipe
+ * @param enabled true to export the attributes
+ * @return an error code
+ */
+static inline int upipe_ts_eitd_set_event_attrs(struct upipe *upipe,
+                                                bool enabled)
+{
+    return upipe_control(upipe, UPIPE_TS_EITD_SET_EVENT_ATTRS,
+                         UPIPE_TS_EITD_SIGNATURE, enabled ? 1 : 0);
+}
+
 /** @This returns the management structure for all ts_eitd pipes.
  *
  * @return pointer to manager
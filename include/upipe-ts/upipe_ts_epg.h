@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe refcounted store of DVB EIT events
+ *
+ * The store keeps one compact record per event, sorted by service and start
+ * time, and is updated section by section. Each update reports only the
+ * events that were inserted, updated or removed.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_EPG_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_EPG_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** @This is the description of an event in the store. */
+struct upipe_ts_epg_event {
+    /** service ID */
+    uint16_t sid;
+    /** event ID */
+    uint16_t event_id;
+    /** table ID of the section that last carried the event */
+    uint8_t table_id;
+    /** number of the section that last carried the event */
+    uint8_t section;
+    /** running status */
+    uint8_t running_status;
+    /** true if the event is scrambled */
+    bool scrambled;
+    /** start date (in 27 MHz units, since the epoch) */
+    uint64_t start;
+    /** duration (in 27 MHz units) */
+    uint64_t duration;
+    /** serial of the last update that carried the event */
+    uint32_t serial;
+    /** size of the descriptor loop */
+    uint16_t descs_size;
+    /** raw descriptor loop */
+    uint8_t descs[];
+};
+
+/** @This is a refcounted store of events. */
+struct upipe_ts_epg {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** events sorted by service ID, then start date */
+    struct upipe_ts_epg_event **events;
+    /** same events sorted by service ID, then event ID */
+    struct upipe_ts_epg_event **by_id;
+    /** number of events */
+    size_t events_nb;
+    /** allocated size of the events and by_id arrays */
+    size_t events_size;
+    /** serial of the current update */
+    uint32_t serial;
+};
+
+/** @This describes the changes caused by an update of the store.
+ * Inserted and updated events belong to the store; removed and previous
+ * events are freed by @ref upipe_ts_epg_change_clean. */
+struct upipe_ts_epg_change {
+    /** inserted events */
+    struct upipe_ts_epg_event **inserted;
+    /** number of inserted events */
+    size_t inserted_nb;
+    /** updated events */
+    struct upipe_ts_epg_event **updated;
+    /** former version of the updated events, in the same order */
+    struct upipe_ts_epg_event **previous;
+    /** number of updated events */
+    size_t updated_nb;
+    /** removed events */
+    struct upipe_ts_epg_event **removed;
+    /** number of removed events */
+    size_t removed_nb;
+};
+
+/** @This allocates an empty store.
+ *
+ * @return pointer to the store, or NULL in case of allocation error
+ */
+struct upipe_ts_epg *upipe_ts_epg_alloc(void);
+
+/** @This increments the reference count of a store.
+ *
+ * @param epg pointer to the store
+ * @return same pointer to the store
+ */
+static inline struct upipe_ts_epg *upipe_ts_epg_use(struct upipe_ts_epg *epg)
+{
+    if (epg == NULL)
+        return NULL;
+    urefcount_use(&epg->urefcount);
+    return epg;
+}
+
+/** @This decrements the reference count of a store or frees it.
+ *
+ * @param epg pointer to the store
+ */
+static inline void upipe_ts_epg_release(struct upipe_ts_epg *epg)
+{
+    if (epg != NULL)
+        urefcount_release(&epg->urefcount);
+}
+
+/** @This initializes a change description.
+ *
+ * @param change pointer to the change description
+ */
+static inline void upipe_ts_epg_change_init(struct upipe_ts_epg_change *change)
+{
+    change->inserted = change->updated = change->previous =
+        change->removed = NULL;
+    change->inserted_nb = change->updated_nb = change->removed_nb = 0;
+}
+
+/** @This checks if a change description is empty.
+ *
+ * @param change pointer to the change description
+ * @return true if no event was inserted, updated or removed
+ */
+static inline bool
+    upipe_ts_epg_change_empty(const struct upipe_ts_epg_change *change)
+{
+    return !change->inserted_nb && !change->updated_nb && !change->removed_nb;
+}
+
+/** @This releases the events and arrays of a change description.
+ *
+ * @param change pointer to the change description
+ */
+void upipe_ts_epg_change_clean(struct upipe_ts_epg_change *change);
+
+/** @This updates the store with a validated EIT section.
+ *
+ * The section that last carried an event owns it: events that used to be
+ * carried by the same section and are no longer present, or by sections
+ * beyond the new last section number of the sub-table, are removed. A store
+ * must therefore only be fed with the sections of a single table ID.
+ *
+ * @param epg pointer to the store
+ * @param section pointer to the EIT section
+ * @param change change description to fill in, previously initialized
+ * @return an error code
+ */
+int upipe_ts_epg_section(struct upipe_ts_epg *epg, const uint8_t *section,
+                         struct upipe_ts_epg_change *change);
+
+/** @This returns the events of a service, sorted by start date.
+ *
+ * @param epg pointer to the store
+ * @param sid service ID
+ * @param events_p filled in with a pointer to the first event
+ * @param events_nb_p filled in with the number of events
+ */
+void upipe_ts_epg_get_service(struct upipe_ts_epg *epg, uint16_t sid,
+                              struct upipe_ts_epg_event ***events_p,
+                              size_t *events_nb_p);
+
+/** @This finds the event of a service running at a given date, or else the
+ * next one.
+ *
+ * @param epg pointer to the store
+ * @param sid service ID
+ * @param date date (in 27 MHz units, since the epoch)
+ * @return pointer to the event, or NULL if there is none
+ */
+struct upipe_ts_epg_event *upipe_ts_epg_find(struct upipe_ts_epg *epg,
+                                             uint16_t sid, uint64_t date);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
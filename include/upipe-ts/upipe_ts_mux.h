@@ -158,6 +158,12 @@ enum upipe_ts_mux_command {
     /** prepares the next access unit/section for the given date
      * (uint64_t, uint64_t) */
     UPIPE_TS_MUX_PREPARE,
+    /** returns the number of output buffers in the dedicated pool
+     * (unsigned int *) */
+    UPIPE_TS_MUX_GET_OUTPUT_POOL,
+    /** sets the number of output buffers in the dedicated pool
+     * (unsigned int) */
+    UPIPE_TS_MUX_SET_OUTPUT_POOL,
 
     /** ts_encaps commands begin here */
     UPIPE_TS_MUX_ENCAPS = UPIPE_CONTROL_LOCAL + 0x1000,
@@ -687,6 +693,37 @@ static inline int upipe_ts_mux_set_encoding(struct upipe *upipe,
                          UPIPE_TS_MUX_SIGNATURE, encoding);
 }
 
+/** @This returns the number of output buffers preallocated in the dedicated
+ * pool of the mux.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth_p filled in with the number of buffers, or 0
+ * @return an error code
+ */
+static inline int upipe_ts_mux_get_output_pool(struct upipe *upipe,
+                                               unsigned int *depth_p)
+{
+    return upipe_control(upipe, UPIPE_TS_MUX_GET_OUTPUT_POOL,
+                         UPIPE_TS_MUX_SIGNATURE, depth_p);
+}
+
+/** @This sets the number of output buffers preallocated in a pool dedicated
+ * to the mux. Each output uref is then a single MTU-sized buffer taken from
+ * this pool, instead of the ubuf manager provided by the pipeline, and
+ * returns to it when the sink releases it.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth number of buffers, or 0 to use the ubuf manager of the
+ * pipeline (default: 0)
+ * @return an error code
+ */
+static inline int upipe_ts_mux_set_output_pool(struct upipe *upipe,
+                                               unsigned int depth)
+{
+    return upipe_control(upipe, UPIPE_TS_MUX_SET_OUTPUT_POOL,
+                         UPIPE_TS_MUX_SIGNATURE, depth);
+}
+
 /** @This stops updating a PSI table upon sub removal.
  *
  * @param upipe description structure of the pipe
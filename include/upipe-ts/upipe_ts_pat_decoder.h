@@ -39,7 +39,9 @@ enum upipe_ts_patd_command {
     UPIPE_TS_PATD_SENTINEL = UPIPE_CONTROL_LOCAL,
 
     /** returns the flow definition of the NIT (struct uref **) */
-    UPIPE_TS_PATD_GET_NIT
+    UPIPE_TS_PATD_GET_NIT,
+    /** returns the number of unchanged sections skipped (uint64_t *) */
+    UPIPE_TS_PATD_GET_SKIPPED
 };
 
 /** @This returns the flow definition of the NIT.
@@ -55,6 +57,20 @@ static inline bool upipe_ts_patd_get_nit(struct upipe *upipe,
                          UPIPE_TS_PATD_SIGNATURE, flow_def_p);
 }
 
+/** @This returns the number of sections that were recognized as unchanged
+ * from their header and CRC, and dropped without further processing.
+ *
+ * @param upipe description structure of the pipe
+ * @param skipped_p filled in with the number of skipped sections
+ * @return an error code
+ */
+static inline int upipe_ts_patd_get_skipped(struct upipe *upipe,
+                                            uint64_t *skipped_p)
+{
+    return upipe_control(upipe, UPIPE_TS_PATD_GET_SKIPPED,
+                         UPIPE_TS_PATD_SIGNATURE, skipped_p);
+}
+
 /** @This returns the management structure for all ts_patd pipes.
  *
  * @return pointer to manager
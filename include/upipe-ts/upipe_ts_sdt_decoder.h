@@ -34,6 +34,28 @@ extern "C" {
 
 #define UPIPE_TS_SDTD_SIGNATURE UBASE_FOURCC('t','s',0x42,'d')
 
+/** @This extends upipe_command with specific commands for ts sdtd. */
+enum upipe_ts_sdtd_command {
+    UPIPE_TS_SDTD_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the number of unchanged sections skipped (uint64_t *) */
+    UPIPE_TS_SDTD_GET_SKIPPED
+};
+
+/** @This returns the number of sections that were recognized as unchanged
+ * from their header and CRC, and dropped without further processing.
+ *
+ * @param upipe description structure of the pipe
+ * @param skipped_p filled in with the number of skipped sections
+ * @return an error code
+ */
+static inline int upipe_ts_sdtd_get_skipped(struct upipe *upipe,
+                                            uint64_t *skipped_p)
+{
+    return upipe_control(upipe, UPIPE_TS_SDTD_GET_SKIPPED,
+                         UPIPE_TS_SDTD_SIGNATURE, skipped_p);
+}
+
 /** @This returns the management structure for all ts_sdtd pipes.
  *
  * @return pointer to manager
@@ -42,6 +42,7 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/uio.h>
 #include <assert.h>
@@ -50,6 +51,18 @@ extern "C" {
  * is used properly. */
 #define UBUF_ALLOC_BLOCK UBASE_FOURCC('b','l','c','k')
 
+/** @This is the number of segments a lookup may walk before an offset index
+ * is built for the chain. */
+#define UBUF_BLOCK_INDEX_STEPS 32
+
+/** @internal @This is an entry of the offset index of a segmented block. */
+struct ubuf_block_index {
+    /** offset of the segment in the whole chain */
+    size_t offset;
+    /** pointer to the segment */
+    struct ubuf *ubuf;
+};
+
 /** @internal @This is a common section of block ubuf, allowing to segment
  * data. In an opaque area you would typically store a pointer to shared
  * buffer space. It is mandatory for block managers to include this
@@ -77,6 +90,13 @@ struct ubuf_block {
     /** cached end ubuf */
     struct ubuf *cached_end_ubuf;
 
+    /** offset index of the first segments, sorted by offset (head only) */
+    struct ubuf_block_index *index;
+    /** number of indexed segments */
+    size_t index_count;
+    /** number of allocated index entries */
+    size_t index_size;
+
     /** common structure */
     struct ubuf ubuf;
 };
@@ -112,6 +132,40 @@ static inline int ubuf_block_size(struct ubuf *ubuf, size_t *size_p)
     return UBASE_ERR_NONE;
 }
 
+/** @This builds or extends the offset index of a segmented block, so that
+ * the following lookups are done in O(log n). It is automatically called
+ * when a lookup walks too many segments.
+ *
+ * @param ubuf pointer to head ubuf
+ * @return an error code
+ */
+int ubuf_block_index_build(struct ubuf *ubuf);
+
+/** @internal @This releases the offset index of a block.
+ *
+ * @param block pointer to head block
+ */
+static inline void ubuf_block_index_clean(struct ubuf_block *block)
+{
+    free(block->index);
+    block->index = NULL;
+    block->index_count = block->index_size = 0;
+}
+
+/** @internal @This drops the index entries of the segments that may start at
+ * or after the given offset, because the chain is modified from there.
+ *
+ * @param block pointer to head block
+ * @param offset offset of the first modified octet in the whole chain
+ */
+static inline void ubuf_block_index_cut(struct ubuf_block *block,
+                                        size_t offset)
+{
+    while (block->index_count &&
+           block->index[block->index_count - 1].offset >= offset)
+        block->index_count--;
+}
+
 /** @internal @This returns the ubuf corresponding to the given offset.
  *
  * @param ubuf pointer to head ubuf
@@ -127,27 +181,51 @@ static inline struct ubuf *ubuf_block_get(struct ubuf *ubuf, int *offset_p,
 {
     struct ubuf_block *block = ubuf_block_from_ubuf(ubuf);
     struct ubuf_block *head_block = block;
-    int saved_offset = *offset_p;
 
     if (*offset_p < 0)
         *offset_p += block->total_size;
     if (size_p != NULL && *size_p == -1)
         *size_p = block->total_size - *offset_p;
+    int saved_offset = *offset_p;
 
+    size_t start = 0;
     if (block->cached_offset <= *offset_p) {
-        *offset_p -= block->cached_offset;
+        start = block->cached_offset;
         ubuf = block->cached_ubuf;
-        block = ubuf_block_from_ubuf(ubuf);
     }
 
+    if (head_block->index_count) {
+        /* last indexed segment starting at or before the offset */
+        size_t low = 0, high = head_block->index_count;
+        while (high - low > 1) {
+            size_t mid = (low + high) / 2;
+            if (head_block->index[mid].offset <= *offset_p)
+                low = mid;
+            else
+                high = mid;
+        }
+        if (head_block->index[low].offset > start) {
+            start = head_block->index[low].offset;
+            ubuf = head_block->index[low].ubuf;
+        }
+    }
+    *offset_p -= start;
+    block = ubuf_block_from_ubuf(ubuf);
+
+    unsigned int steps = 0;
     while (*offset_p >= block->size) {
         *offset_p -= block->size;
         ubuf = block->next_ubuf;
         if (unlikely(ubuf == NULL))
             return NULL;
         block = ubuf_block_from_ubuf(ubuf);
+        steps++;
     }
 
+    /* the index is optional, so failing to build it is not an error */
+    if (unlikely(steps > UBUF_BLOCK_INDEX_STEPS))
+        ubuf_block_index_build(&head_block->ubuf);
+
     head_block->cached_ubuf = ubuf;
     head_block->cached_offset = saved_offset - *offset_p;
     return ubuf;
@@ -284,6 +362,7 @@ static inline int ubuf_block_append(struct ubuf *ubuf, struct ubuf *append)
     struct ubuf_block *head_block = block;
     struct ubuf_block *append_block = ubuf_block_from_ubuf(append);
     block->total_size += append_block->total_size;
+    ubuf_block_index_clean(append_block);
 
     if (block->cached_end_ubuf != NULL) {
         ubuf = block->cached_end_ubuf;
@@ -346,6 +425,7 @@ static inline int ubuf_block_insert(struct ubuf *ubuf, int offset,
     struct ubuf_block *head_block = ubuf_block_from_ubuf(ubuf);
     if (unlikely((ubuf = ubuf_block_get(ubuf, &offset, NULL)) == NULL))
         return UBASE_ERR_INVALID;
+    ubuf_block_index_cut(head_block, head_block->cached_offset + offset);
 
     struct ubuf_block *block = ubuf_block_from_ubuf(ubuf);
     if (offset < block->size) {
@@ -377,6 +457,7 @@ static inline int ubuf_block_delete(struct ubuf *ubuf, int offset, int size)
     if (unlikely((ubuf = ubuf_block_get(ubuf, &offset, &size)) == NULL))
         return UBASE_ERR_INVALID;
     int delete_size = size;
+    ubuf_block_index_cut(head_block, head_block->cached_offset + offset);
 
     do {
         struct ubuf_block *block = ubuf_block_from_ubuf(ubuf);
@@ -434,6 +515,7 @@ static inline int ubuf_block_truncate(struct ubuf *ubuf, int offset)
         head_block->total_size = 0;
         head_block->cached_ubuf = head_block->cached_end_ubuf = ubuf;
         head_block->cached_offset = 0;
+        ubuf_block_index_clean(head_block);
         return UBASE_ERR_NONE;
     }
 
@@ -449,6 +531,7 @@ static inline int ubuf_block_truncate(struct ubuf *ubuf, int offset)
     }
     block->size = offset + 1;
     head_block->total_size = saved_size;
+    ubuf_block_index_cut(head_block, saved_size);
     head_block->cached_ubuf = &head_block->ubuf;
     head_block->cached_offset = 0;
     head_block->cached_end_ubuf = ubuf;
@@ -513,6 +596,8 @@ static inline int ubuf_block_prepend(struct ubuf *ubuf, int prepend)
     block->size += prepend;
     block->total_size += prepend;
     block->cached_offset += prepend;
+    /* only the head segment keeps its offset */
+    ubuf_block_index_cut(block, 1);
     return UBASE_ERR_NONE;
 }
 
@@ -562,6 +647,7 @@ static inline struct ubuf *ubuf_block_split(struct ubuf *ubuf, int offset)
 
     if (saved_offset < 0)
         saved_offset += head_block->total_size;
+    ubuf_block_index_cut(head_block, saved_offset);
 
     struct ubuf *new_ubuf = block->next_ubuf;
     block->next_ubuf = NULL;
@@ -917,6 +1003,34 @@ static inline int ubuf_block_merge(struct ubuf_mgr *mgr, struct ubuf **ubuf_p,
     return UBASE_ERR_NONE;
 }
 
+/** @This coalesces the segments of a block ubuf into a newly allocated
+ * linear ubuf, but only if it is made of more than the given number of
+ * segments; otherwise the ubuf is left untouched.
+ *
+ * @param mgr management structure for the new ubuf
+ * @param ubuf_p reference to a pointer to ubuf to replace with a non-segmented
+ * block ubuf
+ * @param threshold maximum number of segments to keep
+ * @return an error code
+ */
+static inline int ubuf_block_compact(struct ubuf_mgr *mgr,
+                                     struct ubuf **ubuf_p,
+                                     unsigned int threshold)
+{
+    if (unlikely((*ubuf_p)->mgr->signature != UBUF_ALLOC_BLOCK))
+        return UBASE_ERR_INVALID;
+
+    struct ubuf_block *block = ubuf_block_from_ubuf(*ubuf_p);
+    unsigned int segments = 1;
+    while (segments <= threshold) {
+        if (block->next_ubuf == NULL)
+            return UBASE_ERR_NONE;
+        block = ubuf_block_from_ubuf(block->next_ubuf);
+        segments++;
+    }
+    return ubuf_block_merge(mgr, ubuf_p, 0, -1);
+}
+
 /** @This allocates a new ubuf and copies data from an opaque pointer to it.
  *
  * @param mgr management structure for this ubuf type
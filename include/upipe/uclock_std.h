@@ -39,7 +39,11 @@ extern "C" {
 /** flags for the creation of a uclock structure */
 enum uclock_std_flags {
     /** force using a real-time clock even if a monotonic clock is available */
-    UCLOCK_FLAG_REALTIME = 0x1
+    UCLOCK_FLAG_REALTIME = 0x1,
+    /** read the invariant TSC instead of calling the system for each
+     * timestamp, if the platform provides a reliable one (ignored with
+     * @ref UCLOCK_FLAG_REALTIME) */
+    UCLOCK_FLAG_TSC = 0x2
 };
 
 /** @This allocates a new uclock structure.
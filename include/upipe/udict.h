@@ -148,7 +148,10 @@ enum udict_type {
     /** p.afd */
     UDICT_TYPE_PIC_AFD,
     /** p.cea_708 */
-    UDICT_TYPE_PIC_CEA_708
+    UDICT_TYPE_PIC_CEA_708,
+
+    /** t.id */
+    UDICT_TYPE_TRACE_ID
 };
 
 /** @This defines standard commands which udict modules may implement. */
@@ -39,11 +39,47 @@ extern "C" {
 
 #include <upipe/udict.h>
 
+#include <stdint.h>
+
+/** @This is a simple signature to make sure the udict_mgr_control internal
+ * API is used properly. */
+#define UDICT_INLINE_SIGNATURE UBASE_FOURCC('i','n','l','n')
+
 struct umem_mgr;
 
-/** @This allocates a new instance of the inline udict manager.
+/** @This extends udict_mgr_command with specific commands for the inline
+ * manager. */
+enum udict_inline_mgr_command {
+    UDICT_INLINE_MGR_SENTINEL = UDICT_MGR_CONTROL_LOCAL,
+
+    /** returns the number of shared and detached buffers
+     * (uint32_t *, uint32_t *) */
+    UDICT_INLINE_MGR_GET_STATS
+};
+
+/** @This returns statistics about copy-on-write buffers: the number of
+ * udicts duplicated by sharing the buffer of the original, and the number of
+ * shared buffers which had to be copied because a udict was modified.
+ *
+ * @param mgr pointer to udict manager
+ * @param shared_p filled in with the number of shared buffers (may be NULL)
+ * @param detached_p filled in with the number of detached buffers (may be
+ * NULL)
+ * @return an error code
+ */
+static inline int udict_inline_mgr_get_stats(struct udict_mgr *mgr,
+                                             uint32_t *shared_p,
+                                             uint32_t *detached_p)
+{
+    return udict_mgr_control(mgr, UDICT_INLINE_MGR_GET_STATS,
+                             UDICT_INLINE_SIGNATURE, shared_p, detached_p);
+}
+
+/** @This allocates a new instance of the inline udict manager. Duplicated
+ * udicts share their buffer of attributes until one of them is modified.
  *
- * @param udict_pool_depth maximum number of udict structures in the pool
+ * @param udict_pool_depth maximum number of udict structures (and shared
+ * buffers) in the pools
  * @param umem_mgr memory allocator to use for buffers
  * @param min_size minimum allocated space for the udict (if set to -1, a
  * default sensible value is used)
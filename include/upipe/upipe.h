@@ -39,6 +39,8 @@ extern "C" {
 #include <upipe/uprobe.h>
 #include <upipe/urequest.h>
 #include <upipe/udict_dump.h>
+#include <upipe/upipe_profile.h>
+#include <upipe/upipe_trace.h>
 
 #include <stdint.h>
 #include <stdarg.h>
@@ -179,6 +181,10 @@ struct upipe {
     struct uprobe *uprobe;
     /** pointer to the manager for this pipe type */
     struct upipe_mgr *mgr;
+    /** profiling counters, or NULL if the pipe is not profiled */
+    struct upipe_profile *profile;
+    /** tracing description, or NULL if the pipe is not traced */
+    struct upipe_trace_pipe *trace;
 };
 
 UBASE_FROM_TO(upipe, uchain, uchain, uchain)
@@ -440,6 +446,8 @@ static inline void upipe_init(struct upipe *upipe, struct upipe_mgr *mgr,
     upipe->uprobe = uprobe;
     upipe->refcount = NULL;
     upipe->mgr = mgr;
+    upipe->profile = NULL;
+    upipe->trace = NULL;
     upipe_mgr_use(mgr);
 }
 
@@ -1057,7 +1065,12 @@ static inline void upipe_input(struct upipe *upipe, struct uref *uref,
         return;
     }
     upipe_use(upipe);
-    upipe->mgr->upipe_input(upipe, uref, upump_p);
+    if (unlikely(upipe->trace != NULL))
+        upipe_trace_input(upipe, uref, upump_p);
+    else if (unlikely(upipe->profile != NULL))
+        upipe_profile_input(upipe, uref, upump_p);
+    else
+        upipe->mgr->upipe_input(upipe, uref, upump_p);
     upipe_release(upipe);
 }
 
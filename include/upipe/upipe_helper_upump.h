@@ -106,6 +106,8 @@ static void STRUCTURE##_set_##UPUMP(struct upipe *upipe,                    \
         upump_free(s->UPUMP);                                               \
     }                                                                       \
     s->UPUMP = upump;                                                       \
+    if (upump != NULL)                                                      \
+        upump->profile_p = &upipe->profile;                                 \
 }                                                                           \
 /** @internal @This sets the upump to use.                                  \
  *                                                                          \
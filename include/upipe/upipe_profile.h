@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe per-pipe profiling counters
+ *
+ * Counters are attached to pipes by @ref uprobe_profile_alloc. When a pipe
+ * has counters, @ref upipe_input goes through @ref upipe_profile_input, and
+ * the pumps stored with @ref #UPIPE_HELPER_UPUMP are accounted to it.
+ */
+
+#ifndef _UPIPE_UPIPE_PROFILE_H_
+/** @hidden */
+#define _UPIPE_UPIPE_PROFILE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** @hidden */
+struct upipe;
+/** @hidden */
+struct uref;
+/** @hidden */
+struct upump;
+/** @hidden */
+struct uclock;
+
+/** one input out of this number is used to sample the latency */
+#define UPIPE_PROFILE_LATENCY_SAMPLING 16
+/** one call tree out of this number is timed, per thread */
+#define UPIPE_PROFILE_CYCLES_SAMPLING 16
+
+/** @This stores the profiling counters of a pipe. They are written by the
+ * thread running the pipe without locking, so they may be slightly
+ * inconsistent when read from another thread. */
+struct upipe_profile {
+    /** uclock used to sample latencies, or NULL */
+    struct uclock *uclock;
+
+    /** number of urefs received */
+    uint64_t inputs;
+    /** number of urefs sent to profiled pipes */
+    uint64_t outputs;
+    /** number of pump callbacks */
+    uint64_t pumps;
+    /** cycles spent in the pipe itself, estimated from the timed call
+     * trees */
+    uint64_t cycles;
+    /** cycles spent in the pipe and the pipes it called, estimated from the
+     * timed call trees */
+    uint64_t total_cycles;
+
+    /** number of latency samples */
+    uint64_t latency_count;
+    /** sum of sampled latencies (difference between the input date and the
+     * system clock reference of the uref), in 27 MHz ticks */
+    uint64_t latency_sum;
+    /** maximum sampled latency, in 27 MHz ticks */
+    uint64_t latency_max;
+
+    /** current number of urefs held by the pipe */
+    unsigned int queue;
+    /** maximum number of urefs held by the pipe */
+    unsigned int queue_max;
+};
+
+/** @This initializes profiling counters.
+ *
+ * @param profile pointer to counters
+ * @param uclock uclock used to sample latencies, or NULL
+ */
+static inline void upipe_profile_init(struct upipe_profile *profile,
+                                      struct uclock *uclock)
+{
+    memset(profile, 0, sizeof(*profile));
+    profile->uclock = uclock;
+}
+
+/** @This returns a timestamp in CPU cycles (or in nanoseconds on platforms
+ * without a cycle counter).
+ *
+ * @return timestamp
+ */
+uint64_t upipe_profile_cycles(void);
+
+/** @This reports the number of urefs held by a pipe.
+ *
+ * @param profile pointer to counters of the pipe, or NULL
+ * @param length number of urefs currently held
+ */
+static inline void upipe_profile_queue(struct upipe_profile *profile,
+                                       unsigned int length)
+{
+    if (likely(profile == NULL))
+        return;
+    profile->queue = length;
+    if (length > profile->queue_max)
+        profile->queue_max = length;
+}
+
+/** @This sends a uref into a profiled pipe, updating its counters.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure to send
+ * @param upump_p reference to the pump that generated the buffer
+ */
+void upipe_profile_input(struct upipe *upipe, struct uref *uref,
+                         struct upump **upump_p);
+
+/** @This calls the callback of a pump, accounting it to the pipe owning
+ * the pump, which must have counters.
+ *
+ * @param upump description structure of the pump
+ */
+void upipe_profile_dispatch(struct upump *upump);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
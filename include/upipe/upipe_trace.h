@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe uref lifecycle tracing
+ *
+ * Tracers are attached to pipes by @ref uprobe_trace_alloc. When a pipe is
+ * traced, @ref upipe_input goes through @ref upipe_trace_input, which tags
+ * one uref out of a given number with a trace identifier (see
+ * @ref uref_trace_set_id), and records the time spent by tagged urefs in
+ * each traced pipe. Events are written by each thread to its own ring
+ * buffer without locking, and may be exported in the Chrome trace event
+ * format, to be displayed by chrome://tracing or Perfetto.
+ */
+
+#ifndef _UPIPE_UPIPE_TRACE_H_
+/** @hidden */
+#define _UPIPE_UPIPE_TRACE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/uatomic.h>
+#include <upipe/ulist.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/** @hidden */
+struct upipe;
+/** @hidden */
+struct uref;
+/** @hidden */
+struct upump;
+/** @hidden */
+struct uclock;
+
+/** default number of events in the ring buffer of each thread */
+#define UPIPE_TRACE_RING_SIZE 65536
+
+/** @This stores the state of a tracer. */
+struct upipe_trace {
+    /** uclock used to timestamp events */
+    struct uclock *uclock;
+    /** one uref out of this number is tagged (0 to only follow urefs
+     * which are already tagged) */
+    unsigned int sampling;
+    /** number of events in each ring buffer (power of 2) */
+    unsigned int ring_size;
+    /** date of the initialization */
+    uint64_t start;
+
+    /** last allocated trace identifier */
+    uatomic_uint32_t last_id;
+    /** number of threads which recorded events */
+    uatomic_uint32_t nb_rings;
+    /** lock-free list of ring buffers, one per thread */
+    uatomic_ptr_t rings;
+};
+
+/** @This describes a traced pipe. It is kept until the tracer is cleaned,
+ * so that recorded events remain valid after the death of the pipe. */
+struct upipe_trace_pipe {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** pointer to the tracer */
+    struct upipe_trace *trace;
+    /** pointer to the pipe, or NULL if it is dead */
+    struct upipe *upipe;
+    /** name of the pipe (allocated) */
+    char *name;
+    /** signature of the manager of the pipe */
+    uint32_t signature;
+};
+
+UBASE_FROM_TO(upipe_trace_pipe, uchain, uchain, uchain)
+
+/** @This initializes a tracer.
+ *
+ * @param trace pointer to tracer
+ * @param uclock uclock used to timestamp events
+ * @param sampling one uref out of this number is tagged (0 to only follow
+ * urefs which are already tagged)
+ * @param ring_size number of events kept for each thread, rounded up to a
+ * power of 2 (0 for the default)
+ * @return an error code
+ */
+int upipe_trace_init(struct upipe_trace *trace, struct uclock *uclock,
+                     unsigned int sampling, unsigned int ring_size);
+
+/** @This cleans up a tracer. All threads must have stopped recording events.
+ *
+ * @param trace pointer to tracer
+ */
+void upipe_trace_clean(struct upipe_trace *trace);
+
+/** @This sends a uref into a traced pipe, tagging it if it is sampled and
+ * recording the time it spent in the pipe if it is tagged. Only urefs which
+ * are not sent by another traced pipe of the same thread are sampled, so
+ * untagged urefs crossing a thread boundary may be sampled again.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure to send
+ * @param upump_p reference to the pump that generated the buffer
+ */
+void upipe_trace_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p);
+
+/** @This writes the recorded events in the Chrome trace event format (JSON
+ * object format). Each slice is the time spent by a tagged uref in a pipe,
+ * and slices of the same uref are linked by flow events. Events which are
+ * recorded during the call may be skipped or garbled.
+ *
+ * @param trace pointer to tracer
+ * @param file file to write to
+ * @return an error code
+ */
+int upipe_trace_write(struct upipe_trace *trace, FILE *file);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe attaching profiling counters to pipes
+ *
+ * This probe attaches @ref upipe_profile counters to every pipe throwing
+ * ready through it, so it is typically inserted near the root of the probe
+ * hierarchy. It records the number of calls, the CPU cycles spent in each
+ * pipe (excluding other profiled pipes it calls), the sampled latency of
+ * urefs and the number of urefs held by pipes using the input helper.
+ */
+
+#ifndef _UPIPE_UPROBE_PROFILE_H_
+/** @hidden */
+#define _UPIPE_UPROBE_PROFILE_H_
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+#include <upipe/ulist.h>
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @hidden */
+struct uclock;
+/** @hidden */
+struct umutex;
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_profile {
+    /** uclock used to sample latencies, or NULL */
+    struct uclock *uclock;
+    /** mutex protecting the list of pipes, or NULL */
+    struct umutex *umutex;
+    /** list of profiled pipes */
+    struct uchain pipes;
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_profile, uprobe)
+
+/** @This initializes an already allocated uprobe_profile structure.
+ *
+ * @param uprobe_profile pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock uclock used to sample latencies, or NULL to disable them
+ * @param umutex mutex protecting the probe if it is used by pipes running
+ * in several threads, or NULL
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_profile_init(struct uprobe_profile *uprobe_profile,
+                                   struct uprobe *next, struct uclock *uclock,
+                                   struct umutex *umutex);
+
+/** @This cleans a uprobe_profile structure. The profiled pipes must have
+ * been released before.
+ *
+ * @param uprobe_profile structure to clean
+ */
+void uprobe_profile_clean(struct uprobe_profile *uprobe_profile);
+
+/** @This allocates a new uprobe_profile structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock uclock used to sample latencies, or NULL to disable them
+ * @param umutex mutex protecting the probe if it is used by pipes running
+ * in several threads, or NULL
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_profile_alloc(struct uprobe *next,
+                                    struct uclock *uclock,
+                                    struct umutex *umutex);
+
+/** @This writes a snapshot of the counters of all profiled pipes, as a
+ * single line of JSON. It is typically called periodically, and consecutive
+ * snapshots may be subtracted to get rates.
+ *
+ * @param uprobe pointer to probe
+ * @param file file to write to
+ * @return an error code
+ */
+int uprobe_profile_snapshot(struct uprobe *uprobe, FILE *file);
+
+/** @This converts a pipe to a label with its profiling counters, for use
+ * as the pipe_label argument of @ref upipe_dump.
+ *
+ * @param upipe upipe structure
+ * @return allocated string
+ */
+char *uprobe_profile_upipe_label(struct upipe *upipe);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
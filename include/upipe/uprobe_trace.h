@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe attaching a uref tracer to pipes
+ *
+ * This probe attaches a tracer to all pipes throwing UPROBE_READY through
+ * it. One uref out of a given number entering a traced pipe is tagged with
+ * a trace identifier, and the time spent by tagged urefs in traced pipes is
+ * recorded, including across threads (see @ref upipe_trace_input). The
+ * events may then be written in the Chrome trace event format, for
+ * chrome://tracing or Perfetto.
+ */
+
+#ifndef _UPIPE_UPROBE_TRACE_H_
+/** @hidden */
+#define _UPIPE_UPROBE_TRACE_H_
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+#include <upipe/ulist.h>
+#include <upipe/upipe_trace.h>
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @hidden */
+struct uclock;
+/** @hidden */
+struct umutex;
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_trace {
+    /** mutex protecting the list of pipes, or NULL */
+    struct umutex *umutex;
+    /** list of traced pipes, including dead ones */
+    struct uchain pipes;
+    /** tracer */
+    struct upipe_trace trace;
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_trace, uprobe)
+
+/** @This initializes an already allocated uprobe_trace structure.
+ *
+ * @param uprobe_trace pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock uclock used to timestamp events
+ * @param sampling one uref out of this number is tagged (0 to only follow
+ * urefs which are already tagged)
+ * @param umutex mutex protecting the probe if it is used by pipes running
+ * in several threads, or NULL
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_trace_init(struct uprobe_trace *uprobe_trace,
+                                 struct uprobe *next, struct uclock *uclock,
+                                 unsigned int sampling, struct umutex *umutex);
+
+/** @This cleans a uprobe_trace structure. The traced pipes must have been
+ * released before.
+ *
+ * @param uprobe_trace structure to clean
+ */
+void uprobe_trace_clean(struct uprobe_trace *uprobe_trace);
+
+/** @This allocates a new uprobe_trace structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock uclock used to timestamp events
+ * @param sampling one uref out of this number is tagged (0 to only follow
+ * urefs which are already tagged)
+ * @param umutex mutex protecting the probe if it is used by pipes running
+ * in several threads, or NULL
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_trace_alloc(struct uprobe *next, struct uclock *uclock,
+                                  unsigned int sampling,
+                                  struct umutex *umutex);
+
+/** @This writes the recorded events in the Chrome trace event format.
+ *
+ * @param uprobe pointer to probe
+ * @param file file to write to
+ * @return an error code
+ */
+int uprobe_trace_write(struct uprobe *uprobe, FILE *file);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -51,6 +51,8 @@ struct upump;
 struct upump_blocker;
 /** @hidden */
 struct umutex;
+/** @hidden */
+struct upipe_profile;
 
 /** @This defines the standard types of pumps. */
 enum upump_type {
@@ -121,6 +123,9 @@ struct upump {
     void *opaque;
     /** pointer to urefcount structure to increment during callback */
     struct urefcount *refcount;
+    /** pointer to the profiling counters of the pipe owning the pump, or
+     * NULL */
+    struct upipe_profile **profile_p;
 };
 
 UBASE_FROM_TO(upump, uchain, uchain, uchain)
@@ -191,6 +196,7 @@ static inline struct upump *upump_alloc(struct upump_mgr *mgr,
     upump->cb = cb;
     upump->opaque = opaque;
     upump->refcount = refcount;
+    upump->profile_p = NULL;
     return upump;
 }
 
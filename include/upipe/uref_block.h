@@ -286,6 +286,16 @@ static inline int uref_block_merge(struct uref *uref, struct ubuf_mgr *ubuf_mgr,
     return ubuf_block_merge(ubuf_mgr, &uref->ubuf, skip, new_size);
 }
 
+/** @see ubuf_block_compact */
+static inline int uref_block_compact(struct uref *uref,
+                                     struct ubuf_mgr *ubuf_mgr,
+                                     unsigned int threshold)
+{
+    if (uref->ubuf == NULL)
+        return UBASE_ERR_INVALID;
+    return ubuf_block_compact(ubuf_mgr, &uref->ubuf, threshold);
+}
+
 /** @see ubuf_block_compare */
 static inline int uref_block_compare(struct uref *uref, int offset,
                                      struct uref *uref_small)
@@ -34,6 +34,7 @@
 #include <upipe/uref_flow.h>
 #include <upipe/uref_sound_flow.h>
 #include <upipe/uref_sound.h>
+#include <upipe/uclock.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
@@ -78,6 +79,19 @@ struct upipe_ebur128 {
     uint8_t planes;
     /** sample format */
     enum upipe_ebur128_fmt fmt;
+    /** sample rate */
+    uint64_t rate;
+
+    /** reporting interval of the histogram-based values */
+    uint64_t interval;
+    /** samples received since the last report */
+    uint64_t samples;
+    /** true if the cached values must be computed again */
+    bool report;
+    /** cached loudness range */
+    double lra;
+    /** cached integrated loudness */
+    double global;
 
     /** public structure */
     struct upipe upipe;
@@ -108,6 +122,12 @@ static struct upipe *upipe_ebur128_alloc(struct upipe_mgr *mgr,
         return NULL;
     struct upipe_ebur128 *upipe_ebur128 = upipe_ebur128_from_upipe(upipe);
     upipe_ebur128->st = NULL;
+    upipe_ebur128->rate = 0;
+    upipe_ebur128->interval = 0;
+    upipe_ebur128->samples = 0;
+    upipe_ebur128->report = true;
+    upipe_ebur128->lra = 0;
+    upipe_ebur128->global = 0;
 
     upipe_ebur128_init_urefcount(upipe);
     upipe_ebur128_init_output(upipe);
@@ -125,9 +145,10 @@ static void upipe_ebur128_input(struct upipe *upipe, struct uref *uref,
                                 struct upump **upump_p)
 {
     struct upipe_ebur128 *upipe_ebur128 = upipe_ebur128_from_upipe(upipe);
-    double loud = 0, lra = 0, global = 0;
+    double loud = 0;
 
-    if (unlikely(upipe_ebur128->output_flow == NULL)) {
+    if (unlikely(upipe_ebur128->output_flow == NULL ||
+                 upipe_ebur128->st == NULL)) {
         upipe_err_va(upipe, "invalid input");
         uref_free(uref);
         return;
@@ -164,6 +185,7 @@ static void upipe_ebur128_input(struct upipe *upipe, struct uref *uref,
                                                samples, sample_size,
                                                upipe_ebur128->planes))) {
             upipe_warn(upipe, "error mapping sound buffer");
+            free(buf);
             uref_free(uref);
             return;
         }
@@ -205,14 +227,26 @@ static void upipe_ebur128_input(struct upipe *upipe, struct uref *uref,
         free(buf);
 
     ebur128_loudness_momentary(upipe_ebur128->st, &loud);
-    ebur128_loudness_range(upipe_ebur128->st, &lra);
-    ebur128_loudness_global(upipe_ebur128->st, &global);
+
+    /* range and integrated loudness scan the whole histogram */
+    upipe_ebur128->samples += samples;
+    if (!upipe_ebur128->report && upipe_ebur128->interval &&
+        upipe_ebur128->samples * UCLOCK_FREQ >=
+            upipe_ebur128->interval * upipe_ebur128->rate)
+        upipe_ebur128->report = true;
+    if (upipe_ebur128->report || !upipe_ebur128->interval) {
+        ebur128_loudness_range(upipe_ebur128->st, &upipe_ebur128->lra);
+        ebur128_loudness_global(upipe_ebur128->st, &upipe_ebur128->global);
+        upipe_ebur128->samples = 0;
+        upipe_ebur128->report = false;
+    }
 
     uref_ebur128_set_momentary(uref, loud);
-    uref_ebur128_set_lra(uref, lra);
-    uref_ebur128_set_global(uref, global);
+    uref_ebur128_set_lra(uref, upipe_ebur128->lra);
+    uref_ebur128_set_global(uref, upipe_ebur128->global);
 
-    upipe_verbose_va(upipe, "loud %f lra %f global %f", loud, lra, global);
+    upipe_verbose_va(upipe, "loud %f lra %f global %f", loud,
+                     upipe_ebur128->lra, upipe_ebur128->global);
 
     upipe_ebur128_output(upipe, uref, upump_p);
 }
@@ -258,6 +292,8 @@ static int upipe_ebur128_set_flow_def(struct upipe *upipe,
         return UBASE_ERR_ALLOC;
     }
     upipe_ebur128->fmt = fmt;
+    upipe_ebur128->rate = rate;
+    upipe_ebur128->report = true;
 
     if (unlikely(upipe_ebur128->st)) {
         //ebur128_destroy(&upipe_ebur128->st);
@@ -273,6 +309,34 @@ static int upipe_ebur128_set_flow_def(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This restarts the integrated and range measurements.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ebur128_reset_state(struct upipe *upipe)
+{
+    struct upipe_ebur128 *upipe_ebur128 = upipe_ebur128_from_upipe(upipe);
+    upipe_ebur128->samples = 0;
+    upipe_ebur128->report = true;
+    upipe_ebur128->lra = 0;
+    upipe_ebur128->global = 0;
+    if (upipe_ebur128->st == NULL)
+        return UBASE_ERR_NONE;
+
+    /* keep measuring with the old state if the new one can't be allocated */
+    ebur128_state *st = ebur128_init(upipe_ebur128->channels,
+            upipe_ebur128->rate,
+            EBUR128_MODE_LRA | EBUR128_MODE_I | EBUR128_MODE_HISTOGRAM);
+    if (unlikely(st == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    ebur128_destroy(&upipe_ebur128->st);
+    upipe_ebur128->st = st;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This provides a flow format suggestion.
  *
  * @param upipe description structure of the pipe
@@ -303,6 +367,8 @@ static int upipe_ebur128_provide_flow_format(struct upipe *upipe,
 static int upipe_ebur128_control(struct upipe *upipe,
                                  int command, va_list args)
 {
+    struct upipe_ebur128 *upipe_ebur128 = upipe_ebur128_from_upipe(upipe);
+
     switch (command) {
         case UPIPE_REGISTER_REQUEST: {
             struct urequest *request = va_arg(args, struct urequest *);
@@ -322,6 +388,23 @@ static int upipe_ebur128_control(struct upipe *upipe,
         case UPIPE_GET_OUTPUT:
         case UPIPE_SET_OUTPUT:
             return upipe_ebur128_control_output(upipe, command, args);
+
+        case UPIPE_EBUR128_SET_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_EBUR128_SIGNATURE)
+            upipe_ebur128->interval = va_arg(args, uint64_t);
+            upipe_ebur128->report = true;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_EBUR128_GET_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_EBUR128_SIGNATURE)
+            uint64_t *interval_p = va_arg(args, uint64_t *);
+            *interval_p = upipe_ebur128->interval;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_EBUR128_RESET: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_EBUR128_SIGNATURE)
+            return upipe_ebur128_reset_state(upipe);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short shared peak, RMS and true peak metering kernels for audio filters
+ *
+ * The kernels are written without branches and with independent
+ * accumulators, so that the compiler vectorizes the contiguous (planar) case.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uref.h>
+#include <upipe/uref_sound.h>
+#include <upipe-filters/upipe_audio_max.h>
+
+#include "audio_meter.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+/** number of independent accumulators */
+#define LANES 8
+/** number of samples converted at once for the true peak filter */
+#define TP_CHUNK 256
+
+/** ITU-R BS.1770-4 annex 2 interpolation filter, one row per phase */
+static const float tp_coeffs[UPIPE_AUDIO_METER_TP_PHASES]
+                            [UPIPE_AUDIO_METER_TP_TAPS] = {
+    {  0.0017089843750,  0.0109863281250, -0.0196533203125,
+       0.0332031250000, -0.0594482421875,  0.1373291015625,
+       0.9721679687500, -0.1022949218750,  0.0476074218750,
+      -0.0266113281250,  0.0148925781250, -0.0083007812500 },
+    { -0.0291748046875,  0.0292968750000, -0.0517578125000,
+       0.0891113281250, -0.1665039062500,  0.4650878906250,
+       0.7797851562500, -0.2003173828125,  0.1015625000000,
+      -0.0582275390625,  0.0330810546875, -0.0189208984375 },
+    { -0.0189208984375,  0.0330810546875, -0.0582275390625,
+       0.1015625000000, -0.2003173828125,  0.7797851562500,
+       0.4650878906250, -0.1665039062500,  0.0891113281250,
+      -0.0517578125000,  0.0292968750000, -0.0291748046875 },
+    { -0.0083007812500,  0.0148925781250, -0.0266113281250,
+       0.0476074218750, -0.1022949218750,  0.9721679687500,
+       0.1373291015625, -0.0594482421875,  0.0332031250000,
+      -0.0196533203125,  0.0109863281250,  0.0017089843750 },
+};
+
+/** @This returns the sample format matching a flow definition.
+ *
+ * @param def flow definition string
+ * @return sample format, or UPIPE_AUDIO_METER_NONE if unsupported
+ */
+enum upipe_audio_meter_fmt upipe_audio_meter_fmt_from_def(const char *def)
+{
+    if (!ubase_ncmp(def, "sound.u8."))
+        return UPIPE_AUDIO_METER_U8;
+    if (!ubase_ncmp(def, "sound.s16."))
+        return UPIPE_AUDIO_METER_S16;
+    if (!ubase_ncmp(def, "sound.s32."))
+        return UPIPE_AUDIO_METER_S32;
+    if (!ubase_ncmp(def, "sound.f32."))
+        return UPIPE_AUDIO_METER_F32;
+    if (!ubase_ncmp(def, "sound.f64."))
+        return UPIPE_AUDIO_METER_F64;
+    return UPIPE_AUDIO_METER_NONE;
+}
+
+/** @This resets the true peak filter state of a channel.
+ *
+ * @param tp true peak filter state
+ */
+void upipe_audio_meter_tp_init(struct upipe_audio_meter_tp *tp)
+{
+    memset(tp->history, 0, sizeof(tp->history));
+}
+
+/** @internal @This runs the oversampling filter on normalized samples.
+ *
+ * @param buf samples, preceded by UPIPE_AUDIO_METER_TP_TAPS - 1 samples of
+ * history
+ * @param samples number of new samples
+ * @return maximum absolute value of the oversampled signal
+ */
+static float upipe_audio_meter_tp_filter(const float *buf, size_t samples)
+{
+    float max[LANES] = { 0 };
+    for (int p = 0; p < UPIPE_AUDIO_METER_TP_PHASES; p++) {
+        const float *h = tp_coeffs[p];
+        for (size_t i = 0; i < samples; i++) {
+            float y = 0;
+            for (int k = 0; k < UPIPE_AUDIO_METER_TP_TAPS; k++)
+                y += h[k] * buf[i + UPIPE_AUDIO_METER_TP_TAPS - 1 - k];
+            y = fabsf(y);
+            max[i % LANES] = y > max[i % LANES] ? y : max[i % LANES];
+        }
+    }
+    for (int j = 1; j < LANES; j++)
+        max[0] = max[j] > max[0] ? max[j] : max[0];
+    return max[0];
+}
+
+#define U8_ABS(c) (uint32_t)abs((int)(c) - 128)
+#define U8_SQ(c) (int64_t)(((int)(c) - 128) * ((int)(c) - 128))
+#define U8_NORM(c) (((int)(c) - 128) / 128.f)
+#define S16_ABS(c) (uint32_t)abs(c)
+#define S16_SQ(c) ((int64_t)(c) * (c))
+#define S16_NORM(c) ((c) / (float)INT16_MAX)
+#define S32_ABS(c) ((c) < 0 ? 0u - (uint32_t)(c) : (uint32_t)(c))
+#define S32_SQ(c) ((double)(c) * (c))
+#define S32_NORM(c) (float)((c) / (double)INT32_MAX)
+#define F32_ABS(c) fabsf(c)
+#define F32_SQ(c) ((double)(c) * (c))
+#define F32_NORM(c) (c)
+#define F64_ABS(c) fabs(c)
+#define F64_SQ(c) ((c) * (c))
+#define F64_NORM(c) (float)(c)
+
+#define UPIPE_AUDIO_METER_TEMPLATE(fmt, type, abs_type, sum_type, type_max) \
+/** @internal @This computes the peak and sum of squares of type samples.   \
+ *                                                                          \
+ * @param buf first sample of the channel                                   \
+ * @param samples number of samples                                         \
+ * @param stride distance between two samples of the channel               \
+ * @param peak_p filled in with the peak amplitude                          \
+ * @param sum_p filled in with the sum of squared samples                   \
+ */                                                                         \
+static void upipe_audio_meter_stats_##type(const type *buf, size_t samples, \
+                                           size_t stride,                   \
+                                           float *peak_p, double *sum_p)    \
+{                                                                           \
+    abs_type max[LANES] = { 0 };                                            \
+    sum_type sum[LANES] = { 0 };                                            \
+    size_t i = 0;                                                           \
+    if (stride == 1) {                                                      \
+        for ( ; i + LANES <= samples; i += LANES) {                         \
+            for (int j = 0; j < LANES; j++) {                               \
+                abs_type a = fmt##_ABS(buf[i + j]);                         \
+                max[j] = a > max[j] ? a : max[j];                           \
+                sum[j] += fmt##_SQ(buf[i + j]);                             \
+            }                                                               \
+        }                                                                   \
+    }                                                                       \
+    for ( ; i < samples; i++) {                                             \
+        abs_type a = fmt##_ABS(buf[i * stride]);                            \
+        max[0] = a > max[0] ? a : max[0];                                   \
+        sum[0] += fmt##_SQ(buf[i * stride]);                                \
+    }                                                                       \
+    for (int j = 1; j < LANES; j++) {                                       \
+        max[0] = max[j] > max[0] ? max[j] : max[0];                         \
+        sum[0] += sum[j];                                                   \
+    }                                                                       \
+    *peak_p = (max[0] * 1.0f) / type_max;                                   \
+    *sum_p = (double)sum[0] / ((double)type_max * type_max);                \
+}                                                                           \
+/** @internal @This computes the true peak of type samples.                 \
+ *                                                                          \
+ * @param buf first sample of the channel                                   \
+ * @param samples number of samples                                         \
+ * @param stride distance between two samples of the channel               \
+ * @param tp true peak filter state of the channel                          \
+ * @return true peak amplitude                                              \
+ */                                                                         \
+static float upipe_audio_meter_tp_##type(const type *buf, size_t samples,   \
+                                         size_t stride,                     \
+                                         struct upipe_audio_meter_tp *tp)   \
+{                                                                           \
+    float chunk[UPIPE_AUDIO_METER_TP_TAPS - 1 + TP_CHUNK];                  \
+    float max = 0;                                                          \
+    memcpy(chunk, tp->history, sizeof(tp->history));                        \
+    while (samples) {                                                       \
+        size_t size = samples < TP_CHUNK ? samples : TP_CHUNK;              \
+        float *in = chunk + UPIPE_AUDIO_METER_TP_TAPS - 1;                  \
+        for (size_t i = 0; i < size; i++)                                   \
+            in[i] = fmt##_NORM(buf[i * stride]);                            \
+        float peak = upipe_audio_meter_tp_filter(chunk, size);              \
+        max = peak > max ? peak : max;                                      \
+        memmove(chunk, chunk + size, sizeof(tp->history));                  \
+        buf += size * stride;                                               \
+        samples -= size;                                                    \
+    }                                                                       \
+    memcpy(tp->history, chunk, sizeof(tp->history));                        \
+    return max;                                                             \
+}
+UPIPE_AUDIO_METER_TEMPLATE(U8, uint8_t, uint32_t, int64_t, 128)
+UPIPE_AUDIO_METER_TEMPLATE(S16, int16_t, uint32_t, int64_t, INT16_MAX)
+UPIPE_AUDIO_METER_TEMPLATE(S32, int32_t, uint32_t, double, INT32_MAX)
+UPIPE_AUDIO_METER_TEMPLATE(F32, float, float, double, 1.)
+UPIPE_AUDIO_METER_TEMPLATE(F64, double, double, double, 1.)
+#undef UPIPE_AUDIO_METER_TEMPLATE
+
+/** @This computes the peak and the sum of squares of a channel. Samples are
+ * normalized to [-1, 1].
+ *
+ * @param fmt sample format
+ * @param buf first sample of the channel
+ * @param samples number of samples
+ * @param stride distance between two samples of the channel, in samples
+ * @param peak_p filled in with the peak amplitude
+ * @param sum_p filled in with the sum of squared samples
+ */
+void upipe_audio_meter_stats(enum upipe_audio_meter_fmt fmt, const void *buf,
+                             size_t samples, size_t stride,
+                             float *peak_p, double *sum_p)
+{
+    switch (fmt) {
+        case UPIPE_AUDIO_METER_U8:
+            upipe_audio_meter_stats_uint8_t(buf, samples, stride,
+                                            peak_p, sum_p);
+            break;
+        case UPIPE_AUDIO_METER_S16:
+            upipe_audio_meter_stats_int16_t(buf, samples, stride,
+                                            peak_p, sum_p);
+            break;
+        case UPIPE_AUDIO_METER_S32:
+            upipe_audio_meter_stats_int32_t(buf, samples, stride,
+                                            peak_p, sum_p);
+            break;
+        case UPIPE_AUDIO_METER_F32:
+            upipe_audio_meter_stats_float(buf, samples, stride,
+                                          peak_p, sum_p);
+            break;
+        case UPIPE_AUDIO_METER_F64:
+            upipe_audio_meter_stats_double(buf, samples, stride,
+                                           peak_p, sum_p);
+            break;
+        default:
+            *peak_p = 0;
+            *sum_p = 0;
+            break;
+    }
+}
+
+/** @This computes the true peak of a channel, by oversampling it 4 times
+ * with the interpolation filter of ITU-R BS.1770-4 annex 2.
+ *
+ * @param fmt sample format
+ * @param buf first sample of the channel
+ * @param samples number of samples
+ * @param stride distance between two samples of the channel, in samples
+ * @param tp true peak filter state of the channel
+ * @return true peak amplitude
+ */
+float upipe_audio_meter_true_peak(enum upipe_audio_meter_fmt fmt,
+                                  const void *buf, size_t samples,
+                                  size_t stride,
+                                  struct upipe_audio_meter_tp *tp)
+{
+    switch (fmt) {
+        case UPIPE_AUDIO_METER_U8:
+            return upipe_audio_meter_tp_uint8_t(buf, samples, stride, tp);
+        case UPIPE_AUDIO_METER_S16:
+            return upipe_audio_meter_tp_int16_t(buf, samples, stride, tp);
+        case UPIPE_AUDIO_METER_S32:
+            return upipe_audio_meter_tp_int32_t(buf, samples, stride, tp);
+        case UPIPE_AUDIO_METER_F32:
+            return upipe_audio_meter_tp_float(buf, samples, stride, tp);
+        case UPIPE_AUDIO_METER_F64:
+            return upipe_audio_meter_tp_double(buf, samples, stride, tp);
+        default:
+            return 0;
+    }
+}
+
+/** @internal @This returns the size of a sample.
+ *
+ * @param fmt sample format
+ * @return size in octets
+ */
+static size_t upipe_audio_meter_sample_size(enum upipe_audio_meter_fmt fmt)
+{
+    switch (fmt) {
+        case UPIPE_AUDIO_METER_U8: return 1;
+        case UPIPE_AUDIO_METER_S16: return 2;
+        case UPIPE_AUDIO_METER_S32:
+        case UPIPE_AUDIO_METER_F32: return 4;
+        case UPIPE_AUDIO_METER_F64: return 8;
+        default: return 0;
+    }
+}
+
+/** @This meters all channels of a sound buffer and attaches the peak
+ * (amax.amp), RMS (amax.rms) and optionally true peak (amax.tp) attributes
+ * to the uref.
+ *
+ * @param uref sound buffer
+ * @param fmt sample format
+ * @param channels number of channels
+ * @param tp array of channels true peak filter states, or NULL to skip true
+ * peak computation
+ * @return an error code
+ */
+int upipe_audio_meter_uref(struct uref *uref, enum upipe_audio_meter_fmt fmt,
+                           uint8_t channels, struct upipe_audio_meter_tp *tp)
+{
+    size_t samples;
+    UBASE_RETURN(uref_sound_size(uref, &samples, NULL))
+    size_t sample_size = upipe_audio_meter_sample_size(fmt);
+    if (unlikely(!sample_size))
+        return UBASE_ERR_INVALID;
+
+    uint8_t planes = 0;
+    const char *channel;
+    uref_sound_foreach_plane(uref, channel)
+        planes++;
+    if (unlikely(planes != channels && planes != 1))
+        return UBASE_ERR_INVALID;
+    size_t stride = planes == 1 ? channels : 1;
+
+    uint8_t chan = 0;
+    uref_sound_foreach_plane(uref, channel) {
+        const uint8_t *buf;
+        UBASE_RETURN(uref_sound_plane_read_uint8_t(uref, channel, 0, -1, &buf))
+
+        for (size_t i = 0; i < stride && chan < channels; i++, chan++) {
+            const void *start = buf + i * sample_size;
+            float peak;
+            double sum;
+            upipe_audio_meter_stats(fmt, start, samples, stride, &peak, &sum);
+            uref_amax_set_amplitude(uref, peak, chan);
+            uref_amax_set_rms(uref, samples ? sqrt(sum / samples) : 0., chan);
+            if (tp != NULL) {
+                float true_peak = upipe_audio_meter_true_peak(fmt, start,
+                        samples, stride, &tp[chan]);
+                uref_amax_set_true_peak(uref,
+                        true_peak > peak ? true_peak : peak, chan);
+            }
+        }
+        uref_sound_plane_unmap(uref, channel, 0, -1);
+    }
+    return UBASE_ERR_NONE;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short shared peak, RMS and true peak metering kernels for audio filters
+ */
+
+#ifndef _UPIPE_FILTERS_AUDIO_METER_H_
+/** @hidden */
+#define _UPIPE_FILTERS_AUDIO_METER_H_
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct uref;
+
+/** number of phases of the true peak oversampling filter */
+#define UPIPE_AUDIO_METER_TP_PHASES 4
+/** number of taps per phase of the true peak oversampling filter */
+#define UPIPE_AUDIO_METER_TP_TAPS 12
+
+/** @This enumerates the supported sample formats. */
+enum upipe_audio_meter_fmt {
+    /** unsupported format */
+    UPIPE_AUDIO_METER_NONE,
+    /** unsigned 8 bits */
+    UPIPE_AUDIO_METER_U8,
+    /** signed 16 bits */
+    UPIPE_AUDIO_METER_S16,
+    /** signed 32 bits */
+    UPIPE_AUDIO_METER_S32,
+    /** 32 bits floating point */
+    UPIPE_AUDIO_METER_F32,
+    /** 64 bits floating point */
+    UPIPE_AUDIO_METER_F64
+};
+
+/** @This is the true peak filter state of a channel. */
+struct upipe_audio_meter_tp {
+    /** last input samples, oldest first */
+    float history[UPIPE_AUDIO_METER_TP_TAPS - 1];
+};
+
+/** @This returns the sample format matching a flow definition.
+ *
+ * @param def flow definition string
+ * @return sample format, or UPIPE_AUDIO_METER_NONE if unsupported
+ */
+enum upipe_audio_meter_fmt upipe_audio_meter_fmt_from_def(const char *def);
+
+/** @This resets the true peak filter state of a channel.
+ *
+ * @param tp true peak filter state
+ */
+void upipe_audio_meter_tp_init(struct upipe_audio_meter_tp *tp);
+
+/** @This computes the peak and the sum of squares of a channel. Samples are
+ * normalized to [-1, 1].
+ *
+ * @param fmt sample format
+ * @param buf first sample of the channel
+ * @param samples number of samples
+ * @param stride distance between two samples of the channel, in samples
+ * @param peak_p filled in with the peak amplitude
+ * @param sum_p filled in with the sum of squared samples
+ */
+void upipe_audio_meter_stats(enum upipe_audio_meter_fmt fmt, const void *buf,
+                             size_t samples, size_t stride,
+                             float *peak_p, double *sum_p);
+
+/** @This computes the true peak of a channel, by oversampling it 4 times
+ * with the interpolation filter of ITU-R BS.1770-4 annex 2.
+ *
+ * @param fmt sample format
+ * @param buf first sample of the channel
+ * @param samples number of samples
+ * @param stride distance between two samples of the channel, in samples
+ * @param tp true peak filter state of the channel
+ * @return true peak amplitude
+ */
+float upipe_audio_meter_true_peak(enum upipe_audio_meter_fmt fmt,
+                                  const void *buf, size_t samples,
+                                  size_t stride,
+                                  struct upipe_audio_meter_tp *tp);
+
+/** @This meters all channels of a sound buffer and attaches the peak
+ * (amax.amp), RMS (amax.rms) and optionally true peak (amax.tp) attributes
+ * to the uref.
+ *
+ * @param uref sound buffer
+ * @param fmt sample format
+ * @param channels number of channels
+ * @param tp array of channels true peak filter states, or NULL to skip true
+ * peak computation
+ * @return an error code
+ */
+int upipe_audio_meter_uref(struct uref *uref, enum upipe_audio_meter_fmt fmt,
+                           uint8_t channels, struct upipe_audio_meter_tp *tp);
+
+#endif
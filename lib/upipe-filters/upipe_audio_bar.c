@@ -42,6 +42,8 @@
 #include <upipe-filters/upipe_audio_bar.h>
 #include <upipe-filters/upipe_audio_max.h>
 
+#include "audio_meter.h"
+
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -112,6 +114,8 @@ struct upipe_audiobar {
 
     /** number of input channels */
     uint8_t channels;
+    /** input sample format */
+    enum upipe_audio_meter_fmt fmt;
     /** requested width */
     uint64_t hsize;
     /** requested height */
@@ -167,6 +171,7 @@ static struct upipe *upipe_audiobar_alloc(struct upipe_mgr *mgr,
     upipe_audiobar_init_ubuf_mgr(upipe);
     upipe_audiobar_init_flow_format(upipe);
     upipe_audiobar->flow_def_config = flow_def;
+    upipe_audiobar->fmt = UPIPE_AUDIO_METER_NONE;
     upipe_audiobar->alpha = DEFAULT_ALPHA;
     upipe_audiobar->hsize = upipe_audiobar->vsize =
         upipe_audiobar->sep_width = upipe_audiobar->pad_width = UINT64_MAX;
@@ -244,6 +249,7 @@ static bool upipe_audiobar_handle(struct upipe *upipe, struct uref *uref,
     if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
         UBASE_FATAL(upipe,
                 uref_sound_flow_get_channels(uref, &upipe_audiobar->channels))
+        upipe_audiobar->fmt = upipe_audio_meter_fmt_from_def(def);
         uref_sound_flow_clear_format(uref);
         UBASE_FATAL(upipe,
                 uref_attr_import(uref, upipe_audiobar->flow_def_config))
@@ -268,6 +274,13 @@ static bool upipe_audiobar_handle(struct upipe *upipe, struct uref *uref,
     if (unlikely(upipe_audiobar->hsize == UINT64_MAX))
         return false;
 
+    /* meter the sound buffer if no amax pipe did it upstream */
+    double amp;
+    if (!ubase_check(uref_amax_get_amplitude(uref, &amp, 0)) &&
+        upipe_audiobar->fmt != UPIPE_AUDIO_METER_NONE && uref->ubuf != NULL)
+        upipe_audio_meter_uref(uref, upipe_audiobar->fmt,
+                               upipe_audiobar->channels, NULL);
+
     struct ubuf *ubuf = ubuf_pic_alloc(upipe_audiobar->ubuf_mgr,
                                        upipe_audiobar->hsize,
                                        upipe_audiobar->vsize);
@@ -42,6 +42,8 @@
 #include <upipe-filters/upipe_audio_graph.h>
 #include <upipe-filters/upipe_audio_max.h>
 
+#include "audio_meter.h"
+
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -110,6 +112,8 @@ struct upipe_agraph {
 
     /** number of input channels */
     uint8_t channels;
+    /** input sample format */
+    enum upipe_audio_meter_fmt fmt;
     /** requested width */
     uint64_t hsize;
     /** requested height */
@@ -167,6 +171,7 @@ static struct upipe *upipe_agraph_alloc(struct upipe_mgr *mgr,
     upipe_agraph_init_ubuf_mgr(upipe);
     upipe_agraph_init_flow_format(upipe);
     upipe_agraph->flow_def_config = flow_def;
+    upipe_agraph->fmt = UPIPE_AUDIO_METER_NONE;
     upipe_agraph->hsize = upipe_agraph->vsize =
         upipe_agraph->sep_width = upipe_agraph->pad_width = UINT64_MAX;
 
@@ -242,6 +247,7 @@ static bool upipe_agraph_handle(struct upipe *upipe, struct uref *uref,
     if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
         UBASE_FATAL(upipe,
                 uref_sound_flow_get_channels(uref, &upipe_agraph->channels))
+        upipe_agraph->fmt = upipe_audio_meter_fmt_from_def(def);
         uref_sound_flow_clear_format(uref);
         UBASE_FATAL(upipe,
                 uref_attr_import(uref, upipe_agraph->flow_def_config))
@@ -265,6 +271,13 @@ static bool upipe_agraph_handle(struct upipe *upipe, struct uref *uref,
     if (unlikely(upipe_agraph->hsize == UINT64_MAX))
         return false;
 
+    /* meter the sound buffer if no amax pipe did it upstream */
+    double amp;
+    if (!ubase_check(uref_amax_get_amplitude(uref, &amp, 0)) &&
+        upipe_agraph->fmt != UPIPE_AUDIO_METER_NONE && uref->ubuf != NULL)
+        upipe_audio_meter_uref(uref, upipe_agraph->fmt,
+                               upipe_agraph->channels, NULL);
+
     struct ubuf *ubuf = ubuf_pic_alloc(upipe_agraph->ubuf_mgr,
                                        upipe_agraph->hsize,
                                        upipe_agraph->vsize);
@@ -36,20 +36,26 @@
 #include <upipe/upipe_helper_output.h>
 #include <upipe-filters/upipe_audio_max.h>
 
+#include "audio_meter.h"
+
 #include <stdlib.h>
 #include <strings.h>
 #include <stdint.h>
 #include <stdio.h>
 
-typedef double (*upipe_amax_process)(struct upipe *, struct uref *,
-                                     const char *, size_t);
-
 /** @internal upipe_amax private structure */
 struct upipe_amax {
     /** refcount management structure */
     struct urefcount urefcount;
 
-    upipe_amax_process process;
+    /** sample format */
+    enum upipe_audio_meter_fmt fmt;
+    /** number of channels */
+    uint8_t channels;
+    /** true if true peak metering is enabled */
+    bool true_peak;
+    /** true peak filter states, one per channel */
+    struct upipe_audio_meter_tp *tp;
 
     /** output */
     struct upipe *output;
@@ -88,47 +94,15 @@ static struct upipe *upipe_amax_alloc(struct upipe_mgr *mgr,
     struct upipe_amax *upipe_amax = upipe_amax_from_upipe(upipe);
     upipe_amax_init_urefcount(upipe);
     upipe_amax_init_output(upipe);
-    upipe_amax->process = NULL;
+    upipe_amax->fmt = UPIPE_AUDIO_METER_NONE;
+    upipe_amax->channels = 0;
+    upipe_amax->true_peak = false;
+    upipe_amax->tp = NULL;
 
     upipe_throw_ready(upipe);
     return upipe;
 }
 
-#define UPIPE_AMAX_TEMPLATE(type, type_max)                                 \
-/** @internal @This processes input of format type.                         \
- *                                                                          \
- * @param upipe description structure of the pipe                           \
- * @param uref uref structure                                               \
- * @param channel channel name                                              \
- * @param samples number of samples                                         \
- */                                                                         \
-static double upipe_amax_process_##type(struct upipe *upipe,                \
-        struct uref *uref, const char *channel, size_t samples)             \
-{                                                                           \
-    const type *buf = NULL;                                                 \
-    if (unlikely(!ubase_check(uref_sound_plane_read_##type(uref,            \
-            channel, 0, -1, &buf)))) {                                      \
-        upipe_warn(upipe, "error mapping sound buffer");                    \
-        return 0.;                                                          \
-    }                                                                       \
-    type max = 0;                                                           \
-    for (size_t i = 0; i < samples; i++) {                                  \
-        type c = buf[i];                                                    \
-        if (c > max)                                                        \
-            max = c;                                                        \
-        else if (-c > max)                                                  \
-            max = -c;                                                       \
-    }                                                                       \
-    uref_sound_plane_unmap(uref, channel, 0, -1);                           \
-    return (max * 1.0f) / type_max;                                         \
-}
-UPIPE_AMAX_TEMPLATE(uint8_t, UINT8_MAX)
-UPIPE_AMAX_TEMPLATE(int16_t, INT16_MAX)
-UPIPE_AMAX_TEMPLATE(int32_t, INT32_MAX)
-UPIPE_AMAX_TEMPLATE(float, 1.)
-UPIPE_AMAX_TEMPLATE(double, 1.)
-#undef UPIPE_AMAX_TEMPLATE
-
 /** @internal @This handles input.
  *
  * @param upipe description structure of the pipe
@@ -139,24 +113,20 @@ static void upipe_amax_input(struct upipe *upipe, struct uref *uref,
                              struct upump **upump_p)
 {
     struct upipe_amax *upipe_amax = upipe_amax_from_upipe(upipe);
-    if (unlikely(upipe_amax->process == NULL || uref->ubuf == NULL)) {
+    if (unlikely(upipe_amax->fmt == UPIPE_AUDIO_METER_NONE ||
+                 uref->ubuf == NULL)) {
         upipe_warn(upipe, "invalid uref received");
         uref_free(uref);
         return;
     }
 
-    size_t samples;
-    if (unlikely(!ubase_check(uref_sound_size(uref, &samples, NULL)))) {
+    if (unlikely(!ubase_check(upipe_audio_meter_uref(uref, upipe_amax->fmt,
+                        upipe_amax->channels,
+                        upipe_amax->true_peak ? upipe_amax->tp : NULL)))) {
         upipe_warn(upipe, "invalid sound buffer");
         uref_free(uref);
         return;
     }
-    const char *channel = NULL;
-    uint8_t j = 0;
-    uref_sound_foreach_plane(uref, channel) {
-        double maxf = upipe_amax->process(upipe, uref, channel, samples);
-        uref_amax_set_amplitude(uref, maxf, j++);
-    }
 
     upipe_amax_output(upipe, uref, upump_p);
 }
@@ -175,33 +145,36 @@ static int upipe_amax_set_flow_def(struct upipe *upipe, struct uref *flow)
 
     const char *def;
     UBASE_RETURN(uref_flow_get_def(flow, &def))
-    upipe_amax_process process = NULL;
-    if (!ubase_ncmp(def, "sound.u8."))
-        process = upipe_amax_process_uint8_t;
-    else if (!ubase_ncmp(def, "sound.s16."))
-        process = upipe_amax_process_int16_t;
-    else if (!ubase_ncmp(def, "sound.s32."))
-        process = upipe_amax_process_int32_t;
-    else if (!ubase_ncmp(def, "sound.f32."))
-        process = upipe_amax_process_float;
-    else if (!ubase_ncmp(def, "sound.f64."))
-        process = upipe_amax_process_double;
-    else
+    enum upipe_audio_meter_fmt fmt = upipe_audio_meter_fmt_from_def(def);
+    if (fmt == UPIPE_AUDIO_METER_NONE)
         return UBASE_ERR_INVALID;
     uint8_t channels, planes;
     if (unlikely(!ubase_check(uref_sound_flow_get_channels(flow, &channels))
               || !ubase_check(uref_sound_flow_get_planes(flow, &planes))
-              || planes != channels))
+              || (planes != channels && planes != 1)))
         return UBASE_ERR_INVALID;
 
-    upipe_amax->process = process;
-
     struct uref *flow_dup;
     if (unlikely((flow_dup = uref_dup(flow)) == NULL)) {
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return UBASE_ERR_ALLOC;
     }
 
+    if (channels != upipe_amax->channels) {
+        struct upipe_audio_meter_tp *tp =
+            realloc(upipe_amax->tp, channels * sizeof(*tp));
+        if (unlikely(tp == NULL && channels)) {
+            uref_free(flow_dup);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe_amax->tp = tp;
+        upipe_amax->channels = channels;
+        for (uint8_t i = 0; i < channels; i++)
+            upipe_audio_meter_tp_init(&upipe_amax->tp[i]);
+    }
+    upipe_amax->fmt = fmt;
+
     upipe_amax_store_flow_def(upipe, flow_dup);
     return UBASE_ERR_NONE;
 }
@@ -274,6 +247,17 @@ static int upipe_amax_control(struct upipe *upipe, int command, va_list args)
         case UPIPE_GET_OUTPUT:
         case UPIPE_SET_OUTPUT:
             return upipe_amax_control_output(upipe, command, args);
+
+        case UPIPE_AMAX_SET_TRUE_PEAK: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AUDIO_MAX_SIGNATURE)
+            struct upipe_amax *upipe_amax = upipe_amax_from_upipe(upipe);
+            bool true_peak = !!va_arg(args, int);
+            if (true_peak && !upipe_amax->true_peak)
+                for (uint8_t i = 0; i < upipe_amax->channels; i++)
+                    upipe_audio_meter_tp_init(&upipe_amax->tp[i]);
+            upipe_amax->true_peak = true_peak;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -288,6 +272,8 @@ static void upipe_amax_free(struct upipe *upipe)
     struct upipe_amax *upipe_amax = upipe_amax_from_upipe(upipe);
     upipe_throw_dead(upipe);
 
+    free(upipe_amax->tp);
+
     upipe_amax_clean_output(upipe);
     upipe_amax_clean_urefcount(upipe);
     upipe_amax_free_void(upipe);
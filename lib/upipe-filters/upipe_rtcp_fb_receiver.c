@@ -63,9 +63,32 @@
 
 #include <bitstream/ietf/rtp.h>
 #include <bitstream/ietf/rtcp.h>
+#include <bitstream/ietf/rtcp_rr.h>
 #include <bitstream/ietf/rtcp_fb.h>
 
 #define EXPECTED_FLOW_DEF "block."
+/** size of the header common to all RTCP packets */
+#define RTCP_COMMON_HEADER_SIZE 4
+/** default delay between two retransmissions of the same packet (msecs) */
+#define DEFAULT_HOLDOFF 20
+/** number of entries in the NACK history of a receiver */
+#define NACK_HISTORY 64
+/** initial number of entries in the retransmission cache (power of 2) */
+#define CACHE_SIZE 1024
+/** maximum number of entries in the retransmission cache */
+#define CACHE_MAX_SIZE (UINT16_MAX + 1)
+
+/** @internal @This is an entry of the retransmission cache. */
+struct upipe_rtcpfb_slot {
+    /** buffered packet, or NULL */
+    struct uref *uref;
+    /** sequence number of the buffered packet */
+    uint16_t seq;
+    /** date at which the packet was buffered */
+    uint64_t date;
+    /** date of the last retransmission, or UINT64_MAX */
+    uint64_t retransmit;
+};
 
 /** upipe_rtcpfb structure */
 struct upipe_rtcpfb {
@@ -89,8 +112,9 @@ struct upipe_rtcpfb {
     struct upump *upump_timer;
     struct uclock *uclock;
     struct urequest uclock_request;
-    struct uchain queue;
     unsigned last_seq;
+    /** sequence number of the oldest buffered packet */
+    uint16_t first_seq;
 
     /** list of input subpipes */
     struct uchain inputs;
@@ -111,6 +135,18 @@ struct upipe_rtcpfb {
 
     /** buffer latency */
     uint64_t latency;
+    /** minimum delay between two retransmissions of a packet (msecs) */
+    uint64_t holdoff;
+
+    /** retransmission counters */
+    struct upipe_rtcpfb_stats stats;
+    /** true if the counters changed since the last event */
+    bool stats_changed;
+
+    /** retransmission cache, indexed by sequence number modulo its size */
+    struct upipe_rtcpfb_slot *cache;
+    /** number of entries in the cache (power of 2) */
+    unsigned int cache_size;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -134,6 +170,16 @@ UBASE_FROM_TO(upipe_rtcpfb, urefcount, urefcount_real, urefcount_real)
 UPIPE_HELPER_UPUMP_MGR(upipe_rtcpfb, upump_mgr)
 UPIPE_HELPER_UCLOCK(upipe_rtcpfb, uclock, uclock_request, NULL, upipe_throw_provide_request, NULL)
 
+/** @internal @This is an entry of the NACK history of a receiver. */
+struct upipe_rtcpfb_history {
+    /** sequence number */
+    uint16_t seq;
+    /** date of the last retransmission to the receiver, or UINT64_MAX */
+    uint64_t date;
+};
+
+/** @internal @This is the private context of an input subpipe, receiving
+ * the RTCP messages of a receiver. */
 struct upipe_rtcpfb_input {
     /** refcount management structure */
     struct urefcount urefcount;
@@ -148,6 +194,19 @@ struct upipe_rtcpfb_input {
     enum upipe_helper_output_state output_state;
     /** list of output requests */
     struct uchain request_list;
+    /** input flow definition packet */
+    struct uref *flow_def_input;
+
+    /** retransmission cap (octets per second), or 0 */
+    uint64_t rate;
+    /** octets that may be retransmitted right now */
+    uint64_t tokens;
+    /** date of the last refill of tokens */
+    uint64_t tokens_date;
+    /** recent retransmissions to the receiver, indexed by sequence number */
+    struct upipe_rtcpfb_history history[NACK_HISTORY];
+    /** receiver counters */
+    struct upipe_rtcpfb_receiver_stats stats;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -158,67 +217,10 @@ struct upipe_rtcpfb_input {
     struct uchain blockers;
 };
 
-static void upipe_rtcpfb_lost_sub(struct upipe *upipe, uint16_t seq, uint16_t mask);
-
-/** @internal @This handles NACK RTCP messages.
- *
- * @param upipe description structure of the pipe
- * @param uref uref structure
- * @param upump_p reference to pump that generated the buffer
- */
-
-static inline void upipe_rtcpfb_input_sub(struct upipe *upipe, struct uref *uref,
-                                    struct upump **upump_p)
-{
-    size_t s = 0;
-    uref_block_size(uref, &s);
-    const uint8_t *rtp = uref_block_peek(uref, 0, s, NULL);
-    if (!rtp) {
-        upipe_err(upipe, "Can't peek rtcp message");
-        uref_free(uref);
-        return;
-    }
-
-    if (s < RTP_HEADER_SIZE || !rtp_check_hdr(rtp)) {
-        upipe_warn_va(upipe, "Received invalid RTP packet");
-        goto end;
-    }
-
-    if (rtcp_get_pt(rtp) != RTCP_PT_RTPFB) {
-        upipe_warn_va(upipe, "Received non Transport Layer specific message");
-        goto end;
-    }
-
-    if (rtcp_fb_get_fmt(rtp) != RTCP_PT_RTPFB_GENERIC_NACK) {
-        upipe_warn_va(upipe, "Received non generic NACK message");
-        goto end;
-    }
-
-    uint16_t len = rtpx_get_length(rtp);
-    if ((len + 1) * 4 != s) {
-        upipe_warn_va(upipe, "Invalid RTP length");
-        goto end;
-    }
-
-    // TODO: ssrc
-
-    s -= RTCP_FB_HEADER_SIZE;
-    const uint8_t *fci = &rtp[RTCP_FB_HEADER_SIZE];
-
-    for (size_t i = 0; i < s; i += RTCP_FB_FCI_GENERIC_NACK_SIZE) {
-        uint16_t id = rtcp_fb_nack_get_packet_id(&fci[i]);
-        uint16_t mask = rtcp_fb_nack_get_bitmask_lost(&fci[i]);
-        upipe_verbose_va(upipe, "Received NACK: %hu (0x%hx)", id, mask);
-        upipe_rtcpfb_lost_sub(upipe, id, mask);
-    }
-
-end:
-    uref_block_peek_unmap(uref, 0, NULL, rtp);
-    uref_free(uref);
-}
-
 UPIPE_HELPER_UPIPE(upipe_rtcpfb_input, upipe, UPIPE_RTCPFB_INPUT_SIGNATURE)
 UPIPE_HELPER_UREFCOUNT(upipe_rtcpfb_input, urefcount, upipe_rtcpfb_input_free)
+UPIPE_HELPER_OUTPUT(upipe_rtcpfb_input, output, flow_def, output_state,
+                    request_list)
 UPIPE_HELPER_INPUT(upipe_rtcpfb_input, urefs, nb_urefs, max_urefs, blockers, NULL)
 UPIPE_HELPER_SUBPIPE(upipe_rtcpfb, upipe_rtcpfb_input, output, sub_mgr, inputs,
                      uchain)
@@ -235,36 +237,237 @@ static int ctz(unsigned int x)
 #endif
 }
 
-/** @internal @This retransmits a list of packets described by a single FCI.
- * TODO: handle a list of FCIs.
+/** @internal @This returns the cache entry of a sequence number.
+ *
+ * @param upipe_rtcpfb private context of the pipe
+ * @param seq sequence number
+ * @return pointer to the cache entry
  */
-static void upipe_rtcpfb_lost_sub(struct upipe *upipe, uint16_t seq, uint16_t mask)
+static inline struct upipe_rtcpfb_slot *
+    upipe_rtcpfb_slot(struct upipe_rtcpfb *upipe_rtcpfb, uint16_t seq)
 {
+    return &upipe_rtcpfb->cache[seq & (upipe_rtcpfb->cache_size - 1)];
+}
+
+/** @internal @This queues the retransmission of a buffered packet to a
+ * receiver.
+ *
+ * If the receiver has its own output (unicast), the request is dropped if
+ * the packet was already sent to this receiver less than max(holdoff, RTT)
+ * ago. Otherwise retransmissions are shared by all receivers, and the
+ * request is dropped if the packet was retransmitted to anyone less than
+ * the holdoff delay ago. The request is also dropped if it exceeds the
+ * retransmission rate of the receiver.
+ *
+ * @param upipe description structure of the input subpipe
+ * @param seq sequence number of the packet
+ * @param now current date, or UINT64_MAX if unknown
+ * @param batch list of retransmissions to append to
+ */
+static void upipe_rtcpfb_retransmit(struct upipe *upipe, uint16_t seq,
+                                    uint64_t now, struct uchain *batch)
+{
+    struct upipe_rtcpfb_input *upipe_rtcpfb_input =
+        upipe_rtcpfb_input_from_upipe(upipe);
     struct upipe *upipe_super = NULL;
     upipe_rtcpfb_input_get_super(upipe, &upipe_super);
     struct upipe_rtcpfb *upipe_rtcpfb = upipe_rtcpfb_from_upipe(upipe_super);
+    struct upipe_rtcpfb_receiver_stats *stats = &upipe_rtcpfb_input->stats;
+    struct upipe_rtcpfb_slot *slot = upipe_rtcpfb_slot(upipe_rtcpfb, seq);
+    upipe_rtcpfb->stats.nacks++;
+    upipe_rtcpfb->stats_changed = true;
+    stats->nacks++;
+
+    if (slot->uref == NULL || slot->seq != seq) {
+        upipe_rtcpfb->stats.missing++;
+        stats->missing++;
+        upipe_warn_va(upipe, "Couldn't find seq %hu", seq);
+        return;
+    }
 
-    struct uchain *uchain;
-    ulist_foreach(&upipe_rtcpfb->queue, uchain) {
-        struct uref *uref = uref_from_uchain(uchain);
-        uint64_t uref_seqnum = 0;
-        uref_attr_get_priv(uref, &uref_seqnum);
+    uint64_t holdoff = upipe_rtcpfb->holdoff * UCLOCK_FREQ / 1000;
+    uint64_t *last;
+    if (upipe_rtcpfb_input->output != NULL) {
+        struct upipe_rtcpfb_history *history =
+            &upipe_rtcpfb_input->history[seq % NACK_HISTORY];
+        if (history->seq != seq) {
+            history->seq = seq;
+            history->date = UINT64_MAX;
+        }
+        last = &history->date;
+        if (stats->rtt > holdoff)
+            holdoff = stats->rtt;
+    } else
+        last = &slot->retransmit;
+
+    if (now != UINT64_MAX && *last != UINT64_MAX && now - *last < holdoff) {
+        upipe_rtcpfb->stats.coalesced++;
+        stats->coalesced++;
+        upipe_verbose_va(upipe, "Coalesce retransmission of %hu", seq);
+        return;
+    }
+
+    if (upipe_rtcpfb_input->rate && now != UINT64_MAX) {
+        uint64_t elapsed = now - upipe_rtcpfb_input->tokens_date;
+        if (elapsed < UCLOCK_FREQ)
+            upipe_rtcpfb_input->tokens +=
+                elapsed * upipe_rtcpfb_input->rate / UCLOCK_FREQ;
+        /* allow bursts of up to one second */
+        if (elapsed >= UCLOCK_FREQ ||
+            upipe_rtcpfb_input->tokens > upipe_rtcpfb_input->rate)
+            upipe_rtcpfb_input->tokens = upipe_rtcpfb_input->rate;
+        upipe_rtcpfb_input->tokens_date = now;
+
+        size_t size = 0;
+        uref_block_size(slot->uref, &size);
+        if (upipe_rtcpfb_input->tokens < size) {
+            upipe_rtcpfb->stats.capped++;
+            stats->capped++;
+            upipe_verbose_va(upipe, "Rate exceeded, not retransmitting %hu",
+                             seq);
+            return;
+        }
+        upipe_rtcpfb_input->tokens -= size;
+    }
+
+    struct uref *uref = uref_dup(slot->uref);
+    if (unlikely(uref == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    *last = now;
+    upipe_rtcpfb->stats.retransmitted++;
+    stats->retransmitted++;
+    upipe_verbose_va(upipe, "Retransmit %hu", seq);
+    ulist_add(batch, uref_to_uchain(uref));
+}
 
-        if (seq != uref_seqnum)
-            continue;
+/** @internal @This updates the round-trip time estimate of a receiver
+ * from the first report block of a receiver report. This assumes sender
+ * reports carry the system clock in NTP format, as @ref upipe_rtcp does.
+ *
+ * @param upipe description structure of the input subpipe
+ * @param rr pointer to the receiver report
+ * @param len size of the receiver report
+ * @param date arrival date of the receiver report
+ */
+static void upipe_rtcpfb_input_rr(struct upipe *upipe, const uint8_t *rr,
+                                  size_t len, uint64_t date)
+{
+    struct upipe_rtcpfb_input *upipe_rtcpfb_input =
+        upipe_rtcpfb_input_from_upipe(upipe);
+    if (len < RTCP_RR_SIZE)
+        return;
 
-        upipe_warn_va(upipe, "Retransmit %hu", seq);
-        upipe_rtcpfb_output(upipe_super, uref_dup(uref), NULL);
+    /* cast needed because biTStream expects an uint8_t * (but doesn't write
+     * to it */
+    uint32_t last_sr = rtcp_rr_get_last_sr((uint8_t *)rr);
+    uint32_t delay = rtcp_rr_get_delay_since_last_sr((uint8_t *)rr);
+    if (!last_sr)
+        return;
 
-        if (!mask)
-            return;
+    lldiv_t div = lldiv(date, UCLOCK_FREQ);
+    uint64_t ntp_time = ((uint64_t)div.quot << 32) +
+        ((uint64_t)div.rem << 32) / UCLOCK_FREQ;
+    uint32_t rtt = (uint32_t)(ntp_time >> 16) - last_sr - delay;
+    if (rtt & UINT32_C(0x80000000))
+        return; /* not our clock */
+
+    uint64_t sample = (uint64_t)rtt * UCLOCK_FREQ / 65536;
+    uint64_t *estimate = &upipe_rtcpfb_input->stats.rtt;
+    *estimate = *estimate ? (*estimate * 7 + sample) / 8 : sample;
+    upipe_verbose_va(upipe, "RTT %"PRIu64" us",
+                     *estimate * 1000000 / UCLOCK_FREQ);
+}
 
-        int zeros = ctz(mask);
-        mask >>= zeros + 1;
-        seq += zeros + 1;
+/** @internal @This handles the RTCP messages of a receiver. The message may
+ * be a compound RTCP packet, and each NACK may carry several FCIs. The
+ * requested packets are retransmitted in a single batch, on the output of
+ * the subpipe if it has one, or else on the output of the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtcpfb_input_sub(struct upipe *upipe, struct uref *uref,
+                                   struct upump **upump_p)
+{
+    struct upipe_rtcpfb_input *upipe_rtcpfb_input =
+        upipe_rtcpfb_input_from_upipe(upipe);
+    struct upipe *upipe_super = NULL;
+    upipe_rtcpfb_input_get_super(upipe, &upipe_super);
+    struct upipe_rtcpfb *upipe_rtcpfb = upipe_rtcpfb_from_upipe(upipe_super);
+    uint64_t now = upipe_rtcpfb->uclock != NULL ?
+                   uclock_now(upipe_rtcpfb->uclock) : UINT64_MAX;
+    uint64_t date;
+    if (!ubase_check(uref_clock_get_cr_sys(uref, &date)))
+        date = now;
+
+    size_t s = 0;
+    uref_block_size(uref, &s);
+    const uint8_t *rtp = uref_block_peek(uref, 0, s, NULL);
+    if (!rtp) {
+        upipe_err(upipe, "Can't peek rtcp message");
+        uref_free(uref);
+        return;
     }
 
-    upipe_warn_va(upipe, "Couldn't find seq %hu", seq);
+    struct uchain batch;
+    ulist_init(&batch);
+    const uint8_t *rtcp = rtp;
+    while (s > 0) {
+        if (s < RTCP_COMMON_HEADER_SIZE || !rtp_check_hdr(rtcp)) {
+            upipe_warn_va(upipe, "Received invalid RTCP packet");
+            break;
+        }
+
+        size_t len = (rtpx_get_length(rtcp) + 1) * 4;
+        if (len > s) {
+            upipe_warn_va(upipe, "Invalid RTCP length");
+            break;
+        }
+
+        if (len >= RTCP_COMMON_HEADER_SIZE + 4)
+            upipe_rtcpfb_input->stats.ssrc =
+                ((uint32_t)rtcp[4] << 24) | (rtcp[5] << 16) |
+                (rtcp[6] << 8) | rtcp[7];
+
+        if (rtcp_get_pt(rtcp) == RTCP_PT_RR && date != UINT64_MAX)
+            upipe_rtcpfb_input_rr(upipe, rtcp, len, date);
+        else if (rtcp_get_pt(rtcp) == RTCP_PT_RTPFB &&
+                 rtcp_fb_get_fmt(rtcp) == RTCP_PT_RTPFB_GENERIC_NACK) {
+            for (size_t i = RTCP_FB_HEADER_SIZE;
+                 i + RTCP_FB_FCI_GENERIC_NACK_SIZE <= len;
+                 i += RTCP_FB_FCI_GENERIC_NACK_SIZE) {
+                uint16_t seq = rtcp_fb_nack_get_packet_id(&rtcp[i]);
+                uint16_t mask = rtcp_fb_nack_get_bitmask_lost(&rtcp[i]);
+                upipe_verbose_va(upipe, "Received NACK: %hu (0x%hx)",
+                                 seq, mask);
+                upipe_rtcpfb_retransmit(upipe, seq, now, &batch);
+                while (mask) {
+                    int zeros = ctz(mask);
+                    mask &= mask - 1;
+                    upipe_rtcpfb_retransmit(upipe, seq + zeros + 1, now,
+                                            &batch);
+                }
+            }
+        }
+
+        rtcp += len;
+        s -= len;
+    }
+
+    uref_block_peek_unmap(uref, 0, NULL, rtp);
+    uref_free(uref);
+
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&batch)) != NULL) {
+        struct uref *retransmit = uref_from_uchain(uchain);
+        if (upipe_rtcpfb_input->output != NULL)
+            upipe_rtcpfb_input_output(upipe, retransmit, NULL);
+        else
+            upipe_rtcpfb_output(upipe_super, retransmit, NULL);
+    }
 }
 
 /** @This is called when there is no external reference to the pipe anymore.
@@ -300,15 +503,34 @@ static struct upipe *upipe_rtcpfb_input_alloc(struct upipe_mgr *mgr,
     if (unlikely(upipe_rtcpfb_input == NULL))
         return NULL;
 
-    upipe_rtcpfb_input->flow_def = NULL;
+    upipe_rtcpfb_input->flow_def_input = NULL;
+    upipe_rtcpfb_input->rate = 0;
+    upipe_rtcpfb_input->tokens = 0;
+    upipe_rtcpfb_input->tokens_date = 0;
+    for (unsigned i = 0; i < NACK_HISTORY; i++) {
+        upipe_rtcpfb_input->history[i].seq = 0;
+        upipe_rtcpfb_input->history[i].date = UINT64_MAX;
+    }
+    memset(&upipe_rtcpfb_input->stats, 0, sizeof(upipe_rtcpfb_input->stats));
 
     struct upipe *upipe = upipe_rtcpfb_input_to_upipe(upipe_rtcpfb_input);
     upipe_init(upipe, mgr, uprobe);
     upipe_rtcpfb_input_init_urefcount(upipe);
+    upipe_rtcpfb_input_init_output(upipe);
     upipe_rtcpfb_input_init_input(upipe);
     upipe_rtcpfb_input_init_sub(upipe);
 
     upipe_throw_ready(upipe);
+
+    /* retransmissions carry the flow of the pipe */
+    if (upipe_rtcpfb->flow_def != NULL) {
+        struct uref *flow_def = uref_dup(upipe_rtcpfb->flow_def);
+        if (unlikely(flow_def == NULL)) {
+            upipe_release(upipe);
+            return NULL;
+        }
+        upipe_rtcpfb_input_store_flow_def(upipe, flow_def);
+    }
     return upipe;
 }
 
@@ -322,6 +544,8 @@ static void upipe_rtcpfb_input_free(struct upipe *upipe)
         upipe_rtcpfb_input_from_upipe(upipe);
     upipe_throw_dead(upipe);
 
+    uref_free(upipe_rtcpfb_input->flow_def_input);
+    upipe_rtcpfb_input_clean_output(upipe);
     upipe_rtcpfb_input_clean_input(upipe);
     upipe_rtcpfb_input_clean_sub(upipe);
     upipe_rtcpfb_input_clean_urefcount(upipe);
@@ -370,8 +594,8 @@ static int upipe_rtcpfb_input_set_flow_def(struct upipe *upipe, struct uref *flo
         return UBASE_ERR_ALLOC;
 
     struct upipe_rtcpfb_input *upipe_rtcpfb_input = upipe_rtcpfb_input_from_upipe(upipe);
-    uref_free(upipe_rtcpfb_input->flow_def);
-    upipe_rtcpfb_input->flow_def = flow_def_dup;
+    uref_free(upipe_rtcpfb_input->flow_def_input);
+    upipe_rtcpfb_input->flow_def_input = flow_def_dup;
     return UBASE_ERR_NONE;
 }
 
@@ -386,6 +610,8 @@ static int upipe_rtcpfb_input_set_flow_def(struct upipe *upipe, struct uref *flo
 static int upipe_rtcpfb_input_control(struct upipe *upipe,
                                     int command, va_list args)
 {
+    UBASE_HANDLED_RETURN(upipe_rtcpfb_input_control_output(upipe, command,
+                                                           args));
     switch (command) {
         case UPIPE_SET_FLOW_DEF: {
             struct uref *flow_def = va_arg(args, struct uref *);
@@ -395,6 +621,27 @@ static int upipe_rtcpfb_input_control(struct upipe *upipe,
             struct upipe **p = va_arg(args, struct upipe **);
             return upipe_rtcpfb_input_get_super(upipe, p);
         }
+        case UPIPE_SET_OPTION: {
+            const char *k = va_arg(args, const char *);
+            const char *v = va_arg(args, const char *);
+            if (strcmp(k, "rate"))
+                return UBASE_ERR_INVALID;
+
+            struct upipe_rtcpfb_input *upipe_rtcpfb_input =
+                upipe_rtcpfb_input_from_upipe(upipe);
+            upipe_rtcpfb_input->rate = strtoull(v, NULL, 10) / 8;
+            upipe_rtcpfb_input->tokens = upipe_rtcpfb_input->rate;
+            upipe_dbg_va(upipe, "Set retransmission rate to %"PRIu64" B/s",
+                    upipe_rtcpfb_input->rate);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_RTCPFB_INPUT_GET_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTCPFB_INPUT_SIGNATURE)
+            struct upipe_rtcpfb_receiver_stats *stats =
+                va_arg(args, struct upipe_rtcpfb_receiver_stats *);
+            *stats = upipe_rtcpfb_input_from_upipe(upipe)->stats;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -418,35 +665,52 @@ static void upipe_rtcpfb_init_sub_mgr(struct upipe *upipe)
 
 static void upipe_rtcpfb_free(struct urefcount *urefcount_real);
 
+/** @internal @This removes from the cache packets that are too old to be
+ * recovered by receivers. The cache is walked from the oldest packet, so
+ * the cost is proportional to the number of expired packets.
+ *
+ * @param upipe description structure of the pipe
+ * @param now current date
+ */
+static void upipe_rtcpfb_expire(struct upipe *upipe, uint64_t now)
+{
+    struct upipe_rtcpfb *upipe_rtcpfb = upipe_rtcpfb_from_upipe(upipe);
+    uint64_t latency = upipe_rtcpfb->latency * UCLOCK_FREQ / 1000;
+
+    while (upipe_rtcpfb->stats.buffered) {
+        struct upipe_rtcpfb_slot *slot =
+            upipe_rtcpfb_slot(upipe_rtcpfb, upipe_rtcpfb->first_seq);
+        if (slot->uref != NULL && slot->seq == upipe_rtcpfb->first_seq) {
+            if (now <= slot->date || now - slot->date < latency)
+                return;
+
+            upipe_verbose_va(upipe, "Delete seq %hu after %"PRIu64" clocks",
+                    upipe_rtcpfb->first_seq, now - slot->date);
+            uref_free(slot->uref);
+            slot->uref = NULL;
+            upipe_rtcpfb->stats.buffered--;
+            upipe_rtcpfb->stats.expired++;
+            upipe_rtcpfb->stats_changed = true;
+        }
+        upipe_rtcpfb->first_seq++;
+    }
+}
+
 /** @internal this timer removes from the queue packets that are too
- * early to be recovered by receiver.
+ * early to be recovered by receiver, and reports the counters.
  */
 static void upipe_rtcpfb_timer(struct upump *upump)
 {
     struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
     struct upipe_rtcpfb *upipe_rtcpfb = upipe_rtcpfb_from_upipe(upipe);
 
-    uint64_t now = uclock_now(upipe_rtcpfb->uclock);
-
-    struct uchain *uchain, *uchain_tmp;
-    ulist_delete_foreach(&upipe_rtcpfb->queue, uchain, uchain_tmp) {
-        struct uref *uref = uref_from_uchain(uchain);
+    if (upipe_rtcpfb->uclock != NULL)
+        upipe_rtcpfb_expire(upipe, uclock_now(upipe_rtcpfb->uclock));
 
-        uint64_t seqnum = 0;
-        uref_attr_get_priv(uref, &seqnum);
-
-        uint64_t cr_sys = 0;
-        if (unlikely(!ubase_check(uref_clock_get_cr_sys(uref, &cr_sys))))
-            upipe_warn(upipe, "Couldn't read cr_sys");
-
-        if (now - cr_sys < upipe_rtcpfb->latency * UCLOCK_FREQ / 1000)
-            return;
-
-        upipe_verbose_va(upipe, "Delete seq %" PRIu64 " after %"PRIu64" clocks",
-                seqnum, now - cr_sys);
-
-        ulist_delete(uchain);
-        uref_free(uref);
+    if (upipe_rtcpfb->stats_changed) {
+        upipe_rtcpfb->stats_changed = false;
+        upipe_throw(upipe, UPROBE_RTCPFB_STATS, UPIPE_RTCPFB_SIGNATURE,
+                    &upipe_rtcpfb->stats);
     }
 }
 
@@ -468,12 +732,23 @@ static struct upipe *upipe_rtcpfb_alloc(struct upipe_mgr *mgr,
         return NULL;
 
     struct upipe_rtcpfb *upipe_rtcpfb = upipe_rtcpfb_from_upipe(upipe);
+    upipe_rtcpfb->cache_size = CACHE_SIZE;
+    upipe_rtcpfb->cache = malloc(CACHE_SIZE * sizeof(struct upipe_rtcpfb_slot));
+    if (unlikely(upipe_rtcpfb->cache == NULL)) {
+        upipe_rtcpfb_free_void(upipe);
+        return NULL;
+    }
+    for (unsigned i = 0; i < CACHE_SIZE; i++)
+        upipe_rtcpfb->cache[i].uref = NULL;
+
     upipe_rtcpfb_init_urefcount(upipe);
     urefcount_init(upipe_rtcpfb_to_urefcount_real(upipe_rtcpfb), upipe_rtcpfb_free);
     upipe_rtcpfb_init_upump_mgr(upipe);
     upipe_rtcpfb_check_upump_mgr(upipe);
     upipe_rtcpfb_init_uclock(upipe);
-    ulist_init(&upipe_rtcpfb->queue);
+    upipe_rtcpfb->first_seq = 0;
+    memset(&upipe_rtcpfb->stats, 0, sizeof(upipe_rtcpfb->stats));
+    upipe_rtcpfb->stats_changed = false;
     upipe_rtcpfb_init_output(upipe);
     upipe_rtcpfb_init_sub_mgr(upipe);
     upipe_rtcpfb_init_sub_outputs(upipe);
@@ -484,17 +759,49 @@ static struct upipe *upipe_rtcpfb_alloc(struct upipe_mgr *mgr,
     upipe_rtcpfb->last_seq = UINT_MAX;
     upipe_rtcpfb_require_uclock(upipe);
     upipe_rtcpfb->latency = 1000; /* 1 sec */
+    upipe_rtcpfb->holdoff = DEFAULT_HOLDOFF;
 
     /* This timer does not need to run frequently */
-    upipe_rtcpfb->upump_timer = upump_alloc_timer(upipe_rtcpfb->upump_mgr,
-            upipe_rtcpfb_timer, upipe, upipe->refcount,
-            UCLOCK_FREQ, UCLOCK_FREQ);
-    upump_start(upipe_rtcpfb->upump_timer);
+    upipe_rtcpfb->upump_timer = NULL;
+    if (upipe_rtcpfb->upump_mgr != NULL) {
+        upipe_rtcpfb->upump_timer = upump_alloc_timer(upipe_rtcpfb->upump_mgr,
+                upipe_rtcpfb_timer, upipe, upipe->refcount,
+                UCLOCK_FREQ, UCLOCK_FREQ);
+        upump_start(upipe_rtcpfb->upump_timer);
+    }
 
     upipe_throw_ready(upipe);
     return upipe;
 }
 
+/** @internal @This doubles the size of the retransmission cache, when the
+ * packets buffered within the latency no longer fit.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_rtcpfb_grow(struct upipe *upipe)
+{
+    struct upipe_rtcpfb *upipe_rtcpfb = upipe_rtcpfb_from_upipe(upipe);
+    unsigned int size = upipe_rtcpfb->cache_size * 2;
+    struct upipe_rtcpfb_slot *cache =
+        malloc(size * sizeof(struct upipe_rtcpfb_slot));
+    if (unlikely(cache == NULL))
+        return UBASE_ERR_ALLOC;
+    for (unsigned i = 0; i < size; i++)
+        cache[i].uref = NULL;
+    for (unsigned i = 0; i < upipe_rtcpfb->cache_size; i++) {
+        struct upipe_rtcpfb_slot *slot = &upipe_rtcpfb->cache[i];
+        if (slot->uref != NULL)
+            cache[slot->seq & (size - 1)] = *slot;
+    }
+    free(upipe_rtcpfb->cache);
+    upipe_rtcpfb->cache = cache;
+    upipe_rtcpfb->cache_size = size;
+    upipe_dbg_va(upipe, "retransmission cache grown to %u packets", size);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -521,7 +828,11 @@ static inline void upipe_rtcpfb_input(struct upipe *upipe, struct uref *uref,
 #endif
     uref_block_peek_unmap(uref, 0, rtp_buffer, rtp_header);
 
-    uref_attr_set_priv(uref, seqnum);
+    uint64_t now = upipe_rtcpfb->uclock != NULL ?
+                   uclock_now(upipe_rtcpfb->uclock) : 0;
+    uint64_t date;
+    if (unlikely(!ubase_check(uref_clock_get_cr_sys(uref, &date))))
+        date = now;
 
     /* Output packet immediately */
     upipe_rtcpfb_output(upipe, uref_dup(uref), NULL); // FIXME : upump?
@@ -529,9 +840,33 @@ static inline void upipe_rtcpfb_input(struct upipe *upipe, struct uref *uref,
     upipe_verbose_va(upipe, "Output & buffer %hu", seqnum);
 
     /* Buffer packet in case retransmission is needed */
-    ulist_add(&upipe_rtcpfb->queue, uref_to_uchain(uref));
+    struct upipe_rtcpfb_slot *slot = upipe_rtcpfb_slot(upipe_rtcpfb, seqnum);
+    while (unlikely(slot->uref != NULL && slot->seq != seqnum &&
+                    upipe_rtcpfb->cache_size < CACHE_MAX_SIZE)) {
+        if (unlikely(!ubase_check(upipe_rtcpfb_grow(upipe)))) {
+            upipe_warn(upipe, "unable to grow the retransmission cache");
+            break;
+        }
+        slot = upipe_rtcpfb_slot(upipe_rtcpfb, seqnum);
+    }
+    if (unlikely(slot->uref != NULL)) {
+        /* the packet is repeated, or the cache wrapped within the latency */
+        uref_free(slot->uref);
+        upipe_rtcpfb->stats.buffered--;
+    }
+    if (!upipe_rtcpfb->stats.buffered ||
+        (int16_t)(seqnum - upipe_rtcpfb->first_seq) < 0)
+        upipe_rtcpfb->first_seq = seqnum;
+    slot->uref = uref;
+    slot->seq = seqnum;
+    slot->date = date;
+    slot->retransmit = UINT64_MAX;
+    upipe_rtcpfb->stats.buffered++;
 
     upipe_rtcpfb->last_seq = seqnum;
+
+    if (upipe_rtcpfb->uclock != NULL)
+        upipe_rtcpfb_expire(upipe, now);
 }
 
 /** @internal @This sets the input flow definition.
@@ -551,7 +886,20 @@ static int upipe_rtcpfb_set_flow_def(struct upipe *upipe, struct uref *flow_def)
     struct upipe_rtcpfb *upipe_rtcpfb = upipe_rtcpfb_from_upipe(upipe);
     uref_free(upipe_rtcpfb->flow_def_input);
     upipe_rtcpfb->flow_def_input = flow_def_dup;
-    upipe_rtcpfb_store_flow_def(upipe, flow_def);
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL))
+        return UBASE_ERR_ALLOC;
+    upipe_rtcpfb_store_flow_def(upipe, flow_def_dup);
+
+    /* retransmissions to receivers carry the same flow */
+    struct uchain *uchain;
+    ulist_foreach(&upipe_rtcpfb->inputs, uchain) {
+        struct upipe_rtcpfb_input *upipe_rtcpfb_input =
+            upipe_rtcpfb_input_from_uchain(uchain);
+        if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL))
+            return UBASE_ERR_ALLOC;
+        upipe_rtcpfb_input_store_flow_def(
+                upipe_rtcpfb_input_to_upipe(upipe_rtcpfb_input), flow_def_dup);
+    }
 
     return UBASE_ERR_NONE;
 }
@@ -597,15 +945,28 @@ static int _upipe_rtcpfb_control(struct upipe *upipe, int command, va_list args)
         case UPIPE_SET_OPTION: {
             const char *k = va_arg(args, const char *);
             const char *v = va_arg(args, const char *);
+            struct upipe_rtcpfb *upipe_rtcpfb = upipe_rtcpfb_from_upipe(upipe);
+            if (!strcmp(k, "nack-holdoff")) {
+                upipe_rtcpfb->holdoff = atoi(v);
+                upipe_dbg_va(upipe, "Set NACK holdoff to %"PRIu64" msecs",
+                        upipe_rtcpfb->holdoff);
+                return UBASE_ERR_NONE;
+            }
             if (strcmp(k, "latency"))
                 return UBASE_ERR_INVALID;
 
-            struct upipe_rtcpfb *upipe_rtcpfb = upipe_rtcpfb_from_upipe(upipe);
             upipe_rtcpfb->latency = atoi(v);
             upipe_dbg_va(upipe, "Set latency to %"PRIu64" msecs",
                     upipe_rtcpfb->latency);
             return UBASE_ERR_NONE;
         }
+        case UPIPE_RTCPFB_GET_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTCPFB_SIGNATURE)
+            struct upipe_rtcpfb_stats *stats =
+                va_arg(args, struct upipe_rtcpfb_stats *);
+            *stats = upipe_rtcpfb_from_upipe(upipe)->stats;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -633,17 +994,16 @@ static void upipe_rtcpfb_free(struct urefcount *urefcount_real)
     upipe_rtcpfb_clean_urefcount(upipe);
     upipe_rtcpfb_clean_ubuf_mgr(upipe);
     upipe_rtcpfb_clean_uref_mgr(upipe);
-    upump_stop(upipe_rtcpfb->upump_timer);
-    upump_free(upipe_rtcpfb->upump_timer);
+    if (upipe_rtcpfb->upump_timer != NULL) {
+        upump_stop(upipe_rtcpfb->upump_timer);
+        upump_free(upipe_rtcpfb->upump_timer);
+    }
     upipe_rtcpfb_clean_upump_mgr(upipe);
     upipe_rtcpfb_clean_uclock(upipe);
 
-    struct uchain *uchain, *uchain_tmp;
-    ulist_delete_foreach(&upipe_rtcpfb->queue, uchain, uchain_tmp) {
-        struct uref *uref = uref_from_uchain(uchain);
-        ulist_delete(uchain);
-        uref_free(uref);
-    }
+    for (unsigned i = 0; i < upipe_rtcpfb->cache_size; i++)
+        uref_free(upipe_rtcpfb->cache[i].uref);
+    free(upipe_rtcpfb->cache);
 
     upipe_rtcpfb_free_void(upipe);
 }
@@ -30,6 +30,7 @@
  */
 
 #include <upipe/ubase.h>
+#include <upipe/ulist.h>
 #include <upipe/uprobe.h>
 #include <upipe/uref.h>
 #include <upipe/uref_clock.h>
@@ -47,9 +48,41 @@
 #include <upipe/upipe_helper_input.h>
 #include <upipe-freetype/upipe_freetype.h>
 
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
+/** number of buckets of the glyph cache */
+#define GLYPH_BUCKETS 256
+
+/** @internal @This describes a rendered glyph. */
+struct upipe_freetype_glyph {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** unicode code point */
+    uint32_t codepoint;
+    /** horizontal offset from the pen to the bitmap */
+    int left;
+    /** vertical offset from the baseline to the top of the bitmap */
+    int top;
+    /** width of the bitmap */
+    unsigned width;
+    /** number of rows of the bitmap */
+    unsigned rows;
+    /** horizontal advance, in 26.6 */
+    FT_Pos advance;
+    /** coverage bitmap, width * rows */
+    uint8_t buffer[];
+};
+
+UBASE_FROM_TO(upipe_freetype_glyph, uchain, uchain, uchain)
+
 /** upipe_freetype structure */
 struct upipe_freetype {
     /** refcount management structure exported to the public structure */
@@ -89,6 +122,13 @@ struct upipe_freetype {
 
     /** font handle */
     FT_Face face;
+    /** rendered glyphs of the current face and size, by code point */
+    struct uchain glyphs[GLYPH_BUCKETS];
+
+    /** text of the cached line */
+    char *line_text;
+    /** cached line rendered with the current flow format */
+    struct ubuf *line;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -130,6 +170,39 @@ static int upipe_freetype_check_flow_format(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This frees the cached line.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_freetype_flush_line(struct upipe *upipe)
+{
+    struct upipe_freetype *upipe_freetype = upipe_freetype_from_upipe(upipe);
+
+    if (upipe_freetype->line)
+        ubuf_free(upipe_freetype->line);
+    upipe_freetype->line = NULL;
+    free(upipe_freetype->line_text);
+    upipe_freetype->line_text = NULL;
+}
+
+/** @internal @This frees the cached glyphs and line.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_freetype_flush_glyphs(struct upipe *upipe)
+{
+    struct upipe_freetype *upipe_freetype = upipe_freetype_from_upipe(upipe);
+
+    for (int i = 0; i < GLYPH_BUCKETS; i++) {
+        struct uchain *uchain, *uchain_tmp;
+        ulist_delete_foreach(&upipe_freetype->glyphs[i], uchain, uchain_tmp) {
+            ulist_delete(uchain);
+            free(upipe_freetype_glyph_from_uchain(uchain));
+        }
+    }
+    upipe_freetype_flush_line(upipe);
+}
+
 /** @internal @This checks the freetype pipe state.
  *
  * @param upipe description structure of the pipe
@@ -143,6 +216,7 @@ static int upipe_freetype_check(struct upipe *upipe, struct uref *flow_format)
     if (flow_format) {
         ubase_assert(upipe_freetype_check_flow_format(upipe, flow_format));
         upipe_freetype_store_flow_def(upipe, flow_format);
+        upipe_freetype_flush_line(upipe);
     }
 
     if (!upipe_freetype->ubuf_mgr) {
@@ -171,6 +245,7 @@ static void upipe_freetype_free(struct upipe *upipe)
 
     upipe_throw_dead(upipe);
 
+    upipe_freetype_flush_glyphs(upipe);
     if (upipe_freetype->face)
         FT_Done_Face(upipe_freetype->face);
 
@@ -214,6 +289,10 @@ static struct upipe *upipe_freetype_alloc(struct upipe_mgr *mgr,
     }
 
     upipe_freetype->face = NULL;
+    for (int i = 0; i < GLYPH_BUCKETS; i++)
+        ulist_init(&upipe_freetype->glyphs[i]);
+    upipe_freetype->line_text = NULL;
+    upipe_freetype->line = NULL;
 
     upipe_freetype_init_urefcount(upipe);
     upipe_freetype_init_output(upipe);
@@ -232,35 +311,154 @@ static struct upipe *upipe_freetype_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
-/** @internal @This tries to output input buffers.
+/** @internal @This decodes the next UTF-8 character of a string.
+ *
+ * @param text_p pointer to the string, advanced past the character
+ * @return unicode code point, or U+FFFD for invalid sequences
+ */
+static uint32_t upipe_freetype_utf8(const char **text_p)
+{
+    const uint8_t *s = (const uint8_t *)*text_p;
+    uint32_t codepoint;
+    int n;
+
+    if (s[0] < 0x80) {
+        codepoint = s[0];
+        n = 0;
+    } else if ((s[0] & 0xe0) == 0xc0) {
+        codepoint = s[0] & 0x1f;
+        n = 1;
+    } else if ((s[0] & 0xf0) == 0xe0) {
+        codepoint = s[0] & 0x0f;
+        n = 2;
+    } else if ((s[0] & 0xf8) == 0xf0) {
+        codepoint = s[0] & 0x07;
+        n = 3;
+    } else {
+        *text_p += 1;
+        return 0xfffd;
+    }
+
+    for (int i = 1; i <= n; i++) {
+        /* this also stops on the terminating nul */
+        if ((s[i] & 0xc0) != 0x80) {
+            *text_p += i;
+            return 0xfffd;
+        }
+        codepoint = (codepoint << 6) | (s[i] & 0x3f);
+    }
+    *text_p += n + 1;
+    return codepoint;
+}
+
+/** @internal @This returns a rendered glyph, rendering it on the first use.
  *
  * @param upipe description structure of the pipe
- * @param uref input buffer to output
- * @param upump_p reference to pump that generated the buffer
- * @return true if the buffer was output
+ * @param codepoint unicode code point
+ * @return pointer to the glyph, or NULL if it cannot be rendered
  */
-static bool upipe_freetype_handle(struct upipe *upipe, struct uref *uref,
-                                  struct upump **upump_p)
+static struct upipe_freetype_glyph *
+    upipe_freetype_glyph(struct upipe *upipe, uint32_t codepoint)
 {
     struct upipe_freetype *upipe_freetype = upipe_freetype_from_upipe(upipe);
+    struct uchain *bucket =
+        &upipe_freetype->glyphs[codepoint % GLYPH_BUCKETS];
+    struct uchain *uchain;
+    ulist_foreach(bucket, uchain) {
+        struct upipe_freetype_glyph *glyph =
+            upipe_freetype_glyph_from_uchain(uchain);
+        if (glyph->codepoint == codepoint)
+            return glyph;
+    }
 
-    if (!upipe_freetype->ubuf_mgr)
-            return false;
+    if (FT_Load_Char(upipe_freetype->face, codepoint, FT_LOAD_RENDER))
+        return NULL;
+
+    FT_GlyphSlot slot = upipe_freetype->face->glyph;
+    FT_Bitmap *bitmap = &slot->bitmap;
+    struct upipe_freetype_glyph *glyph =
+        malloc(sizeof(struct upipe_freetype_glyph) +
+               bitmap->width * bitmap->rows);
+    if (unlikely(glyph == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return NULL;
+    }
+
+    uchain_init(&glyph->uchain);
+    glyph->codepoint = codepoint;
+    glyph->left = slot->bitmap_left;
+    glyph->top = slot->bitmap_top;
+    glyph->width = bitmap->width;
+    glyph->rows = bitmap->rows;
+    glyph->advance = slot->advance.x;
+    for (unsigned j = 0; j < bitmap->rows; j++) {
+        /* a negative pitch means the rows are stored bottom-up */
+        const uint8_t *src = bitmap->pitch >= 0 ?
+            bitmap->buffer + j * bitmap->pitch :
+            bitmap->buffer + (bitmap->rows - 1 - j) * -bitmap->pitch;
+        memcpy(glyph->buffer + j * glyph->width, src, glyph->width);
+    }
+    ulist_add(bucket, &glyph->uchain);
+    return glyph;
+}
+
+/** @internal @This composites a row of coverage onto a plane.
+ *
+ * @param dst destination row
+ * @param src coverage row
+ * @param width number of pixels
+ */
+static void upipe_freetype_blend(uint8_t *dst, const uint8_t *src, int width)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= width; i += 16) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(d, s));
+    }
+#endif
+    for (; i < width; i++)
+        dst[i] |= src[i];
+}
+
+/** @internal @This renders a line of text into a new picture buffer, unless
+ * it is the one already cached.
+ *
+ * @param upipe description structure of the pipe
+ * @param text UTF-8 encoded text
+ * @return an error code
+ */
+static int upipe_freetype_render(struct upipe *upipe, const char *text)
+{
+    struct upipe_freetype *upipe_freetype = upipe_freetype_from_upipe(upipe);
+
+    if (upipe_freetype->line && !strcmp(text, upipe_freetype->line_text))
+        return UBASE_ERR_NONE;
+
+    upipe_freetype_flush_line(upipe);
+
+    if (!upipe_freetype->face) {
+        upipe_err(upipe, "no font loaded");
+        return UBASE_ERR_INVALID;
+    }
 
     struct uref *flow_format = upipe_freetype->flow_format;
     uint64_t h, v;
     if (!ubase_check(uref_pic_flow_get_hsize(flow_format, &h)) ||
         !ubase_check(uref_pic_flow_get_vsize(flow_format, &v))) {
         upipe_err_va(upipe, "Could not read output dimensions");
-        uref_free(uref);
-        return true;
+        return UBASE_ERR_INVALID;
     }
 
+    char *line_text = strdup(text);
+    UBASE_ALLOC_RETURN(line_text);
+
     struct ubuf *ubuf = ubuf_pic_alloc(upipe_freetype->ubuf_mgr, h, v);
     if (!ubuf) {
         upipe_err(upipe, "Could not allocate pic");
-        uref_free(uref);
-        return true;
+        free(line_text);
+        return UBASE_ERR_ALLOC;
     }
 
     ubuf_pic_clear(ubuf, 0, 0, -1, -1, 0);
@@ -274,8 +472,8 @@ static bool upipe_freetype_handle(struct upipe *upipe, struct uref *uref,
             ubuf_pic_plane_size(ubuf, "y8", &stride_y, NULL, NULL, NULL))) {
         upipe_err(upipe, "Could not read ubuf luma plane sizes");
         ubuf_free(ubuf);
-        uref_free(uref);
-        return true;
+        free(line_text);
+        return UBASE_ERR_INVALID;
     }
 
     if (has_alpha &&
@@ -283,8 +481,8 @@ static bool upipe_freetype_handle(struct upipe *upipe, struct uref *uref,
             ubuf_pic_plane_size(ubuf, "a8", &stride_a, NULL, NULL, NULL))) {
         upipe_err(upipe, "Could not read ubuf alpha plane sizes");
         ubuf_free(ubuf);
-        uref_free(uref);
-        return true;
+        free(line_text);
+        return UBASE_ERR_INVALID;
     }
 
     uint8_t *dst;
@@ -292,84 +490,109 @@ static bool upipe_freetype_handle(struct upipe *upipe, struct uref *uref,
     if (!ubase_check(ubuf_pic_plane_write(ubuf, "y8", 0, 0, -1, -1, &dst))) {
         upipe_err(upipe, "Could not map luma plane");
         ubuf_free(ubuf);
-        uref_free(uref);
-        return true;
+        free(line_text);
+        return UBASE_ERR_INVALID;
     }
     if (has_alpha &&
         !ubase_check(ubuf_pic_plane_write(ubuf, "a8", 0, 0, -1, -1, &dsta))) {
         upipe_err(upipe, "Could not map alpha plane");
         ubuf_pic_plane_unmap(ubuf, "y8", 0, 0, -1, -1);
         ubuf_free(ubuf);
-        uref_free(uref);
-        return true;
+        free(line_text);
+        return UBASE_ERR_INVALID;
     }
 
-    /* the pen position in 26.6 cartesian space coordinates */
-    FT_Vector pen; /* untransformed origin  */
-    pen.x = 0;
-    pen.y = v*8;
-
-    FT_GlyphSlot slot = upipe_freetype->face->glyph;
-    const char *text;
-    int r = uref_attr_get_string(uref, &text, UDICT_TYPE_STRING, "text");
-    if (!ubase_check(r)) {
-        uref_dump(uref, upipe->uprobe);
-        text = "fail";
+    /* measure the line to center it */
+    FT_Pos pen = 0;
+    for (const char *p = text; *p; ) {
+        struct upipe_freetype_glyph *glyph =
+            upipe_freetype_glyph(upipe, upipe_freetype_utf8(&p));
+        if (glyph)
+            pen += glyph->advance;
     }
-    for (int i = 0; i < strlen(text); i++) {
-        FT_Set_Transform(upipe_freetype->face, NULL, &pen);
-
-        /* load glyph image into the slot(erase previous one) */
-        if (FT_Load_Char(upipe_freetype->face, text[i], FT_LOAD_RENDER))
+    uint64_t text_w = pen / 64;
+    int origin = text_w < h ? (h - text_w) / 2 : 0;
+    int baseline = v - v / 8;
+
+    pen = 0;
+    for (const char *p = text; *p; ) {
+        struct upipe_freetype_glyph *glyph =
+            upipe_freetype_glyph(upipe, upipe_freetype_utf8(&p));
+        if (!glyph)
             continue;                 /* ignore errors */
 
-        /* now, draw to our target surface(convert position) */
-        FT_Bitmap *bitmap = &slot->bitmap;
-        FT_Int x = slot->bitmap_left;
-        FT_Int y = v - slot->bitmap_top;
-        FT_Int x_max = x + bitmap->width;
+        int x = origin + pen / 64 + glyph->left;
+        int y = baseline - glyph->top;
+        int x_max = x + glyph->width;
         if (x_max > h) {
             upipe_err_va(upipe, "clipping x, %"PRIu64" < %d", h, x_max);
             x_max = h;
         }
-        FT_Int y_max = y + bitmap->rows;
+        int y_max = y + glyph->rows;
         if (y_max > v) {
             upipe_err_va(upipe, "clipping y, %"PRIu64" < %d", v, y_max);
             y_max = v;
         }
+        int x_min = x < 0 ? 0 : x;
+
+        /* row-major, so that both sides are read sequentially */
+        for (int j = (y < 0 ? 0 : y); j < y_max && x_min < x_max; j++) {
+            const uint8_t *src =
+                glyph->buffer + (j - y) * glyph->width + (x_min - x);
+            upipe_freetype_blend(dst + j * stride_y + x_min, src,
+                                 x_max - x_min);
+            if (has_alpha)
+                upipe_freetype_blend(dsta + j * stride_a + x_min, src,
+                                     x_max - x_min);
+        }
 
-        for (FT_Int i = (x < 0 ? 0 : x); i < x_max; i++)
-            for (FT_Int j = (y < 0 ? 0 : y); j < y_max; j++) {
-                dst[j*stride_y + i] |=
-                    bitmap->buffer[(j - y) * bitmap->width + (i - x)];
-                if (has_alpha)
-                    dsta[j*stride_a + i] |=
-                        bitmap->buffer[(j - y) * bitmap->width + (i - x)];
-            }
-
-        /* increment pen position */
-        pen.x += slot->advance.x;
-        pen.y += slot->advance.y;
-    }
-
-    unsigned text_w = pen.x / 64;
-
-    if (text_w < h)
-        for (int i = 0; i < v; i++) {
-            memmove(&dst[i*stride_y + (h - text_w) / 2],
-                    &dst[i*stride_y], text_w);
-            memset(&dst[i*stride_y], 0, (h - text_w) / 2);
-            if (has_alpha) {
-                memmove(&dsta[i*stride_a + (h - text_w) / 2],
-                        &dsta[i*stride_a], text_w);
-                memset(&dsta[i*stride_a], 0, (h - text_w) / 2);
-            }
+        pen += glyph->advance;
     }
 
     ubuf_pic_plane_unmap(ubuf, "y8", 0, 0, -1, -1);
     if (has_alpha)
         ubuf_pic_plane_unmap(ubuf, "a8", 0, 0, -1, -1);
 
+    upipe_freetype->line = ubuf;
+    upipe_freetype->line_text = line_text;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This tries to output input buffers.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref input buffer to output
+ * @param upump_p reference to pump that generated the buffer
+ * @return true if the buffer was output
+ */
+static bool upipe_freetype_handle(struct upipe *upipe, struct uref *uref,
+                                  struct upump **upump_p)
+{
+    struct upipe_freetype *upipe_freetype = upipe_freetype_from_upipe(upipe);
+
+    if (!upipe_freetype->ubuf_mgr)
+            return false;
+
+    const char *text;
+    int r = uref_attr_get_string(uref, &text, UDICT_TYPE_STRING, "text");
+    if (!ubase_check(r)) {
+        uref_dump(uref, upipe->uprobe);
+        text = "fail";
+    }
+
+    /* the line is only rendered again when the text changes */
+    if (!ubase_check(upipe_freetype_render(upipe, text))) {
+        uref_free(uref);
+        return true;
+    }
+
+    struct ubuf *ubuf = ubuf_dup(upipe_freetype->line);
+    if (!ubuf) {
+        upipe_err(upipe, "Could not allocate pic");
+        uref_free(uref);
+        return true;
+    }
+
     uref_attach_ubuf(uref, ubuf);
 
     upipe_freetype_output(upipe, uref, upump_p);
@@ -411,6 +634,7 @@ static int upipe_freetype_set_option(struct upipe *upipe,
     if (strcmp(option, "font"))
         return UBASE_ERR_INVALID;
 
+    upipe_freetype_flush_glyphs(upipe);
     if (upipe_freetype->face)
         FT_Done_Face(upipe_freetype->face);
 
@@ -27,9 +27,381 @@
  * @short Upipe GL - common definitions
  */
 
+#define GL_GLEXT_PROTOTYPES
+
+#include <upipe/ubase.h>
 #include <upipe/uref_pic.h>
 #include <upipe-gl/upipe_gl_sink_common.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
 #include <GL/gl.h>
+#include <GL/glext.h>
+
+/** @internal @This converts limited range YUV to RGB. The coefficients are
+ * passed in matrix, see @ref upipe_gl_texture_bind. */
+static const char *upipe_gl_texture_yuv_shader =
+    "uniform sampler2D y, u, v;\n"
+    "uniform mat3 matrix;\n"
+    "void main() {\n"
+    "    vec2 pos = gl_TexCoord[0].st;\n"
+    "    vec3 yuv = vec3(texture2D(y, pos).r - 0.0625,\n"
+    "                    texture2D(u, pos).r - 0.5,\n"
+    "                    texture2D(v, pos).r - 0.5);\n"
+    "    gl_FragColor = vec4(matrix * yuv, 1.0);\n"
+    "}\n";
+
+/** @internal BT.601 limited range coefficients, column-major */
+static const GLfloat upipe_gl_texture_bt601[9] = {
+    1.164,  1.164, 1.164,
+    0.,    -0.392, 2.017,
+    1.596, -0.813, 0.
+};
+
+/** @internal BT.709 limited range coefficients, column-major */
+static const GLfloat upipe_gl_texture_bt709[9] = {
+    1.164,  1.164, 1.164,
+    0.,    -0.213, 2.112,
+    1.793, -0.533, 0.
+};
+
+/** @internal @This describes a plane of a picture. */
+struct upipe_gl_texture_plane {
+    /** chroma name */
+    const char *chroma;
+    /** pixel format */
+    GLenum format;
+    /** pixel type */
+    GLenum type;
+    /** width in pixels */
+    size_t width;
+    /** number of lines */
+    size_t height;
+    /** octets per pixel */
+    uint8_t msize;
+};
+
+/** @internal @This checks whether the current GL context is at least of the
+ * given version.
+ *
+ * @param major required major version
+ * @param minor required minor version
+ * @return true if the version is supported
+ */
+static bool upipe_gl_texture_check_version(int major, int minor)
+{
+    const char *version = (const char *)glGetString(GL_VERSION);
+    int cur_major, cur_minor;
+    if (version == NULL ||
+        sscanf(version, "%d.%d", &cur_major, &cur_minor) != 2)
+        return false;
+    return cur_major > major || (cur_major == major && cur_minor >= minor);
+}
+
+/** @internal @This compiles the YUV to RGB program.
+ *
+ * @return program, or 0 in case of error
+ */
+static GLuint upipe_gl_texture_compile(void)
+{
+    GLint status;
+    GLuint shader = glCreateShader(GL_FRAGMENT_SHADER);
+    if (!shader)
+        return 0;
+    glShaderSource(shader, 1, &upipe_gl_texture_yuv_shader, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    if (!program) {
+        glDeleteShader(shader);
+        return 0;
+    }
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    /* the shader is freed along with the program */
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "y"), 0);
+    glUniform1i(glGetUniformLocation(program, "u"), 1);
+    glUniform1i(glGetUniformLocation(program, "v"), 2);
+    glUseProgram(0);
+    return program;
+}
+
+/** @This allocates the GL objects of a texture. It must be called with the
+ * GL context current.
+ *
+ * @param texture pointer to texture structure
+ * @return false in case of error
+ */
+bool upipe_gl_texture_init(struct upipe_gl_texture *texture)
+{
+    memset(texture, 0, sizeof(*texture));
+    texture->format = UPIPE_GL_TEXTURE_NONE;
+
+    glGenTextures(3, texture->textures);
+    for (int i = 0; i < 3; i++) {
+        glBindTexture(GL_TEXTURE_2D, texture->textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    /* pixel buffer objects are core in 2.1, shaders in 2.0 */
+    if (upipe_gl_texture_check_version(2, 1))
+        glGenBuffers(UPIPE_GL_TEXTURE_PBOS, texture->pbos);
+    if (upipe_gl_texture_check_version(2, 0))
+        texture->program = upipe_gl_texture_compile();
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+/** @This releases the GL objects of a texture. It must be called with the
+ * GL context current.
+ *
+ * @param texture pointer to texture structure
+ */
+void upipe_gl_texture_clean(struct upipe_gl_texture *texture)
+{
+    if (!texture->textures[0])
+        return;
+    glDeleteTextures(3, texture->textures);
+    if (texture->pbos[0])
+        glDeleteBuffers(UPIPE_GL_TEXTURE_PBOS, texture->pbos);
+    if (texture->program)
+        glDeleteProgram(texture->program);
+    memset(texture, 0, sizeof(*texture));
+}
+
+/** @internal @This fills in the description of the planes of a picture.
+ *
+ * @param uref uref structure describing the picture
+ * @param planes filled in with the description of the planes
+ * @param nb_planes_p filled in with the number of planes
+ * @return the layout of the picture, or UPIPE_GL_TEXTURE_NONE
+ */
+static enum upipe_gl_texture_format
+    upipe_gl_texture_planes(struct uref *uref,
+                            struct upipe_gl_texture_plane planes[3],
+                            int *nb_planes_p)
+{
+    size_t width, height;
+    uint8_t hsub, vsub, msize;
+    if (!ubase_check(uref_pic_size(uref, &width, &height, NULL)))
+        return UPIPE_GL_TEXTURE_NONE;
+
+    if (ubase_check(uref_pic_plane_size(uref, "r8g8b8", NULL,
+                                        NULL, NULL, &msize))) {
+        planes[0] = (struct upipe_gl_texture_plane){
+            "r8g8b8", GL_RGB, GL_UNSIGNED_BYTE, width, height, msize };
+        *nb_planes_p = 1;
+        return UPIPE_GL_TEXTURE_RGB;
+    }
+    if (ubase_check(uref_pic_plane_size(uref, "r5g6b5", NULL,
+                                        NULL, NULL, &msize))) {
+        planes[0] = (struct upipe_gl_texture_plane){
+            "r5g6b5", GL_RGB, GL_UNSIGNED_SHORT_5_6_5, width, height, msize };
+        *nb_planes_p = 1;
+        return UPIPE_GL_TEXTURE_RGB565;
+    }
+
+    static const char *chromas[3] = { "y8", "u8", "v8" };
+    for (int i = 0; i < 3; i++) {
+        if (!ubase_check(uref_pic_plane_size(uref, chromas[i], NULL,
+                                             &hsub, &vsub, &msize)) ||
+            msize != 1)
+            return UPIPE_GL_TEXTURE_NONE;
+        planes[i] = (struct upipe_gl_texture_plane){
+            chromas[i], GL_LUMINANCE, GL_UNSIGNED_BYTE,
+            (width + hsub - 1) / hsub, (height + vsub - 1) / vsub, 1 };
+    }
+    *nb_planes_p = 3;
+    if (planes[1].height == height)
+        return UPIPE_GL_TEXTURE_YUV422P;
+    return UPIPE_GL_TEXTURE_YUV420P;
+}
+
+/** @internal @This uploads a plane from client memory.
+ *
+ * @param plane description of the plane
+ * @param data plane buffer
+ * @param stride plane stride
+ */
+static void upipe_gl_texture_upload_client(
+        const struct upipe_gl_texture_plane *plane,
+        const uint8_t *data, size_t stride)
+{
+    if (stride % plane->msize == 0) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / plane->msize);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, plane->width, plane->height,
+                        plane->format, plane->type, data);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        return;
+    }
+
+    for (size_t y = 0; y < plane->height; y++)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, plane->width, 1,
+                        plane->format, plane->type, data + y * stride);
+}
+
+/** @This uploads a uref picture (r8g8b8, r5g6b5, or planar y8 u8 v8 in
+ * 4:2:0 or 4:2:2) into a texture.
+ *
+ * @param texture pointer to texture structure
+ * @param uref uref structure describing the picture
+ * @return false in case of error
+ */
+bool upipe_gl_texture_load(struct upipe_gl_texture *texture,
+                           struct uref *uref)
+{
+    struct upipe_gl_texture_plane planes[3];
+    int nb_planes = 0;
+    enum upipe_gl_texture_format format =
+        upipe_gl_texture_planes(uref, planes, &nb_planes);
+    if (format == UPIPE_GL_TEXTURE_NONE)
+        return false;
+    if (nb_planes > 1 && !texture->program)
+        return false;
+
+    const uint8_t *data[3];
+    size_t strides[3];
+    for (int i = 0; i < nb_planes; i++) {
+        if (!ubase_check(uref_pic_plane_size(uref, planes[i].chroma,
+                                             &strides[i], NULL, NULL, NULL)) ||
+            !ubase_check(uref_pic_plane_read(uref, planes[i].chroma,
+                                             0, 0, -1, -1, &data[i]))) {
+            for (int j = 0; j < i; j++)
+                uref_pic_plane_unmap(uref, planes[j].chroma, 0, 0, -1, -1);
+            return false;
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    /* only (re)allocate storage when the picture layout changes */
+    if (texture->format != format ||
+        texture->width != planes[0].width ||
+        texture->height != planes[0].height) {
+        for (int i = 0; i < nb_planes; i++) {
+            glBindTexture(GL_TEXTURE_2D, texture->textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, planes[i].format,
+                         planes[i].width, planes[i].height, 0,
+                         planes[i].format, planes[i].type, NULL);
+        }
+        texture->format = format;
+        texture->width = planes[0].width;
+        texture->height = planes[0].height;
+    }
+
+    uint8_t *pbo = NULL;
+    size_t size = 0;
+    if (texture->pbos[0]) {
+        for (int i = 0; i < nb_planes; i++)
+            size += planes[i].width * planes[i].msize * planes[i].height;
+
+        /* orphan the previous storage so that the driver does not have to
+         * wait for a pending transfer */
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture->pbos[texture->pbo]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        pbo = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if (pbo == NULL)
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        texture->pbo = (texture->pbo + 1) % UPIPE_GL_TEXTURE_PBOS;
+    }
+
+    if (pbo != NULL) {
+        size_t offsets[3];
+        size_t offset = 0;
+        for (int i = 0; i < nb_planes; i++) {
+            size_t line = planes[i].width * planes[i].msize;
+            offsets[i] = offset;
+            if (strides[i] == line)
+                memcpy(pbo + offset, data[i], line * planes[i].height);
+            else
+                for (size_t y = 0; y < planes[i].height; y++)
+                    memcpy(pbo + offset + y * line, data[i] + y * strides[i],
+                           line);
+            offset += line * planes[i].height;
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        /* the transfers are asynchronous from now on */
+        for (int i = 0; i < nb_planes; i++) {
+            glBindTexture(GL_TEXTURE_2D, texture->textures[i]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                            planes[i].width, planes[i].height,
+                            planes[i].format, planes[i].type,
+                            (const GLvoid *)(uintptr_t)offsets[i]);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        for (int i = 0; i < nb_planes; i++) {
+            glBindTexture(GL_TEXTURE_2D, texture->textures[i]);
+            upipe_gl_texture_upload_client(&planes[i], data[i], strides[i]);
+        }
+    }
+
+    for (int i = 0; i < nb_planes; i++)
+        uref_pic_plane_unmap(uref, planes[i].chroma, 0, 0, -1, -1);
+    return true;
+}
+
+/** @This binds a texture to GL_TEXTURE_2D, together with the YUV to RGB
+ * program if needed.
+ *
+ * @param texture pointer to texture structure
+ */
+void upipe_gl_texture_bind(struct upipe_gl_texture *texture)
+{
+    if (texture->format != UPIPE_GL_TEXTURE_YUV420P &&
+        texture->format != UPIPE_GL_TEXTURE_YUV422P) {
+        glBindTexture(GL_TEXTURE_2D, texture->textures[0]);
+        return;
+    }
+
+    glUseProgram(texture->program);
+    glUniformMatrix3fv(glGetUniformLocation(texture->program, "matrix"),
+                       1, GL_FALSE, texture->height > 576 ?
+                       upipe_gl_texture_bt709 : upipe_gl_texture_bt601);
+    for (int i = 2; i >= 0; i--) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, texture->textures[i]);
+    }
+}
+
+/** @This unbinds a texture bound with @ref upipe_gl_texture_bind.
+ *
+ * @param texture pointer to texture structure
+ */
+void upipe_gl_texture_unbind(struct upipe_gl_texture *texture)
+{
+    if (texture->format == UPIPE_GL_TEXTURE_YUV420P ||
+        texture->format == UPIPE_GL_TEXTURE_YUV422P) {
+        glUseProgram(0);
+        for (int i = 2; i > 0; i--) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
 
 /** @This loads a uref picture into the specified texture
  * @param uref uref structure describing the picture
@@ -42,6 +414,7 @@ bool upipe_gl_texture_load_uref(struct uref *uref, GLuint texture)
     bool rgb565 = false;
     size_t width, height, stride;
     uint8_t msize;
+    GLint cur_width, cur_height, cur_format;
     uref_pic_size(uref, &width, &height, NULL);
     if (!ubase_check(uref_pic_plane_read(uref, "r8g8b8", 0, 0, -1, -1,
                                          &data)) ||
@@ -58,8 +431,19 @@ bool upipe_gl_texture_load_uref(struct uref *uref, GLuint texture)
     glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / msize);
     glPixelStorei(GL_UNPACK_ALIGNMENT, rgb565 ? 2 : 4);
     glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
-            rgb565 ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE, data);
+
+    /* keep the existing storage if it fits */
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &cur_width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &cur_height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT,
+                             &cur_format);
+    if (cur_width == width && cur_height == height && cur_format == GL_RGB)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB,
+                rgb565 ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE, data);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
+                rgb565 ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
     uref_pic_plane_unmap(uref, rgb565 ? "r5g6b5" : "r8g8b8", 0, 0, -1, -1);
 
     return true;
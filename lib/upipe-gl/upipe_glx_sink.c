@@ -476,6 +476,25 @@ static void upipe_glx_sink_input(struct upipe *upipe, struct uref *uref,
     }
 }
 
+/** @internal @This checks if a flow definition is planar yuv 4:2:0 or 4:2:2
+ * with 8 bits per sample.
+ *
+ * @param flow_def flow definition packet
+ * @return true if the flow definition is supported
+ */
+static bool upipe_glx_sink_check_yuv(struct uref *flow_def)
+{
+    uint8_t planes;
+    if (!ubase_check(uref_pic_flow_get_planes(flow_def, &planes)) ||
+        planes != 3 ||
+        !ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 1, "y8")))
+        return false;
+    return (ubase_check(uref_pic_flow_check_chroma(flow_def, 2, 2, 1, "u8")) &&
+            ubase_check(uref_pic_flow_check_chroma(flow_def, 2, 2, 1, "v8"))) ||
+           (ubase_check(uref_pic_flow_check_chroma(flow_def, 2, 1, 1, "u8")) &&
+            ubase_check(uref_pic_flow_check_chroma(flow_def, 2, 1, 1, "v8")));
+}
+
 /** @internal @This sets the input flow definition.
  *
  * @param upipe description structure of the pipe
@@ -489,12 +508,13 @@ static int upipe_glx_sink_set_flow_def(struct upipe *upipe,
         return UBASE_ERR_INVALID;
     UBASE_RETURN(uref_flow_match_def(flow_def, "pic."))
 
-    /* for the moment we only support rgb24 */
+    /* we support packed rgb, and planar yuv 4:2:0 or 4:2:2 */
     uint8_t macropixel;
     if (!ubase_check(uref_pic_flow_get_macropixel(flow_def, &macropixel)) ||
         macropixel != 1 ||
         (!ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 2, "r5g6b5")) &&
-         !ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 3, "r8g8b8")))) {
+         !ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 3, "r8g8b8")) &&
+         !upipe_glx_sink_check_yuv(flow_def))) {
         upipe_err(upipe, "incompatible flow definition");
         uref_dump(flow_def, upipe->uprobe);
         return UBASE_ERR_INVALID;
@@ -518,6 +538,13 @@ static int upipe_glx_sink_provide_flow_format(struct upipe *upipe,
     struct uref *flow_format = uref_dup(request->uref);
     UBASE_ALLOC_RETURN(flow_format);
     bool rgb565 = ubase_check(uref_pic_flow_check_chroma(flow_format, 1, 1, 2, "r5g6b5"));
+    uint8_t macropixel;
+    if (ubase_check(uref_pic_flow_get_macropixel(flow_format, &macropixel)) &&
+        macropixel == 1 && upipe_glx_sink_check_yuv(flow_format)) {
+        /* planar yuv is converted by the GPU */
+        uref_pic_set_progressive(flow_format);
+        return urequest_provide_flow_format(request, flow_format);
+    }
 
     uref_pic_flow_clear_format(flow_format);
     uref_pic_flow_set_macropixel(flow_format, 1);
@@ -21,6 +21,10 @@
 #include <stdint.h>
 #include "sdidec.h"
 
+#ifdef UPIPE_HBRMT_AVX512
+#include <immintrin.h>
+#endif
+
 void upipe_sdi_to_uyvy_c(const uint8_t *src, uint16_t *y, int64_t pixels)
 {
     pixels *= 2; /* change to number of samples */
@@ -36,3 +40,46 @@ void upipe_sdi_to_uyvy_c(const uint8_t *src, uint16_t *y, int64_t pixels)
         y[i+3] = ((d & 0x03) << 8) | e;                 //4455555555
     }
 }
+
+#ifdef UPIPE_HBRMT_AVX512
+/* for each output sample, the two source bytes it straddles, big endian */
+static const uint8_t sdi_shuf_avx512[64] = {
+     1,  0,  2,  1,  3,  2,  4,  3,  6,  5,  7,  6,  8,  7,  9,  8,
+    11, 10, 12, 11, 13, 12, 14, 13, 16, 15, 17, 16, 18, 17, 19, 18,
+    21, 20, 22, 21, 23, 22, 24, 23, 26, 25, 27, 26, 28, 27, 29, 28,
+    31, 30, 32, 31, 33, 32, 34, 33, 36, 35, 37, 36, 38, 37, 39, 38,
+};
+
+/* right shift aligning each sample once its two bytes are gathered */
+static const uint16_t sdi_shift_avx512[32] = {
+    6, 4, 2, 0, 6, 4, 2, 0, 6, 4, 2, 0, 6, 4, 2, 0,
+    6, 4, 2, 0, 6, 4, 2, 0, 6, 4, 2, 0, 6, 4, 2, 0,
+};
+
+/* 32 samples (40 bytes) per iteration; loads and stores are masked so
+ * neither the source nor the destination need padding */
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+void upipe_sdi_to_uyvy_avx512(const uint8_t *src, uint16_t *y, int64_t pixels)
+{
+    const __m512i shuf = _mm512_loadu_si512(sdi_shuf_avx512);
+    const __m512i shift = _mm512_loadu_si512(sdi_shift_avx512);
+    const __m512i mask = _mm512_set1_epi16(0x3ff);
+    int64_t samples = pixels * 2;
+
+    for (; samples >= 32; samples -= 32, src += 40, y += 32) {
+        __m512i v = _mm512_maskz_loadu_epi8(0xffffffffffULL, src);
+        v = _mm512_permutexvar_epi8(shuf, v);
+        v = _mm512_and_si512(_mm512_srlv_epi16(v, shift), mask);
+        _mm512_storeu_si512(y, v);
+    }
+
+    if (samples > 0) {
+        __mmask64 load = (1ULL << ((samples * 10 + 7) / 8)) - 1;
+        __mmask32 store = (1U << samples) - 1;
+        __m512i v = _mm512_maskz_loadu_epi8(load, src);
+        v = _mm512_permutexvar_epi8(shuf, v);
+        v = _mm512_and_si512(_mm512_srlv_epi16(v, shift), mask);
+        _mm512_mask_storeu_epi16(y, store, v);
+    }
+}
+#endif
@@ -1,3 +1,8 @@
 void upipe_sdi_to_uyvy_c(const uint8_t *src, uint16_t *y, int64_t pixels);
 void upipe_sdi_to_uyvy_ssse3(const uint8_t *src, uint16_t *y, int64_t pixels);
 void upipe_sdi_to_uyvy_avx2 (const uint8_t *src, uint16_t *y, int64_t pixels);
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define UPIPE_HBRMT_AVX512 1
+void upipe_sdi_to_uyvy_avx512(const uint8_t *src, uint16_t *y, int64_t pixels);
+#endif
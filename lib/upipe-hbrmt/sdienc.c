@@ -24,6 +24,10 @@
 
 #include "sdienc.h"
 
+#ifdef UPIPE_HBRMT_AVX512
+#include <immintrin.h>
+#endif
+
 void upipe_uyvy_to_sdi_c(uint8_t *dst, const uint8_t *y, int64_t pixels)
 {
     struct ubits s;
@@ -40,3 +44,50 @@ void upipe_uyvy_to_sdi_c(uint8_t *dst, const uint8_t *y, int64_t pixels)
         // check buffer end?
     }
 }
+
+#ifdef UPIPE_HBRMT_AVX512
+/* gathers the 5 big endian bytes of each 40-bit group */
+static const uint8_t sdi_perm_avx512[64] = {
+     4,  3,  2,  1,  0, 12, 11, 10,  9,  8, 20, 19, 18, 17, 16, 28,
+    27, 26, 25, 24, 36, 35, 34, 33, 32, 44, 43, 42, 41, 40, 52, 51,
+    50, 49, 48, 60, 59, 58, 57, 56,
+};
+
+/** @internal @This packs 4 samples per 64-bit lane into the low 40 bits,
+ * first sample in the most significant bits.
+ */
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static inline __m512i upipe_uyvy_to_sdi_avx512_pack(__m512i v)
+{
+    /* s0 << 10 | s1 and s2 << 10 | s3 in each 32-bit half */
+    v = _mm512_and_si512(v, _mm512_set1_epi16(0x3ff));
+    v = _mm512_madd_epi16(v, _mm512_set1_epi32(0x00010400));
+    /* (s0 s1) << 20 | (s2 s3) */
+    __m512i hi = _mm512_and_si512(_mm512_slli_epi64(v, 20),
+                                  _mm512_set1_epi64(0xffffffffffLL));
+    v = _mm512_or_si512(hi, _mm512_srli_epi64(v, 32));
+    return _mm512_permutexvar_epi8(_mm512_loadu_si512(sdi_perm_avx512), v);
+}
+
+/* 32 samples (40 bytes) per iteration; loads and stores are masked so
+ * neither the source nor the destination need padding */
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+void upipe_uyvy_to_sdi_avx512(uint8_t *dst, const uint8_t *y, int64_t pixels)
+{
+    const uint16_t *src = (const uint16_t *)y;
+    int64_t samples = pixels * 2;
+
+    for (; samples >= 32; samples -= 32, src += 32, dst += 40) {
+        __m512i v = _mm512_loadu_si512(src);
+        _mm512_mask_storeu_epi8(dst, 0xffffffffffULL,
+                                upipe_uyvy_to_sdi_avx512_pack(v));
+    }
+
+    if (samples > 0) {
+        __mmask32 load = (1U << samples) - 1;
+        __mmask64 store = (1ULL << ((samples * 10 + 7) / 8)) - 1;
+        __m512i v = _mm512_maskz_loadu_epi16(load, src);
+        _mm512_mask_storeu_epi8(dst, store, upipe_uyvy_to_sdi_avx512_pack(v));
+    }
+}
+#endif
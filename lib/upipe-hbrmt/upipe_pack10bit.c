@@ -346,6 +346,12 @@ static struct upipe *upipe_pack10bit_alloc(struct upipe_mgr *mgr,
 #endif
 #endif
 
+#if defined(UPIPE_HBRMT_AVX512)
+    if (__builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vbmi"))
+        upipe_pack10bit->pack = upipe_uyvy_to_sdi_avx512;
+#endif
+
     upipe_pack10bit_init_urefcount(upipe);
     upipe_pack10bit_init_ubuf_mgr(upipe);
     upipe_pack10bit_init_output(upipe);
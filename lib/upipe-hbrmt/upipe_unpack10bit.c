@@ -343,6 +343,12 @@ static struct upipe *upipe_unpack10bit_alloc(struct upipe_mgr *mgr,
 #endif
 #endif
 
+#if defined(UPIPE_HBRMT_AVX512)
+    if (__builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vbmi"))
+        upipe_unpack10bit->unpack = upipe_sdi_to_uyvy_avx512;
+#endif
+
     upipe_unpack10bit_init_urefcount(upipe);
     upipe_unpack10bit_init_ubuf_mgr(upipe);
     upipe_unpack10bit_init_output(upipe);
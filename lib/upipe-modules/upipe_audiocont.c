@@ -53,6 +53,7 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <string.h>
+#include <math.h>
 #include <assert.h>
 
 /** only accept sound in 32 bit floating-point */
@@ -417,6 +418,37 @@ static void upipe_audiocont_sub_consume(struct upipe *upipe,
     }
 }
 
+/** @internal @This mixes samples into a buffer with a linear gain ramp.
+ * The gain of each sample is computed from its index rather than
+ * accumulated, so that the loops have no carried dependency and can be
+ * vectorized by the compiler.
+ *
+ * @param dst buffer to mix into
+ * @param src samples to mix
+ * @param samples number of samples
+ * @param channels number of interleaved channels per sample
+ * @param gain gain of the first sample
+ * @param step gain increment between two consecutive samples
+ */
+static void upipe_audiocont_ramp(float *dst, const float *src,
+                                 size_t samples, unsigned int channels,
+                                 float gain, float step)
+{
+    if (channels == 1) {
+        for (size_t i = 0; i < samples; i++)
+            dst[i] += src[i] * (gain + step * i);
+        return;
+    }
+
+    for (size_t i = 0; i < samples; i++) {
+        float g = gain + step * i;
+        for (unsigned int j = 0; j < channels; j++)
+            dst[j] += src[j] * g;
+        dst += channels;
+        src += channels;
+    }
+}
+
 /** @internal @This extracts from the uref stream to an allocated ubuf.
  *
  * @param upipe description structure of the pipe
@@ -483,34 +515,35 @@ static int upipe_audiocont_sub_extract(struct upipe *upipe, struct ubuf *ubuf,
             uref_free(uref_from_uchain(ulist_pop(&sub->urefs)));
             continue;
         }
+        /* number of samples still in the crossblend window */
+        size_t faded = extracted;
+        if (initial_crossblend >= 1.)
+            faded = 0;
+        else if (upipe_audiocont->crossblend_step > 0.) {
+            float window = ceilf((1. - initial_crossblend) /
+                                 upipe_audiocont->crossblend_step);
+            if (window < faded)
+                faded = window;
+        }
+        float gain = previous ? 1. - initial_crossblend : initial_crossblend;
+        float step = previous ? -upipe_audiocont->crossblend_step :
+                                upipe_audiocont->crossblend_step;
+        unsigned int channels = sample_size / sizeof(float);
+
         uint8_t plane;
         for (plane = 0;
              (plane < planes) && ref_buffers[plane] && in_buffers[plane];
              plane++) {
-            float *ref_buffer = ref_buffers[plane] +
-                                offset * sample_size / sizeof(float);
+            float *ref_buffer = ref_buffers[plane] + offset * channels;
             const float *in_buffer = in_buffers[plane];
-            size_t extracted_plane = extracted;
-            float crossblend = initial_crossblend;
-
-            while (extracted_plane) {
-                if (crossblend >= 1.) {
-                    if (!previous)
-                        memcpy(ref_buffer, in_buffer,
-                               extracted_plane * sample_size);
-                    break;
-                }
-
-                float real_crossblend = previous ?
-                                        (1. - crossblend) : crossblend;
-                for (int i = 0; i < sample_size / sizeof(float); i++)
-                    ref_buffer[i] += in_buffer[i] * real_crossblend;
-
-                ref_buffer += sample_size / sizeof(float);
-                in_buffer += sample_size / sizeof(float);
-                extracted_plane--;
-                crossblend += upipe_audiocont->crossblend_step;
-            }
+
+            if (faded)
+                upipe_audiocont_ramp(ref_buffer, in_buffer, faded, channels,
+                                     gain, step);
+            if (!previous && faded < extracted)
+                memcpy(ref_buffer + faded * channels,
+                       in_buffer + faded * channels,
+                       (extracted - faded) * sample_size);
         }
 
         uref_sound_unmap(input_uref, 0, extracted, planes);
@@ -726,10 +759,9 @@ static void upipe_audiocont_input(struct upipe *upipe, struct uref *uref,
     const char *channel;
     uref_sound_foreach_plane(uref, channel) {
         float *buf;
-        uref_sound_plane_write_float(uref, channel, 0, -1, &buf);
-        for (int i = 0; i < ref_size; i++)
-            for (int j = 0; j < sample_size / sizeof(float); j++)
-                *buf++ = 0.;
+        if (ubase_check(uref_sound_plane_write_float(uref, channel, 0, -1,
+                                                     &buf)))
+            memset(buf, 0, ref_size * sample_size);
         uref_sound_plane_unmap(uref, channel, 0, -1);
     }
 
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module coalescing segmented blocks
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_flow.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe/upipe_helper_input.h>
+#include <upipe-modules/upipe_block_compact.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <assert.h>
+
+/** we only accept blocks */
+#define EXPECTED_FLOW_DEF "block."
+/** default maximum number of segments before compaction */
+#define DEFAULT_THRESHOLD 16
+/** alignment of the compacted buffers */
+#define UBUF_ALIGN 64
+
+/** @internal @This is the private context of a block_compact pipe. */
+struct upipe_block_compact {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** output pipe */
+    struct upipe *output;
+    /** flow_definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** temporary uref storage (used during urequest) */
+    struct uchain urefs;
+    /** nb urefs in storage */
+    unsigned int nb_urefs;
+    /** max urefs in storage */
+    unsigned int max_urefs;
+    /** list of blockers (used during urequest) */
+    struct uchain blockers;
+
+    /** maximum number of segments before compaction */
+    unsigned int threshold;
+    /** number of compacted blocks */
+    uint64_t compacted;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** @hidden */
+static bool upipe_block_compact_handle(struct upipe *upipe, struct uref *uref,
+                                       struct upump **upump_p);
+/** @hidden */
+static int upipe_block_compact_check(struct upipe *upipe,
+                                     struct uref *flow_format);
+
+UPIPE_HELPER_UPIPE(upipe_block_compact, upipe, UPIPE_BLOCK_COMPACT_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_block_compact, urefcount,
+                       upipe_block_compact_free)
+UPIPE_HELPER_VOID(upipe_block_compact);
+UPIPE_HELPER_OUTPUT(upipe_block_compact, output, flow_def, output_state,
+                    request_list)
+UPIPE_HELPER_UBUF_MGR(upipe_block_compact, ubuf_mgr, flow_format,
+                      ubuf_mgr_request, upipe_block_compact_check,
+                      upipe_block_compact_register_output_request,
+                      upipe_block_compact_unregister_output_request)
+UPIPE_HELPER_INPUT(upipe_block_compact, urefs, nb_urefs, max_urefs, blockers,
+                   upipe_block_compact_handle)
+
+/** @internal @This allocates a block_compact pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_block_compact_alloc(struct upipe_mgr *mgr,
+                                               struct uprobe *uprobe,
+                                               uint32_t signature,
+                                               va_list args)
+{
+    struct upipe *upipe = upipe_block_compact_alloc_void(mgr, uprobe,
+                                                         signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_block_compact *upipe_block_compact =
+        upipe_block_compact_from_upipe(upipe);
+    upipe_block_compact_init_urefcount(upipe);
+    upipe_block_compact_init_output(upipe);
+    upipe_block_compact_init_ubuf_mgr(upipe);
+    upipe_block_compact_init_input(upipe);
+    upipe_block_compact->threshold = DEFAULT_THRESHOLD;
+    upipe_block_compact->compacted = 0;
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This compacts a block if it has too many segments, and outputs
+ * it.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ * @return false if the input must be blocked
+ */
+static bool upipe_block_compact_handle(struct upipe *upipe, struct uref *uref,
+                                       struct upump **upump_p)
+{
+    struct upipe_block_compact *upipe_block_compact =
+        upipe_block_compact_from_upipe(upipe);
+    if (upipe_block_compact->ubuf_mgr == NULL)
+        return false;
+
+    struct ubuf *ubuf = uref->ubuf;
+    if (unlikely(!ubase_check(uref_block_compact(uref,
+                        upipe_block_compact->ubuf_mgr,
+                        upipe_block_compact->threshold)))) {
+        upipe_warn(upipe, "unable to compact block");
+        uref_free(uref);
+        return true;
+    }
+    if (uref->ubuf != ubuf)
+        upipe_block_compact->compacted++;
+
+    upipe_block_compact_output(upipe, uref, upump_p);
+    return true;
+}
+
+/** @internal @This receives incoming uref.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_block_compact_input(struct upipe *upipe, struct uref *uref,
+                                      struct upump **upump_p)
+{
+    if (unlikely(uref->ubuf == NULL)) {
+        upipe_warn(upipe, "received empty packet");
+        uref_free(uref);
+        return;
+    }
+
+    if (!upipe_block_compact_check_input(upipe)) {
+        upipe_block_compact_hold_input(upipe, uref);
+        upipe_block_compact_block_input(upipe, upump_p);
+    } else if (!upipe_block_compact_handle(upipe, uref, upump_p)) {
+        upipe_block_compact_hold_input(upipe, uref);
+        upipe_block_compact_block_input(upipe, upump_p);
+        /* Increment upipe refcount to avoid disappearing before all packets
+         * have been sent. */
+        upipe_use(upipe);
+    }
+}
+
+/** @internal @This receives a provided ubuf manager.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_block_compact_check(struct upipe *upipe,
+                                     struct uref *flow_format)
+{
+    /* the output flow definition is the input one */
+    uref_free(flow_format);
+
+    bool was_buffered = !upipe_block_compact_check_input(upipe);
+    upipe_block_compact_output_input(upipe);
+    upipe_block_compact_unblock_input(upipe);
+    if (was_buffered && upipe_block_compact_check_input(upipe)) {
+        /* All packets have been output, release again the pipe that has been
+         * used in @ref upipe_block_compact_input. */
+        upipe_release(upipe);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the input flow definition, and requires a ubuf
+ * manager for aligned buffers.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_block_compact_set_flow_def(struct upipe *upipe,
+                                            struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+
+    struct uref *flow_def_dup = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def_dup);
+    struct uref *flow_format = uref_dup(flow_def);
+    if (unlikely(flow_format == NULL)) {
+        uref_free(flow_def_dup);
+        return UBASE_ERR_ALLOC;
+    }
+    uref_block_flow_set_align(flow_format, UBUF_ALIGN);
+
+    upipe_block_compact_store_flow_def(upipe, flow_def_dup);
+    upipe_block_compact_require_ubuf_mgr(upipe, flow_format);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_block_compact_control(struct upipe *upipe,
+                                       int command, va_list args)
+{
+    struct upipe_block_compact *upipe_block_compact =
+        upipe_block_compact_from_upipe(upipe);
+
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return upipe_throw_provide_request(upipe, request);
+            return upipe_block_compact_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return UBASE_ERR_NONE;
+            return upipe_block_compact_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_OUTPUT:
+        case UPIPE_SET_OUTPUT:
+        case UPIPE_GET_FLOW_DEF:
+            return upipe_block_compact_control_output(upipe, command, args);
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_block_compact_set_flow_def(upipe, flow_def);
+        }
+
+        case UPIPE_BLOCK_COMPACT_GET_THRESHOLD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_BLOCK_COMPACT_SIGNATURE)
+            unsigned int *threshold_p = va_arg(args, unsigned int *);
+            *threshold_p = upipe_block_compact->threshold;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_BLOCK_COMPACT_SET_THRESHOLD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_BLOCK_COMPACT_SIGNATURE)
+            upipe_block_compact->threshold = va_arg(args, unsigned int);
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This frees all resources allocated.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_block_compact_free(struct upipe *upipe)
+{
+    struct upipe_block_compact *upipe_block_compact =
+        upipe_block_compact_from_upipe(upipe);
+    upipe_dbg_va(upipe, "compacted %"PRIu64" blocks",
+                 upipe_block_compact->compacted);
+    upipe_throw_dead(upipe);
+
+    upipe_block_compact_clean_input(upipe);
+    upipe_block_compact_clean_output(upipe);
+    upipe_block_compact_clean_ubuf_mgr(upipe);
+    upipe_block_compact_clean_urefcount(upipe);
+    upipe_block_compact_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_block_compact_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_BLOCK_COMPACT_SIGNATURE,
+
+    .upipe_alloc = upipe_block_compact_alloc,
+    .upipe_input = upipe_block_compact_input,
+    .upipe_control = upipe_block_compact_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for block_compact pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_block_compact_mgr_alloc(void)
+{
+    return &upipe_block_compact_mgr;
+}
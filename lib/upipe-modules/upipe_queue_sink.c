@@ -475,6 +475,23 @@ static void upipe_qsink_oob(struct upump *upump)
     upipe_queue_upstream_free(upstream);
 }
 
+/** @internal @This returns the number of urefs not yet popped by the queue
+ * source.
+ *
+ * @param upipe description structure of the pipe
+ * @param length_p filled in with the number of pending urefs
+ * @return an error code
+ */
+static int _upipe_qsink_get_length(struct upipe *upipe,
+                                   unsigned int *length_p)
+{
+    struct upipe_qsink *upipe_qsink = upipe_qsink_from_upipe(upipe);
+    assert(length_p != NULL);
+    *length_p = uqueue_length(&upipe_queue(upipe_qsink->qsrc)->uqueue) +
+                upipe_qsink->nb_urefs;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a queue sink pipe.
  *
  * @param upipe description structure of the pipe
@@ -520,6 +537,12 @@ static int _upipe_qsink_control(struct upipe *upipe, int command, va_list args)
 
         case UPIPE_FLUSH:
             return upipe_qsink_flush(upipe);
+
+        case UPIPE_QSINK_GET_LENGTH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_QSINK_SIGNATURE)
+            unsigned int *length_p = va_arg(args, unsigned int *);
+            return _upipe_qsink_get_length(upipe, length_p);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -453,6 +453,16 @@ static int upipe_work_control(struct upipe *upipe, int command, va_list args)
             struct upipe **p = va_arg(args, struct upipe **);
             return upipe_work_get_last_inner(upipe, p);
         }
+        case UPIPE_QSINK_GET_LENGTH: {
+            /* Local commands of different pipes share values, e.g. this one
+             * is also UPIPE_QSRC_GET_MAX_LENGTH. The queue sink checks the
+             * signature and leaves other commands unhandled, so that they
+             * are forwarded to the inner pipes below. */
+            int err = upipe_work_control_in_qsink(upipe, command, args);
+            if (err != UBASE_ERR_UNHANDLED)
+                return err;
+            break;
+        }
         default:
             break;
     }
@@ -126,6 +126,14 @@ struct upipe_sws_thumbs {
     struct uref *gallery;
     /** thumb counter */
     int counter;
+    /** selection interval */
+    unsigned int interval;
+    /** pictures dropped since the last selected picture */
+    unsigned int skipped;
+    /** true if the gallery is kept across outputs */
+    bool persistent;
+    /** true if fast scaling is enabled */
+    bool fast;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -157,7 +165,8 @@ static inline bool upipe_sws_thumbs_set_context(struct upipe *upipe,
     upipe_sws_thumbs->convert_ctx = sws_getCachedContext(upipe_sws_thumbs->convert_ctx,
                 srcsize->hsize, srcsize->vsize, upipe_sws_thumbs->input_pix_fmt,
                 dstsize->hsize, dstsize->vsize, upipe_sws_thumbs->output_pix_fmt,
-                SWS_GAUSS, NULL, NULL, NULL);
+                upipe_sws_thumbs->fast ? SWS_FAST_BILINEAR : SWS_GAUSS,
+                NULL, NULL, NULL);
 
     if (unlikely(!upipe_sws_thumbs->convert_ctx)) {
         upipe_err(upipe, "could not get swscale context");
@@ -183,6 +192,65 @@ static inline void upipe_sws_thumbs_flush(struct upipe *upipe, struct upump **up
     }
 }
 
+/** @internal @This outputs a reference to the persistent gallery with the
+ * attributes of the last picture, and keeps the gallery for the next tiles.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref last scaled picture
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_sws_thumbs_output_persistent(struct upipe *upipe,
+                                               struct uref *uref,
+                                               struct upump **upump_p)
+{
+    struct upipe_sws_thumbs *upipe_sws_thumbs = upipe_sws_thumbs_from_upipe(upipe);
+    struct ubuf *ubuf = ubuf_dup(upipe_sws_thumbs->gallery->ubuf);
+    if (unlikely(!ubuf)) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    uref_attach_ubuf(uref, ubuf);
+    upipe_sws_thumbs_output(upipe, uref, upump_p);
+}
+
+/** @internal @This returns the line decimation factor to apply to the input
+ * picture in fast mode, so that the scaler works on at most twice the number
+ * of lines of the tile.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref input picture
+ * @param inputsize input picture size
+ * @param surface scaled picture size
+ * @return decimation factor (1 if no decimation is possible)
+ */
+static unsigned int upipe_sws_thumbs_decimation(struct upipe *upipe,
+                                                struct uref *uref,
+                                                struct picsize *inputsize,
+                                                struct picsize *surface)
+{
+    struct upipe_sws_thumbs *upipe_sws_thumbs = upipe_sws_thumbs_from_upipe(upipe);
+    const char **planes = upipe_sws_thumbs->input_chroma_map;
+    if (!upipe_sws_thumbs->fast)
+        return 1;
+
+    uint8_t vsub_max = 1;
+    for (int i = 0; i < UPIPE_AV_MAX_PLANES && planes[i]; i++) {
+        uint8_t vsub;
+        if (unlikely(!ubase_check(uref_pic_plane_size(uref, planes[i],
+                                        NULL, NULL, &vsub, NULL))))
+            return 1;
+        if (vsub > vsub_max)
+            vsub_max = vsub;
+    }
+
+    unsigned int factor = 1;
+    while (inputsize->vsize / (factor * 2) >= surface->vsize * 2 &&
+           !(inputsize->vsize % (factor * 2 * vsub_max)))
+        factor *= 2;
+    return factor;
+}
+
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -214,6 +282,14 @@ static bool upipe_sws_thumbs_handle(struct upipe *upipe, struct uref *uref,
         return true;
     }
 
+    /* only scale selected pictures */
+    if (upipe_sws_thumbs->skipped + 1 < upipe_sws_thumbs->interval) {
+        upipe_sws_thumbs->skipped++;
+        uref_free(uref);
+        return true;
+    }
+    upipe_sws_thumbs->skipped = 0;
+
     const char **planes;
     struct uref *gallery;
     struct ubuf *ubuf;
@@ -223,6 +299,7 @@ static bool upipe_sws_thumbs_handle(struct upipe *upipe, struct uref *uref,
     const uint8_t *slices[4];
     uint8_t *dslices[4];
     int counter, ret, i;
+    unsigned int factor;
     struct urational ratio, sar;
 
     /* set picture sizes */
@@ -267,6 +344,10 @@ static bool upipe_sws_thumbs_handle(struct upipe *upipe, struct uref *uref,
     pos.hsize = thumbsize->hsize*(counter % thumbnum->hsize);
     pos.vsize = thumbsize->vsize*(counter / thumbnum->hsize);
 
+    /* decimate input lines in fast mode */
+    factor = upipe_sws_thumbs_decimation(upipe, uref, &inputsize, &surface);
+    inputsize.vsize /= factor;
+
     /* get sws context */
     if (unlikely(!upipe_sws_thumbs_set_context(upipe, &inputsize, &surface))) {
         uref_free(uref);
@@ -294,6 +375,23 @@ static bool upipe_sws_thumbs_handle(struct upipe *upipe, struct uref *uref,
         }
         ubuf_pic_clear(ubuf, 0, 0, -1, -1, 0);
         uref_attach_ubuf(gallery, ubuf);
+    } else if (upipe_sws_thumbs->persistent) {
+        /* previous output still in use downstream: copy the gallery once
+         * instead of scaling all tiles again */
+        ubuf = gallery->ubuf;
+        if (unlikely(!ubase_check(ubuf_pic_plane_write(ubuf,
+                            upipe_sws_thumbs->output_chroma_map[0],
+                            0, 0, -1, -1, &dslices[0])))) {
+            if (unlikely(!ubase_check(uref_pic_replace(gallery,
+                                upipe_sws_thumbs->ubuf_mgr, 0, 0, -1, -1)))) {
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                uref_free(uref);
+                return true;
+            }
+        } else {
+            ubuf_pic_plane_unmap(ubuf, upipe_sws_thumbs->output_chroma_map[0],
+                                 0, 0, -1, -1);
+        }
     }
 
     /* map input */
@@ -317,6 +415,10 @@ static bool upipe_sws_thumbs_handle(struct upipe *upipe, struct uref *uref,
         dstrides[i] = stride;
     }
 
+    /* skip lines of the input */
+    for (i = 0; i < UPIPE_AV_MAX_PLANES; i++)
+        strides[i] *= factor;
+
     /* fire ! */
     ret = sws_scale(upipe_sws_thumbs->convert_ctx,
                     (const uint8_t *const*) slices, strides, 0, inputsize.vsize,
@@ -332,17 +434,24 @@ static bool upipe_sws_thumbs_handle(struct upipe *upipe, struct uref *uref,
         uref_pic_plane_unmap(gallery, planes[i], 0, 0, -1, -1);
     }
 
-    /* clean */
-    uref_free(uref);
     if (unlikely(ret <= 0)) {
+        uref_free(uref);
         upipe_warn(upipe, "error during sws conversion");
         return true;
     }
 
-    /* output if gallery is complete */
     counter++;
     counter = counter % (thumbnum->hsize*thumbnum->vsize);
     upipe_sws_thumbs->counter = counter;
+
+    /* output the updated persistent gallery */
+    if (upipe_sws_thumbs->persistent) {
+        upipe_sws_thumbs_output_persistent(upipe, uref, upump_p);
+        return true;
+    }
+
+    /* output if gallery is complete */
+    uref_free(uref);
     if (unlikely(counter == 0)) {
         upipe_sws_thumbs_flush(upipe, upump_p);
     }
@@ -392,6 +501,11 @@ static int _upipe_sws_thumbs_set_size(struct upipe *upipe,
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return UBASE_ERR_ALLOC;
     }
+    if (upipe_sws_thumbs->persistent) {
+        uref_free(upipe_sws_thumbs->gallery);
+        upipe_sws_thumbs->gallery = NULL;
+        upipe_sws_thumbs->counter = 0;
+    }
     upipe_sws_thumbs->thumbsize->hsize = hsize;
     upipe_sws_thumbs->thumbsize->vsize = vsize;
     upipe_sws_thumbs->thumbnum->hsize = cols;
@@ -453,6 +567,26 @@ static int _upipe_sws_thumbs_get_size(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the selection interval.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval selection interval
+ * @return an error code
+ */
+static int _upipe_sws_thumbs_set_interval(struct upipe *upipe,
+                                          unsigned int interval)
+{
+    struct upipe_sws_thumbs *upipe_sws_thumbs = upipe_sws_thumbs_from_upipe(upipe);
+    if (unlikely(!interval)) {
+        upipe_warn(upipe, "invalid selection interval");
+        return UBASE_ERR_INVALID;
+    }
+    upipe_sws_thumbs->interval = interval;
+    upipe_sws_thumbs->skipped = 0;
+    upipe_dbg_va(upipe, "selecting one picture out of %u", interval);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This receives a provided ubuf manager.
  *
  * @param upipe description structure of the pipe
@@ -556,6 +690,9 @@ static int upipe_sws_thumbs_set_flow_def(struct upipe *upipe,
 static int upipe_sws_thumbs_control(struct upipe *upipe,
                                     int command, va_list args)
 {
+    struct upipe_sws_thumbs *upipe_sws_thumbs =
+        upipe_sws_thumbs_from_upipe(upipe);
+
     switch (command) {
         /* generic commands */
         case UPIPE_REGISTER_REQUEST: {
@@ -606,6 +743,33 @@ static int upipe_sws_thumbs_control(struct upipe *upipe,
             upipe_sws_thumbs_flush(upipe, NULL);
             return UBASE_ERR_NONE;
         }
+        case UPIPE_SWS_THUMBS_SET_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_SWS_THUMBS_SIGNATURE)
+            unsigned int interval = va_arg(args, unsigned int);
+            return _upipe_sws_thumbs_set_interval(upipe, interval);
+        }
+        case UPIPE_SWS_THUMBS_GET_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_SWS_THUMBS_SIGNATURE)
+            unsigned int *interval_p = va_arg(args, unsigned int *);
+            *interval_p = upipe_sws_thumbs->interval;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_SWS_THUMBS_SET_PERSISTENT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_SWS_THUMBS_SIGNATURE)
+            bool persistent = !!va_arg(args, int);
+            if (upipe_sws_thumbs->persistent && !persistent) {
+                uref_free(upipe_sws_thumbs->gallery);
+                upipe_sws_thumbs->gallery = NULL;
+                upipe_sws_thumbs->counter = 0;
+            }
+            upipe_sws_thumbs->persistent = persistent;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_SWS_THUMBS_SET_FAST: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_SWS_THUMBS_SIGNATURE)
+            upipe_sws_thumbs->fast = !!va_arg(args, int);
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -655,6 +819,10 @@ static struct upipe *upipe_sws_thumbs_alloc(struct upipe_mgr *mgr,
 
     upipe_sws_thumbs->gallery = NULL;
     upipe_sws_thumbs->counter = 0;
+    upipe_sws_thumbs->interval = 1;
+    upipe_sws_thumbs->skipped = 0;
+    upipe_sws_thumbs->persistent = false;
+    upipe_sws_thumbs->fast = false;
 
     upipe_throw_ready(upipe);
 
@@ -679,7 +847,10 @@ static void upipe_sws_thumbs_free(struct upipe *upipe)
     }
     free(upipe_sws_thumbs->thumbsize);
     free(upipe_sws_thumbs->thumbnum);
-    if (upipe_sws_thumbs->gallery) {
+    if (upipe_sws_thumbs->persistent) {
+        uref_free(upipe_sws_thumbs->gallery);
+        upipe_sws_thumbs->gallery = NULL;
+    } else if (upipe_sws_thumbs->gallery) {
         upipe_sws_thumbs_flush(upipe, NULL);
     }
 
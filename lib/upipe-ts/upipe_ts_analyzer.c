@@ -0,0 +1,678 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/** @file
+ * @short Upipe sink module analyzing a transport stream
+ *
+ * The packets are processed in batches: the headers of a batch are first
+ * gathered in a flat array and checked for sync bytes and transport errors
+ * in tight loops, then the state of each PID is updated from a flat table
+ * indexed by PID.
+ *
+ * PAT and PMT repetition is checked against the arrival date of the urefs
+ * (cr_sys) or, if the urefs are not dated, against the latest PCR of the
+ * stream. PCR accuracy is checked against the rate of the previous PCR
+ * interval of the same PID, which assumes a constant bitrate.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe-ts/upipe_ts_analyzer.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/psi.h>
+
+/** we only accept blocks */
+#define EXPECTED_FLOW_DEF "block."
+/** TS synchronization word */
+#define TS_SYNC 0x47
+/** number of PIDs */
+#define MAX_PIDS 8192
+/** null PID */
+#define NULL_PID 8191
+/** 2^33 (max resolution of PCR, PTS and DTS) */
+#define POW2_33 UINT64_C(8589934592)
+/** max resolution of PCR in 27 MHz units */
+#define TS_CLOCK_MAX (POW2_33 * UCLOCK_FREQ / 90000)
+/** largest supported packet size */
+#define MAX_PACKET_SIZE 204
+/** number of packets in a batch */
+#define BATCH_SIZE 32
+/** max number of PMT PIDs */
+#define MAX_PMTS 256
+/** max interval between two PAT or PMT sections */
+#define TABLE_INTERVAL (UCLOCK_FREQ / 2)
+/** max interval between two PCRs */
+#define PCR_INTERVAL (UCLOCK_FREQ / 25)
+/** max interval between two PCRs without discontinuity */
+#define PCR_DISCONTINUITY (UCLOCK_FREQ / 10)
+/** max PCR jitter (500 ns) */
+#define PCR_ACCURACY (UCLOCK_FREQ / 2000000)
+/** interval between two stats events */
+#define STATS_INTERVAL UCLOCK_FREQ
+
+/** the continuity counter of the PID is known */
+#define PID_CC          0x01
+/** the last packet of the PID was a duplicate */
+#define PID_DUP         0x02
+/** the last PCR of the PID is known */
+#define PID_PCR         0x04
+/** the previous PCR interval of the PID is known */
+#define PID_PCR_RATE    0x08
+/** the PID carries a PMT */
+#define PID_PMT         0x10
+/** the PAT or PMT of the PID was already reported late */
+#define PID_LATE        0x20
+
+/** @internal @This is the state of a PID. */
+struct upipe_ts_analyzer_pid {
+    /** counters */
+    struct upipe_ts_analyzer_stats stats;
+    /** last PCR */
+    uint64_t pcr;
+    /** PCR before the last PCR */
+    uint64_t pcr_prev;
+    /** index in the stream of the packet carrying the last PCR */
+    uint64_t pcr_index;
+    /** index in the stream of the packet carrying the previous PCR */
+    uint64_t pcr_prev_index;
+    /** date of the last PAT or PMT section, or UINT64_MAX */
+    uint64_t table_date;
+    /** last continuity counter */
+    uint8_t cc;
+    /** PID_* flags */
+    uint8_t flags;
+};
+
+/** @internal @This is the private context of a ts_analyzer pipe. */
+struct upipe_ts_analyzer {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** TS packet size */
+    unsigned int output_size;
+    /** beginning of a packet split across urefs */
+    uint8_t residue[MAX_PACKET_SIZE];
+    /** size of the residue */
+    unsigned int residue_size;
+    /** number of consecutive corrupted sync bytes */
+    unsigned int sync_errors;
+    /** last PCR of the stream, or UINT64_MAX */
+    uint64_t pcr;
+    /** date of the last stats event, or UINT64_MAX */
+    uint64_t stats_date;
+    /** PMT PIDs */
+    uint16_t pmts[MAX_PMTS];
+    /** number of PMT PIDs */
+    unsigned int nb_pmts;
+    /** counters of the stream */
+    struct upipe_ts_analyzer_stats stats;
+    /** state of the PIDs */
+    struct upipe_ts_analyzer_pid pids[MAX_PIDS];
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ts_analyzer, upipe, UPIPE_TS_ANALYZER_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ts_analyzer, urefcount, upipe_ts_analyzer_free)
+UPIPE_HELPER_VOID(upipe_ts_analyzer)
+
+/** @internal @This resets the state of all PIDs and the counters.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_analyzer_reset(struct upipe *upipe)
+{
+    struct upipe_ts_analyzer *upipe_ts_analyzer =
+        upipe_ts_analyzer_from_upipe(upipe);
+    upipe_ts_analyzer->residue_size = 0;
+    upipe_ts_analyzer->sync_errors = 0;
+    upipe_ts_analyzer->pcr = UINT64_MAX;
+    upipe_ts_analyzer->stats_date = UINT64_MAX;
+    upipe_ts_analyzer->nb_pmts = 0;
+    memset(&upipe_ts_analyzer->stats, 0, sizeof(upipe_ts_analyzer->stats));
+    memset(upipe_ts_analyzer->pids, 0, sizeof(upipe_ts_analyzer->pids));
+    for (unsigned int i = 0; i < MAX_PIDS; i++)
+        upipe_ts_analyzer->pids[i].table_date = UINT64_MAX;
+}
+
+/** @internal @This allocates a ts_analyzer pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ts_analyzer_alloc(struct upipe_mgr *mgr,
+                                             struct uprobe *uprobe,
+                                             uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_ts_analyzer_alloc_void(mgr, uprobe, signature,
+                                                       args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ts_analyzer *upipe_ts_analyzer =
+        upipe_ts_analyzer_from_upipe(upipe);
+    upipe_ts_analyzer_init_urefcount(upipe);
+    upipe_ts_analyzer->output_size = TS_SIZE;
+    upipe_ts_analyzer_reset(upipe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This counts an indicator on a PID and on the stream.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid state of the PID, or NULL
+ * @param indicator indicator
+ */
+static inline void upipe_ts_analyzer_count(struct upipe *upipe,
+        struct upipe_ts_analyzer_pid *pid,
+        enum upipe_ts_analyzer_indicator indicator)
+{
+    struct upipe_ts_analyzer *upipe_ts_analyzer =
+        upipe_ts_analyzer_from_upipe(upipe);
+    upipe_ts_analyzer->stats.indicators[indicator]++;
+    if (pid != NULL)
+        pid->stats.indicators[indicator]++;
+}
+
+/** @internal @This records the arrival of a PAT or PMT section.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid state of the PID
+ * @param indicator indicator to count if the section is late
+ * @param date date of the packet, or UINT64_MAX
+ */
+static void upipe_ts_analyzer_table(struct upipe *upipe,
+        struct upipe_ts_analyzer_pid *pid,
+        enum upipe_ts_analyzer_indicator indicator, uint64_t date)
+{
+    if (date == UINT64_MAX)
+        return;
+    if (pid->table_date != UINT64_MAX && !(pid->flags & PID_LATE) &&
+        date > pid->table_date + TABLE_INTERVAL)
+        upipe_ts_analyzer_count(upipe, pid, indicator);
+    pid->table_date = date;
+    pid->flags &= ~PID_LATE;
+}
+
+/** @internal @This parses a PAT section starting in a packet, and
+ * registers the PMT PIDs.
+ *
+ * @param upipe description structure of the pipe
+ * @param section pointer to the section
+ * @param size number of octets of the section in the packet
+ * @param date date of the packet, or UINT64_MAX
+ */
+static void upipe_ts_analyzer_pat(struct upipe *upipe, const uint8_t *section,
+                                  size_t size, uint64_t date)
+{
+    struct upipe_ts_analyzer *upipe_ts_analyzer =
+        upipe_ts_analyzer_from_upipe(upipe);
+    struct upipe_ts_analyzer_pid *pid = &upipe_ts_analyzer->pids[PAT_PID];
+    if (psi_get_tableid(section) != PAT_TABLE_ID) {
+        upipe_ts_analyzer_count(upipe, pid, UPIPE_TS_ANALYZER_PAT);
+        return;
+    }
+    upipe_ts_analyzer_table(upipe, pid, UPIPE_TS_ANALYZER_PAT, date);
+
+    /* only sections contained in a single packet are parsed */
+    if (size < PSI_HEADER_SIZE ||
+        psi_get_length(section) + PSI_HEADER_SIZE > size)
+        return;
+
+    const uint8_t *program;
+    int j = 0;
+    /* cast needed because biTStream expects an uint8_t * (but doesn't write
+     * to it */
+    while ((program = pat_get_program((uint8_t *)section, j++)) != NULL) {
+        uint16_t pmt_pid = patn_get_pid(program);
+        if (!patn_get_program(program) || pmt_pid >= NULL_PID)
+            continue;
+
+        struct upipe_ts_analyzer_pid *pmt = &upipe_ts_analyzer->pids[pmt_pid];
+        if (pmt->flags & PID_PMT)
+            continue;
+        if (upipe_ts_analyzer->nb_pmts >= MAX_PMTS) {
+            upipe_warn_va(upipe, "too many PMTs, ignoring PID %"PRIu16,
+                          pmt_pid);
+            continue;
+        }
+        upipe_dbg_va(upipe, "new PMT PID %"PRIu16, pmt_pid);
+        upipe_ts_analyzer->pmts[upipe_ts_analyzer->nb_pmts++] = pmt_pid;
+        pmt->flags |= PID_PMT;
+        pmt->table_date = date;
+    }
+}
+
+/** @internal @This checks the PCR of a packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid state of the PID
+ * @param ts pointer to the packet
+ * @param discontinuity true if the discontinuity indicator is set
+ */
+static void upipe_ts_analyzer_pcr(struct upipe *upipe,
+                                  struct upipe_ts_analyzer_pid *pid,
+                                  const uint8_t *ts, bool discontinuity)
+{
+    struct upipe_ts_analyzer *upipe_ts_analyzer =
+        upipe_ts_analyzer_from_upipe(upipe);
+    uint64_t index = upipe_ts_analyzer->stats.packets;
+    uint64_t pcr = tsaf_get_pcr(ts) * 300 + tsaf_get_pcrext(ts);
+
+    if (discontinuity || !(pid->flags & PID_PCR))
+        pid->flags &= ~PID_PCR_RATE;
+    else {
+        uint64_t delta = (TS_CLOCK_MAX + pcr - pid->pcr) % TS_CLOCK_MAX;
+        if (delta > PCR_DISCONTINUITY) {
+            upipe_ts_analyzer_count(upipe, pid,
+                                    UPIPE_TS_ANALYZER_PCR_DISCONTINUITY);
+            pid->flags &= ~PID_PCR_RATE;
+        } else {
+            if (delta > PCR_INTERVAL)
+                upipe_ts_analyzer_count(upipe, pid,
+                                        UPIPE_TS_ANALYZER_PCR_REPETITION);
+            else if (pid->flags & PID_PCR_RATE) {
+                /* expected PCR at the rate of the previous interval */
+                uint64_t span = (TS_CLOCK_MAX + pid->pcr - pid->pcr_prev) %
+                                TS_CLOCK_MAX;
+                uint64_t expected = span * (index - pid->pcr_index) /
+                                    (pid->pcr_index - pid->pcr_prev_index);
+                if (delta > expected + PCR_ACCURACY ||
+                    delta + PCR_ACCURACY < expected)
+                    upipe_ts_analyzer_count(upipe, pid,
+                                            UPIPE_TS_ANALYZER_PCR_ACCURACY);
+            }
+            pid->pcr_prev = pid->pcr;
+            pid->pcr_prev_index = pid->pcr_index;
+            pid->flags |= PID_PCR_RATE;
+        }
+    }
+
+    pid->pcr = pcr;
+    pid->pcr_index = index;
+    pid->flags |= PID_PCR;
+    upipe_ts_analyzer->pcr = pcr;
+}
+
+/** @internal @This analyzes a packet whose header was already checked.
+ *
+ * @param upipe description structure of the pipe
+ * @param ts pointer to the packet
+ * @param header first four octets of the packet
+ * @param date date of the packet, or UINT64_MAX
+ */
+static inline void upipe_ts_analyzer_packet(struct upipe *upipe,
+                                            const uint8_t *ts,
+                                            uint32_t header, uint64_t date)
+{
+    struct upipe_ts_analyzer *upipe_ts_analyzer =
+        upipe_ts_analyzer_from_upipe(upipe);
+    uint16_t pid_nb = (header >> 8) & 0x1fff;
+    struct upipe_ts_analyzer_pid *pid = &upipe_ts_analyzer->pids[pid_nb];
+    pid->stats.packets++;
+
+    if (unlikely(header & 0x800000)) {
+        /* the rest of the packet is unreliable */
+        upipe_ts_analyzer_count(upipe, pid, UPIPE_TS_ANALYZER_TRANSPORT);
+        return;
+    }
+
+    bool table = pid_nb == PAT_PID || (pid->flags & PID_PMT);
+    uint8_t scrambling = (header >> 6) & 0x3;
+    if (unlikely(scrambling)) {
+        upipe_ts_analyzer_count(upipe, pid, UPIPE_TS_ANALYZER_SCRAMBLED);
+        if (table)
+            upipe_ts_analyzer_count(upipe, pid, pid_nb == PAT_PID ?
+                    UPIPE_TS_ANALYZER_PAT : UPIPE_TS_ANALYZER_PMT);
+    }
+
+    bool discontinuity = false, pcr = false;
+    if ((header & 0x20) && ts_get_adaptation(ts)) {
+        discontinuity = tsaf_has_discontinuity(ts);
+        pcr = tsaf_has_pcr(ts) &&
+            ts_get_adaptation(ts) + 1 >= TS_HEADER_SIZE_PCR - TS_HEADER_SIZE;
+    }
+
+    bool dup = false;
+    if (pid_nb != NULL_PID) {
+        uint8_t cc = header & 0xf;
+        if ((pid->flags & PID_CC) && !discontinuity) {
+            if (!(header & 0x10)) {
+                /* no payload: the counter must not change */
+                if (cc != pid->cc)
+                    upipe_ts_analyzer_count(upipe, pid, UPIPE_TS_ANALYZER_CC);
+            } else if (cc == pid->cc) {
+                /* one duplicate packet is allowed */
+                dup = true;
+                if (pid->flags & PID_DUP)
+                    upipe_ts_analyzer_count(upipe, pid, UPIPE_TS_ANALYZER_CC);
+                pid->flags |= PID_DUP;
+            } else {
+                if (cc != ((pid->cc + 1) & 0xf))
+                    upipe_ts_analyzer_count(upipe, pid, UPIPE_TS_ANALYZER_CC);
+                pid->flags &= ~PID_DUP;
+            }
+        }
+        pid->cc = cc;
+        pid->flags |= PID_CC;
+    }
+
+    /* a duplicate packet repeats the PCR of the original packet */
+    if (pcr && !dup)
+        upipe_ts_analyzer_pcr(upipe, pid, ts, discontinuity);
+
+    if (table && !scrambling && (header & 0x400000) && (header & 0x10)) {
+        /* cast needed because biTStream expects an uint8_t * (but doesn't
+         * write to it */
+        const uint8_t *payload = ts_payload((uint8_t *)ts);
+        if (payload >= ts + TS_SIZE || payload + 1 + *payload >= ts + TS_SIZE)
+            return;
+        const uint8_t *section = payload + 1 + *payload;
+        size_t size = ts + TS_SIZE - section;
+        if (pid_nb == PAT_PID)
+            upipe_ts_analyzer_pat(upipe, section, size, date);
+        else if (psi_get_tableid(section) == PMT_TABLE_ID)
+            upipe_ts_analyzer_table(upipe, pid, UPIPE_TS_ANALYZER_PMT, date);
+    }
+}
+
+/** @internal @This analyzes a batch of contiguous packets.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer pointer to the first packet
+ * @param nb number of packets, at most BATCH_SIZE
+ * @param date date of the packets, or UINT64_MAX
+ */
+static void upipe_ts_analyzer_batch(struct upipe *upipe, const uint8_t *buffer,
+                                    unsigned int nb, uint64_t date)
+{
+    struct upipe_ts_analyzer *upipe_ts_analyzer =
+        upipe_ts_analyzer_from_upipe(upipe);
+    unsigned int stride = upipe_ts_analyzer->output_size;
+    uint32_t headers[BATCH_SIZE];
+    unsigned int bad_sync = 0;
+
+    assert(nb <= BATCH_SIZE);
+    for (unsigned int i = 0; i < nb; i++) {
+        const uint8_t *ts = buffer + i * stride;
+        headers[i] = ((uint32_t)ts[0] << 24) | ((uint32_t)ts[1] << 16) |
+                     ((uint32_t)ts[2] << 8) | ts[3];
+    }
+    for (unsigned int i = 0; i < nb; i++)
+        bad_sync += (headers[i] >> 24) != TS_SYNC;
+
+    for (unsigned int i = 0; i < nb; i++) {
+        if (unlikely(bad_sync && (headers[i] >> 24) != TS_SYNC)) {
+            upipe_ts_analyzer_count(upipe, NULL,
+                                    UPIPE_TS_ANALYZER_SYNC_BYTE);
+            if (++upipe_ts_analyzer->sync_errors == 2)
+                upipe_ts_analyzer_count(upipe, NULL,
+                                        UPIPE_TS_ANALYZER_SYNC_LOSS);
+        } else {
+            upipe_ts_analyzer->sync_errors = 0;
+            upipe_ts_analyzer_packet(upipe, buffer + i * stride, headers[i],
+                                     date);
+        }
+        upipe_ts_analyzer->stats.packets++;
+    }
+}
+
+/** @internal @This checks that the PAT and PMTs are not late, and reports
+ * the counters periodically.
+ *
+ * @param upipe description structure of the pipe
+ * @param date current date
+ */
+static void upipe_ts_analyzer_check(struct upipe *upipe, uint64_t date)
+{
+    struct upipe_ts_analyzer *upipe_ts_analyzer =
+        upipe_ts_analyzer_from_upipe(upipe);
+    struct upipe_ts_analyzer_pid *pat = &upipe_ts_analyzer->pids[PAT_PID];
+
+    if (pat->table_date == UINT64_MAX)
+        pat->table_date = date;
+    else if (!(pat->flags & PID_LATE) &&
+             date > pat->table_date + TABLE_INTERVAL) {
+        upipe_ts_analyzer_count(upipe, pat, UPIPE_TS_ANALYZER_PAT);
+        pat->flags |= PID_LATE;
+    }
+
+    for (unsigned int i = 0; i < upipe_ts_analyzer->nb_pmts; i++) {
+        struct upipe_ts_analyzer_pid *pmt =
+            &upipe_ts_analyzer->pids[upipe_ts_analyzer->pmts[i]];
+        if (pmt->table_date == UINT64_MAX)
+            pmt->table_date = date;
+        else if (!(pmt->flags & PID_LATE) &&
+                 date > pmt->table_date + TABLE_INTERVAL) {
+            upipe_ts_analyzer_count(upipe, pmt, UPIPE_TS_ANALYZER_PMT);
+            pmt->flags |= PID_LATE;
+        }
+    }
+
+    if (upipe_ts_analyzer->stats_date == UINT64_MAX)
+        upipe_ts_analyzer->stats_date = date;
+    else if (date >= upipe_ts_analyzer->stats_date + STATS_INTERVAL) {
+        upipe_ts_analyzer->stats_date = date;
+        upipe_throw(upipe, UPROBE_TS_ANALYZER_STATS,
+                    UPIPE_TS_ANALYZER_SIGNATURE,
+                    (const struct upipe_ts_analyzer_stats *)
+                    &upipe_ts_analyzer->stats);
+    }
+}
+
+/** @internal @This analyzes the packets of a uref. Packets may span
+ * several urefs.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_analyzer_input(struct upipe *upipe, struct uref *uref,
+                                    struct upump **upump_p)
+{
+    struct upipe_ts_analyzer *upipe_ts_analyzer =
+        upipe_ts_analyzer_from_upipe(upipe);
+    unsigned int stride = upipe_ts_analyzer->output_size;
+    uint64_t date;
+    if (!ubase_check(uref_clock_get_cr_sys(uref, &date)))
+        date = upipe_ts_analyzer->pcr;
+
+    int offset = 0;
+    for ( ; ; ) {
+        const uint8_t *buffer;
+        int size = -1;
+        if (!ubase_check(uref_block_read(uref, offset, &size, &buffer)) ||
+            size <= 0)
+            break;
+        const uint8_t *end = buffer + size;
+        const uint8_t *p = buffer;
+
+        if (upipe_ts_analyzer->residue_size) {
+            unsigned int missing = stride - upipe_ts_analyzer->residue_size;
+            unsigned int copy = missing < size ? missing : size;
+            memcpy(upipe_ts_analyzer->residue +
+                   upipe_ts_analyzer->residue_size, p, copy);
+            upipe_ts_analyzer->residue_size += copy;
+            p += copy;
+            if (upipe_ts_analyzer->residue_size == stride) {
+                upipe_ts_analyzer_batch(upipe, upipe_ts_analyzer->residue, 1,
+                                        date);
+                upipe_ts_analyzer->residue_size = 0;
+            }
+        }
+
+        while (end - p >= stride) {
+            unsigned int nb = (end - p) / stride;
+            if (nb > BATCH_SIZE)
+                nb = BATCH_SIZE;
+            upipe_ts_analyzer_batch(upipe, p, nb, date);
+            p += nb * stride;
+        }
+
+        if (p < end) {
+            memcpy(upipe_ts_analyzer->residue, p, end - p);
+            upipe_ts_analyzer->residue_size = end - p;
+        }
+
+        uref_block_unmap(uref, offset);
+        offset += size;
+    }
+    uref_free(uref);
+
+    if (date == UINT64_MAX)
+        date = upipe_ts_analyzer->pcr;
+    if (date != UINT64_MAX)
+        upipe_ts_analyzer_check(upipe, date);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_ts_analyzer_set_flow_def(struct upipe *upipe,
+                                          struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a ts_analyzer pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ts_analyzer_control(struct upipe *upipe,
+                                     int command, va_list args)
+{
+    struct upipe_ts_analyzer *upipe_ts_analyzer =
+        upipe_ts_analyzer_from_upipe(upipe);
+
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_ts_analyzer_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_OUTPUT_SIZE: {
+            unsigned int *output_size_p = va_arg(args, unsigned int *);
+            *output_size_p = upipe_ts_analyzer->output_size;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_SET_OUTPUT_SIZE: {
+            unsigned int output_size = va_arg(args, unsigned int);
+            if (output_size < TS_SIZE || output_size > MAX_PACKET_SIZE)
+                return UBASE_ERR_INVALID;
+            upipe_ts_analyzer->output_size = output_size;
+            upipe_ts_analyzer->residue_size = 0;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_FLUSH:
+            upipe_ts_analyzer_reset(upipe);
+            return UBASE_ERR_NONE;
+
+        case UPIPE_TS_ANALYZER_GET_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_ANALYZER_SIGNATURE)
+            struct upipe_ts_analyzer_stats *stats =
+                va_arg(args, struct upipe_ts_analyzer_stats *);
+            *stats = upipe_ts_analyzer->stats;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_ANALYZER_GET_PID_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_ANALYZER_SIGNATURE)
+            unsigned int pid = va_arg(args, unsigned int);
+            struct upipe_ts_analyzer_stats *stats =
+                va_arg(args, struct upipe_ts_analyzer_stats *);
+            if (pid >= MAX_PIDS)
+                return UBASE_ERR_INVALID;
+            *stats = upipe_ts_analyzer->pids[pid].stats;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_analyzer_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+
+    upipe_ts_analyzer_clean_urefcount(upipe);
+    upipe_ts_analyzer_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_ts_analyzer_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_TS_ANALYZER_SIGNATURE,
+
+    .upipe_alloc = upipe_ts_analyzer_alloc,
+    .upipe_input = upipe_ts_analyzer_input,
+    .upipe_control = upipe_ts_analyzer_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all ts_analyzer pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_analyzer_mgr_alloc(void)
+{
+    return &upipe_ts_analyzer_mgr;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short CRC32/MPEG-2 engine for PSI sections
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_CRC_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_CRC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** size of the CRC at the end of a PSI section */
+#define UPIPE_TS_CRC_SIZE 4
+
+/** @This updates a CRC32/MPEG-2 with the contents of a buffer, using
+ * slicing-by-8 tables.
+ *
+ * @param crc current value of the CRC, UINT32_MAX for a new computation
+ * @param buf pointer to the buffer
+ * @param size size of the buffer
+ * @return updated CRC
+ */
+uint32_t upipe_ts_crc_c(uint32_t crc, const uint8_t *buf, size_t size);
+
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__)
+#define UPIPE_TS_CRC_PCLMUL 1
+/** @This updates a CRC32/MPEG-2 with the contents of a buffer, using
+ * carry-less multiplications. The CPU must support PCLMULQDQ and SSSE3.
+ *
+ * @param crc current value of the CRC, UINT32_MAX for a new computation
+ * @param buf pointer to the buffer
+ * @param size size of the buffer
+ * @return updated CRC
+ */
+uint32_t upipe_ts_crc_pclmul(uint32_t crc, const uint8_t *buf, size_t size);
+#endif
+
+/** @This computes the CRC32/MPEG-2 of a buffer, using the fastest
+ * implementation supported by the CPU.
+ *
+ * @param buf pointer to the buffer
+ * @param size size of the buffer
+ * @return CRC
+ */
+uint32_t upipe_ts_crc(const uint8_t *buf, size_t size);
+
+/** @internal @This returns the size of a PSI section, excluding the CRC.
+ *
+ * @param section pointer to the PSI section
+ * @return size of the section, or -1 if it cannot hold a CRC
+ */
+static inline int upipe_ts_psi_crc_end(const uint8_t *section)
+{
+    int length = ((section[1] & 0xf) << 8) | section[2];
+    if (length < UPIPE_TS_CRC_SIZE)
+        return -1;
+    return length + 3 - UPIPE_TS_CRC_SIZE;
+}
+
+/** @This writes the CRC at the end of a PSI section. It replaces bitstream's
+ * psi_set_crc.
+ *
+ * @param section pointer to the PSI section
+ */
+static inline void upipe_ts_psi_set_crc(uint8_t *section)
+{
+    int end = upipe_ts_psi_crc_end(section);
+    if (end < 0)
+        return;
+    uint32_t crc = upipe_ts_crc(section, end);
+    section[end] = crc >> 24;
+    section[end + 1] = crc >> 16;
+    section[end + 2] = crc >> 8;
+    section[end + 3] = crc;
+}
+
+/** @This checks the CRC at the end of a PSI section. It replaces bitstream's
+ * psi_check_crc.
+ *
+ * @param section pointer to the PSI section
+ * @return false if the CRC is invalid
+ */
+static inline bool upipe_ts_psi_check_crc(const uint8_t *section)
+{
+    int end = upipe_ts_psi_crc_end(section);
+    if (end < 0)
+        return false;
+    uint32_t crc = upipe_ts_crc(section, end);
+    return section[end] == (uint8_t)(crc >> 24) &&
+           section[end + 1] == (uint8_t)(crc >> 16) &&
+           section[end + 2] == (uint8_t)(crc >> 8) &&
+           section[end + 3] == (uint8_t)crc;
+}
+
+#endif
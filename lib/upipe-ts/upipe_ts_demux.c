@@ -68,6 +68,9 @@
 #include <upipe-modules/upipe_idem.h>
 #include <upipe-modules/upipe_setflowdef.h>
 #include <upipe-modules/upipe_probe_uref.h>
+#include <upipe-modules/upipe_queue_sink.h>
+#include <upipe-modules/upipe_queue_source.h>
+#include <upipe-modules/upipe_worker_linear.h>
 #include <upipe-ts/uref_ts_flow.h>
 #include <upipe-ts/uref_ts_event.h>
 #include <upipe-ts/upipe_ts_demux.h>
@@ -179,6 +182,8 @@ UBASE_FROM_TO(upipe_ts_demux_mgr, urefcount, urefcount, urefcount)
 
 /** @hidden */
 struct upipe_ts_demux_psi_pid;
+/** @hidden */
+struct upipe_ts_demux_worker;
 
 /** @internal @This is the private context of a ts_demux pipe. */
 struct upipe_ts_demux {
@@ -277,6 +282,8 @@ struct upipe_ts_demux {
 
     /** list of programs */
     struct uchain programs;
+    /** list of workers running program framers */
+    struct uchain workers;
 
     /** manager to create programs */
     struct upipe_mgr program_mgr;
@@ -324,6 +331,8 @@ struct upipe_ts_demux_program {
     struct uref *flow_def_input;
     /** program number */
     uint64_t program;
+    /** worker running the framers of the program, or NULL */
+    struct upipe_ts_demux_worker *worker;
     /** psi_pid structure for PMT */
     struct upipe_ts_demux_psi_pid *psi_pid_pmt;
     /** ts_psi_split_output inner pipe */
@@ -612,6 +621,122 @@ static void
 }
 
 
+/*
+ * worker structure handling
+ */
+
+/** @internal @This is the context of a worker thread of a ts_demux pipe. */
+struct upipe_ts_demux_worker {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** manager to transfer framers to the worker thread */
+    struct upipe_mgr *wlin_mgr;
+    /** probe hierarchy to use on the worker thread */
+    struct uprobe *uprobe_remote;
+    /** number of packets in the queue to the worker thread */
+    unsigned int input_queue_length;
+    /** number of packets in the queue from the worker thread */
+    unsigned int output_queue_length;
+    /** number of programs bound to the worker */
+    unsigned int nb_programs;
+};
+
+UBASE_FROM_TO(upipe_ts_demux_worker, uchain, uchain, uchain)
+
+/** @internal @This adds a worker to the list of workers.
+ *
+ * @param upipe description structure of the pipe
+ * @param wlin_mgr manager of upipe_wlin pipes
+ * @param uprobe_remote probe hierarchy to use on the worker thread
+ * (belongs to the callee)
+ * @param input_queue_length length of the queue to the worker thread
+ * @param output_queue_length length of the queue from the worker thread
+ * @return an error code
+ */
+static int _upipe_ts_demux_add_worker(struct upipe *upipe,
+                                      struct upipe_mgr *wlin_mgr,
+                                      struct uprobe *uprobe_remote,
+                                      unsigned int input_queue_length,
+                                      unsigned int output_queue_length)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    if (unlikely(wlin_mgr == NULL || !input_queue_length ||
+                 !output_queue_length)) {
+        uprobe_release(uprobe_remote);
+        return UBASE_ERR_INVALID;
+    }
+
+    struct upipe_ts_demux_worker *worker =
+        malloc(sizeof(struct upipe_ts_demux_worker));
+    if (unlikely(worker == NULL)) {
+        uprobe_release(uprobe_remote);
+        return UBASE_ERR_ALLOC;
+    }
+    worker->wlin_mgr = upipe_mgr_use(wlin_mgr);
+    worker->uprobe_remote = uprobe_remote;
+    worker->input_queue_length = input_queue_length;
+    worker->output_queue_length = output_queue_length;
+    worker->nb_programs = 0;
+    uchain_init(upipe_ts_demux_worker_to_uchain(worker));
+    ulist_add(&upipe_ts_demux->workers,
+              upipe_ts_demux_worker_to_uchain(worker));
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This binds a new program to the worker running the fewest
+ * programs.
+ *
+ * @param upipe description structure of the pipe
+ * @return pointer to the worker, or NULL if no worker was added
+ */
+static struct upipe_ts_demux_worker *
+    upipe_ts_demux_worker_bind(struct upipe *upipe)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    struct upipe_ts_demux_worker *selected = NULL;
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_demux->workers, uchain) {
+        struct upipe_ts_demux_worker *worker =
+            upipe_ts_demux_worker_from_uchain(uchain);
+        if (selected == NULL || worker->nb_programs < selected->nb_programs)
+            selected = worker;
+    }
+    if (selected != NULL)
+        selected->nb_programs++;
+    return selected;
+}
+
+/** @internal @This unbinds a program from its worker.
+ *
+ * @param worker worker structure, or NULL
+ */
+static void upipe_ts_demux_worker_unbind(struct upipe_ts_demux_worker *worker)
+{
+    if (worker != NULL) {
+        assert(worker->nb_programs);
+        worker->nb_programs--;
+    }
+}
+
+/** @internal @This frees all workers.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_demux_clean_workers(struct upipe *upipe)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&upipe_ts_demux->workers, uchain, uchain_tmp) {
+        struct upipe_ts_demux_worker *worker =
+            upipe_ts_demux_worker_from_uchain(uchain);
+        ulist_delete(uchain);
+        upipe_mgr_release(worker->wlin_mgr);
+        uprobe_release(worker->uprobe_remote);
+        free(worker);
+    }
+}
+
+
 /*
  * upipe_ts_demux_output structure handling (derived from upipe structure)
  */
@@ -700,6 +825,46 @@ static int upipe_ts_demux_output_clock_ts(struct upipe *upipe,
     return upipe_throw(upipe, event, uref);
 }
 
+/** @internal @This allocates the framer of an output on the thread of a
+ * worker. Only the framer is moved, as the clock references and timestamps
+ * thrown by ts_decaps and ts_pesd update the program and must be handled in
+ * the thread of the demux.
+ *
+ * @param upipe description structure of the pipe
+ * @param inner pointer to the inner pipe to link the framer to
+ * @param autof_mgr manager of the framer
+ * @param worker worker structure
+ * @return an error code
+ */
+static int upipe_ts_demux_output_alloc_worker(struct upipe *upipe,
+        struct upipe *inner, struct upipe_mgr *autof_mgr,
+        struct upipe_ts_demux_worker *worker)
+{
+    struct upipe_ts_demux_output *upipe_ts_demux_output =
+        upipe_ts_demux_output_from_upipe(upipe);
+    struct upipe *autof = upipe_void_alloc(autof_mgr,
+            uprobe_pfx_alloc_va(uprobe_use(worker->uprobe_remote),
+                                UPROBE_LOG_VERBOSE, "autof %"PRIu64,
+                                upipe_ts_demux_output->pid));
+    UBASE_ALLOC_RETURN(autof);
+
+    struct upipe *wlin = upipe_wlin_alloc(worker->wlin_mgr,
+            uprobe_pfx_alloc(
+                uprobe_use(&upipe_ts_demux_output->last_inner_probe),
+                UPROBE_LOG_VERBOSE, "wlin"),
+            autof, uprobe_use(worker->uprobe_remote),
+            worker->input_queue_length, worker->output_queue_length);
+    UBASE_ALLOC_RETURN(wlin);
+
+    int err = upipe_set_output(inner, wlin);
+    if (unlikely(!ubase_check(err))) {
+        upipe_release(wlin);
+        return err;
+    }
+    upipe_ts_demux_output_store_bin_output(upipe, wlin);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This catches need_output events coming from output inner pipes.
  *
  * @param upipe description structure of the pipe
@@ -780,6 +945,10 @@ static int upipe_ts_demux_output_plumber(struct upipe *upipe,
         upipe_release(inner);
     }
 
+    if (program->worker != NULL)
+        return upipe_ts_demux_output_alloc_worker(upipe, inner,
+                ts_demux_mgr->autof_mgr, program->worker);
+
     if (ts_demux_mgr->autof_mgr != NULL) {
         /* allocate autof inner */
         struct upipe *output =
@@ -1779,6 +1948,13 @@ static struct upipe *upipe_ts_demux_program_alloc(struct upipe_mgr *mgr,
     upipe_throw_ready(upipe);
 
     struct upipe_ts_demux *demux = upipe_ts_demux_from_program_mgr(upipe->mgr);
+    struct upipe_ts_demux_mgr *ts_demux_mgr =
+        upipe_ts_demux_mgr_from_upipe_mgr(upipe_ts_demux_to_upipe(demux)->mgr);
+    /* only framers are moved to workers */
+    upipe_ts_demux_program->worker = NULL;
+    if (ts_demux_mgr->autof_mgr != NULL)
+        upipe_ts_demux_program->worker =
+            upipe_ts_demux_worker_bind(upipe_ts_demux_to_upipe(demux));
     const uint8_t *filter, *mask;
     size_t size;
     const char *def;
@@ -1837,8 +2013,6 @@ static struct upipe *upipe_ts_demux_program_alloc(struct upipe_mgr *mgr,
         return upipe;
     }
 
-    struct upipe_ts_demux_mgr *ts_demux_mgr =
-        upipe_ts_demux_mgr_from_upipe_mgr(upipe_ts_demux_to_upipe(demux)->mgr);
     upipe_ts_demux_program->pmtd =
         upipe_void_alloc_output(upipe_ts_demux_program->setflowdef,
                 ts_demux_mgr->ts_pmtd_mgr,
@@ -1858,6 +2032,45 @@ static struct upipe *upipe_ts_demux_program_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This returns the number of urefs of a program waiting in the
+ * queues of its worker.
+ *
+ * @param upipe description structure of the pipe
+ * @param input_p filled in with the number of urefs not yet framed
+ * @param output_p filled in with the number of framed urefs not yet output
+ * @return an error code
+ */
+static int _upipe_ts_demux_program_get_queue_lengths(struct upipe *upipe,
+                                                     unsigned int *input_p,
+                                                     unsigned int *output_p)
+{
+    struct upipe_ts_demux_program *upipe_ts_demux_program =
+        upipe_ts_demux_program_from_upipe(upipe);
+    if (upipe_ts_demux_program->worker == NULL)
+        return UBASE_ERR_INVALID;
+
+    unsigned int input = 0, output = 0;
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_demux_program->outputs, uchain) {
+        struct upipe_ts_demux_output *upipe_ts_demux_output =
+            upipe_ts_demux_output_from_uchain(uchain);
+        struct upipe *wlin = upipe_ts_demux_output->last_inner;
+        unsigned int length;
+        if (wlin == NULL)
+            continue;
+        if (ubase_check(upipe_qsink_get_length(wlin, &length)))
+            input += length;
+        if (ubase_check(upipe_qsrc_get_length(wlin, &length)))
+            output += length;
+    }
+
+    if (input_p != NULL)
+        *input_p = input;
+    if (output_p != NULL)
+        *output_p = output;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a ts_demux_program pipe.
  *
  * @param upipe description structure of the pipe
@@ -1901,6 +2114,14 @@ static int upipe_ts_demux_program_control(struct upipe *upipe,
             return (*p != NULL) ? UBASE_ERR_NONE : UBASE_ERR_UNHANDLED;
         }
 
+        case UPIPE_TS_DEMUX_PROGRAM_GET_QUEUE_LENGTHS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_PROGRAM_SIGNATURE)
+            unsigned int *input_p = va_arg(args, unsigned int *);
+            unsigned int *output_p = va_arg(args, unsigned int *);
+            return _upipe_ts_demux_program_get_queue_lengths(upipe, input_p,
+                                                             output_p);
+        }
+
         default:
             return UBASE_ERR_NONE;
     }
@@ -1974,6 +2195,8 @@ static void upipe_ts_demux_program_no_input(struct upipe *upipe)
 
     if (upipe_ts_demux_program->pcr_split_output != NULL)
         upipe_release(upipe_ts_demux_program->pcr_split_output);
+    upipe_ts_demux_worker_unbind(upipe_ts_demux_program->worker);
+    upipe_ts_demux_program->worker = NULL;
     upipe_ts_demux_program_clean_output(upipe);
     upipe_ts_demux_program_clean_sub(upipe);
     urefcount_release(upipe_ts_demux_program_to_urefcount_real(upipe_ts_demux_program));
@@ -2783,6 +3006,7 @@ static struct upipe *upipe_ts_demux_alloc(struct upipe_mgr *mgr,
     ulist_init(&upipe_ts_demux->pat_programs);
 
     ulist_init(&upipe_ts_demux->psi_pids);
+    ulist_init(&upipe_ts_demux->workers);
     upipe_ts_demux->conformance = UPIPE_TS_CONFORMANCE_DVB_NO_TABLES;
     upipe_ts_demux->auto_conformance = true;
     upipe_ts_demux->nit_pid = 0;
@@ -3056,6 +3280,16 @@ static int upipe_ts_demux_control(struct upipe *upipe,
                 va_arg(args, enum upipe_ts_conformance);
             return _upipe_ts_demux_set_conformance(upipe, conformance);
         }
+        case UPIPE_TS_DEMUX_ADD_WORKER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct upipe_mgr *wlin_mgr = va_arg(args, struct upipe_mgr *);
+            struct uprobe *uprobe_remote = va_arg(args, struct uprobe *);
+            unsigned int input_queue_length = va_arg(args, unsigned int);
+            unsigned int output_queue_length = va_arg(args, unsigned int);
+            return _upipe_ts_demux_add_worker(upipe, wlin_mgr, uprobe_remote,
+                                              input_queue_length,
+                                              output_queue_length);
+        }
 
         default:
             break;
@@ -3083,6 +3317,7 @@ static void upipe_ts_demux_free(struct urefcount *urefcount_real)
     uprobe_clean(&upipe_ts_demux->split_probe);
     uref_free(upipe_ts_demux->flow_def_input);
     upipe_ts_demux_clean_sub_programs(upipe);
+    upipe_ts_demux_clean_workers(upipe);
     upipe_ts_demux_clean_sync(upipe);
     upipe_ts_demux_clean_uref_mgr(upipe);
     urefcount_clean(urefcount_real);
@@ -43,9 +43,11 @@
 #include <upipe/upipe_helper_flow_def.h>
 #include <upipe/upipe_helper_iconv.h>
 #include <upipe-ts/upipe_ts_eit_decoder.h>
+#include <upipe-ts/upipe_ts_epg.h>
 #include <upipe-ts/uref_ts_event.h>
 #include <upipe-ts/uref_ts_flow.h>
 #include "upipe_ts_psi_decoder.h"
+#include "upipe_ts_crc.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -94,6 +96,18 @@ struct upipe_ts_eitd {
     UPIPE_TS_PSID_TABLE_DECLARE(eit);
     /** EIT table being gathered */
     UPIPE_TS_PSID_TABLE_DECLARE(next_eit);
+    /** number of sections of the EIT table being gathered */
+    unsigned int nb_next_eit;
+    /** original network ID of the EIT table being gathered */
+    uint16_t next_onid;
+    /** transport stream ID of the EIT table being gathered */
+    uint16_t next_tsid;
+    /** number of unchanged sections skipped */
+    uint64_t skipped;
+    /** store of events, updated section by section */
+    struct upipe_ts_epg *epg;
+    /** true if the events are also exported as flow definition attributes */
+    bool event_attrs;
 
     /** encoding of the following iconv handle */
     const char *current_encoding;
@@ -138,9 +152,16 @@ static struct upipe *upipe_ts_eitd_alloc(struct upipe_mgr *mgr,
     upipe_ts_eitd_init_ubuf_mgr(upipe);
     upipe_ts_eitd_init_flow_def(upipe);
     upipe_ts_eitd_init_iconv(upipe);
-    upipe_ts_psid_table_init(upipe_ts_eitd->eit);
-    upipe_ts_psid_table_init(upipe_ts_eitd->next_eit);
+    upipe_ts_psid_table_init(upipe_ts_eitd->eit, NULL);
+    upipe_ts_psid_table_init(upipe_ts_eitd->next_eit,
+                             &upipe_ts_eitd->nb_next_eit);
+    upipe_ts_eitd->skipped = 0;
+    upipe_ts_eitd->epg = upipe_ts_epg_alloc();
+    upipe_ts_eitd->next_onid = upipe_ts_eitd->next_tsid = 0;
+    upipe_ts_eitd->event_attrs = true;
     upipe_throw_ready(upipe);
+    if (unlikely(upipe_ts_eitd->epg == NULL))
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
     return upipe;
 }
 
@@ -148,10 +169,12 @@ static struct upipe *upipe_ts_eitd_alloc(struct upipe_mgr *mgr,
  * @ref upipe_ts_psid_table_section because the EIT may contain holes.
  *
  * @param sections PSI table
+ * @param nb_p pointer to the number of sections of the table
  * @param uref new section
  * @return true if the table is complete
  */
 static inline bool upipe_ts_eitd_table_section(struct uref **sections,
+                                               unsigned int *nb_p,
                                                struct uref *uref)
 {
     uint8_t buffer[EIT_HEADER_SIZE];
@@ -168,6 +191,8 @@ static inline bool upipe_ts_eitd_table_section(struct uref **sections,
     int err = uref_block_peek_unmap(uref, 0, buffer, section_header);
     ubase_assert(err);
 
+    if (sections[section] == NULL)
+        (*nb_p)++;
     uref_free(sections[section]);
     sections[section] = uref;
 
@@ -205,6 +230,8 @@ static inline bool upipe_ts_eitd_table_section(struct uref **sections,
 
     /* free spurious, invalid sections */
     for ( ; i < PSI_TABLE_MAX_SECTIONS; i++) {
+        if (sections[i] != NULL)
+            (*nb_p)--;
         uref_free(sections[i]);
         sections[i] = NULL;
     }
@@ -232,7 +259,7 @@ static bool upipe_ts_eitd_table_validate(struct upipe *upipe)
                                                   &section))))
             return false;
 
-        if (!eit_validate(section)) {
+        if (!eit_validate(section) || !upipe_ts_psi_check_crc(section)) {
             uref_block_unmap(section_uref, 0);
             return false;
         }
@@ -319,6 +346,87 @@ static void upipe_ts_eitd_parse_descs(struct upipe *upipe,
     }
 }
 
+/** @internal @This updates the store of events with a new section, and
+ * throws the resulting changes. The section is only applied if its CRC is
+ * valid, and if it belongs to the same network and transport stream as the
+ * other sections of the table being gathered.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ */
+static void upipe_ts_eitd_update_epg(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_ts_eitd *upipe_ts_eitd = upipe_ts_eitd_from_upipe(upipe);
+    if (unlikely(upipe_ts_eitd->epg == NULL))
+        return;
+
+    size_t total_size;
+    const uint8_t *section;
+    int size = -1;
+    if (unlikely(!ubase_check(uref_block_size(uref, &total_size)) ||
+                 !ubase_check(uref_block_read(uref, 0, &size, &section))))
+        return;
+
+    uint8_t *buffer = NULL;
+    if ((size_t)size != total_size) {
+        /* The section is segmented, linearize it. */
+        uref_block_unmap(uref, 0);
+        buffer = malloc(total_size);
+        if (unlikely(buffer == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        if (unlikely(!ubase_check(uref_block_extract(uref, 0, total_size,
+                                                     buffer)))) {
+            free(buffer);
+            return;
+        }
+        section = buffer;
+    }
+
+    bool valid = eit_validate(section) && upipe_ts_psi_check_crc(section);
+    if (valid) {
+        uint16_t onid = eit_get_onid(section);
+        uint16_t tsid = eit_get_tsid(section);
+        uint8_t number = psi_get_section(section);
+        if (upipe_ts_eitd->nb_next_eit > 1 ||
+            (upipe_ts_eitd->nb_next_eit == 1 &&
+             upipe_ts_eitd->next_eit[number] == NULL)) {
+            if (onid != upipe_ts_eitd->next_onid ||
+                tsid != upipe_ts_eitd->next_tsid) {
+                upipe_warn(upipe, "inconsistent EIT section received");
+                valid = false;
+            }
+        } else {
+            upipe_ts_eitd->next_onid = onid;
+            upipe_ts_eitd->next_tsid = tsid;
+        }
+    }
+
+    if (!valid || !psi_get_current(section)) {
+        if (buffer != NULL)
+            free(buffer);
+        else
+            uref_block_unmap(uref, 0);
+        return;
+    }
+
+    struct upipe_ts_epg_change change;
+    upipe_ts_epg_change_init(&change);
+    int err = upipe_ts_epg_section(upipe_ts_eitd->epg, section, &change);
+    if (buffer != NULL)
+        free(buffer);
+    else
+        uref_block_unmap(uref, 0);
+
+    if (!upipe_ts_epg_change_empty(&change))
+        upipe_throw(upipe, UPROBE_TS_EITD_EPG_CHANGE, UPIPE_TS_EITD_SIGNATURE,
+                    upipe_ts_eitd->epg, &change);
+    upipe_ts_epg_change_clean(&change);
+    if (unlikely(!ubase_check(err)))
+        upipe_throw_fatal(upipe, err);
+}
+
 /** @internal @This parses a new PSI section.
  *
  * @param upipe description structure of the pipe
@@ -331,15 +439,29 @@ static void upipe_ts_eitd_input(struct upipe *upipe, struct uref *uref,
     struct upipe_ts_eitd *upipe_ts_eitd = upipe_ts_eitd_from_upipe(upipe);
     assert(upipe_ts_eitd->flow_def_input != NULL);
 
-    if (!upipe_ts_eitd_table_section(upipe_ts_eitd->next_eit, uref))
+    if (upipe_ts_psid_table_skip(upipe_ts_eitd->eit,
+                                 upipe_ts_eitd->next_eit,
+                                 &upipe_ts_eitd->nb_next_eit, uref, NULL)) {
+        /* Identical section. */
+        upipe_ts_eitd->skipped++;
+        uref_free(uref);
+        return;
+    }
+
+    upipe_ts_eitd_update_epg(upipe, uref);
+
+    if (!upipe_ts_eitd_table_section(upipe_ts_eitd->next_eit,
+                                     &upipe_ts_eitd->nb_next_eit, uref))
         return;
 
     if (upipe_ts_psid_table_validate(upipe_ts_eitd->eit) &&
         upipe_ts_psid_table_compare(upipe_ts_eitd->eit,
                                     upipe_ts_eitd->next_eit)) {
         /* Identical EIT. */
-        upipe_ts_psid_table_clean(upipe_ts_eitd->next_eit);
-        upipe_ts_psid_table_init(upipe_ts_eitd->next_eit);
+        upipe_ts_psid_table_clean(upipe_ts_eitd->next_eit,
+                                  &upipe_ts_eitd->nb_next_eit);
+        upipe_ts_psid_table_init(upipe_ts_eitd->next_eit,
+                                 &upipe_ts_eitd->nb_next_eit);
         return;
     }
 
@@ -347,8 +469,10 @@ static void upipe_ts_eitd_input(struct upipe *upipe, struct uref *uref,
                                                upipe_ts_eitd->ubuf_mgr)) ||
         !upipe_ts_eitd_table_validate(upipe)) {
         upipe_warn(upipe, "invalid EIT section received");
-        upipe_ts_psid_table_clean(upipe_ts_eitd->next_eit);
-        upipe_ts_psid_table_init(upipe_ts_eitd->next_eit);
+        upipe_ts_psid_table_clean(upipe_ts_eitd->next_eit,
+                                  &upipe_ts_eitd->nb_next_eit);
+        upipe_ts_psid_table_init(upipe_ts_eitd->next_eit,
+                                 &upipe_ts_eitd->nb_next_eit);
         return;
     }
 
@@ -385,6 +509,11 @@ static void upipe_ts_eitd_input(struct upipe *upipe, struct uref *uref,
                                                               last_tid))
         }
 
+        if (!upipe_ts_eitd->event_attrs) {
+            uref_block_unmap(section_uref, 0);
+            break;
+        }
+
         const uint8_t *eit_event;
         int j = 0;
         while ((eit_event = eit_get_event((uint8_t *)section, j)) != NULL) {
@@ -415,13 +544,15 @@ static void upipe_ts_eitd_input(struct upipe *upipe, struct uref *uref,
         uref_block_unmap(section_uref, 0);
     }
 
-    UBASE_FATAL(upipe, uref_event_set_events(flow_def, event))
+    if (upipe_ts_eitd->event_attrs)
+        UBASE_FATAL(upipe, uref_event_set_events(flow_def, event))
 
     /* Switch tables. */
     if (upipe_ts_psid_table_validate(upipe_ts_eitd->eit))
-        upipe_ts_psid_table_clean(upipe_ts_eitd->eit);
+        upipe_ts_psid_table_clean(upipe_ts_eitd->eit, NULL);
     upipe_ts_psid_table_copy(upipe_ts_eitd->eit, upipe_ts_eitd->next_eit);
-    upipe_ts_psid_table_init(upipe_ts_eitd->next_eit);
+    upipe_ts_psid_table_init(upipe_ts_eitd->next_eit,
+                             &upipe_ts_eitd->nb_next_eit);
 
     flow_def = upipe_ts_eitd_store_flow_def_attr(upipe, flow_def);
     if (unlikely(flow_def == NULL)) {
@@ -490,6 +621,29 @@ static int upipe_ts_eitd_control(struct upipe *upipe, int command, va_list args)
             struct uref *flow_def = va_arg(args, struct uref *);
             return upipe_ts_eitd_set_flow_def(upipe, flow_def);
         }
+        case UPIPE_TS_EITD_GET_SKIPPED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_EITD_SIGNATURE)
+            uint64_t *p = va_arg(args, uint64_t *);
+            *p = upipe_ts_eitd_from_upipe(upipe)->skipped;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_EITD_GET_EPG: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_EITD_SIGNATURE)
+            struct upipe_ts_epg **p = va_arg(args, struct upipe_ts_epg **);
+            *p = upipe_ts_eitd_from_upipe(upipe)->epg;
+            return *p != NULL ? UBASE_ERR_NONE : UBASE_ERR_INVALID;
+        }
+        case UPIPE_TS_EITD_GET_EVENT_ATTRS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_EITD_SIGNATURE)
+            int *p = va_arg(args, int *);
+            *p = upipe_ts_eitd_from_upipe(upipe)->event_attrs;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_EITD_SET_EVENT_ATTRS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_EITD_SIGNATURE)
+            upipe_ts_eitd_from_upipe(upipe)->event_attrs = !!va_arg(args, int);
+            return UBASE_ERR_NONE;
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
@@ -505,8 +659,10 @@ static void upipe_ts_eitd_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     struct upipe_ts_eitd *upipe_ts_eitd = upipe_ts_eitd_from_upipe(upipe);
-    upipe_ts_psid_table_clean(upipe_ts_eitd->eit);
-    upipe_ts_psid_table_clean(upipe_ts_eitd->next_eit);
+    upipe_ts_psid_table_clean(upipe_ts_eitd->eit, NULL);
+    upipe_ts_psid_table_clean(upipe_ts_eitd->next_eit,
+                              &upipe_ts_eitd->nb_next_eit);
+    upipe_ts_epg_release(upipe_ts_eitd->epg);
     upipe_ts_eitd_clean_output(upipe);
     upipe_ts_eitd_clean_ubuf_mgr(upipe);
     upipe_ts_eitd_clean_flow_def(upipe);
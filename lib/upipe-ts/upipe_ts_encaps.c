@@ -1080,18 +1080,17 @@ static int upipe_ts_encaps_promote_au(struct upipe *upipe)
     return UBASE_ERR_NONE;
 }
 
-/** @internal @This builds a TS header.
+/** @internal @This returns the size of the TS header of a packet.
  *
  * @param upipe description structure of the pipe
  * @param payload_size available size of the payload
- * @param start true if it's the first packet of the access unit
  * @param pcr_prog value of the PCR field, in 27 MHz units, or UINT64_MAX
  * @param random true if the packet is a random access point
  * @param discontinuity true if the packet must have the discontinuity flag
- * @return allocated TS header
+ * @return size of the TS header, including the adaptation field
  */
-static struct ubuf *upipe_ts_encaps_build_ts(struct upipe *upipe,
-                                             size_t payload_size, bool start,
+static size_t upipe_ts_encaps_ts_header_size(struct upipe *upipe,
+                                             size_t payload_size,
                                              uint64_t pcr_prog, bool random,
                                              bool discontinuity)
 {
@@ -1106,23 +1105,32 @@ static struct ubuf *upipe_ts_encaps_build_ts(struct upipe *upipe,
 
     if (!encaps->psi && payload_size < TS_SIZE - header_size)
         header_size = TS_SIZE - payload_size;
+    return header_size;
+}
 
+/** @internal @This writes a TS header into a buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer pointer to a buffer of at least header_size octets
+ * @param header_size size of the TS header
+ * @param payload_size available size of the payload
+ * @param start true if it's the first packet of the access unit
+ * @param pcr_prog value of the PCR field, in 27 MHz units, or UINT64_MAX
+ * @param random true if the packet is a random access point
+ * @param discontinuity true if the packet must have the discontinuity flag
+ */
+static void upipe_ts_encaps_write_ts(struct upipe *upipe, uint8_t *buffer,
+                                     size_t header_size, size_t payload_size,
+                                     bool start, uint64_t pcr_prog,
+                                     bool random, bool discontinuity)
+{
+    struct upipe_ts_encaps *encaps = upipe_ts_encaps_from_upipe(upipe);
 #ifdef VERBOSE_HEADERS
     upipe_verbose_va(upipe, "preparing TS header (size %zu%s%s%s%s)",
             header_size, start ? ", start" : "", random ? ", random" : "",
             discontinuity ? ", disc" : "",
             pcr_prog != UINT64_MAX ? ", pcr" : "");
 #endif
-    struct ubuf *ubuf = ubuf_block_alloc(encaps->ubuf_mgr, header_size);
-    uint8_t *buffer;
-    int size = -1;
-    if (unlikely(ubuf == NULL ||
-                 !ubase_check(ubuf_block_write(ubuf, 0, &size, &buffer)))) {
-        ubuf_free(ubuf);
-        return NULL;
-    }
-    assert(size == header_size);
-
     ts_init(buffer);
     ts_set_pid(buffer, encaps->pid);
     if (payload_size) {
@@ -1146,77 +1154,120 @@ static struct ubuf *upipe_ts_encaps_build_ts(struct upipe *upipe,
             tsaf_set_pcrext(buffer, pcr_prog % SCALE_33);
         }
     }
+}
 
+/** @internal @This builds a TS header.
+ *
+ * @param upipe description structure of the pipe
+ * @param header_size size of the TS header
+ * @param payload_size available size of the payload
+ * @param start true if it's the first packet of the access unit
+ * @param pcr_prog value of the PCR field, in 27 MHz units, or UINT64_MAX
+ * @param random true if the packet is a random access point
+ * @param discontinuity true if the packet must have the discontinuity flag
+ * @return allocated TS header
+ */
+static struct ubuf *upipe_ts_encaps_build_ts(struct upipe *upipe,
+                                             size_t header_size,
+                                             size_t payload_size, bool start,
+                                             uint64_t pcr_prog, bool random,
+                                             bool discontinuity)
+{
+    struct upipe_ts_encaps *encaps = upipe_ts_encaps_from_upipe(upipe);
+    struct ubuf *ubuf = ubuf_block_alloc(encaps->ubuf_mgr, header_size);
+    uint8_t *buffer;
+    int size = -1;
+    if (unlikely(ubuf == NULL ||
+                 !ubase_check(ubuf_block_write(ubuf, 0, &size, &buffer)))) {
+        ubuf_free(ubuf);
+        return NULL;
+    }
+    assert(size == header_size);
+
+    upipe_ts_encaps_write_ts(upipe, buffer, header_size, payload_size, start,
+                             pcr_prog, random, discontinuity);
     ubuf_block_unmap(ubuf, 0);
     return ubuf;
 }
 
-/** @internal @This splices the input uref and appends to the given ubuf to
- * build a complete TS packet. For PSI sections it may also append padding.
+/** @internal @This splices the input uref and appends to the given ubuf, or
+ * copies to the given buffer, to build a complete TS packet. For PSI sections
+ * it may also append padding.
  *
  * @param upipe description structure of the pipe
- * @param ubuf_p appended with the payload of the packet
+ * @param buffer TS_SIZE octets buffer to write into, or NULL
+ * @param ubuf_p appended with the payload of the packet, if buffer is NULL
+ * @param header_size size of the TS header already written
  * @param dts_sys_p filled in with the DTS, or UINT64_MAX
  * @return an error code
  */
-static int upipe_ts_encaps_complete(struct upipe *upipe, struct ubuf **ubuf_p,
+static int upipe_ts_encaps_complete(struct upipe *upipe, uint8_t *buffer,
+                                    struct ubuf **ubuf_p, size_t header_size,
                                     uint64_t *dts_sys_p)
 {
     struct upipe_ts_encaps *encaps = upipe_ts_encaps_from_upipe(upipe);
     encaps->need_status = true;
     *dts_sys_p = UINT64_MAX;
 
-    size_t ubuf_size;
-    UBASE_RETURN(ubuf_block_size(*ubuf_p, &ubuf_size));
+    size_t ubuf_size = header_size;
     assert(ubuf_size < TS_SIZE);
 
     for ( ; ; ) {
         size_t uref_size = encaps->uref_size;
-        uint64_t header_size = 0;
-        uref_attr_get_priv(encaps->uref, &header_size);
+        uint64_t pes_header_size = 0;
+        uref_attr_get_priv(encaps->uref, &pes_header_size);
 
         uint64_t dts_sys = UINT64_MAX;
         uref_clock_get_dts_sys(encaps->uref, &dts_sys);
 
         if (dts_sys != UINT64_MAX && *dts_sys_p == UINT64_MAX)
             *dts_sys_p = dts_sys -
-                (uint64_t)(uref_size - header_size) * UCLOCK_FREQ /
+                (uint64_t)(uref_size - pes_header_size) * UCLOCK_FREQ /
                 encaps->tb_rate;
 
-        struct ubuf *payload = uref_detach_ubuf(encaps->uref);
-        if (uref_size >= TS_SIZE - ubuf_size) {
-            size_t payload_size = TS_SIZE - ubuf_size;
-            assert(payload_size);
-            uref_attach_ubuf(encaps->uref,
-                             ubuf_block_split(payload, payload_size));
-            encaps->uref_size -= payload_size;
-            encaps->au_size -= payload_size;
-            if (payload_size >= header_size)
-                uref_attr_set_priv(encaps->uref, 0);
-            else
-                uref_attr_set_priv(encaps->uref, header_size - payload_size);
-            encaps->tb_buffer -= payload_size;
+        size_t payload_size = uref_size;
+        if (payload_size > TS_SIZE - ubuf_size)
+            payload_size = TS_SIZE - ubuf_size;
+
+        if (buffer != NULL) {
+            /* copy the payload and skip it in the uref, without allocating */
+            if (unlikely(!ubase_check(uref_block_extract(encaps->uref, 0,
+                                payload_size, buffer + ubuf_size)) ||
+                         (payload_size < uref_size &&
+                          !ubase_check(uref_block_resize(encaps->uref,
+                                  payload_size, -1)))))
+                return UBASE_ERR_INVALID;
         } else {
-            encaps->tb_buffer -= uref_size;
-            encaps->au_size -= uref_size;
-        }
-
-        if (unlikely(payload == NULL ||
-                     !ubase_check(ubuf_block_append(*ubuf_p, payload)))) {
-            ubuf_free(payload);
-            ubuf_free(*ubuf_p);
-            return UBASE_ERR_ALLOC;
+            struct ubuf *payload = uref_detach_ubuf(encaps->uref);
+            if (payload_size < uref_size)
+                uref_attach_ubuf(encaps->uref,
+                                 ubuf_block_split(payload, payload_size));
+            if (unlikely(payload == NULL ||
+                         !ubase_check(ubuf_block_append(*ubuf_p, payload)))) {
+                ubuf_free(payload);
+                ubuf_free(*ubuf_p);
+                return UBASE_ERR_ALLOC;
+            }
         }
 
-        if (uref_size <= TS_SIZE - ubuf_size)
-            upipe_ts_encaps_consume_uref(upipe);
+        encaps->tb_buffer -= payload_size;
+        encaps->au_size -= payload_size;
+        ubuf_size += payload_size;
 
-        if (uref_size >= TS_SIZE - ubuf_size) {
-            ubuf_size = TS_SIZE;
+        if (payload_size < uref_size) {
+            encaps->uref_size -= payload_size;
+            if (payload_size >= pes_header_size)
+                uref_attr_set_priv(encaps->uref, 0);
+            else
+                uref_attr_set_priv(encaps->uref,
+                                   pes_header_size - payload_size);
             break;
         }
 
-        ubuf_size += uref_size;
+        upipe_ts_encaps_consume_uref(upipe);
+        if (ubuf_size >= TS_SIZE)
+            break;
+
         if (encaps->uref == NULL ||
             ubase_check(uref_block_get_start(encaps->uref))) {
             assert(!encaps->au_size);
@@ -1226,6 +1277,11 @@ static int upipe_ts_encaps_complete(struct upipe *upipe, struct ubuf **ubuf_p,
 
     if (ubuf_size < TS_SIZE) {
         /* With PSI, pad with 0xff */
+        if (buffer != NULL) {
+            memset(buffer + ubuf_size, 0xff, TS_SIZE - ubuf_size);
+            return UBASE_ERR_NONE;
+        }
+
         struct ubuf *padding = ubuf_dup(encaps->padding);
         if (unlikely(padding == NULL ||
                      !ubase_check(ubuf_block_resize(padding, 0,
@@ -1240,17 +1296,21 @@ static int upipe_ts_encaps_complete(struct upipe *upipe, struct ubuf **ubuf_p,
     return UBASE_ERR_NONE;
 }
 
-/** @This returns a ubuf containing a TS packet, and the dts_sys of the packet.
+/** @This builds a TS packet, either in a newly allocated ubuf or in the
+ * given buffer, and returns the dts_sys of the packet.
  *
  * @param upipe description structure of the pipe
  * @param cr_sys_min date at which the packet will be muxed
  * @param cr_sys_max maximum date allowed for muxing
- * @param ubuf_p filled in with a pointer to the ubuf (may be NULL)
+ * @param buffer TS_SIZE octets buffer to write the packet into, or NULL
+ * @param ubuf_p filled in with a pointer to the ubuf if buffer is NULL (if
+ * ubuf_p is also NULL, flushes late packets)
  * @param dts_sys_p filled in with the dts_sys, or UINT64_MAX
  * @return an error code
  */
 static int _upipe_ts_encaps_splice(struct upipe *upipe, uint64_t cr_sys_min,
-        uint64_t cr_sys_max, struct ubuf **ubuf_p, uint64_t *dts_sys_p)
+        uint64_t cr_sys_max, uint8_t *buffer, struct ubuf **ubuf_p,
+        uint64_t *dts_sys_p)
 {
     struct upipe_ts_encaps *encaps = upipe_ts_encaps_from_upipe(upipe);
     if (encaps->ubuf_mgr == NULL)
@@ -1264,7 +1324,7 @@ static int _upipe_ts_encaps_splice(struct upipe *upipe, uint64_t cr_sys_min,
     }
     encaps->last_splice = cr_sys_min;
 
-    if (ubuf_p == NULL) {
+    if (buffer == NULL && ubuf_p == NULL) {
         /* Flush until cr_sys_min */
         while (encaps->uref != NULL) {
             if (encaps->uref_dts_sys != UINT64_MAX) {
@@ -1306,8 +1366,16 @@ static int _upipe_ts_encaps_splice(struct upipe *upipe, uint64_t cr_sys_min,
         if (unlikely(pcr_prog == UINT64_MAX))
             upipe_dbg(upipe, "adding unnecessary padding (internal error)");
 
-        *ubuf_p = upipe_ts_encaps_build_ts(upipe, 0, false, pcr_prog, false,
-                                           false);
+        size_t header_size = upipe_ts_encaps_ts_header_size(upipe, 0,
+                pcr_prog, false, false);
+        if (buffer != NULL) {
+            upipe_ts_encaps_write_ts(upipe, buffer, header_size, 0, false,
+                                     pcr_prog, false, false);
+            if (header_size < TS_SIZE)
+                memset(buffer + header_size, 0xff, TS_SIZE - header_size);
+        } else
+            *ubuf_p = upipe_ts_encaps_build_ts(upipe, header_size, 0, false,
+                                               pcr_prog, false, false);
         *dts_sys_p = pcr_prog != UINT64_MAX ? cr_sys_min : UINT64_MAX;
         encaps->need_status = true;
         upipe_ts_encaps_check_status(upipe);
@@ -1321,15 +1389,24 @@ static int _upipe_ts_encaps_splice(struct upipe *upipe, uint64_t cr_sys_min,
     assert(encaps->uref_size);
     assert(encaps->au_size);
 
-    *ubuf_p = upipe_ts_encaps_build_ts(upipe, encaps->au_size, start, pcr_prog,
-            ubase_check(uref_flow_get_random(encaps->uref)),
-            ubase_check(uref_flow_get_discontinuity(encaps->uref)));
-    UBASE_ALLOC_RETURN(*ubuf_p);
+    bool random = ubase_check(uref_flow_get_random(encaps->uref));
+    bool discontinuity = ubase_check(uref_flow_get_discontinuity(encaps->uref));
+    size_t header_size = upipe_ts_encaps_ts_header_size(upipe, encaps->au_size,
+            pcr_prog, random, discontinuity);
+    if (buffer != NULL)
+        upipe_ts_encaps_write_ts(upipe, buffer, header_size, encaps->au_size,
+                                 start, pcr_prog, random, discontinuity);
+    else {
+        *ubuf_p = upipe_ts_encaps_build_ts(upipe, header_size,
+                encaps->au_size, start, pcr_prog, random, discontinuity);
+        UBASE_ALLOC_RETURN(*ubuf_p);
+    }
     uref_block_delete_start(encaps->uref);
     uref_flow_delete_random(encaps->uref);
     uref_flow_delete_discontinuity(encaps->uref);
 
-    UBASE_RETURN(upipe_ts_encaps_complete(upipe, ubuf_p, dts_sys_p));
+    UBASE_RETURN(upipe_ts_encaps_complete(upipe, buffer, ubuf_p, header_size,
+                                          dts_sys_p));
     if (pcr_prog != UINT64_MAX)
         *dts_sys_p = encaps->last_splice;
 
@@ -1420,7 +1497,18 @@ static int upipe_ts_encaps_control(struct upipe *upipe,
             struct ubuf **ubuf_p = va_arg(args, struct ubuf **);
             uint64_t *dts_sys_p = va_arg(args, uint64_t *);
             return _upipe_ts_encaps_splice(upipe, cr_sys_min, cr_sys_max,
-                                           ubuf_p, dts_sys_p);
+                                           NULL, ubuf_p, dts_sys_p);
+        }
+        case UPIPE_TS_ENCAPS_SPLICE_BUFFER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_ENCAPS_SIGNATURE)
+            uint64_t cr_sys_min = va_arg(args, uint64_t);
+            uint64_t cr_sys_max = va_arg(args, uint64_t);
+            uint8_t *buffer = va_arg(args, uint8_t *);
+            uint64_t *dts_sys_p = va_arg(args, uint64_t *);
+            if (unlikely(buffer == NULL))
+                return UBASE_ERR_INVALID;
+            return _upipe_ts_encaps_splice(upipe, cr_sys_min, cr_sys_max,
+                                           buffer, NULL, dts_sys_p);
         }
         case UPIPE_TS_ENCAPS_EOS: {
             UBASE_SIGNATURE_CHECK(args, UPIPE_TS_ENCAPS_SIGNATURE)
@@ -1468,6 +1556,7 @@ static const char *upipe_ts_encaps_command_str(int cmd)
     switch (cmd) {
         UBASE_CASE_TO_STR(UPIPE_TS_ENCAPS_SET_TB_SIZE);
         UBASE_CASE_TO_STR(UPIPE_TS_ENCAPS_SPLICE);
+        UBASE_CASE_TO_STR(UPIPE_TS_ENCAPS_SPLICE_BUFFER);
         UBASE_CASE_TO_STR(UPIPE_TS_ENCAPS_EOS);
         default: break;
     }
@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe refcounted store of DVB EIT events
+ * Normative references:
+ *  - ETSI EN 300 468 V1.13.1 (2012-08) (SI in DVB systems)
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uclock.h>
+#include <upipe/urefcount.h>
+#include <upipe-ts/upipe_ts_epg.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/psi.h>
+#include <bitstream/dvb/si.h>
+
+/** @internal @This frees the store when the last reference is released.
+ *
+ * @param urefcount pointer to the urefcount structure
+ */
+static void upipe_ts_epg_free(struct urefcount *urefcount)
+{
+    struct upipe_ts_epg *epg =
+        container_of(urefcount, struct upipe_ts_epg, urefcount);
+    for (size_t i = 0; i < epg->events_nb; i++)
+        free(epg->events[i]);
+    free(epg->events);
+    free(epg->by_id);
+    urefcount_clean(urefcount);
+    free(epg);
+}
+
+/** @This allocates an empty store.
+ *
+ * @return pointer to the store, or NULL in case of allocation error
+ */
+struct upipe_ts_epg *upipe_ts_epg_alloc(void)
+{
+    struct upipe_ts_epg *epg = malloc(sizeof(struct upipe_ts_epg));
+    if (unlikely(epg == NULL))
+        return NULL;
+    urefcount_init(&epg->urefcount, upipe_ts_epg_free);
+    epg->events = epg->by_id = NULL;
+    epg->events_nb = epg->events_size = 0;
+    epg->serial = 0;
+    return epg;
+}
+
+/** @This releases the events and arrays of a change description.
+ *
+ * @param change pointer to the change description
+ */
+void upipe_ts_epg_change_clean(struct upipe_ts_epg_change *change)
+{
+    for (size_t i = 0; i < change->updated_nb; i++)
+        free(change->previous[i]);
+    for (size_t i = 0; i < change->removed_nb; i++)
+        free(change->removed[i]);
+    free(change->inserted);
+    free(change->updated);
+    free(change->previous);
+    free(change->removed);
+    upipe_ts_epg_change_init(change);
+}
+
+/** @internal @This makes room for one more entry in a change array.
+ *
+ * @param array pointer to the array
+ * @param nb number of entries in the array
+ * @return an error code
+ */
+static int upipe_ts_epg_change_reserve(struct upipe_ts_epg_event ***array,
+                                       size_t nb)
+{
+    struct upipe_ts_epg_event **tmp =
+        realloc(*array, (nb + 1) * sizeof(struct upipe_ts_epg_event *));
+    if (unlikely(tmp == NULL))
+        return UBASE_ERR_ALLOC;
+    *array = tmp;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This makes room for one more event in the store.
+ *
+ * @param epg pointer to the store
+ * @return an error code
+ */
+static int upipe_ts_epg_reserve(struct upipe_ts_epg *epg)
+{
+    if (epg->events_nb < epg->events_size)
+        return UBASE_ERR_NONE;
+    size_t size = epg->events_size ? epg->events_size * 2 : 64;
+    struct upipe_ts_epg_event **tmp =
+        realloc(epg->events, size * sizeof(struct upipe_ts_epg_event *));
+    if (unlikely(tmp == NULL))
+        return UBASE_ERR_ALLOC;
+    epg->events = tmp;
+    tmp = realloc(epg->by_id, size * sizeof(struct upipe_ts_epg_event *));
+    if (unlikely(tmp == NULL))
+        return UBASE_ERR_ALLOC;
+    epg->by_id = tmp;
+    epg->events_size = size;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the index of the first event not sorted before
+ * the given key.
+ *
+ * @param epg pointer to the store
+ * @param sid service ID (may be 65536 to point past the last service)
+ * @param start start date
+ * @param event_id event ID
+ * @return index in the events array
+ */
+static size_t upipe_ts_epg_bound(struct upipe_ts_epg *epg, uint32_t sid,
+                                 uint64_t start, uint16_t event_id)
+{
+    size_t low = 0, high = epg->events_nb;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        struct upipe_ts_epg_event *event = epg->events[mid];
+        if (event->sid < sid ||
+            (event->sid == sid && (event->start < start ||
+             (event->start == start && event->event_id < event_id))))
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/** @internal @This returns the index in the event ID index of the first
+ * event not sorted before the given key.
+ *
+ * @param epg pointer to the store
+ * @param sid service ID
+ * @param event_id event ID
+ * @return index in the by_id array
+ */
+static size_t upipe_ts_epg_id_bound(struct upipe_ts_epg *epg, uint16_t sid,
+                                    uint16_t event_id)
+{
+    size_t low = 0, high = epg->events_nb;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        struct upipe_ts_epg_event *event = epg->by_id[mid];
+        if (event->sid < sid ||
+            (event->sid == sid && event->event_id < event_id))
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/** @internal @This looks up an event by its ID.
+ *
+ * @param epg pointer to the store
+ * @param sid service ID
+ * @param event_id event ID
+ * @return pointer to the event, or NULL if there is none
+ */
+static struct upipe_ts_epg_event *upipe_ts_epg_lookup(struct upipe_ts_epg *epg,
+                                                      uint16_t sid,
+                                                      uint16_t event_id)
+{
+    size_t i = upipe_ts_epg_id_bound(epg, sid, event_id);
+    if (i < epg->events_nb && epg->by_id[i]->sid == sid &&
+        epg->by_id[i]->event_id == event_id)
+        return epg->by_id[i];
+    return NULL;
+}
+
+/** @internal @This inserts an event at its sorted positions. The store must
+ * have room for it.
+ *
+ * @param epg pointer to the store
+ * @param event event to insert
+ */
+static void upipe_ts_epg_insert(struct upipe_ts_epg *epg,
+                                struct upipe_ts_epg_event *event)
+{
+    size_t i = upipe_ts_epg_bound(epg, event->sid, event->start,
+                                  event->event_id);
+    memmove(&epg->events[i + 1], &epg->events[i],
+            (epg->events_nb - i) * sizeof(struct upipe_ts_epg_event *));
+    epg->events[i] = event;
+    i = upipe_ts_epg_id_bound(epg, event->sid, event->event_id);
+    memmove(&epg->by_id[i + 1], &epg->by_id[i],
+            (epg->events_nb - i) * sizeof(struct upipe_ts_epg_event *));
+    epg->by_id[i] = event;
+    epg->events_nb++;
+}
+
+/** @internal @This removes an event from the store.
+ *
+ * @param epg pointer to the store
+ * @param event event to remove
+ */
+static void upipe_ts_epg_remove(struct upipe_ts_epg *epg,
+                                struct upipe_ts_epg_event *event)
+{
+    size_t i = upipe_ts_epg_bound(epg, event->sid, event->start,
+                                  event->event_id);
+    size_t j = upipe_ts_epg_id_bound(epg, event->sid, event->event_id);
+    assert(epg->events[i] == event && epg->by_id[j] == event);
+    epg->events_nb--;
+    memmove(&epg->events[i], &epg->events[i + 1],
+            (epg->events_nb - i) * sizeof(struct upipe_ts_epg_event *));
+    memmove(&epg->by_id[j], &epg->by_id[j + 1],
+            (epg->events_nb - j) * sizeof(struct upipe_ts_epg_event *));
+}
+
+/** @This returns the events of a service, sorted by start date.
+ *
+ * @param epg pointer to the store
+ * @param sid service ID
+ * @param events_p filled in with a pointer to the first event
+ * @param events_nb_p filled in with the number of events
+ */
+void upipe_ts_epg_get_service(struct upipe_ts_epg *epg, uint16_t sid,
+                              struct upipe_ts_epg_event ***events_p,
+                              size_t *events_nb_p)
+{
+    size_t begin = upipe_ts_epg_bound(epg, sid, 0, 0);
+    size_t end = upipe_ts_epg_bound(epg, (uint32_t)sid + 1, 0, 0);
+    *events_p = epg->events + begin;
+    *events_nb_p = end - begin;
+}
+
+/** @This finds the event of a service running at a given date, or else the
+ * next one.
+ *
+ * @param epg pointer to the store
+ * @param sid service ID
+ * @param date date (in 27 MHz units, since the epoch)
+ * @return pointer to the event, or NULL if there is none
+ */
+struct upipe_ts_epg_event *upipe_ts_epg_find(struct upipe_ts_epg *epg,
+                                             uint16_t sid, uint64_t date)
+{
+    size_t begin = upipe_ts_epg_bound(epg, sid, 0, 0);
+    size_t i = upipe_ts_epg_bound(epg, sid, date, UINT16_MAX);
+    if (i > begin && epg->events[i - 1]->start +
+                     epg->events[i - 1]->duration > date)
+        return epg->events[i - 1];
+    if (i < epg->events_nb && epg->events[i]->sid == sid)
+        return epg->events[i];
+    return NULL;
+}
+
+/** @This updates the store with a validated EIT section.
+ *
+ * @param epg pointer to the store
+ * @param section pointer to the EIT section
+ * @param change change description to fill in, previously initialized
+ * @return an error code
+ */
+int upipe_ts_epg_section(struct upipe_ts_epg *epg, const uint8_t *section,
+                         struct upipe_ts_epg_change *change)
+{
+    uint16_t sid = psi_get_tableidext(section);
+    uint8_t table_id = psi_get_tableid(section);
+    uint8_t section_nb = psi_get_section(section);
+    uint8_t last_section = psi_get_lastsection(section);
+    uint32_t serial = ++epg->serial;
+
+    const uint8_t *eit_event;
+    int j = 0;
+    /* cast needed because biTStream expects an uint8_t * (but doesn't write
+     * to it */
+    while ((eit_event = eit_get_event((uint8_t *)section, j++)) != NULL) {
+        uint16_t event_id = eitn_get_event_id(eit_event);
+        uint64_t start = (uint64_t)
+            dvb_time_decode_UTC(eitn_get_start_time(eit_event)) * UCLOCK_FREQ;
+        int duration, hour, min, sec;
+        dvb_time_decode_bcd(eitn_get_duration_bcd(eit_event), &duration,
+                            &hour, &min, &sec);
+        uint8_t running_status = eitn_get_running(eit_event);
+        bool scrambled = eitn_get_ca(eit_event);
+        uint16_t descs_size = eitn_get_desclength(eit_event);
+        const uint8_t *descs =
+            descs_get_desc(eitn_get_descs((uint8_t *)eit_event), 0);
+
+        struct upipe_ts_epg_event *previous =
+            upipe_ts_epg_lookup(epg, sid, event_id);
+
+        if (previous != NULL && previous->start == start &&
+            previous->duration == (uint64_t)duration * UCLOCK_FREQ &&
+            previous->running_status == running_status &&
+            previous->scrambled == scrambled &&
+            previous->descs_size == descs_size &&
+            !memcmp(previous->descs, descs, descs_size)) {
+            /* Unchanged event. */
+            previous->table_id = table_id;
+            previous->section = section_nb;
+            previous->serial = serial;
+            continue;
+        }
+
+        struct upipe_ts_epg_event *event =
+            malloc(sizeof(struct upipe_ts_epg_event) + descs_size);
+        if (unlikely(event == NULL))
+            return UBASE_ERR_ALLOC;
+        event->sid = sid;
+        event->event_id = event_id;
+        event->table_id = table_id;
+        event->section = section_nb;
+        event->running_status = running_status;
+        event->scrambled = scrambled;
+        event->start = start;
+        event->duration = (uint64_t)duration * UCLOCK_FREQ;
+        event->serial = serial;
+        event->descs_size = descs_size;
+        memcpy(event->descs, descs, descs_size);
+
+        if (previous != NULL) {
+            if (unlikely(!ubase_check(upipe_ts_epg_change_reserve(
+                                &change->updated, change->updated_nb)) ||
+                         !ubase_check(upipe_ts_epg_change_reserve(
+                                &change->previous, change->updated_nb)))) {
+                free(event);
+                return UBASE_ERR_ALLOC;
+            }
+            upipe_ts_epg_remove(epg, previous);
+            change->updated[change->updated_nb] = event;
+            change->previous[change->updated_nb] = previous;
+            change->updated_nb++;
+        } else {
+            if (unlikely(!ubase_check(upipe_ts_epg_reserve(epg)) ||
+                         !ubase_check(upipe_ts_epg_change_reserve(
+                                &change->inserted, change->inserted_nb)))) {
+                free(event);
+                return UBASE_ERR_ALLOC;
+            }
+            change->inserted[change->inserted_nb++] = event;
+        }
+        upipe_ts_epg_insert(epg, event);
+    }
+
+    /* Remove events that are no longer carried by this sub-table. */
+    struct upipe_ts_epg_event **events;
+    size_t events_nb;
+    upipe_ts_epg_get_service(epg, sid, &events, &events_nb);
+    size_t i = events - epg->events;
+    size_t end = i + events_nb;
+    while (i < end) {
+        struct upipe_ts_epg_event *event = epg->events[i];
+        if (event->table_id != table_id || event->serial == serial ||
+            (event->section != section_nb && event->section <= last_section)) {
+            i++;
+            continue;
+        }
+        UBASE_RETURN(upipe_ts_epg_change_reserve(&change->removed,
+                                                 change->removed_nb))
+        upipe_ts_epg_remove(epg, event);
+        change->removed[change->removed_nb++] = event;
+        end--;
+    }
+    return UBASE_ERR_NONE;
+}
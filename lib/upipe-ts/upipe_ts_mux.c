@@ -49,6 +49,8 @@
 #include <upipe/uref_program_flow.h>
 #include <upipe/uref_clock.h>
 #include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/umem_pool.h>
 #include <upipe/uclock.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
@@ -280,8 +282,8 @@ struct upipe_ts_mux {
     /** psi_pid structure for TDT */
     struct upipe_ts_mux_psi_pid *psi_pid_tdt;
 
-    /** one TS packet of padding */
-    struct ubuf *padding;
+    /** one TS packet of padding, copied into output buffers */
+    uint8_t padding[TS_SIZE];
 
     /** input flow definition */
     struct uref *flow_def_input;
@@ -358,6 +360,12 @@ struct upipe_ts_mux {
     struct uref *uref;
     /** size of current aggregation */
     size_t uref_size;
+    /** mapped buffer of the current aggregation, or NULL */
+    uint8_t *uref_buffer;
+    /** number of buffers in the dedicated output pool, or 0 */
+    unsigned int pool_depth;
+    /** ubuf manager of the dedicated output pool, or NULL */
+    struct ubuf_mgr *pool_mgr;
     /** true during the preroll period */
     bool preroll;
 
@@ -2455,7 +2463,7 @@ static struct upipe *upipe_ts_mux_alloc(struct upipe_mgr *mgr,
     upipe_ts_mux->psi_pid_sdt = NULL;
     upipe_ts_mux->psi_pid_eit = NULL;
     upipe_ts_mux->psi_pid_tdt = NULL;
-    upipe_ts_mux->padding = NULL;
+    ts_pad(upipe_ts_mux->padding);
 
     upipe_ts_mux->flow_def_input = NULL;
     upipe_ts_mux->auto_conformance = true;
@@ -2494,6 +2502,9 @@ static struct upipe *upipe_ts_mux_alloc(struct upipe_mgr *mgr,
     upipe_ts_mux->cr_sys_remainder = 0;
     upipe_ts_mux->uref = NULL;
     upipe_ts_mux->uref_size = 0;
+    upipe_ts_mux->uref_buffer = NULL;
+    upipe_ts_mux->pool_depth = 0;
+    upipe_ts_mux->pool_mgr = NULL;
     upipe_ts_mux->preroll = true;
 
     uprobe_init(&upipe_ts_mux->probe, upipe_ts_mux_probe, NULL);
@@ -2613,20 +2624,44 @@ static uint64_t upipe_ts_mux_show_increment(struct upipe *upipe)
         mux->total_octetrate;
 }
 
-/** @internal @This splices a ubuf to output.
+/** @internal @This splices a TS packet from an encaps pipe.
  *
  * @param upipe description structure of the pipe
- * @param ubuf_p filled in with the ubuf to output, or NULL if none is available
+ * @param encaps encaps pipe to splice from
+ * @param buffer slot of the output buffer to write the packet into
  * @param dts_sys_p filled with the dts_sys of the fragment
+ * @return true if a packet was spliced
  */
-static void upipe_ts_mux_splice(struct upipe *upipe, struct ubuf **ubuf_p,
+static bool upipe_ts_mux_splice_encaps(struct upipe *upipe,
+                                       struct upipe *encaps, uint8_t *buffer,
+                                       uint64_t *dts_sys_p)
+{
+    struct upipe_ts_mux *mux = upipe_ts_mux_from_upipe(upipe);
+    uint64_t original_cr_sys = mux->cr_sys - mux->latency;
+    int err = upipe_ts_encaps_splice_buffer(encaps, original_cr_sys,
+                                            original_cr_sys + mux->interval,
+                                            buffer, dts_sys_p);
+    if (!ubase_check(err)) {
+        upipe_warn(upipe, "internal error in splice");
+        upipe_throw_fatal(upipe, err);
+        return false;
+    }
+    return true;
+}
+
+/** @internal @This splices a TS packet to output.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer slot of the output buffer to write the packet into
+ * @param dts_sys_p filled with the dts_sys of the fragment
+ * @return false if no packet is available
+ */
+static bool upipe_ts_mux_splice(struct upipe *upipe, uint8_t *buffer,
                                 uint64_t *dts_sys_p)
 {
     struct upipe_ts_mux *mux = upipe_ts_mux_from_upipe(upipe);
     uint64_t original_cr_sys = mux->cr_sys - mux->latency;
     struct uchain *uchain;
-    int err;
-    *ubuf_p = NULL;
 
     /* Order of priority: 1. PSI */
     while (!ulist_empty(&mux->psi_pids_splice)) {
@@ -2645,15 +2680,9 @@ static void upipe_ts_mux_splice(struct upipe *upipe, struct ubuf **ubuf_p,
         if (psi_pid->cr_sys > original_cr_sys)
             break; /* Too soon */
 
-        err = upipe_ts_encaps_splice(psi_pid->encaps, original_cr_sys,
-                                     original_cr_sys + mux->interval,
-                                     ubuf_p, dts_sys_p);
-        if (!ubase_check(err)) {
-            upipe_warn(upipe, "internal error in splice");
-            upipe_throw_fatal(upipe, err);
-        }
         /* No need to pop uchain as the probe does it for us. */
-        return;
+        return upipe_ts_mux_splice_encaps(upipe, psi_pid->encaps, buffer,
+                                          dts_sys_p);
     }
 
     /* 2. Inputs */
@@ -2698,45 +2727,78 @@ static void upipe_ts_mux_splice(struct upipe *upipe, struct ubuf **ubuf_p,
 
     if (selected_input == NULL ||
         selected_input->cr_sys > original_cr_sys)
-        return;
+        return false;
 
-upipe_ts_mux_splice_done:
-    err = upipe_ts_encaps_splice(selected_input->encaps, original_cr_sys,
-                                 original_cr_sys + mux->interval,
-                                 ubuf_p, dts_sys_p);
-    if (!ubase_check(err)) {
-        upipe_warn(upipe, "internal error in splice");
-        upipe_throw_fatal(upipe, err);
-    }
+upipe_ts_mux_splice_done:;
+    bool spliced = upipe_ts_mux_splice_encaps(upipe, selected_input->encaps,
+                                              buffer, dts_sys_p);
 
     if (selected_input->deleted && !selected_input->ready) {
         /* This triggers the immediate deletion of the input. */
         upipe_release(selected_input->encaps);
     }
+    return spliced;
 }
 
-/** @internal @This appends a uref to our buffer.
+/** @internal @This opens a new aggregation, with an output buffer of the
+ * size of the MTU which stays mapped until the aggregation is complete. The
+ * buffer comes from the dedicated output pool if there is one.
  *
  * @param upipe description structure of the pipe
- * @param ubuf ubuf to append
- * @param dts_sys dts_sys associated with the ubuf
+ * @return false in case of allocation error
  */
-static void upipe_ts_mux_append(struct upipe *upipe, struct ubuf *ubuf,
-                                uint64_t dts_sys)
+static bool upipe_ts_mux_open(struct upipe *upipe)
 {
     struct upipe_ts_mux *mux = upipe_ts_mux_from_upipe(upipe);
-    if (mux->uref == NULL) {
-        mux->uref = uref_alloc(mux->uref_mgr);
-        if (unlikely(mux->uref == NULL)) {
-            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-            ubuf_free(ubuf);
-            return;
-        }
+    struct ubuf_mgr *ubuf_mgr = mux->pool_mgr != NULL ? mux->pool_mgr :
+                                mux->ubuf_mgr;
+    struct ubuf *ubuf = NULL;
+    int size = -1;
+    mux->uref = uref_alloc(mux->uref_mgr);
+    if (unlikely(mux->uref == NULL ||
+                 (ubuf = ubuf_block_alloc(ubuf_mgr, mux->mtu)) == NULL ||
+                 !ubase_check(ubuf_block_write(ubuf, 0, &size,
+                                               &mux->uref_buffer)))) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        ubuf_free(ubuf);
+        uref_free(mux->uref);
+        mux->uref = NULL;
+        mux->uref_buffer = NULL;
+        return false;
+    }
+    assert(size == mux->mtu);
+    uref_attach_ubuf(mux->uref, ubuf);
+    return true;
+}
+
+/** @internal @This returns the slot of the next packet in the output buffer
+ * of the current aggregation, opening the aggregation if needed.
+ *
+ * @param upipe description structure of the pipe
+ * @return pointer to TS_SIZE writable octets, or NULL in case of error
+ */
+static uint8_t *upipe_ts_mux_slot(struct upipe *upipe)
+{
+    struct upipe_ts_mux *mux = upipe_ts_mux_from_upipe(upipe);
+    if (mux->uref == NULL && !upipe_ts_mux_open(upipe))
+        return NULL;
+    return mux->uref_buffer + mux->uref_size;
+}
+
+/** @internal @This appends the packet written into the slot of the output
+ * buffer to our aggregation.
+ *
+ * @param upipe description structure of the pipe
+ * @param dts_sys dts_sys associated with the packet
+ */
+static void upipe_ts_mux_append(struct upipe *upipe, uint64_t dts_sys)
+{
+    struct upipe_ts_mux *mux = upipe_ts_mux_from_upipe(upipe);
+    if (!mux->uref_size) {
         uref_clock_set_cr_sys(mux->uref, mux->cr_sys - mux->latency);
         if (dts_sys != UINT64_MAX)
             uref_clock_set_cr_dts_delay(mux->uref,
                     dts_sys - (mux->cr_sys - mux->latency));
-        uref_attach_ubuf(mux->uref, ubuf);
     } else {
         uint64_t current_dts_sys;
         if (dts_sys != UINT64_MAX &&
@@ -2745,11 +2807,26 @@ static void upipe_ts_mux_append(struct upipe *upipe, struct ubuf *ubuf,
              current_dts_sys > dts_sys))
             uref_clock_set_cr_dts_delay(mux->uref,
                     dts_sys - (mux->cr_sys - mux->latency));
-        uref_block_append(mux->uref, ubuf);
     }
     mux->uref_size += TS_SIZE;
 }
 
+/** @internal @This appends a padding packet to our aggregation.
+ *
+ * @param upipe description structure of the pipe
+ * @return false if the packet could not be appended
+ */
+static bool upipe_ts_mux_append_padding(struct upipe *upipe)
+{
+    struct upipe_ts_mux *mux = upipe_ts_mux_from_upipe(upipe);
+    uint8_t *slot = upipe_ts_mux_slot(upipe);
+    if (unlikely(slot == NULL))
+        return false;
+    memcpy(slot, mux->padding, TS_SIZE);
+    upipe_ts_mux_append(upipe, UINT64_MAX);
+    return true;
+}
+
 /** @internal @This completes a uref and outputs it.
  *
  * @param upipe description structure of the pipe
@@ -2760,6 +2837,15 @@ static void upipe_ts_mux_complete(struct upipe *upipe, struct upump **upump_p)
     struct upipe_ts_mux *mux = upipe_ts_mux_from_upipe(upipe);
     struct uref *uref = mux->uref;
     mux->uref = NULL;
+    mux->uref_buffer = NULL;
+    uref_block_unmap(uref, 0);
+    if (unlikely(!mux->uref_size)) {
+        /* the aggregation was opened but no packet was written */
+        uref_free(uref);
+        return;
+    }
+    if (mux->uref_size < mux->mtu)
+        uref_block_resize(uref, 0, mux->uref_size);
     mux->uref_size = 0;
     upipe_ts_mux_output(upipe, uref, upump_p);
 }
@@ -2782,12 +2868,11 @@ static void _upipe_ts_mux_watcher(struct upipe *upipe)
 
         while (mux->uref_size < mux->mtu) {
             nb_packets++;
-            struct ubuf *ubuf;
+            uint8_t *slot = upipe_ts_mux_slot(upipe);
             uint64_t dts_sys;
-            upipe_ts_mux_splice(upipe, &ubuf, &dts_sys);
-            if (ubuf == NULL)
+            if (slot == NULL || !upipe_ts_mux_splice(upipe, slot, &dts_sys))
                 break;
-            upipe_ts_mux_append(upipe, ubuf, dts_sys);
+            upipe_ts_mux_append(upipe, dts_sys);
         }
 
         uint64_t dts_sys;
@@ -2797,10 +2882,8 @@ static void _upipe_ts_mux_watcher(struct upipe *upipe)
              dts_sys + mux->latency < upipe_ts_mux_show_increment(upipe))) {
             while (mux->uref_size < mux->mtu) {
                 nb_packets++;
-                struct ubuf *ubuf = ubuf_dup(mux->padding);
-                if (ubuf == NULL)
+                if (!upipe_ts_mux_append_padding(upipe))
                     break;
-                upipe_ts_mux_append(upipe, ubuf, UINT64_MAX);
             }
         }
 
@@ -2909,11 +2992,12 @@ static void upipe_ts_mux_work_file(struct upipe *upipe, struct upump **upump_p)
             upipe_ts_mux_prepare_psi(upipe, min_cr_sys, 0);
         }
 
-        struct ubuf *ubuf;
+        uint8_t *slot = upipe_ts_mux_slot(upipe);
         uint64_t dts_sys;
-        upipe_ts_mux_splice(upipe, &ubuf, &dts_sys);
-        if (ubuf != NULL) {
-            upipe_ts_mux_append(upipe, ubuf, dts_sys);
+        if (unlikely(slot == NULL))
+            break;
+        if (upipe_ts_mux_splice(upipe, slot, &dts_sys)) {
+            upipe_ts_mux_append(upipe, dts_sys);
             if (mux->uref_size >= mux->mtu) {
                 upipe_ts_mux_complete(upipe, &mux->upump);
                 upipe_ts_mux_increment(upipe);
@@ -2929,12 +3013,9 @@ static void upipe_ts_mux_work_file(struct upipe *upipe, struct upump **upump_p)
             continue;
         }
 
-        while (mux->uref_size < mux->mtu) {
-            struct ubuf *ubuf = ubuf_dup(mux->padding);
-            if (ubuf == NULL)
+        while (mux->uref_size < mux->mtu)
+            if (!upipe_ts_mux_append_padding(upipe))
                 break;
-            upipe_ts_mux_append(upipe, ubuf, UINT64_MAX);
-        }
 
         upipe_ts_mux_complete(upipe, upump_p);
         upipe_ts_mux_increment(upipe);
@@ -3000,7 +3081,7 @@ static void upipe_ts_mux_work_live(struct upipe *upipe, struct upump **upump_p)
 static void upipe_ts_mux_work(struct upipe *upipe, struct upump **upump_p)
 {
     struct upipe_ts_mux *mux = upipe_ts_mux_from_upipe(upipe);
-    if (unlikely(mux->flow_def == NULL || mux->padding == NULL ||
+    if (unlikely(mux->flow_def == NULL || mux->ubuf_mgr == NULL ||
                  !mux->interval))
         return;
 
@@ -3066,26 +3147,6 @@ static int upipe_ts_mux_check(struct upipe *upipe, struct uref *flow_format)
         return UBASE_ERR_NONE;
     }
 
-    if (mux->padding == NULL) {
-        mux->padding = ubuf_block_alloc(mux->ubuf_mgr, TS_SIZE);
-        if (unlikely(mux->padding == NULL)) {
-            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-            return UBASE_ERR_ALLOC;
-        }
-
-        uint8_t *buffer;
-        int size = -1;
-        if (unlikely(!ubase_check(ubuf_block_write(mux->padding, 0, &size,
-                                                   &buffer)))) {
-            ubuf_free(mux->padding);
-            mux->padding = NULL;
-            return UBASE_ERR_ALLOC;
-        }
-        assert(size == TS_SIZE);
-        ts_pad(buffer);
-        ubuf_block_unmap(mux->padding, 0);
-    }
-
     if (mux->live && mux->sig != NULL)
         upipe_ts_mux_set_tdt_interval(mux->sig, mux->tdt_interval);
 
@@ -3538,6 +3599,48 @@ static int upipe_ts_mux_set_flow_def(struct upipe *upipe, struct uref *flow_def)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This allocates the dedicated pool of output buffers for the
+ * current MTU, and fills it with preallocated buffers.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ts_mux_alloc_pool(struct upipe *upipe)
+{
+    struct upipe_ts_mux *mux = upipe_ts_mux_from_upipe(upipe);
+    ubuf_mgr_release(mux->pool_mgr);
+    mux->pool_mgr = NULL;
+    if (!mux->pool_depth)
+        return UBASE_ERR_NONE;
+
+    /* a single pool of the smallest power of 2 holding the MTU */
+    size_t pool_size = 1;
+    while (pool_size < mux->mtu)
+        pool_size <<= 1;
+    struct umem_mgr *umem_mgr = umem_pool_mgr_alloc(pool_size, 1,
+                                                    mux->pool_depth);
+    UBASE_ALLOC_RETURN(umem_mgr);
+    mux->pool_mgr = ubuf_block_mem_mgr_alloc(mux->pool_depth,
+                                             mux->pool_depth, umem_mgr,
+                                             0, 0, 0, 0);
+    umem_mgr_release(umem_mgr);
+    UBASE_ALLOC_RETURN(mux->pool_mgr);
+
+    /* allocate all buffers at once, so that freeing them fills the pool */
+    struct ubuf *ubufs = NULL;
+    for (unsigned int i = 0; i < mux->pool_depth; i++) {
+        struct ubuf *ubuf = ubuf_block_alloc(mux->pool_mgr, mux->mtu);
+        if (unlikely(ubuf == NULL))
+            break;
+        if (ubufs == NULL)
+            ubufs = ubuf;
+        else
+            ubuf_block_append(ubufs, ubuf);
+    }
+    ubuf_free(ubufs);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This returns the configured mtu.
  *
  * @param upipe description structure of the pipe
@@ -3565,6 +3668,15 @@ static int upipe_ts_mux_set_output_size(struct upipe *upipe, unsigned int mtu)
     if (unlikely(mtu < TS_SIZE))
         return UBASE_ERR_INVALID;
     mtu -= mtu % TS_SIZE;
+    bool resize = mtu != upipe_ts_mux->mtu;
+    if (upipe_ts_mux->uref != NULL && resize) {
+        /* the buffer of the current aggregation has the previous size */
+        while (upipe_ts_mux->uref_size &&
+               upipe_ts_mux->uref_size < upipe_ts_mux->mtu)
+            if (!upipe_ts_mux_append_padding(upipe))
+                break;
+        upipe_ts_mux_complete(upipe, NULL);
+    }
     upipe_ts_mux->mtu = mtu;
     if (upipe_ts_mux->total_octetrate)
         upipe_ts_mux->interval = (upipe_ts_mux->mtu * UCLOCK_FREQ +
@@ -3593,6 +3705,10 @@ static int upipe_ts_mux_set_output_size(struct upipe *upipe, unsigned int mtu)
         }
     }
     upipe_ts_mux_build_flow_def(upipe);
+
+    if (resize && upipe_ts_mux->pool_depth)
+        /* the buffers of the dedicated pool have the previous size */
+        return upipe_ts_mux_alloc_pool(upipe);
     return UBASE_ERR_NONE;
 }
 
@@ -4124,6 +4240,40 @@ static int _upipe_ts_mux_set_mode(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the number of buffers in the dedicated output
+ * pool.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth_p filled in with the number of buffers, or 0
+ * @return an error code
+ */
+static int _upipe_ts_mux_get_output_pool(struct upipe *upipe,
+                                         unsigned int *depth_p)
+{
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+    assert(depth_p != NULL);
+    *depth_p = upipe_ts_mux->pool_depth;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the number of buffers in the dedicated output pool.
+ * The current aggregation keeps its buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth number of buffers, or 0 to use the ubuf manager of the
+ * pipeline
+ * @return an error code
+ */
+static int _upipe_ts_mux_set_output_pool(struct upipe *upipe,
+                                         unsigned int depth)
+{
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+    if (unlikely(depth > UINT16_MAX))
+        return UBASE_ERR_INVALID;
+    upipe_ts_mux->pool_depth = depth;
+    return upipe_ts_mux_alloc_pool(upipe);
+}
+
 /** @internal @This returns the current encapsulation for AAC streams.
  *
  * @param upipe description structure of the pipe
@@ -4391,6 +4541,16 @@ static int _upipe_ts_mux_control(struct upipe *upipe, int command, va_list args)
             enum upipe_ts_mux_mode mode = va_arg(args, enum upipe_ts_mux_mode);
             return _upipe_ts_mux_set_mode(upipe, mode);
         }
+        case UPIPE_TS_MUX_GET_OUTPUT_POOL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            unsigned int *depth_p = va_arg(args, unsigned int *);
+            return _upipe_ts_mux_get_output_pool(upipe, depth_p);
+        }
+        case UPIPE_TS_MUX_SET_OUTPUT_POOL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            unsigned int depth = va_arg(args, unsigned int);
+            return _upipe_ts_mux_set_output_pool(upipe, depth);
+        }
         case UPIPE_TS_MUX_GET_AAC_ENCAPS: {
             UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
             int *encaps_p = va_arg(args, int *);
@@ -4460,21 +4620,16 @@ static void upipe_ts_mux_free(struct urefcount *urefcount_real)
     struct upipe *upipe = upipe_ts_mux_to_upipe(mux);
 
     if (mux->uref != NULL) {
-        size_t uref_size;
-        while ((ubase_check(uref_block_size(mux->uref, &uref_size)) &&
-                uref_size < mux->mtu)) {
-            struct ubuf *ubuf = ubuf_dup(mux->padding);
-            if (ubuf == NULL)
+        while (mux->uref_size && mux->uref_size < mux->mtu)
+            if (!upipe_ts_mux_append_padding(upipe))
                 break;
-            upipe_ts_mux_append(upipe, ubuf, UINT64_MAX);
-        }
 
         upipe_ts_mux_complete(upipe, NULL);
     }
 
     upipe_throw_dead(upipe);
 
-    ubuf_free(mux->padding);
+    ubuf_mgr_release(mux->pool_mgr);
     uref_free(mux->flow_def_input);
     uprobe_clean(&mux->probe);
     urefcount_clean(urefcount_real);
@@ -4624,6 +4779,8 @@ const char *upipe_ts_mux_command_str(int cmd)
         UBASE_CASE_TO_STR(UPIPE_TS_MUX_SET_ENCODING);
         UBASE_CASE_TO_STR(UPIPE_TS_MUX_FREEZE_PSI);
         UBASE_CASE_TO_STR(UPIPE_TS_MUX_PREPARE);
+        UBASE_CASE_TO_STR(UPIPE_TS_MUX_GET_OUTPUT_POOL);
+        UBASE_CASE_TO_STR(UPIPE_TS_MUX_SET_OUTPUT_POOL);
         default: break;
     }
     return NULL;
@@ -44,6 +44,7 @@
 #include <upipe-ts/upipe_ts_nit_decoder.h>
 #include <upipe-ts/uref_ts_flow.h>
 #include "upipe_ts_psi_decoder.h"
+#include "upipe_ts_crc.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -92,6 +93,10 @@ struct upipe_ts_nitd {
     UPIPE_TS_PSID_TABLE_DECLARE(nit);
     /** NIT table being gathered */
     UPIPE_TS_PSID_TABLE_DECLARE(next_nit);
+    /** number of sections of the NIT table being gathered */
+    unsigned int nb_next_nit;
+    /** number of unchanged sections skipped */
+    uint64_t skipped;
 
     /** encoding of the following iconv handle */
     const char *current_encoding;
@@ -136,8 +141,10 @@ static struct upipe *upipe_ts_nitd_alloc(struct upipe_mgr *mgr,
     upipe_ts_nitd_init_ubuf_mgr(upipe);
     upipe_ts_nitd_init_flow_def(upipe);
     upipe_ts_nitd_init_iconv(upipe);
-    upipe_ts_psid_table_init(upipe_ts_nitd->nit);
-    upipe_ts_psid_table_init(upipe_ts_nitd->next_nit);
+    upipe_ts_psid_table_init(upipe_ts_nitd->nit, NULL);
+    upipe_ts_psid_table_init(upipe_ts_nitd->next_nit,
+                             &upipe_ts_nitd->nb_next_nit);
+    upipe_ts_nitd->skipped = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -195,7 +202,7 @@ static bool upipe_ts_nitd_table_validate(struct upipe *upipe)
                                                   &section))))
             return false;
 
-        if (!nit_validate(section) || !psi_check_crc(section)) {
+        if (!nit_validate(section) || !upipe_ts_psi_check_crc(section)) {
             uref_block_unmap(section_uref, 0);
             return false;
         }
@@ -314,15 +321,27 @@ static void upipe_ts_nitd_input(struct upipe *upipe, struct uref *uref,
     struct upipe_ts_nitd *upipe_ts_nitd = upipe_ts_nitd_from_upipe(upipe);
     assert(upipe_ts_nitd->flow_def_input != NULL);
 
-    if (!upipe_ts_psid_table_section(upipe_ts_nitd->next_nit, uref))
+    if (upipe_ts_psid_table_skip(upipe_ts_nitd->nit,
+                                 upipe_ts_nitd->next_nit,
+                                 &upipe_ts_nitd->nb_next_nit, uref, NULL)) {
+        /* Identical section. */
+        upipe_ts_nitd->skipped++;
+        uref_free(uref);
+        return;
+    }
+
+    if (!upipe_ts_psid_table_section(upipe_ts_nitd->next_nit,
+                                     &upipe_ts_nitd->nb_next_nit, uref))
         return;
 
     if (upipe_ts_psid_table_validate(upipe_ts_nitd->nit) &&
         upipe_ts_psid_table_compare(upipe_ts_nitd->nit,
                                     upipe_ts_nitd->next_nit)) {
         /* Identical NIT. */
-        upipe_ts_psid_table_clean(upipe_ts_nitd->next_nit);
-        upipe_ts_psid_table_init(upipe_ts_nitd->next_nit);
+        upipe_ts_psid_table_clean(upipe_ts_nitd->next_nit,
+                                  &upipe_ts_nitd->nb_next_nit);
+        upipe_ts_psid_table_init(upipe_ts_nitd->next_nit,
+                                 &upipe_ts_nitd->nb_next_nit);
         return;
     }
 
@@ -330,8 +349,10 @@ static void upipe_ts_nitd_input(struct upipe *upipe, struct uref *uref,
                                                upipe_ts_nitd->ubuf_mgr)) ||
         !upipe_ts_nitd_table_validate(upipe)) {
         upipe_warn(upipe, "invalid NIT section received");
-        upipe_ts_psid_table_clean(upipe_ts_nitd->next_nit);
-        upipe_ts_psid_table_init(upipe_ts_nitd->next_nit);
+        upipe_ts_psid_table_clean(upipe_ts_nitd->next_nit,
+                                  &upipe_ts_nitd->nb_next_nit);
+        upipe_ts_psid_table_init(upipe_ts_nitd->next_nit,
+                                 &upipe_ts_nitd->nb_next_nit);
         return;
     }
 
@@ -386,9 +407,10 @@ static void upipe_ts_nitd_input(struct upipe *upipe, struct uref *uref,
 
     /* Switch tables. */
     if (upipe_ts_psid_table_validate(upipe_ts_nitd->nit))
-        upipe_ts_psid_table_clean(upipe_ts_nitd->nit);
+        upipe_ts_psid_table_clean(upipe_ts_nitd->nit, NULL);
     upipe_ts_psid_table_copy(upipe_ts_nitd->nit, upipe_ts_nitd->next_nit);
-    upipe_ts_psid_table_init(upipe_ts_nitd->next_nit);
+    upipe_ts_psid_table_init(upipe_ts_nitd->next_nit,
+                             &upipe_ts_nitd->nb_next_nit);
 
     flow_def = upipe_ts_nitd_store_flow_def_attr(upipe, flow_def);
     if (unlikely(flow_def == NULL)) {
@@ -457,6 +479,12 @@ static int upipe_ts_nitd_control(struct upipe *upipe, int command, va_list args)
             struct uref *flow_def = va_arg(args, struct uref *);
             return upipe_ts_nitd_set_flow_def(upipe, flow_def);
         }
+        case UPIPE_TS_NITD_GET_SKIPPED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_NITD_SIGNATURE)
+            uint64_t *p = va_arg(args, uint64_t *);
+            *p = upipe_ts_nitd_from_upipe(upipe)->skipped;
+            return UBASE_ERR_NONE;
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
@@ -472,8 +500,9 @@ static void upipe_ts_nitd_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     struct upipe_ts_nitd *upipe_ts_nitd = upipe_ts_nitd_from_upipe(upipe);
-    upipe_ts_psid_table_clean(upipe_ts_nitd->nit);
-    upipe_ts_psid_table_clean(upipe_ts_nitd->next_nit);
+    upipe_ts_psid_table_clean(upipe_ts_nitd->nit, NULL);
+    upipe_ts_psid_table_clean(upipe_ts_nitd->next_nit,
+                              &upipe_ts_nitd->nb_next_nit);
     upipe_ts_nitd_clean_output(upipe);
     upipe_ts_nitd_clean_ubuf_mgr(upipe);
     upipe_ts_nitd_clean_flow_def(upipe);
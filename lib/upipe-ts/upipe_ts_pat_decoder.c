@@ -42,6 +42,7 @@
 #include <upipe-ts/upipe_ts_pat_decoder.h>
 #include <upipe-ts/uref_ts_flow.h>
 #include "upipe_ts_psi_decoder.h"
+#include "upipe_ts_crc.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -87,6 +88,13 @@ struct upipe_ts_patd {
     UPIPE_TS_PSID_TABLE_DECLARE(pat);
     /** PAT table being gathered */
     UPIPE_TS_PSID_TABLE_DECLARE(next_pat);
+    /** number of sections of the PAT table being gathered */
+    unsigned int nb_next_pat;
+    /** number of unchanged sections skipped */
+    uint64_t skipped;
+    /** earliest cr_sys of the skipped sections since the last random
+     * access point */
+    uint64_t skipped_cr_sys;
     /** current TSID */
     int tsid;
     /** NIT flow definition */
@@ -130,8 +138,11 @@ static struct upipe *upipe_ts_patd_alloc(struct upipe_mgr *mgr,
     upipe_ts_patd_init_output(upipe);
     upipe_ts_patd_init_ubuf_mgr(upipe);
     upipe_ts_patd_init_flow_def(upipe);
-    upipe_ts_psid_table_init(upipe_ts_patd->pat);
-    upipe_ts_psid_table_init(upipe_ts_patd->next_pat);
+    upipe_ts_psid_table_init(upipe_ts_patd->pat, NULL);
+    upipe_ts_psid_table_init(upipe_ts_patd->next_pat,
+                             &upipe_ts_patd->nb_next_pat);
+    upipe_ts_patd->skipped = 0;
+    upipe_ts_patd->skipped_cr_sys = UINT64_MAX;
     upipe_ts_patd->tsid = -1;
     upipe_ts_patd->nit = NULL;
     ulist_init(&upipe_ts_patd->programs);
@@ -204,7 +215,7 @@ static bool upipe_ts_patd_table_validate(struct upipe *upipe)
                                                   &section))))
             return false;
 
-        if (!pat_validate(section) || !psi_check_crc(section)) {
+        if (!pat_validate(section) || !upipe_ts_psi_check_crc(section)) {
             uref_block_unmap(section_uref, 0);
             return false;
         }
@@ -345,7 +356,27 @@ static void upipe_ts_patd_input(struct upipe *upipe, struct uref *uref,
     assert(upipe_ts_patd->flow_def_input != NULL);
     assert(upipe_ts_patd->ubuf_mgr != NULL);
 
-    if (!upipe_ts_psid_table_section(upipe_ts_patd->next_pat, uref))
+    bool last;
+    if (upipe_ts_psid_table_skip(upipe_ts_patd->pat,
+                                 upipe_ts_patd->next_pat,
+                                 &upipe_ts_patd->nb_next_pat, uref, &last)) {
+        /* Identical section. */
+        upipe_ts_patd->skipped++;
+        uint64_t cr_sys;
+        if (ubase_check(uref_clock_get_cr_sys(uref, &cr_sys)) &&
+            cr_sys < upipe_ts_patd->skipped_cr_sys)
+            upipe_ts_patd->skipped_cr_sys = cr_sys;
+        if (last && upipe_ts_patd->skipped_cr_sys != UINT64_MAX) {
+            uref_clock_set_rap_sys(uref, upipe_ts_patd->skipped_cr_sys);
+            upipe_throw_new_rap(upipe, uref);
+            upipe_ts_patd->skipped_cr_sys = UINT64_MAX;
+        }
+        uref_free(uref);
+        return;
+    }
+
+    if (!upipe_ts_psid_table_section(upipe_ts_patd->next_pat,
+                                     &upipe_ts_patd->nb_next_pat, uref))
         return;
 
     if (upipe_ts_psid_table_validate(upipe_ts_patd->pat) &&
@@ -353,8 +384,10 @@ static void upipe_ts_patd_input(struct upipe *upipe, struct uref *uref,
                                     upipe_ts_patd->next_pat)) {
         /* Identical PAT. */
         upipe_ts_patd_table_rap(upipe, uref);
-        upipe_ts_psid_table_clean(upipe_ts_patd->next_pat);
-        upipe_ts_psid_table_init(upipe_ts_patd->next_pat);
+        upipe_ts_psid_table_clean(upipe_ts_patd->next_pat,
+                                  &upipe_ts_patd->nb_next_pat);
+        upipe_ts_psid_table_init(upipe_ts_patd->next_pat,
+                                 &upipe_ts_patd->nb_next_pat);
         return;
     }
 
@@ -362,8 +395,10 @@ static void upipe_ts_patd_input(struct upipe *upipe, struct uref *uref,
                                                upipe_ts_patd->ubuf_mgr)) ||
         !upipe_ts_patd_table_validate(upipe)) {
         upipe_warn(upipe, "invalid PAT section received");
-        upipe_ts_psid_table_clean(upipe_ts_patd->next_pat);
-        upipe_ts_psid_table_init(upipe_ts_patd->next_pat);
+        upipe_ts_psid_table_clean(upipe_ts_patd->next_pat,
+                                  &upipe_ts_patd->nb_next_pat);
+        upipe_ts_psid_table_init(upipe_ts_patd->next_pat,
+                                 &upipe_ts_patd->nb_next_pat);
         return;
     }
 
@@ -412,9 +447,11 @@ static void upipe_ts_patd_input(struct upipe *upipe, struct uref *uref,
 
     /* Switch tables. */
     if (upipe_ts_psid_table_validate(upipe_ts_patd->pat))
-        upipe_ts_psid_table_clean(upipe_ts_patd->pat);
+        upipe_ts_psid_table_clean(upipe_ts_patd->pat, NULL);
     upipe_ts_psid_table_copy(upipe_ts_patd->pat, upipe_ts_patd->next_pat);
-    upipe_ts_psid_table_init(upipe_ts_patd->next_pat);
+    upipe_ts_psid_table_init(upipe_ts_patd->next_pat,
+                             &upipe_ts_patd->nb_next_pat);
+    upipe_ts_patd->skipped_cr_sys = UINT64_MAX;
 
     upipe_split_throw_update(upipe);
 }
@@ -524,6 +561,12 @@ static int upipe_ts_patd_control(struct upipe *upipe, int command, va_list args)
             struct uref **p = va_arg(args, struct uref **);
             return _upipe_ts_patd_get_nit(upipe, p);
         }
+        case UPIPE_TS_PATD_GET_SKIPPED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_PATD_SIGNATURE)
+            uint64_t *p = va_arg(args, uint64_t *);
+            *p = upipe_ts_patd_from_upipe(upipe)->skipped;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -539,8 +582,9 @@ static void upipe_ts_patd_free(struct upipe *upipe)
 
     struct upipe_ts_patd *upipe_ts_patd = upipe_ts_patd_from_upipe(upipe);
     uref_free(upipe_ts_patd->nit);
-    upipe_ts_psid_table_clean(upipe_ts_patd->pat);
-    upipe_ts_psid_table_clean(upipe_ts_patd->next_pat);
+    upipe_ts_psid_table_clean(upipe_ts_patd->pat, NULL);
+    upipe_ts_psid_table_clean(upipe_ts_patd->next_pat,
+                              &upipe_ts_patd->nb_next_pat);
     upipe_ts_patd_clean_programs(upipe);
     upipe_ts_patd_clean_output(upipe);
     upipe_ts_patd_clean_ubuf_mgr(upipe);
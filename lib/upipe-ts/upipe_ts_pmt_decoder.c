@@ -103,6 +103,8 @@ struct upipe_ts_pmtd {
 
     /** currently in effect PMT table */
     struct uref *pmt;
+    /** number of unchanged sections skipped */
+    uint64_t skipped;
     /** list of flows */
     struct uchain flows;
 
@@ -143,6 +145,7 @@ static struct upipe *upipe_ts_pmtd_alloc(struct upipe_mgr *mgr,
     upipe_ts_pmtd_init_ubuf_mgr(upipe);
     upipe_ts_pmtd_init_flow_def(upipe);
     upipe_ts_pmtd->pmt = NULL;
+    upipe_ts_pmtd->skipped = 0;
     ulist_init(&upipe_ts_pmtd->flows);
     upipe_throw_ready(upipe);
     return upipe;
@@ -591,9 +594,9 @@ static void upipe_ts_pmtd_input(struct upipe *upipe, struct uref *uref,
 {
     struct upipe_ts_pmtd *upipe_ts_pmtd = upipe_ts_pmtd_from_upipe(upipe);
     assert(upipe_ts_pmtd->flow_def_input != NULL);
-    if (upipe_ts_pmtd->pmt != NULL &&
-        ubase_check(uref_block_equal(upipe_ts_pmtd->pmt, uref))) {
+    if (upipe_ts_psid_equal_crc(upipe_ts_pmtd->pmt, uref)) {
         /* Identical PMT. */
+        upipe_ts_pmtd->skipped++;
         upipe_throw_new_rap(upipe, uref);
         uref_free(uref);
         return;
@@ -737,6 +740,12 @@ static int upipe_ts_pmtd_control(struct upipe *upipe, int command, va_list args)
             struct uref *flow_def = va_arg(args, struct uref *);
             return upipe_ts_pmtd_set_flow_def(upipe, flow_def);
         }
+        case UPIPE_TS_PMTD_GET_SKIPPED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_PMTD_SIGNATURE)
+            uint64_t *p = va_arg(args, uint64_t *);
+            *p = upipe_ts_pmtd_from_upipe(upipe)->skipped;
+            return UBASE_ERR_NONE;
+        }
         case UPIPE_SPLIT_ITERATE: {
             struct uref **p = va_arg(args, struct uref **);
             return upipe_ts_pmtd_iterate(upipe, p);
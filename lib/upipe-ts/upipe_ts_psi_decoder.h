@@ -29,6 +29,7 @@
 #include <upipe/uref_block.h>
 
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 
 #include <bitstream/mpeg/psi.h>
@@ -49,6 +50,51 @@ static inline bool upipe_ts_psid_equal(struct uref *section1,
     return ubase_check(uref_block_equal(section1, section2));
 }
 
+/** @This compares two PSI sections from their headers and CRCs only, so
+ * that an unchanged section may be recognized without reading or merging
+ * its payload.
+ *
+ * @param section1 PSI section 1, already validated
+ * @param section2 PSI section 2
+ * @return false if the sections are (probably) different
+ */
+static inline bool upipe_ts_psid_equal_crc(struct uref *section1,
+                                           struct uref *section2)
+{
+    size_t size1, size2;
+    if (section1 == NULL ||
+        !ubase_check(uref_block_size(section1, &size1)) ||
+        !ubase_check(uref_block_size(section2, &size2)) ||
+        size1 != size2 || size1 < PSI_HEADER_SIZE_SYNTAX1 + PSI_CRC_SIZE)
+        return false;
+
+    uint8_t buffer1[PSI_HEADER_SIZE_SYNTAX1], buffer2[PSI_HEADER_SIZE_SYNTAX1];
+    const uint8_t *header1 = uref_block_peek(section1, 0,
+            PSI_HEADER_SIZE_SYNTAX1, buffer1);
+    const uint8_t *header2 = uref_block_peek(section2, 0,
+            PSI_HEADER_SIZE_SYNTAX1, buffer2);
+    bool equal = header1 != NULL && header2 != NULL &&
+                 !memcmp(header1, header2, PSI_HEADER_SIZE_SYNTAX1);
+    if (header1 != NULL)
+        uref_block_peek_unmap(section1, 0, buffer1, header1);
+    if (header2 != NULL)
+        uref_block_peek_unmap(section2, 0, buffer2, header2);
+    if (!equal)
+        return false;
+
+    const uint8_t *crc1 = uref_block_peek(section1, size1 - PSI_CRC_SIZE,
+                                          PSI_CRC_SIZE, buffer1);
+    const uint8_t *crc2 = uref_block_peek(section2, size2 - PSI_CRC_SIZE,
+                                          PSI_CRC_SIZE, buffer2);
+    equal = crc1 != NULL && crc2 != NULL &&
+            !memcmp(crc1, crc2, PSI_CRC_SIZE);
+    if (crc1 != NULL)
+        uref_block_peek_unmap(section1, size1 - PSI_CRC_SIZE, buffer1, crc1);
+    if (crc2 != NULL)
+        uref_block_peek_unmap(section2, size2 - PSI_CRC_SIZE, buffer2, crc2);
+    return equal;
+}
+
 /** @This declares a PSI table in a structure.
  *
  * @param table name of the member
@@ -59,22 +105,30 @@ static inline bool upipe_ts_psid_equal(struct uref *section1,
 /** @This initializes a PSI table.
  *
  * @param sections PSI table
+ * @param nb_p pointer to the number of sections of the table, or NULL
  */
-static inline void upipe_ts_psid_table_init(struct uref **sections)
+static inline void upipe_ts_psid_table_init(struct uref **sections,
+                                            unsigned int *nb_p)
 {
     for (int i = 0; i < PSI_TABLE_MAX_SECTIONS; i++)
         sections[i] = NULL;
+    if (nb_p != NULL)
+        *nb_p = 0;
 }
 
 /** @This cleans up a PSI table.
  *
  * @param sections PSI table
+ * @param nb_p pointer to the number of sections of the table, or NULL
  */
-static inline void upipe_ts_psid_table_clean(struct uref **sections)
+static inline void upipe_ts_psid_table_clean(struct uref **sections,
+                                             unsigned int *nb_p)
 {
     for (int i = 0; i < PSI_TABLE_MAX_SECTIONS; i++)
         if (sections[i] != NULL)
             uref_free(sections[i]);
+    if (nb_p != NULL)
+        *nb_p = 0;
 }
 
 /** @This checks if a PSI table is valid.
@@ -142,10 +196,12 @@ static inline uint16_t
 /** @This inserts a new section that composes a table.
  *
  * @param sections PSI table
+ * @param nb_p pointer to the number of sections of the table, or NULL
  * @param uref new section
  * @return true if the table is complete
  */
 static inline bool upipe_ts_psid_table_section(struct uref **sections,
+                                               unsigned int *nb_p,
                                                struct uref *uref)
 {
     uint8_t buffer[PSI_HEADER_SIZE_SYNTAX1];
@@ -163,6 +219,8 @@ static inline bool upipe_ts_psid_table_section(struct uref **sections,
     int err = uref_block_peek_unmap(uref, 0, buffer, section_header);
     ubase_assert(err);
 
+    if (sections[section] == NULL && nb_p != NULL)
+        (*nb_p)++;
     uref_free(sections[section]);
     sections[section] = uref;
 
@@ -186,6 +244,8 @@ static inline bool upipe_ts_psid_table_section(struct uref **sections,
 
     /* free spurious, invalid sections */
     for ( ; i < PSI_TABLE_MAX_SECTIONS; i++) {
+        if (sections[i] != NULL && nb_p != NULL)
+            (*nb_p)--;
         uref_free(sections[i]);
         sections[i] = NULL;
     }
@@ -244,6 +304,59 @@ static inline bool upipe_ts_psid_table_compare(struct uref **sections1,
     return true;
 }
 
+/** @This checks if a new section is a repetition of the section with the
+ * same number in a table, from its header (table id, extension, version,
+ * section numbers, length) and CRC. In that case the section may be dropped
+ * without being gathered, merged and compared.
+ *
+ * Sections are only skipped while no new table is being gathered, so that
+ * a table whose content changes without a version bump is still gathered
+ * as a whole, and compared. If a section differs from the section with the
+ * same number being gathered, the table changed again during the gathering
+ * and the partial new table is dropped.
+ *
+ * @param sections currently in effect PSI table
+ * @param next_sections PSI table being gathered
+ * @param nb_next_p pointer to the number of sections of the table being
+ * gathered
+ * @param uref new section
+ * @param last_p filled in with true if the section is the last one of the
+ * table
+ * @return true if the section is already in the table
+ */
+static inline bool upipe_ts_psid_table_skip(struct uref **sections,
+                                            struct uref **next_sections,
+                                            unsigned int *nb_next_p,
+                                            struct uref *uref, bool *last_p)
+{
+    uint8_t buffer[PSI_HEADER_SIZE_SYNTAX1];
+    const uint8_t *section_header = uref_block_peek(uref, 0,
+                                                    PSI_HEADER_SIZE_SYNTAX1,
+                                                    buffer);
+    if (unlikely(section_header == NULL))
+        return false;
+    uint8_t section = psi_get_section(section_header);
+    uint8_t last_section = psi_get_lastsection(section_header);
+    int err = uref_block_peek_unmap(uref, 0, buffer, section_header);
+    ubase_assert(err);
+
+    if (*nb_next_p) {
+        if (next_sections[section] != NULL &&
+            !upipe_ts_psid_equal_crc(next_sections[section], uref)) {
+            upipe_ts_psid_table_clean(next_sections, nb_next_p);
+            upipe_ts_psid_table_init(next_sections, nb_next_p);
+        }
+        return false;
+    }
+
+    if (!upipe_ts_psid_table_validate(sections) ||
+        !upipe_ts_psid_equal_crc(sections[section], uref))
+        return false;
+    if (last_p != NULL)
+        *last_p = section == last_section;
+    return true;
+}
+
 /** @This calls @ref ubuf_block_merge on all sections of the PSI table.
  *
  * @param sections PSI table
@@ -44,6 +44,7 @@
 #include <upipe-ts/upipe_ts_sdt_decoder.h>
 #include <upipe-ts/uref_ts_flow.h>
 #include "upipe_ts_psi_decoder.h"
+#include "upipe_ts_crc.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -92,6 +93,10 @@ struct upipe_ts_sdtd {
     UPIPE_TS_PSID_TABLE_DECLARE(sdt);
     /** SDT table being gathered */
     UPIPE_TS_PSID_TABLE_DECLARE(next_sdt);
+    /** number of sections of the SDT table being gathered */
+    unsigned int nb_next_sdt;
+    /** number of unchanged sections skipped */
+    uint64_t skipped;
     /** current TSID */
     int tsid;
     /** current original network ID */
@@ -142,8 +147,10 @@ static struct upipe *upipe_ts_sdtd_alloc(struct upipe_mgr *mgr,
     upipe_ts_sdtd_init_ubuf_mgr(upipe);
     upipe_ts_sdtd_init_flow_def(upipe);
     upipe_ts_sdtd_init_iconv(upipe);
-    upipe_ts_psid_table_init(upipe_ts_sdtd->sdt);
-    upipe_ts_psid_table_init(upipe_ts_sdtd->next_sdt);
+    upipe_ts_psid_table_init(upipe_ts_sdtd->sdt, NULL);
+    upipe_ts_psid_table_init(upipe_ts_sdtd->next_sdt,
+                             &upipe_ts_sdtd->nb_next_sdt);
+    upipe_ts_sdtd->skipped = 0;
     upipe_ts_sdtd->tsid = upipe_ts_sdtd->onid = -1;
     ulist_init(&upipe_ts_sdtd->services);
     upipe_throw_ready(upipe);
@@ -220,7 +227,7 @@ static bool upipe_ts_sdtd_table_validate(struct upipe *upipe)
                                                   &section))))
             return false;
 
-        if (!sdt_validate(section) || !psi_check_crc(section)) {
+        if (!sdt_validate(section) || !upipe_ts_psi_check_crc(section)) {
             uref_block_unmap(section_uref, 0);
             return false;
         }
@@ -362,15 +369,27 @@ static void upipe_ts_sdtd_input(struct upipe *upipe, struct uref *uref,
     struct upipe_ts_sdtd *upipe_ts_sdtd = upipe_ts_sdtd_from_upipe(upipe);
     assert(upipe_ts_sdtd->flow_def_input != NULL);
 
-    if (!upipe_ts_psid_table_section(upipe_ts_sdtd->next_sdt, uref))
+    if (upipe_ts_psid_table_skip(upipe_ts_sdtd->sdt,
+                                 upipe_ts_sdtd->next_sdt,
+                                 &upipe_ts_sdtd->nb_next_sdt, uref, NULL)) {
+        /* Identical section. */
+        upipe_ts_sdtd->skipped++;
+        uref_free(uref);
+        return;
+    }
+
+    if (!upipe_ts_psid_table_section(upipe_ts_sdtd->next_sdt,
+                                     &upipe_ts_sdtd->nb_next_sdt, uref))
         return;
 
     if (upipe_ts_psid_table_validate(upipe_ts_sdtd->sdt) &&
         upipe_ts_psid_table_compare(upipe_ts_sdtd->sdt,
                                     upipe_ts_sdtd->next_sdt)) {
         /* Identical SDT. */
-        upipe_ts_psid_table_clean(upipe_ts_sdtd->next_sdt);
-        upipe_ts_psid_table_init(upipe_ts_sdtd->next_sdt);
+        upipe_ts_psid_table_clean(upipe_ts_sdtd->next_sdt,
+                                  &upipe_ts_sdtd->nb_next_sdt);
+        upipe_ts_psid_table_init(upipe_ts_sdtd->next_sdt,
+                                 &upipe_ts_sdtd->nb_next_sdt);
         return;
     }
 
@@ -378,8 +397,10 @@ static void upipe_ts_sdtd_input(struct upipe *upipe, struct uref *uref,
                                                upipe_ts_sdtd->ubuf_mgr)) ||
         !upipe_ts_sdtd_table_validate(upipe)) {
         upipe_warn(upipe, "invalid SDT section received");
-        upipe_ts_psid_table_clean(upipe_ts_sdtd->next_sdt);
-        upipe_ts_psid_table_init(upipe_ts_sdtd->next_sdt);
+        upipe_ts_psid_table_clean(upipe_ts_sdtd->next_sdt,
+                                  &upipe_ts_sdtd->nb_next_sdt);
+        upipe_ts_psid_table_init(upipe_ts_sdtd->next_sdt,
+                                 &upipe_ts_sdtd->nb_next_sdt);
         return;
     }
 
@@ -434,9 +455,10 @@ static void upipe_ts_sdtd_input(struct upipe *upipe, struct uref *uref,
 
     /* Switch tables. */
     if (upipe_ts_psid_table_validate(upipe_ts_sdtd->sdt))
-        upipe_ts_psid_table_clean(upipe_ts_sdtd->sdt);
+        upipe_ts_psid_table_clean(upipe_ts_sdtd->sdt, NULL);
     upipe_ts_psid_table_copy(upipe_ts_sdtd->sdt, upipe_ts_sdtd->next_sdt);
-    upipe_ts_psid_table_init(upipe_ts_sdtd->next_sdt);
+    upipe_ts_psid_table_init(upipe_ts_sdtd->next_sdt,
+                             &upipe_ts_sdtd->nb_next_sdt);
 
     upipe_split_throw_update(upipe);
 }
@@ -520,6 +542,12 @@ static int upipe_ts_sdtd_control(struct upipe *upipe, int command, va_list args)
             struct uref *flow_def = va_arg(args, struct uref *);
             return upipe_ts_sdtd_set_flow_def(upipe, flow_def);
         }
+        case UPIPE_TS_SDTD_GET_SKIPPED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_SDTD_SIGNATURE)
+            uint64_t *p = va_arg(args, uint64_t *);
+            *p = upipe_ts_sdtd_from_upipe(upipe)->skipped;
+            return UBASE_ERR_NONE;
+        }
         case UPIPE_SPLIT_ITERATE: {
             struct uref **p = va_arg(args, struct uref **);
             return upipe_ts_sdtd_iterate(upipe, p);
@@ -539,8 +567,9 @@ static void upipe_ts_sdtd_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     struct upipe_ts_sdtd *upipe_ts_sdtd = upipe_ts_sdtd_from_upipe(upipe);
-    upipe_ts_psid_table_clean(upipe_ts_sdtd->sdt);
-    upipe_ts_psid_table_clean(upipe_ts_sdtd->next_sdt);
+    upipe_ts_psid_table_clean(upipe_ts_sdtd->sdt, NULL);
+    upipe_ts_psid_table_clean(upipe_ts_sdtd->next_sdt,
+                              &upipe_ts_sdtd->nb_next_sdt);
     upipe_ts_sdtd_clean_services(upipe);
     upipe_ts_sdtd_clean_output(upipe);
     upipe_ts_sdtd_clean_ubuf_mgr(upipe);
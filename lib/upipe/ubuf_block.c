@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe buffer handling for block managers
+ * This file defines the non-inline parts of the block-specific API.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+
+#include <stdlib.h>
+
+/** minimum number of entries allocated for an offset index */
+#define UBUF_BLOCK_INDEX_MIN 64
+
+/** @This builds or extends the offset index of a segmented block, so that
+ * the following lookups are done in O(log n). Only the segments following
+ * the last indexed segment are walked.
+ *
+ * @param ubuf pointer to head ubuf
+ * @return an error code
+ */
+int ubuf_block_index_build(struct ubuf *ubuf)
+{
+    if (unlikely(ubuf->mgr->signature != UBUF_ALLOC_BLOCK))
+        return UBASE_ERR_INVALID;
+
+    struct ubuf_block *head_block = ubuf_block_from_ubuf(ubuf);
+    size_t count = head_block->index_count;
+    size_t offset = 0;
+    struct ubuf *segment = ubuf;
+    if (count) {
+        struct ubuf_block_index *last = &head_block->index[count - 1];
+        struct ubuf_block *block = ubuf_block_from_ubuf(last->ubuf);
+        offset = last->offset + block->size;
+        segment = block->next_ubuf;
+    }
+
+    while (segment != NULL) {
+        if (unlikely(count >= head_block->index_size)) {
+            size_t size = head_block->index_size * 2;
+            if (size < UBUF_BLOCK_INDEX_MIN)
+                size = UBUF_BLOCK_INDEX_MIN;
+            struct ubuf_block_index *index =
+                realloc(head_block->index, size * sizeof(*index));
+            if (unlikely(index == NULL)) {
+                head_block->index_count = count;
+                return UBASE_ERR_ALLOC;
+            }
+            head_block->index = index;
+            head_block->index_size = size;
+        }
+
+        struct ubuf_block *block = ubuf_block_from_ubuf(segment);
+        head_block->index[count].offset = offset;
+        head_block->index[count].ubuf = segment;
+        count++;
+        offset += block->size;
+        segment = block->next_ubuf;
+    }
+
+    head_block->index_count = count;
+    return UBASE_ERR_NONE;
+}
@@ -34,8 +34,25 @@
 #include <upipe/uclock_std.h>
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <time.h>
 
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__MACH__)
+/** @hidden */
+#define UCLOCK_STD_TSC
+#include <string.h>
+#include <cpuid.h>
+#include <x86intrin.h>
+
+/** duration of the initial TSC calibration */
+#define UCLOCK_STD_TSC_CALIBRATION (UCLOCK_FREQ / 200)
+/** period between two re-synchronizations of the TSC with the system clock */
+#define UCLOCK_STD_TSC_PERIOD (UCLOCK_FREQ / 10)
+/** file describing the clocksource used by the Linux kernel */
+#define UCLOCK_STD_TSC_CLOCKSOURCE \
+    "/sys/devices/system/clocksource/clocksource0/current_clocksource"
+#endif
+
 #ifdef __MACH__
 #include <string.h>
 #include <mach/clock.h>
@@ -53,6 +70,24 @@ struct uclock_std {
     /** mach cclock structure */
     clock_serv_t cclock;
 #endif
+#ifdef UCLOCK_STD_TSC
+    /** sequence number of the conversion parameters, odd during update */
+    uint32_t tsc_seq;
+    /** TSC value at the origin of the conversion */
+    uint64_t tsc_base;
+    /** time at the origin of the conversion, in 27 MHz ticks */
+    uint64_t tsc_base_ticks;
+    /** 32.32 fixed-point number of 27 MHz ticks per TSC tick */
+    uint64_t tsc_mult;
+    /** TSC value after which the conversion must be re-synchronized */
+    uint64_t tsc_next;
+    /** number of TSC ticks between re-synchronizations */
+    uint64_t tsc_period;
+    /** TSC value at calibration */
+    uint64_t tsc_cal;
+    /** system time at calibration, in 27 MHz ticks */
+    uint64_t tsc_cal_ticks;
+#endif
 
     /** structure exported to modules */
     struct uclock uclock;
@@ -100,6 +135,162 @@ static uint64_t uclock_std_now(struct uclock *uclock)
     return uclock_std_now_inner(uclock, std->flags);
 }
 
+#ifdef UCLOCK_STD_TSC
+/** @internal @This converts a number of TSC ticks to 27 MHz ticks.
+ *
+ * @param delta number of TSC ticks
+ * @param mult 32.32 fixed-point number of 27 MHz ticks per TSC tick
+ * @return number of 27 MHz ticks
+ */
+static inline uint64_t uclock_std_tsc_convert(uint64_t delta, uint64_t mult)
+{
+    return ((unsigned __int128)delta * mult) >> 32;
+}
+
+/** @internal @This re-synchronizes the TSC conversion with the monotonic
+ * system clock. The new conversion starts where the previous one ends, so
+ * that time never goes backwards, and its slope is set to absorb the
+ * accumulated error over the next period. Forward errors larger than half
+ * a period are stepped instead.
+ *
+ * @param std pointer to uclock_std
+ * @param seq sequence number of the parameters read by the caller
+ * @return false if another thread is already re-synchronizing
+ */
+static bool uclock_std_tsc_sync(struct uclock_std *std, uint32_t seq)
+{
+    if (!__atomic_compare_exchange_n(&std->tsc_seq, &seq, seq + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return false;
+
+    unsigned int aux;
+    struct timespec ts;
+    uint64_t tsc = __rdtscp(&aux);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    tsc += (__rdtscp(&aux) - tsc) / 2;
+    uint64_t mono = ts.tv_sec * UCLOCK_FREQ +
+                    ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+
+    if (unlikely(tsc < std->tsc_base))
+        tsc = std->tsc_base;
+    uint64_t ticks = std->tsc_base_ticks +
+        uclock_std_tsc_convert(tsc - std->tsc_base, std->tsc_mult);
+    /* rate measured since calibration */
+    uint64_t rate = ((unsigned __int128)(mono - std->tsc_cal_ticks) << 32) /
+                    (tsc - std->tsc_cal);
+    int64_t period = uclock_std_tsc_convert(std->tsc_period, rate);
+    int64_t error = mono - ticks;
+    if (error > period / 2) {
+        ticks = mono;
+        error = 0;
+    } else if (error < -period / 2)
+        error = -period / 2;
+
+    uint64_t mult = ((unsigned __int128)(period + error) << 32) /
+                    std->tsc_period;
+    __atomic_store_n(&std->tsc_base, tsc, __ATOMIC_RELAXED);
+    __atomic_store_n(&std->tsc_base_ticks, ticks, __ATOMIC_RELAXED);
+    __atomic_store_n(&std->tsc_mult, mult, __ATOMIC_RELAXED);
+    __atomic_store_n(&std->tsc_next, tsc + std->tsc_period, __ATOMIC_RELAXED);
+    __atomic_store_n(&std->tsc_seq, seq + 2, __ATOMIC_RELEASE);
+    return true;
+}
+
+/** @This returns the current system time from the TSC.
+ *
+ * @param uclock utility structure passed to the module
+ * @return current system time in 27 MHz ticks
+ */
+static uint64_t uclock_std_now_tsc(struct uclock *uclock)
+{
+    struct uclock_std *std = uclock_std_from_uclock(uclock);
+    for ( ; ; ) {
+        uint32_t seq = __atomic_load_n(&std->tsc_seq, __ATOMIC_ACQUIRE);
+        uint64_t base = __atomic_load_n(&std->tsc_base, __ATOMIC_RELAXED);
+        uint64_t ticks = __atomic_load_n(&std->tsc_base_ticks,
+                                         __ATOMIC_RELAXED);
+        uint64_t mult = __atomic_load_n(&std->tsc_mult, __ATOMIC_RELAXED);
+        uint64_t next = __atomic_load_n(&std->tsc_next, __ATOMIC_RELAXED);
+        /* rdtscp waits for the loads above */
+        unsigned int aux;
+        uint64_t tsc = __rdtscp(&aux);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (unlikely((seq & 1) ||
+                     __atomic_load_n(&std->tsc_seq, __ATOMIC_RELAXED) != seq))
+            continue;
+        if (unlikely(tsc >= next) && uclock_std_tsc_sync(std, seq))
+            continue;
+        /* guard against a slight skew between CPUs */
+        return ticks + uclock_std_tsc_convert(tsc > base ? tsc - base : 0,
+                                              mult);
+    }
+}
+
+/** @internal @This checks whether the TSC is invariant and trusted by the
+ * system, and calibrates it against the monotonic system clock.
+ *
+ * @param std pointer to uclock_std
+ * @return false if the TSC cannot be used
+ */
+static bool uclock_std_tsc_init(struct uclock_std *std)
+{
+    unsigned int eax, ebx, ecx, edx;
+    /* rdtscp */
+    if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) ||
+        !(edx & (1 << 27)))
+        return false;
+    /* invariant TSC */
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+        return false;
+
+    /* the kernel stops using the TSC when it finds it unstable (or
+     * unsynchronized between CPUs) */
+    FILE *file = fopen(UCLOCK_STD_TSC_CLOCKSOURCE, "r");
+    if (file != NULL) {
+        char clocksource[32];
+        bool tsc = fgets(clocksource, sizeof(clocksource), file) != NULL &&
+                   !strcmp(clocksource, "tsc\n");
+        fclose(file);
+        if (!tsc)
+            return false;
+    }
+
+    unsigned int aux;
+    struct timespec ts;
+    uint64_t tsc = __rdtscp(&aux);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    tsc += (__rdtscp(&aux) - tsc) / 2;
+    uint64_t start = ts.tv_sec * UCLOCK_FREQ +
+                     ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+    uint64_t mono;
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        mono = ts.tv_sec * UCLOCK_FREQ +
+               ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+    } while (mono < start + UCLOCK_STD_TSC_CALIBRATION);
+    uint64_t end = __rdtscp(&aux);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    end += (__rdtscp(&aux) - end) / 2;
+    mono = ts.tv_sec * UCLOCK_FREQ +
+           ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+    if (unlikely(end <= tsc))
+        return false;
+
+    uint64_t mult = ((unsigned __int128)(mono - start) << 32) / (end - tsc);
+    if (unlikely(!mult))
+        return false;
+    std->tsc_seq = 0;
+    std->tsc_cal = tsc;
+    std->tsc_cal_ticks = start;
+    std->tsc_base = end;
+    std->tsc_base_ticks = mono;
+    std->tsc_mult = mult;
+    std->tsc_period = ((unsigned __int128)UCLOCK_STD_TSC_PERIOD << 32) / mult;
+    std->tsc_next = end + std->tsc_period;
+    return true;
+}
+#endif
+
 /** @This converts a system time to Epoch-based real time (from
  * 1970-01-01 00:00:00 +0000). The scale is in units of @ref #UCLOCK_FREQ,
  * divide by it to get standard time_t.
@@ -115,7 +306,7 @@ static uint64_t uclock_std_to_real(struct uclock *uclock, uint64_t systime)
     if (std->flags & UCLOCK_FLAG_REALTIME)
         return systime;
 
-    uint64_t now = uclock_std_now(uclock);
+    uint64_t now = uclock->uclock_now(uclock);
     uint64_t ref = uclock_std_now_inner(uclock, UCLOCK_FLAG_REALTIME);
     return ref + systime - now;
 }
@@ -134,7 +325,7 @@ static uint64_t uclock_std_from_real(struct uclock *uclock, uint64_t real)
     if (std->flags & UCLOCK_FLAG_REALTIME)
         return real;
 
-    uint64_t now = uclock_std_now(uclock);
+    uint64_t now = uclock->uclock_now(uclock);
     uint64_t ref = uclock_std_now_inner(uclock, UCLOCK_FLAG_REALTIME);
     return now + real - ref;
 }
@@ -186,6 +377,11 @@ struct uclock *uclock_std_alloc(enum uclock_std_flags flags)
     uclock_std->uclock.uclock_now = uclock_std_now;
     uclock_std->uclock.uclock_to_real = uclock_std_to_real;
     uclock_std->uclock.uclock_from_real = uclock_std_from_real;
+#ifdef UCLOCK_STD_TSC
+    if ((flags & (UCLOCK_FLAG_TSC | UCLOCK_FLAG_REALTIME)) == UCLOCK_FLAG_TSC &&
+        uclock_std_tsc_init(uclock_std))
+        uclock_std->uclock.uclock_now = uclock_std_now_tsc;
+#endif
 #ifdef __MACH__
     memcpy(&uclock_std->cclock, &cclock, sizeof(cclock));
 #endif
@@ -31,6 +31,7 @@
  */
 
 #include <upipe/ubase.h>
+#include <upipe/uatomic.h>
 #include <upipe/urefcount.h>
 #include <upipe/upool.h>
 #include <upipe/umem.h>
@@ -47,6 +48,10 @@
 #define UDICT_MIN_SIZE 128
 /** default extra space added on udict expansion */
 #define UDICT_EXTRA_SIZE 64
+/** number of attributes above which lookups go through the index */
+#define UDICT_INDEX_MIN 8
+/** minimal number of entries of the index (power of 2) */
+#define UDICT_INDEX_MIN_SIZE 32
 
 /** @internal @This represents a shorthand attribute type. */
 struct inline_shorthand {
@@ -102,7 +107,9 @@ static const struct inline_shorthand inline_shorthands[] = {
     { "p.bf", UDICT_TYPE_VOID },
     { "p.tff", UDICT_TYPE_VOID },
     { "p.afd", UDICT_TYPE_SMALL_UNSIGNED },
-    { "p.cea_708", UDICT_TYPE_OPAQUE }
+    { "p.cea_708", UDICT_TYPE_OPAQUE },
+
+    { "t.id", UDICT_TYPE_UNSIGNED }
 };
 
 /** @This stores the size of the value of basic attribute types. */
@@ -120,9 +127,16 @@ struct udict_inline_mgr {
 
     /** udict pool */
     struct upool udict_pool;
+    /** shared buffer pool */
+    struct upool shared_pool;
     /** umem allocator */
     struct umem_mgr *umem_mgr;
 
+    /** number of udicts duplicated by sharing their buffer */
+    uatomic_uint32_t shared;
+    /** number of shared buffers copied on write */
+    uatomic_uint32_t detached;
+
 #ifdef STATS
     uint64_t stats[sizeof(inline_shorthands) / sizeof(struct inline_shorthand)];
 #endif
@@ -134,13 +148,42 @@ struct udict_inline_mgr {
 UBASE_FROM_TO(udict_inline_mgr, udict_mgr, udict_mgr, mgr)
 UBASE_FROM_TO(udict_inline_mgr, urefcount, urefcount, urefcount)
 UBASE_FROM_TO(udict_inline_mgr, upool, udict_pool, udict_pool)
+UBASE_FROM_TO(udict_inline_mgr, upool, shared_pool, shared_pool)
 
-/** super-set of the udict structure with additional local members */
-struct udict_inline {
+/** @internal @This is the buffer of attributes, which may be shared between
+ * several duplicated udicts until one of them is modified. */
+struct udict_inline_shared {
+    /** number of udicts pointing to the buffer */
+    uatomic_uint32_t refcount;
     /** umem structure pointing to buffer */
     struct umem umem;
+};
+
+/** @internal @This is an entry of the attribute index of a udict. */
+struct udict_inline_entry {
+    /** offset of the attribute in the buffer */
+    uint32_t offset;
+    /** hash of the name (0 for shorthands) */
+    uint32_t hash;
+    /** type of the attribute, or UDICT_TYPE_END if the entry is free */
+    uint8_t type;
+};
+
+/** super-set of the udict structure with additional local members */
+struct udict_inline {
+    /** pointer to the shared buffer */
+    struct udict_inline_shared *shared;
     /** used size */
     size_t size;
+    /** number of attributes */
+    size_t count;
+
+    /** open-addressed index of attributes (kept across pool reuse) */
+    struct udict_inline_entry *index;
+    /** number of allocated entries in the index */
+    size_t index_size;
+    /** true if the index reflects the buffer */
+    bool index_valid;
 
     /** common structure */
     struct udict udict;
@@ -148,6 +191,80 @@ struct udict_inline {
 
 UBASE_FROM_TO(udict_inline, udict, udict, udict)
 
+/** @internal @This returns the buffer of attributes of a udict.
+ *
+ * @param inl pointer to the udict_inline
+ * @return pointer to the buffer
+ */
+static inline uint8_t *udict_inline_buffer(struct udict_inline *inl)
+{
+    return umem_buffer(&inl->shared->umem);
+}
+
+/** @internal @This allocates a shared buffer.
+ *
+ * @param inline_mgr pointer to the udict_inline_mgr
+ * @param size size of the buffer
+ * @return pointer to the shared buffer, or NULL in case of allocation error
+ */
+static struct udict_inline_shared *
+    udict_inline_shared_alloc(struct udict_inline_mgr *inline_mgr, size_t size)
+{
+    struct udict_inline_shared *shared =
+        upool_alloc(&inline_mgr->shared_pool, struct udict_inline_shared *);
+    if (unlikely(shared == NULL))
+        return NULL;
+    if (unlikely(!umem_alloc(inline_mgr->umem_mgr, &shared->umem, size))) {
+        upool_free(&inline_mgr->shared_pool, shared);
+        return NULL;
+    }
+    uatomic_store(&shared->refcount, 1);
+    return shared;
+}
+
+/** @internal @This releases a shared buffer, and frees it if it was the last
+ * reference.
+ *
+ * @param inline_mgr pointer to the udict_inline_mgr
+ * @param shared pointer to the shared buffer
+ */
+static void udict_inline_shared_release(struct udict_inline_mgr *inline_mgr,
+                                        struct udict_inline_shared *shared)
+{
+    if (uatomic_fetch_sub(&shared->refcount, 1) == 1) {
+        umem_free(&shared->umem);
+        upool_free(&inline_mgr->shared_pool, shared);
+    }
+}
+
+/** @internal @This makes sure the buffer of attributes of a udict is not
+ * shared with another udict, so that it can be written to. Offsets in the
+ * buffer are preserved.
+ *
+ * @param inl pointer to the udict_inline
+ * @return an error code
+ */
+static int udict_inline_detach(struct udict_inline *inl)
+{
+    struct udict_inline_shared *shared = inl->shared;
+    if (likely(uatomic_load(&shared->refcount) == 1))
+        return UBASE_ERR_NONE;
+
+    struct udict_inline_mgr *inline_mgr =
+        udict_inline_mgr_from_udict_mgr(inl->udict.mgr);
+    struct udict_inline_shared *new_shared =
+        udict_inline_shared_alloc(inline_mgr, umem_size(&shared->umem));
+    if (unlikely(new_shared == NULL))
+        return UBASE_ERR_ALLOC;
+
+    memcpy(umem_buffer(&new_shared->umem), umem_buffer(&shared->umem),
+           inl->size);
+    inl->shared = new_shared;
+    udict_inline_shared_release(inline_mgr, shared);
+    uatomic_fetch_add(&inline_mgr->detached, 1);
+    return UBASE_ERR_NONE;
+}
+
 /** @This allocates a udict with attributes space.
  *
  * @param mgr common management structure
@@ -159,23 +276,29 @@ static struct udict *udict_inline_alloc(struct udict_mgr *mgr, size_t size)
     struct udict_inline_mgr *inline_mgr = udict_inline_mgr_from_udict_mgr(mgr);
     struct udict_inline *inl = upool_alloc(&inline_mgr->udict_pool,
                                            struct udict_inline *);
+    if (unlikely(inl == NULL))
+        return NULL;
     struct udict *udict = udict_inline_to_udict(inl);
 
     if (size < inline_mgr->min_size)
         size = inline_mgr->min_size;
-    if (unlikely(!umem_alloc(inline_mgr->umem_mgr, &inl->umem, size))) {
+    inl->shared = udict_inline_shared_alloc(inline_mgr, size);
+    if (unlikely(inl->shared == NULL)) {
         upool_free(&inline_mgr->udict_pool, inl);
         return NULL;
     }
 
-    uint8_t *buffer = umem_buffer(&inl->umem);
+    uint8_t *buffer = udict_inline_buffer(inl);
     buffer[0] = UDICT_TYPE_END;
     inl->size = 1;
+    inl->count = 0;
+    inl->index_valid = false;
 
     return udict;
 }
 
-/** @This duplicates a given udict.
+/** @This duplicates a given udict. The buffer of attributes is shared
+ * between both udicts until one of them is modified.
  *
  * @param udict pointer to udict
  * @param new_udict_p reference written with a pointer to the newly allocated
@@ -185,16 +308,37 @@ static struct udict *udict_inline_alloc(struct udict_mgr *mgr, size_t size)
 static int udict_inline_dup(struct udict *udict, struct udict **new_udict_p)
 {
     assert(new_udict_p != NULL);
+    struct udict_inline_mgr *inline_mgr =
+        udict_inline_mgr_from_udict_mgr(udict->mgr);
     struct udict_inline *inl = udict_inline_from_udict(udict);
-    struct udict *new_udict = udict_inline_alloc(udict->mgr, inl->size);
-    if (unlikely(new_udict == NULL))
+    struct udict_inline *new_inl = upool_alloc(&inline_mgr->udict_pool,
+                                               struct udict_inline *);
+    if (unlikely(new_inl == NULL))
         return UBASE_ERR_ALLOC;
 
-    *new_udict_p = new_udict;
-
-    struct udict_inline *new_inl = udict_inline_from_udict(new_udict);
-    memcpy(umem_buffer(&new_inl->umem), umem_buffer(&inl->umem), inl->size);
+    uatomic_fetch_add(&inl->shared->refcount, 1);
+    new_inl->shared = inl->shared;
     new_inl->size = inl->size;
+    new_inl->count = inl->count;
+    new_inl->index_valid = false;
+    if (inl->index_valid) {
+        if (new_inl->index_size < inl->index_size) {
+            struct udict_inline_entry *index =
+                realloc(new_inl->index, inl->index_size * sizeof(*index));
+            if (index != NULL) {
+                new_inl->index = index;
+                new_inl->index_size = inl->index_size;
+            }
+        }
+        if (new_inl->index_size == inl->index_size) {
+            memcpy(new_inl->index, inl->index,
+                   inl->index_size * sizeof(*inl->index));
+            new_inl->index_valid = true;
+        }
+    }
+    uatomic_fetch_add(&inline_mgr->shared, 1);
+
+    *new_udict_p = udict_inline_to_udict(new_inl);
     return UBASE_ERR_NONE;
 }
 
@@ -236,6 +380,83 @@ static uint8_t *udict_inline_next(uint8_t *attr)
     return attr + 3 + size;
 }
 
+/** @internal @This hashes an attribute name (FNV-1a).
+ *
+ * @param name name of the attribute
+ * @return hash of the name
+ */
+static inline uint32_t udict_inline_name_hash(const char *name)
+{
+    uint32_t hash = 2166136261U;
+    for (const char *c = name; *c; c++)
+        hash = (hash ^ (uint8_t)*c) * 16777619U;
+    return hash;
+}
+
+/** @internal @This returns the first index entry to probe for an attribute.
+ *
+ * @param inl pointer to the udict_inline
+ * @param hash hash of the name of the attribute
+ * @param type type of the attribute
+ * @return index of the entry
+ */
+static inline size_t udict_inline_index_hash(struct udict_inline *inl,
+                                             uint32_t hash,
+                                             enum udict_type type)
+{
+    return ((hash ^ type) * 2654435761U) & (inl->index_size - 1);
+}
+
+/** @internal @This adds an attribute to the index, which must have a free
+ * entry.
+ *
+ * @param inl pointer to the udict_inline
+ * @param attr pointer to the attribute
+ */
+static void udict_inline_index_add(struct udict_inline *inl, uint8_t *attr)
+{
+    uint32_t hash = 0;
+    if (*attr <= UDICT_TYPE_SHORTHAND)
+        hash = udict_inline_name_hash((const char *)(attr + 3));
+
+    size_t i = udict_inline_index_hash(inl, hash, *attr);
+    while (inl->index[i].type != UDICT_TYPE_END)
+        i = (i + 1) & (inl->index_size - 1);
+    inl->index[i].offset = attr - udict_inline_buffer(inl);
+    inl->index[i].hash = hash;
+    inl->index[i].type = *attr;
+}
+
+/** @internal @This builds the index of attributes from the buffer.
+ *
+ * @param inl pointer to the udict_inline
+ * @return false if the index could not be built
+ */
+static bool udict_inline_index_build(struct udict_inline *inl)
+{
+    size_t index_size = UDICT_INDEX_MIN_SIZE;
+    while (index_size < inl->count * 2)
+        index_size *= 2;
+    if (index_size > inl->index_size) {
+        struct udict_inline_entry *index =
+            realloc(inl->index, index_size * sizeof(*index));
+        if (unlikely(index == NULL))
+            return false;
+        inl->index = index;
+        inl->index_size = index_size;
+    }
+    for (size_t i = 0; i < inl->index_size; i++)
+        inl->index[i].type = UDICT_TYPE_END;
+
+    uint8_t *attr = udict_inline_buffer(inl);
+    while (attr != NULL && *attr != UDICT_TYPE_END) {
+        udict_inline_index_add(inl, attr);
+        attr = udict_inline_next(attr);
+    }
+    inl->index_valid = true;
+    return true;
+}
+
 /** @internal @This finds an attribute (shorthand or not) of the given name
  * and type and returns a pointer to its beginning.
  *
@@ -255,10 +476,30 @@ static uint8_t *udict_inline_find(struct udict *udict, const char *name,
         inline_mgr->stats[type - UDICT_TYPE_SHORTHAND - 1]++;
     }
 #endif
-    uint8_t *attr = umem_buffer(&inl->umem);
+    uint8_t *attr = udict_inline_buffer(inl);
+    if (type == UDICT_TYPE_END)
+        return attr + inl->size - 1;
+
+    if (inl->count >= UDICT_INDEX_MIN &&
+        (inl->index_valid || udict_inline_index_build(inl))) {
+        uint32_t hash = 0;
+        if (type <= UDICT_TYPE_SHORTHAND)
+            hash = udict_inline_name_hash(name);
+        size_t i = udict_inline_index_hash(inl, hash, type);
+        while (inl->index[i].type != UDICT_TYPE_END) {
+            struct udict_inline_entry *entry = &inl->index[i];
+            if (entry->type == type && entry->hash == hash &&
+                (type > UDICT_TYPE_SHORTHAND ||
+                 !strcmp((const char *)(attr + entry->offset + 3), name)))
+                return attr + entry->offset;
+            i = (i + 1) & (inl->index_size - 1);
+        }
+        return NULL;
+    }
+
     while (attr != NULL) {
         if (*attr == type &&
-             (type > UDICT_TYPE_SHORTHAND || type == UDICT_TYPE_END ||
+             (type > UDICT_TYPE_SHORTHAND ||
               !strcmp((const char *)(attr + 3), name)))
             return attr;
         attr = udict_inline_next(attr);
@@ -288,7 +529,7 @@ static void udict_inline_iterate(struct udict *udict, const char **name_p,
         if (likely(attr != NULL))
             attr = udict_inline_next(attr);
     } else
-        attr = umem_buffer(&inl->umem);
+        attr = udict_inline_buffer(inl);
     if (unlikely(attr == NULL || *attr == UDICT_TYPE_END)) {
         *type_p = UDICT_TYPE_END;
         return;
@@ -381,9 +622,15 @@ static int udict_inline_delete(struct udict *udict, const char *name,
     if (unlikely(attr == NULL))
         return UBASE_ERR_INVALID;
 
+    size_t offset = attr - udict_inline_buffer(inl);
+    UBASE_RETURN(udict_inline_detach(inl))
+    attr = udict_inline_buffer(inl) + offset;
+
     uint8_t *end = udict_inline_next(attr);
-    memmove(attr, end, umem_buffer(&inl->umem) + inl->size - end);
+    memmove(attr, end, udict_inline_buffer(inl) + inl->size - end);
     inl->size -= end - attr;
+    inl->count--;
+    inl->index_valid = false;
     return UBASE_ERR_NONE;
 }
 
@@ -409,6 +656,7 @@ static int udict_inline_set(struct udict *udict, const char *name,
             return UBASE_ERR_INVALID;
         base_type = shorthand->base_type;
     }
+    UBASE_RETURN(udict_inline_detach(inl))
 
     /* check if it already exists */
     size_t current_size;
@@ -444,17 +692,17 @@ static int udict_inline_set(struct udict *udict, const char *name,
     }
 
     /* check total attributes size */
-    attr = umem_buffer(&inl->umem) + inl->size - 1;
-    size_t total_size = (attr - umem_buffer(&inl->umem)) + header_size +
+    attr = udict_inline_buffer(inl) + inl->size - 1;
+    size_t total_size = (attr - udict_inline_buffer(inl)) + header_size +
                         attr_size + 1;
-    if (unlikely(total_size >= umem_size(&inl->umem))) {
+    if (unlikely(total_size >= umem_size(&inl->shared->umem))) {
         struct udict_inline_mgr *inline_mgr =
             udict_inline_mgr_from_udict_mgr(udict->mgr);
-        if (unlikely(!umem_realloc(&inl->umem, total_size +
+        if (unlikely(!umem_realloc(&inl->shared->umem, total_size +
                                                inline_mgr->extra_size)))
             return UBASE_ERR_ALLOC;
 
-        attr = umem_buffer(&inl->umem) + inl->size - 1;
+        attr = udict_inline_buffer(inl) + inl->size - 1;
     }
     assert(*attr == UDICT_TYPE_END);
 
@@ -481,6 +729,13 @@ static int udict_inline_set(struct udict *udict, const char *name,
     if (attr_p != NULL)
         *attr_p = attr;
     inl->size += header_size + attr_size;
+    inl->count++;
+    if (inl->index_valid) {
+        if (inl->count * 2 > inl->index_size)
+            inl->index_valid = false;
+        else
+            udict_inline_index_add(inl, attr - header_size);
+    }
     return UBASE_ERR_NONE;
 }
 
@@ -566,7 +821,7 @@ static void udict_inline_free(struct udict *udict)
         udict_inline_mgr_from_udict_mgr(udict->mgr);
     struct udict_inline *inl = udict_inline_from_udict(udict);
 
-    umem_free(&inl->umem);
+    udict_inline_shared_release(inline_mgr, inl->shared);
     upool_free(&inline_mgr->udict_pool, inl);
 }
 
@@ -584,19 +839,51 @@ static void *udict_inline_alloc_inner(struct upool *upool)
         return NULL;
     struct udict *udict = udict_inline_to_udict(inl);
     udict->mgr = udict_inline_mgr_to_udict_mgr(inline_mgr);
+    inl->index = NULL;
+    inl->index_size = 0;
     return inl;
 }
 
 /** @internal @This frees a udict_inline.
  *
  * @param upool pointer to upool
- * @param inl pointer to a udict_inline structure to free
+ * @param _inl pointer to a udict_inline structure to free
  */
-static void udict_inline_free_inner(struct upool *upool, void *inl)
+static void udict_inline_free_inner(struct upool *upool, void *_inl)
 {
+    struct udict_inline *inl = (struct udict_inline *)_inl;
+    free(inl->index);
     free(inl);
 }
 
+/** @internal @This allocates the shared data structure.
+ *
+ * @param upool pointer to upool
+ * @return pointer to udict_inline_shared or NULL in case of allocation error
+ */
+static void *udict_inline_shared_alloc_inner(struct upool *upool)
+{
+    struct udict_inline_shared *shared =
+        malloc(sizeof(struct udict_inline_shared));
+    if (unlikely(shared == NULL))
+        return NULL;
+    uatomic_init(&shared->refcount, 1);
+    return shared;
+}
+
+/** @internal @This frees a udict_inline_shared.
+ *
+ * @param upool pointer to upool
+ * @param _shared pointer to a udict_inline_shared structure to free
+ */
+static void udict_inline_shared_free_inner(struct upool *upool, void *_shared)
+{
+    struct udict_inline_shared *shared =
+        (struct udict_inline_shared *)_shared;
+    uatomic_clean(&shared->refcount);
+    free(shared);
+}
+
 /** @internal @This instructs an existing udict manager to release all
  * structures currently kept in pools. It is intended as a debug tool only.
  *
@@ -606,6 +893,7 @@ static void udict_inline_mgr_vacuum(struct udict_mgr *mgr)
 {
     struct udict_inline_mgr *inline_mgr = udict_inline_mgr_from_udict_mgr(mgr);
     upool_vacuum(&inline_mgr->udict_pool);
+    upool_vacuum(&inline_mgr->shared_pool);
 }
 
 /** @This processes control commands on a udict_std_mgr.
@@ -622,6 +910,18 @@ static int udict_inline_mgr_control(struct udict_mgr *mgr,
         case UDICT_MGR_VACUUM:
             udict_inline_mgr_vacuum(mgr);
             return UBASE_ERR_NONE;
+        case UDICT_INLINE_MGR_GET_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UDICT_INLINE_SIGNATURE)
+            struct udict_inline_mgr *inline_mgr =
+                udict_inline_mgr_from_udict_mgr(mgr);
+            uint32_t *shared_p = va_arg(args, uint32_t *);
+            uint32_t *detached_p = va_arg(args, uint32_t *);
+            if (shared_p != NULL)
+                *shared_p = uatomic_load(&inline_mgr->shared);
+            if (detached_p != NULL)
+                *detached_p = uatomic_load(&inline_mgr->detached);
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -647,15 +947,20 @@ static void udict_inline_mgr_free(struct urefcount *urefcount)
 #endif
 
     upool_clean(&inline_mgr->udict_pool);
+    upool_clean(&inline_mgr->shared_pool);
     umem_mgr_release(inline_mgr->umem_mgr);
+    uatomic_clean(&inline_mgr->shared);
+    uatomic_clean(&inline_mgr->detached);
 
     urefcount_clean(urefcount);
     free(inline_mgr);
 }
 
-/** @This allocates a new instance of the inline udict manager.
+/** @This allocates a new instance of the inline udict manager. Duplicated
+ * udicts share their buffer of attributes until one of them is modified.
  *
- * @param udict_pool_depth maximum number of udict structures in the pool
+ * @param udict_pool_depth maximum number of udict structures (and shared
+ * buffers) in the pools
  * @param umem_mgr memory allocator to use for buffers
  * @param min_size minimum allocated space for the udict (if set to -1, a
  * default sensible value is used)
@@ -669,7 +974,7 @@ struct udict_mgr *udict_inline_mgr_alloc(uint16_t udict_pool_depth,
 {
     struct udict_inline_mgr *inline_mgr =
         malloc(sizeof(struct udict_inline_mgr) +
-               upool_sizeof(udict_pool_depth));
+               2 * upool_sizeof(udict_pool_depth));
     if (unlikely(inline_mgr == NULL))
         return NULL;
 
@@ -685,8 +990,15 @@ struct udict_mgr *udict_inline_mgr_alloc(uint16_t udict_pool_depth,
                udict_pool_depth,
                (void *)inline_mgr + sizeof(struct udict_inline_mgr),
                udict_inline_alloc_inner, udict_inline_free_inner);
+    upool_init(&inline_mgr->shared_pool, inline_mgr->mgr.refcount,
+               udict_pool_depth,
+               (void *)inline_mgr + sizeof(struct udict_inline_mgr) +
+               upool_sizeof(udict_pool_depth),
+               udict_inline_shared_alloc_inner, udict_inline_shared_free_inner);
     inline_mgr->umem_mgr = umem_mgr;
     umem_mgr_use(umem_mgr);
+    uatomic_init(&inline_mgr->shared, 0);
+    uatomic_init(&inline_mgr->detached, 0);
 
     inline_mgr->min_size = min_size > 0 ? min_size : UDICT_MIN_SIZE;
     inline_mgr->extra_size = extra_size > 0 ? extra_size : UDICT_EXTRA_SIZE;
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe per-pipe profiling counters
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_profile.h>
+
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/** @internal @This stores the profiling state of a thread. */
+struct upipe_profile_thread {
+    /** counters of the pipe currently running */
+    struct upipe_profile *current;
+    /** cycles spent by the pipes called by the current pipe */
+    uint64_t children;
+    /** number of nested profiled calls */
+    unsigned int depth;
+    /** number of call trees started */
+    unsigned int trees;
+    /** true if the current call tree is timed */
+    bool timed;
+};
+
+/** profiling state of this thread; the initial-exec model avoids a call
+ * to __tls_get_addr on each access from the shared library */
+static __thread struct upipe_profile_thread upipe_profile_thread
+    __attribute__((tls_model("initial-exec")));
+
+/** @internal @This returns a timestamp in CPU cycles (or in nanoseconds on
+ * platforms without a cycle counter).
+ *
+ * @return timestamp
+ */
+static inline uint64_t upipe_profile_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+#endif
+}
+
+/** @This returns a timestamp in CPU cycles (or in nanoseconds on platforms
+ * without a cycle counter).
+ *
+ * @return timestamp
+ */
+uint64_t upipe_profile_cycles(void)
+{
+    return upipe_profile_now();
+}
+
+/** @internal @This starts running a function of a pipe. Only one call tree
+ * out of @ref UPIPE_PROFILE_CYCLES_SAMPLING is timed, so that the cost of
+ * reading the cycle counter is not paid on every call.
+ *
+ * @param thread profiling state of the thread
+ * @param profile pointer to counters
+ * @param children_p filled in with the cycles of the children of the caller
+ * @param start_p filled in with the timestamp at the beginning of the call
+ * @return counters of the caller
+ */
+static inline struct upipe_profile *
+    upipe_profile_enter(struct upipe_profile_thread *thread,
+                        struct upipe_profile *profile, uint64_t *children_p,
+                        uint64_t *start_p)
+{
+    struct upipe_profile *parent = thread->current;
+    thread->current = profile;
+    if (!thread->depth++)
+        thread->timed = !(thread->trees++ % UPIPE_PROFILE_CYCLES_SAMPLING);
+    if (thread->timed) {
+        *children_p = thread->children;
+        thread->children = 0;
+        *start_p = upipe_profile_now();
+    }
+    return parent;
+}
+
+/** @internal @This accounts the cycles spent since @ref upipe_profile_enter,
+ * excluding cycles spent in other profiled pipes.
+ *
+ * @param thread profiling state of the thread
+ * @param profile pointer to counters
+ * @param parent counters of the caller
+ * @param children cycles of the children of the caller
+ * @param start timestamp at the beginning of the call
+ */
+static inline void upipe_profile_leave(struct upipe_profile_thread *thread,
+                                       struct upipe_profile *profile,
+                                       struct upipe_profile *parent,
+                                       uint64_t children, uint64_t start)
+{
+    if (thread->timed) {
+        uint64_t elapsed = upipe_profile_now() - start;
+        profile->total_cycles += elapsed * UPIPE_PROFILE_CYCLES_SAMPLING;
+        profile->cycles += (elapsed - thread->children) *
+                           UPIPE_PROFILE_CYCLES_SAMPLING;
+        thread->children = children + elapsed;
+    }
+    thread->depth--;
+    thread->current = parent;
+}
+
+/** @This sends a uref into a profiled pipe, updating its counters.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure to send
+ * @param upump_p reference to the pump that generated the buffer
+ */
+void upipe_profile_input(struct upipe *upipe, struct uref *uref,
+                         struct upump **upump_p)
+{
+    struct upipe_profile_thread *thread = &upipe_profile_thread;
+    struct upipe_profile *profile = upipe->profile;
+    if (thread->current != NULL)
+        thread->current->outputs++;
+
+    if (profile->uclock != NULL &&
+        !(profile->inputs % UPIPE_PROFILE_LATENCY_SAMPLING)) {
+        uint64_t cr_sys;
+        if (ubase_check(uref_clock_get_cr_sys(uref, &cr_sys))) {
+            uint64_t now = uclock_now(profile->uclock);
+            uint64_t latency = now > cr_sys ? now - cr_sys : 0;
+            profile->latency_count++;
+            profile->latency_sum += latency;
+            if (latency > profile->latency_max)
+                profile->latency_max = latency;
+        }
+    }
+    profile->inputs++;
+
+    uint64_t children = 0, start = 0;
+    struct upipe_profile *parent =
+        upipe_profile_enter(thread, profile, &children, &start);
+    upipe->mgr->upipe_input(upipe, uref, upump_p);
+    upipe_profile_leave(thread, profile, parent, children, start);
+}
+
+/** @This calls the callback of a pump, accounting it to the pipe owning
+ * the pump, which must have counters.
+ *
+ * @param upump description structure of the pump
+ */
+void upipe_profile_dispatch(struct upump *upump)
+{
+    struct upipe_profile_thread *thread = &upipe_profile_thread;
+    struct upipe_profile *profile = *upump->profile_p;
+    profile->pumps++;
+
+    uint64_t children = 0, start = 0;
+    struct upipe_profile *parent =
+        upipe_profile_enter(thread, profile, &children, &start);
+    upump->cb(upump);
+    upipe_profile_leave(thread, profile, parent, children, start);
+}
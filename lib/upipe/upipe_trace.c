@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe uref lifecycle tracing
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uatomic.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_trace.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_profile.h>
+#include <upipe/upipe_trace.h>
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+/** @internal @This is an event recorded by a thread. */
+struct upipe_trace_event {
+    /** traced pipe */
+    struct upipe_trace_pipe *pipe;
+    /** date of the entry in the pipe */
+    uint64_t enter;
+    /** date of the exit from the pipe */
+    uint64_t exit;
+    /** trace identifier of the uref */
+    uint32_t id;
+    /** true if the uref was tagged by this pipe */
+    bool first;
+};
+
+/** @internal @This is the ring buffer of events of a thread. It is only
+ * written by its thread, and never removed before the tracer is cleaned. */
+struct upipe_trace_ring {
+    /** next ring buffer of the tracer */
+    struct upipe_trace_ring *next;
+    /** identity of the thread owning the ring buffer */
+    const void *thread;
+    /** number of the thread in the trace */
+    unsigned int tid;
+    /** number of events written since the creation */
+    uatomic_uint32_t count;
+    /** events */
+    struct upipe_trace_event events[];
+};
+
+/** the address of this variable identifies the current thread */
+static __thread char upipe_trace_thread;
+/** number of untagged urefs seen by this thread since the last sample */
+static __thread unsigned int upipe_trace_counter = 0;
+/** number of traced pipes currently running in this thread */
+static __thread unsigned int upipe_trace_depth = 0;
+
+/** @This initializes a tracer.
+ *
+ * @param trace pointer to tracer
+ * @param uclock uclock used to timestamp events
+ * @param sampling one uref out of this number is tagged (0 to only follow
+ * urefs which are already tagged)
+ * @param ring_size number of events kept for each thread, rounded up to a
+ * power of 2 (0 for the default)
+ * @return an error code
+ */
+int upipe_trace_init(struct upipe_trace *trace, struct uclock *uclock,
+                     unsigned int sampling, unsigned int ring_size)
+{
+    if (unlikely(uclock == NULL))
+        return UBASE_ERR_INVALID;
+
+    if (!ring_size)
+        ring_size = UPIPE_TRACE_RING_SIZE;
+    trace->ring_size = 1;
+    while (trace->ring_size < ring_size)
+        trace->ring_size <<= 1;
+    trace->uclock = uclock_use(uclock);
+    trace->sampling = sampling;
+    trace->start = uclock_now(uclock);
+    uatomic_init(&trace->last_id, 0);
+    uatomic_init(&trace->nb_rings, 0);
+    uatomic_ptr_init(&trace->rings, NULL);
+    return UBASE_ERR_NONE;
+}
+
+/** @This cleans up a tracer. All threads must have stopped recording events.
+ *
+ * @param trace pointer to tracer
+ */
+void upipe_trace_clean(struct upipe_trace *trace)
+{
+    struct upipe_trace_ring *ring =
+        uatomic_ptr_load_ptr(&trace->rings, struct upipe_trace_ring *);
+    while (ring != NULL) {
+        struct upipe_trace_ring *next = ring->next;
+        uatomic_clean(&ring->count);
+        free(ring);
+        ring = next;
+    }
+    uatomic_ptr_clean(&trace->rings);
+    uatomic_clean(&trace->nb_rings);
+    uatomic_clean(&trace->last_id);
+    uclock_release(trace->uclock);
+}
+
+/** @internal @This returns the ring buffer of the current thread, allocating
+ * it if needed.
+ *
+ * @param trace pointer to tracer
+ * @return pointer to the ring buffer, or NULL in case of allocation error
+ */
+static struct upipe_trace_ring *upipe_trace_ring(struct upipe_trace *trace)
+{
+    struct upipe_trace_ring *ring =
+        uatomic_ptr_load_ptr(&trace->rings, struct upipe_trace_ring *);
+    for ( ; ring != NULL; ring = ring->next)
+        if (ring->thread == &upipe_trace_thread)
+            return ring;
+
+    ring = malloc(sizeof(struct upipe_trace_ring) +
+                  trace->ring_size * sizeof(struct upipe_trace_event));
+    if (unlikely(ring == NULL))
+        return NULL;
+    ring->thread = &upipe_trace_thread;
+    ring->tid = uatomic_fetch_add(&trace->nb_rings, 1) + 1;
+    uatomic_init(&ring->count, 0);
+
+    void *next = uatomic_ptr_load(&trace->rings);
+    do
+        ring->next = next;
+    while (!uatomic_ptr_compare_exchange(&trace->rings, &next, ring));
+    return ring;
+}
+
+/** @internal @This sends a uref into a pipe, through its profiling counters
+ * if any, while preventing the pipes it calls from sampling other urefs.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure to send
+ * @param upump_p reference to the pump that generated the buffer
+ */
+static inline void upipe_trace_forward(struct upipe *upipe,
+                                       struct uref *uref,
+                                       struct upump **upump_p)
+{
+    upipe_trace_depth++;
+    if (unlikely(upipe->profile != NULL))
+        upipe_profile_input(upipe, uref, upump_p);
+    else
+        upipe->mgr->upipe_input(upipe, uref, upump_p);
+    upipe_trace_depth--;
+}
+
+/** @This sends a uref into a traced pipe, tagging it if it is sampled and
+ * recording the time it spent in the pipe if it is tagged. Only urefs which
+ * are not sent by another traced pipe of the same thread are sampled, so
+ * untagged urefs crossing a thread boundary may be sampled again.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure to send
+ * @param upump_p reference to the pump that generated the buffer
+ */
+void upipe_trace_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct upipe_trace_pipe *pipe = upipe->trace;
+    struct upipe_trace *trace = pipe->trace;
+    uint64_t id;
+    bool first = false;
+
+    if (!ubase_check(uref_trace_get_id(uref, &id))) {
+        /* only sample urefs entering the traced pipes of this thread */
+        if (upipe_trace_depth || !trace->sampling ||
+            ++upipe_trace_counter < trace->sampling) {
+            upipe_trace_forward(upipe, uref, upump_p);
+            return;
+        }
+        upipe_trace_counter = 0;
+        id = uatomic_fetch_add(&trace->last_id, 1) + 1;
+        if (unlikely(!ubase_check(uref_trace_set_id(uref, id)))) {
+            upipe_trace_forward(upipe, uref, upump_p);
+            return;
+        }
+        first = true;
+    }
+
+    uint64_t enter = uclock_now(trace->uclock);
+    upipe_trace_forward(upipe, uref, upump_p);
+    uint64_t exit = uclock_now(trace->uclock);
+
+    struct upipe_trace_ring *ring = upipe_trace_ring(trace);
+    if (unlikely(ring == NULL))
+        return;
+    uint32_t count = uatomic_load(&ring->count);
+    struct upipe_trace_event *event =
+        &ring->events[count & (trace->ring_size - 1)];
+    event->pipe = pipe;
+    event->enter = enter;
+    event->exit = exit;
+    event->id = id;
+    event->first = first;
+    uatomic_store(&ring->count, count + 1);
+}
+
+/** @internal @This writes a JSON string without the quotes.
+ *
+ * @param file file to write to
+ * @param string string to escape
+ */
+static void upipe_trace_write_string(FILE *file, const char *string)
+{
+    for ( ; *string; string++) {
+        if (*string == '"' || *string == '\\')
+            fputc('\\', file);
+        if ((unsigned char)*string >= 0x20)
+            fputc(*string, file);
+    }
+}
+
+/** @This writes the recorded events in the Chrome trace event format (JSON
+ * object format). Each slice is the time spent by a tagged uref in a pipe,
+ * and slices of the same uref are linked by flow events. Events which are
+ * recorded during the call may be skipped or garbled.
+ *
+ * @param trace pointer to tracer
+ * @param file file to write to
+ * @return an error code
+ */
+int upipe_trace_write(struct upipe_trace *trace, FILE *file)
+{
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    const char *separator = "";
+    struct upipe_trace_ring *ring =
+        uatomic_ptr_load_ptr(&trace->rings, struct upipe_trace_ring *);
+    for ( ; ring != NULL; ring = ring->next) {
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                "\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                separator, ring->tid, ring->tid);
+        separator = ",";
+
+        uint32_t count = uatomic_load(&ring->count);
+        uint32_t nb = count < trace->ring_size ? count : trace->ring_size;
+        for (uint32_t i = count - nb; i != count; i++) {
+            struct upipe_trace_event *event =
+                &ring->events[i & (trace->ring_size - 1)];
+            double ts = (int64_t)(event->enter - trace->start) *
+                        1000000. / UCLOCK_FREQ;
+            double dur = (event->exit - event->enter) * 1000000. / UCLOCK_FREQ;
+
+            fprintf(file, ",\n{\"name\":\"");
+            upipe_trace_write_string(file, event->pipe->name);
+            fprintf(file, "\",\"cat\":\"%4.4s\",\"ph\":\"X\",\"pid\":1,"
+                    "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"args\":{\"id\":%"PRIu32"}}",
+                    (const char *)&event->pipe->signature, ring->tid,
+                    ts, dur, event->id);
+            fprintf(file, ",\n{\"name\":\"uref\",\"cat\":\"uref\","
+                    "\"ph\":\"%s\",\"id\":%"PRIu32",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%.3f,\"bp\":\"e\"}",
+                    event->first ? "s" : "t", event->id, ring->tid, ts);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    return ferror(file) ? UBASE_ERR_EXTERNAL : UBASE_ERR_NONE;
+}
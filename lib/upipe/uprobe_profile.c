@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe attaching profiling counters to pipes
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/umutex.h>
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_profile.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_dump.h>
+#include <upipe/upipe_profile.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+/** @internal @This stores the counters of a profiled pipe. */
+struct uprobe_profile_pipe {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** pointer to the probe which attached the counters */
+    struct uprobe_profile *uprobe_profile;
+    /** pointer to the pipe */
+    struct upipe *upipe;
+
+    /** counters */
+    struct upipe_profile profile;
+};
+
+UBASE_FROM_TO(uprobe_profile_pipe, uchain, uchain, uchain)
+UBASE_FROM_TO(uprobe_profile_pipe, upipe_profile, profile, profile)
+
+/** @internal @This attaches counters to a pipe.
+ *
+ * @param uprobe_profile pointer to probe
+ * @param upipe pointer to pipe
+ */
+static void uprobe_profile_attach(struct uprobe_profile *uprobe_profile,
+                                  struct upipe *upipe)
+{
+    struct uprobe_profile_pipe *pipe =
+        malloc(sizeof(struct uprobe_profile_pipe));
+    if (unlikely(pipe == NULL))
+        return;
+    uchain_init(uprobe_profile_pipe_to_uchain(pipe));
+    pipe->uprobe_profile = uprobe_profile;
+    pipe->upipe = upipe;
+    upipe_profile_init(&pipe->profile, uprobe_profile->uclock);
+
+    umutex_lock(uprobe_profile->umutex);
+    ulist_add(&uprobe_profile->pipes, uprobe_profile_pipe_to_uchain(pipe));
+    umutex_unlock(uprobe_profile->umutex);
+
+    upipe->profile = &pipe->profile;
+}
+
+/** @internal @This detaches counters from a pipe.
+ *
+ * @param uprobe_profile pointer to probe
+ * @param upipe pointer to pipe
+ */
+static void uprobe_profile_detach(struct uprobe_profile *uprobe_profile,
+                                  struct upipe *upipe)
+{
+    struct uprobe_profile_pipe *pipe =
+        uprobe_profile_pipe_from_profile(upipe->profile);
+    if (pipe->uprobe_profile != uprobe_profile)
+        return;
+
+    upipe->profile = NULL;
+
+    umutex_lock(uprobe_profile->umutex);
+    ulist_delete(uprobe_profile_pipe_to_uchain(pipe));
+    umutex_unlock(uprobe_profile->umutex);
+    free(pipe);
+}
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_profile_throw(struct uprobe *uprobe, struct upipe *upipe,
+                                int event, va_list args)
+{
+    struct uprobe_profile *uprobe_profile =
+        uprobe_profile_from_uprobe(uprobe);
+
+    if (upipe != NULL) {
+        if (event == UPROBE_READY && upipe->profile == NULL)
+            uprobe_profile_attach(uprobe_profile, upipe);
+        else if (event == UPROBE_DEAD && upipe->profile != NULL)
+            uprobe_profile_detach(uprobe_profile, upipe);
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** @This initializes an already allocated uprobe_profile structure.
+ *
+ * @param uprobe_profile pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock uclock used to sample latencies, or NULL to disable them
+ * @param umutex mutex protecting the probe if it is used by pipes running
+ * in several threads, or NULL
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_profile_init(struct uprobe_profile *uprobe_profile,
+                                   struct uprobe *next, struct uclock *uclock,
+                                   struct umutex *umutex)
+{
+    assert(uprobe_profile != NULL);
+    struct uprobe *uprobe = uprobe_profile_to_uprobe(uprobe_profile);
+    uprobe_profile->uclock = uclock_use(uclock);
+    uprobe_profile->umutex = umutex_use(umutex);
+    ulist_init(&uprobe_profile->pipes);
+    uprobe_init(uprobe, uprobe_profile_throw, next);
+    return uprobe;
+}
+
+/** @This cleans a uprobe_profile structure. The profiled pipes must have
+ * been released before.
+ *
+ * @param uprobe_profile structure to clean
+ */
+void uprobe_profile_clean(struct uprobe_profile *uprobe_profile)
+{
+    assert(uprobe_profile != NULL);
+    struct uprobe *uprobe = uprobe_profile_to_uprobe(uprobe_profile);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&uprobe_profile->pipes, uchain, uchain_tmp) {
+        struct uprobe_profile_pipe *pipe =
+            uprobe_profile_pipe_from_uchain(uchain);
+        pipe->upipe->profile = NULL;
+        ulist_delete(uchain);
+        free(pipe);
+    }
+    umutex_release(uprobe_profile->umutex);
+    uclock_release(uprobe_profile->uclock);
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next, struct uclock *uclock, \
+                  struct umutex *umutex
+#define ARGS next, uclock, umutex
+UPROBE_HELPER_ALLOC(uprobe_profile)
+#undef ARGS
+#undef ARGS_DECL
+
+/** @internal @This returns the name given to a pipe by its prefix probe.
+ *
+ * @param upipe pointer to pipe
+ * @return name of the pipe, or an empty string
+ */
+static const char *uprobe_profile_name(struct upipe *upipe)
+{
+    struct uprobe *uprobe = upipe->uprobe;
+    const char *prefix = NULL;
+    while (uprobe != NULL && prefix == NULL) {
+        prefix = uprobe_pfx_get_name(uprobe);
+        uprobe = uprobe->next;
+    }
+    return prefix ?: "";
+}
+
+/** @This writes a snapshot of the counters of all profiled pipes, as a
+ * single line of JSON. It is typically called periodically, and consecutive
+ * snapshots may be subtracted to get rates.
+ *
+ * @param uprobe pointer to probe
+ * @param file file to write to
+ * @return an error code
+ */
+int uprobe_profile_snapshot(struct uprobe *uprobe, FILE *file)
+{
+    struct uprobe_profile *uprobe_profile =
+        uprobe_profile_from_uprobe(uprobe);
+
+    fprintf(file, "{\"date\":%"PRIu64",\"cycles\":%"PRIu64",\"pipes\":[",
+            uprobe_profile->uclock != NULL ?
+            uclock_now(uprobe_profile->uclock) : 0, upipe_profile_cycles());
+
+    umutex_lock(uprobe_profile->umutex);
+    bool first = true;
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_profile->pipes, uchain) {
+        struct uprobe_profile_pipe *pipe =
+            uprobe_profile_pipe_from_uchain(uchain);
+        struct upipe_profile *profile = &pipe->profile;
+        fprintf(file, "%s{\"id\":\"%p\",\"name\":\"", first ? "" : ",",
+                pipe->upipe);
+        for (const char *c = uprobe_profile_name(pipe->upipe); *c; c++) {
+            if (*c == '"' || *c == '\\')
+                fputc('\\', file);
+            fputc(*c, file);
+        }
+        fprintf(file, "\",\"signature\":\"%4.4s\","
+                "\"inputs\":%"PRIu64",\"outputs\":%"PRIu64","
+                "\"pumps\":%"PRIu64",\"cycles\":%"PRIu64","
+                "\"total_cycles\":%"PRIu64","
+                "\"latency_samples\":%"PRIu64",\"latency_sum\":%"PRIu64","
+                "\"latency_max\":%"PRIu64","
+                "\"queue\":%u,\"queue_max\":%u}",
+                (const char *)&pipe->upipe->mgr->signature,
+                profile->inputs, profile->outputs, profile->pumps,
+                profile->cycles, profile->total_cycles,
+                profile->latency_count, profile->latency_sum,
+                profile->latency_max, profile->queue, profile->queue_max);
+        first = false;
+    }
+    umutex_unlock(uprobe_profile->umutex);
+
+    fprintf(file, "]}\n");
+    return ferror(file) ? UBASE_ERR_EXTERNAL : UBASE_ERR_NONE;
+}
+
+/** @This converts a pipe to a label with its profiling counters, for use
+ * as the pipe_label argument of @ref upipe_dump.
+ *
+ * @param upipe upipe structure
+ * @return allocated string
+ */
+char *uprobe_profile_upipe_label(struct upipe *upipe)
+{
+    char *label = upipe_dump_upipe_label_default(upipe);
+    struct upipe_profile *profile = upipe->profile;
+    if (profile == NULL || label == NULL)
+        return label;
+
+    /* share of the cycles of all pipes profiled by the same probe */
+    struct uprobe_profile *uprobe_profile =
+        uprobe_profile_pipe_from_profile(profile)->uprobe_profile;
+    uint64_t cycles = 0;
+    struct uchain *uchain;
+    umutex_lock(uprobe_profile->umutex);
+    ulist_foreach (&uprobe_profile->pipes, uchain)
+        cycles += uprobe_profile_pipe_from_uchain(uchain)->profile.cycles;
+    umutex_unlock(uprobe_profile->umutex);
+
+    uint64_t calls = profile->inputs + profile->pumps;
+    size_t size = strlen(label) + 256;
+    char *string = malloc(size);
+    if (unlikely(string == NULL)) {
+        free(label);
+        return NULL;
+    }
+    snprintf(string, size,
+            "%s\\n%"PRIu64" in / %"PRIu64" out / %"PRIu64" pumps"
+            "\\n%.1f%% cpu, %"PRIu64" cycles/call"
+            "\\nlatency %.3f ms avg, %.3f ms max"
+            "\\nqueue %u (max %u)",
+            label, profile->inputs, profile->outputs, profile->pumps,
+            cycles ? profile->cycles * 100. / cycles : 0.,
+            calls ? profile->cycles / calls : 0,
+            profile->latency_count ?
+            profile->latency_sum * 1000. / UCLOCK_FREQ /
+            profile->latency_count : 0.,
+            profile->latency_max * 1000. / UCLOCK_FREQ,
+            profile->queue, profile->queue_max);
+    free(label);
+    return string;
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe attaching a uref tracer to pipes
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/umutex.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_trace.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_trace.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+/** @internal @This returns the name given to a pipe by its prefix probe.
+ *
+ * @param upipe pointer to pipe
+ * @return name of the pipe, or an empty string
+ */
+static const char *uprobe_trace_name(struct upipe *upipe)
+{
+    struct uprobe *uprobe = upipe->uprobe;
+    const char *prefix = NULL;
+    while (uprobe != NULL && prefix == NULL) {
+        prefix = uprobe_pfx_get_name(uprobe);
+        uprobe = uprobe->next;
+    }
+    return prefix ?: "";
+}
+
+/** @internal @This attaches the tracer to a pipe.
+ *
+ * @param uprobe_trace pointer to probe
+ * @param upipe pointer to pipe
+ */
+static void uprobe_trace_attach(struct uprobe_trace *uprobe_trace,
+                                struct upipe *upipe)
+{
+    struct upipe_trace_pipe *pipe = malloc(sizeof(struct upipe_trace_pipe));
+    if (unlikely(pipe == NULL))
+        return;
+    pipe->name = strdup(uprobe_trace_name(upipe));
+    if (unlikely(pipe->name == NULL)) {
+        free(pipe);
+        return;
+    }
+    uchain_init(upipe_trace_pipe_to_uchain(pipe));
+    pipe->trace = &uprobe_trace->trace;
+    pipe->upipe = upipe;
+    pipe->signature = upipe->mgr->signature;
+
+    umutex_lock(uprobe_trace->umutex);
+    ulist_add(&uprobe_trace->pipes, upipe_trace_pipe_to_uchain(pipe));
+    umutex_unlock(uprobe_trace->umutex);
+
+    upipe->trace = pipe;
+}
+
+/** @internal @This detaches the tracer from a pipe. The description of the
+ * pipe is kept for the recorded events.
+ *
+ * @param uprobe_trace pointer to probe
+ * @param upipe pointer to pipe
+ */
+static void uprobe_trace_detach(struct uprobe_trace *uprobe_trace,
+                                struct upipe *upipe)
+{
+    struct upipe_trace_pipe *pipe = upipe->trace;
+    if (pipe->trace != &uprobe_trace->trace)
+        return;
+
+    umutex_lock(uprobe_trace->umutex);
+    pipe->upipe = NULL;
+    umutex_unlock(uprobe_trace->umutex);
+    upipe->trace = NULL;
+}
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_trace_throw(struct uprobe *uprobe, struct upipe *upipe,
+                              int event, va_list args)
+{
+    struct uprobe_trace *uprobe_trace = uprobe_trace_from_uprobe(uprobe);
+
+    if (upipe != NULL) {
+        if (event == UPROBE_READY && upipe->trace == NULL)
+            uprobe_trace_attach(uprobe_trace, upipe);
+        else if (event == UPROBE_DEAD && upipe->trace != NULL)
+            uprobe_trace_detach(uprobe_trace, upipe);
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** @This initializes an already allocated uprobe_trace structure.
+ *
+ * @param uprobe_trace pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock uclock used to timestamp events
+ * @param sampling one uref out of this number is tagged (0 to only follow
+ * urefs which are already tagged)
+ * @param umutex mutex protecting the probe if it is used by pipes running
+ * in several threads, or NULL
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_trace_init(struct uprobe_trace *uprobe_trace,
+                                 struct uprobe *next, struct uclock *uclock,
+                                 unsigned int sampling, struct umutex *umutex)
+{
+    assert(uprobe_trace != NULL);
+    struct uprobe *uprobe = uprobe_trace_to_uprobe(uprobe_trace);
+    if (unlikely(!ubase_check(upipe_trace_init(&uprobe_trace->trace, uclock,
+                                               sampling, 0)))) {
+        uprobe_release(next);
+        return NULL;
+    }
+    uprobe_trace->umutex = umutex_use(umutex);
+    ulist_init(&uprobe_trace->pipes);
+    uprobe_init(uprobe, uprobe_trace_throw, next);
+    return uprobe;
+}
+
+/** @This cleans a uprobe_trace structure. The traced pipes must have been
+ * released before.
+ *
+ * @param uprobe_trace structure to clean
+ */
+void uprobe_trace_clean(struct uprobe_trace *uprobe_trace)
+{
+    assert(uprobe_trace != NULL);
+    struct uprobe *uprobe = uprobe_trace_to_uprobe(uprobe_trace);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&uprobe_trace->pipes, uchain, uchain_tmp) {
+        struct upipe_trace_pipe *pipe = upipe_trace_pipe_from_uchain(uchain);
+        if (pipe->upipe != NULL)
+            pipe->upipe->trace = NULL;
+        ulist_delete(uchain);
+        free(pipe->name);
+        free(pipe);
+    }
+    upipe_trace_clean(&uprobe_trace->trace);
+    umutex_release(uprobe_trace->umutex);
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next, struct uclock *uclock, \
+                  unsigned int sampling, struct umutex *umutex
+#define ARGS next, uclock, sampling, umutex
+UPROBE_HELPER_ALLOC(uprobe_trace)
+#undef ARGS
+#undef ARGS_DECL
+
+/** @This writes the recorded events in the Chrome trace event format.
+ *
+ * @param uprobe pointer to probe
+ * @param file file to write to
+ * @return an error code
+ */
+int uprobe_trace_write(struct uprobe *uprobe, FILE *file)
+{
+    struct uprobe_trace *uprobe_trace = uprobe_trace_from_uprobe(uprobe);
+    return upipe_trace_write(&uprobe_trace->trace, file);
+}
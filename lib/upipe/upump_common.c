@@ -32,6 +32,7 @@
 #include <upipe/upool.h>
 #include <upipe/upump_common.h>
 #include <upipe/upump_blocker.h>
+#include <upipe/upipe_profile.h>
 
 #include <stdlib.h>
 
@@ -141,7 +142,10 @@ void upump_common_init(struct upump *upump)
 void upump_common_dispatch(struct upump *upump)
 {
     struct urefcount *refcount = urefcount_use(upump->refcount);
-    upump->cb(upump);
+    if (likely(upump->profile_p == NULL || *upump->profile_p == NULL))
+        upump->cb(upump);
+    else
+        upipe_profile_dispatch(upump);
     urefcount_release(refcount);
 }
 
@@ -0,0 +1,110 @@
+#!/usr/bin/env luajit
+
+local ffi = require "ffi"
+local upipe = require "upipe"
+
+require "upipe-modules"
+
+ffi.cdef [[ FILE *stderr; ]]
+
+local UPROBE_LOG_LEVEL = UPROBE_LOG_WARNING
+local UMEM_POOL = 512
+local UDICT_POOL_DEPTH = 500
+local UREF_POOL_DEPTH = 500
+local UBUF_POOL_DEPTH = 3000
+local UBUF_SHARED_POOL_DEPTH = 50
+local BLOCK_SIZE = 7 * 188
+local BLOCKS = tonumber(arg[1]) or 100000
+local BATCH_SIZE = tonumber(arg[2]) or 64
+
+-- managers
+local umem_mgr = umem.pool_simple(UMEM_POOL)
+local udict_mgr = udict.inline(UDICT_POOL_DEPTH, umem_mgr, -1, -1)
+local uref_mgr = uref.std(UREF_POOL_DEPTH, udict_mgr, 0)
+local ubuf_mgr = ubuf.block_mem(UBUF_POOL_DEPTH, UBUF_SHARED_POOL_DEPTH,
+                                umem_mgr, 0, 0, -1, 0)
+
+local function xor(buf, size)
+    for i = 0, size - 1 do
+        buf[i] = bit.bxor(buf[i], 0x42)
+    end
+end
+
+local control = {
+    set_flow_def = function (pipe, flow_def)
+        if not ubase_check(flow_def:flow_match_def("block.")) then
+            return "invalid"
+        end
+        pipe:helper_store_flow_def(flow_def:dup())
+    end
+}
+
+-- one callback per uref
+local upipe_xor_mgr = upipe {
+    output = true,
+
+    input = function (pipe, ref, pump)
+        for buf, size in ref:block_segments(true) do
+            xor(buf, size)
+        end
+        pipe:helper_output(ref, pump)
+    end,
+
+    control = control
+}
+
+-- one callback per batch, with the first segment of each uref mapped
+local upipe_xor_batch_mgr = upipe {
+    output = true,
+    batch_size = BATCH_SIZE,
+    batch_write = true,
+
+    input_batch = function (pipe, batch, pump)
+        for i = 0, batch.nb - 1 do
+            local size = 0
+            if batch.buffers[i] ~= nil then
+                size = batch.sizes[i]
+                xor(batch.buffers[i], size)
+            end
+            for buf, size in batch.urefs[i]:block_segments(true, size) do
+                xor(buf, size)
+            end
+        end
+    end,
+
+    control = control
+}
+
+-- probes
+local probe =
+    uprobe.ubuf_mem(umem_mgr, UBUF_POOL_DEPTH, UBUF_SHARED_POOL_DEPTH) ..
+    uprobe.uref_mgr(uref_mgr) ..
+    uprobe.stdio(ffi.C.stderr, UPROBE_LOG_LEVEL)
+
+local function pfx(tag)
+    return uprobe.pfx(UPROBE_LOG_LEVEL, tag) .. probe
+end
+
+local function bench(name, mgr)
+    local pipe = mgr:new(pfx(name))
+    pipe.output = upipe.null():new(pfx "null")
+    local flow_def = uref_block_flow_alloc_def(uref_mgr, "")
+    ubase_assert(pipe:set_flow_def(flow_def))
+    flow_def:free()
+
+    local start = os.clock()
+    for _ = 1, BLOCKS do
+        local ref = uref_block_alloc(uref_mgr, ubuf_mgr, BLOCK_SIZE)
+        assert(ref ~= nil, "uref_block_alloc failed")
+        pipe:input(ref, nil)
+    end
+    -- flushes the last batch
+    pipe:release()
+    local elapsed = os.clock() - start
+
+    print(string.format("%-10s %10.0f pkt/s %10.1f Mbits/s", name,
+        BLOCKS / elapsed, BLOCKS * BLOCK_SIZE * 8 / elapsed / 1e6))
+end
+
+bench("per-uref", upipe_xor_mgr)
+bench("batched", upipe_xor_batch_mgr)
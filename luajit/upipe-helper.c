@@ -14,6 +14,23 @@
 #include <upipe/upipe_helper_uref_stream.h>
 #include <upipe/upipe_helper_flow_def.h>
 #include <upipe/upipe_helper_upump.h>
+#include <upipe/uref_block.h>
+#include <upipe/upump.h>
+
+// maximum number of urefs in a batch
+#define UPIPE_HELPER_BATCH_MAX 64
+
+// urefs handed to Lua in a single call
+struct upipe_helper_batch {
+    // number of urefs
+    unsigned int nb;
+    // urefs, set to NULL by Lua to drop them
+    struct uref *urefs[UPIPE_HELPER_BATCH_MAX];
+    // first block segment of each uref, mapped, or NULL
+    uint8_t *buffers[UPIPE_HELPER_BATCH_MAX];
+    // size of the mapped segments
+    int sizes[UPIPE_HELPER_BATCH_MAX];
+};
 
 struct upipe_helper_mgr {
     struct upipe_mgr mgr;
@@ -34,6 +51,13 @@ struct upipe_helper_mgr {
 
     // uref_stream
     void (*stream_append_cb)(struct upipe *);
+
+    // batch
+    void (*input_batch)(struct upipe *, struct upipe_helper_batch *,
+                        struct upump **);
+    unsigned int batch_size;
+    bool batch_write;
+    uint64_t batch_timeout;
 };
 
 struct upipe_helper {
@@ -95,6 +119,10 @@ struct upipe_helper {
 
     // upump
     struct upump *upump;
+
+    // batch
+    struct upipe_helper_batch batch;
+    struct upump *batch_upump;
 };
 
 static struct upipe_helper_mgr *upipe_helper_mgr(struct upipe *upipe)
@@ -190,3 +218,126 @@ UPIPE_HELPER_UREF_STREAM(upipe_helper, next_uref, next_uref_size, stream_urefs,
                          append_cb);
 UPIPE_HELPER_FLOW_DEF(upipe_helper, flow_def_input, flow_def_attr);
 UPIPE_HELPER_UPUMP(upipe_helper, upump, upump_mgr);
+
+static void batch_unmap(struct upipe_helper_batch *batch, unsigned int i)
+{
+    if (batch->buffers[i] != NULL) {
+        uref_block_unmap(batch->urefs[i], 0);
+        batch->buffers[i] = NULL;
+    }
+}
+
+static void batch_flush(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_helper *upipe_helper = upipe_helper_from_upipe(upipe);
+    struct upipe_helper_mgr *mgr = upipe_helper_mgr(upipe);
+    struct upipe_helper_batch *batch = &upipe_helper->batch;
+
+    if (upipe_helper->batch_upump != NULL) {
+        upump_stop(upipe_helper->batch_upump);
+        upump_free(upipe_helper->batch_upump);
+        upipe_helper->batch_upump = NULL;
+    }
+    if (!batch->nb)
+        return;
+
+    mgr->input_batch(upipe, batch, upump_p);
+
+    for (unsigned int i = 0; i < batch->nb; i++) {
+        if (batch->urefs[i] == NULL)
+            continue;
+        batch_unmap(batch, i);
+        upipe_helper_output(upipe, batch->urefs[i], upump_p);
+    }
+    batch->nb = 0;
+}
+
+void upipe_helper_init_batch(struct upipe *upipe)
+{
+    struct upipe_helper *upipe_helper = upipe_helper_from_upipe(upipe);
+    upipe_helper->batch.nb = 0;
+    upipe_helper->batch_upump = NULL;
+}
+
+// hands the queued urefs to Lua, then outputs those that were not dropped
+void upipe_helper_flush_batch(struct upipe *upipe, struct upump **upump_p)
+{
+    upipe_use(upipe);
+    batch_flush(upipe, upump_p);
+    upipe_release(upipe);
+}
+
+static void batch_timer(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    upipe_helper_flush_batch(upipe, NULL);
+}
+
+// maps and queues a uref, and flushes the batch when it is full
+void upipe_helper_batch_input(struct upipe *upipe, struct uref *uref,
+                              struct upump **upump_p)
+{
+    struct upipe_helper *upipe_helper = upipe_helper_from_upipe(upipe);
+    struct upipe_helper_mgr *mgr = upipe_helper_mgr(upipe);
+    struct upipe_helper_batch *batch = &upipe_helper->batch;
+
+    unsigned int i = batch->nb;
+    batch->sizes[i] = -1;
+    int err = mgr->batch_write ?
+        uref_block_write(uref, 0, &batch->sizes[i], &batch->buffers[i]) :
+        uref_block_read(uref, 0, &batch->sizes[i],
+                        (const uint8_t **)&batch->buffers[i]);
+    if (!ubase_check(err) && mgr->batch_write && uref->ubuf != NULL) {
+        // the block is shared, write into a private copy
+        struct ubuf *ubuf = ubuf_block_copy(uref->ubuf->mgr, uref->ubuf,
+                                            0, -1);
+        if (ubuf != NULL) {
+            uref_attach_ubuf(uref, ubuf);
+            batch->sizes[i] = -1;
+            err = uref_block_write(uref, 0, &batch->sizes[i],
+                                   &batch->buffers[i]);
+        }
+    }
+    if (!ubase_check(err)) {
+        upipe_warn(upipe, "unable to map buffer, dropping");
+        uref_free(uref);
+        return;
+    }
+    batch->urefs[i] = uref;
+    batch->nb++;
+
+    if (batch->nb >= mgr->batch_size || batch->nb >= UPIPE_HELPER_BATCH_MAX) {
+        upipe_helper_flush_batch(upipe, upump_p);
+        return;
+    }
+
+    // bound the latency of the first uref of the batch
+    if (upipe_helper->batch_upump != NULL || !mgr->batch_timeout)
+        return;
+    upipe_helper_check_upump_mgr(upipe);
+    if (upipe_helper->upump_mgr == NULL)
+        return;
+    upipe_helper->batch_upump = upump_alloc_timer(upipe_helper->upump_mgr,
+            batch_timer, upipe, upipe->refcount, mgr->batch_timeout, 0);
+    if (upipe_helper->batch_upump == NULL) {
+        upipe_helper_flush_batch(upipe, upump_p);
+        return;
+    }
+    upump_start(upipe_helper->batch_upump);
+}
+
+// drops a uref of the batch
+void upipe_helper_batch_drop(struct upipe_helper_batch *batch, unsigned int i)
+{
+    if (i >= batch->nb || batch->urefs[i] == NULL)
+        return;
+    batch_unmap(batch, i);
+    uref_free(batch->urefs[i]);
+    batch->urefs[i] = NULL;
+}
+
+// flushes the remaining urefs, the pipe being released
+void upipe_helper_clean_batch(struct upipe *upipe)
+{
+    batch_flush(upipe, NULL);
+}
@@ -303,13 +303,47 @@ ffi.metatype("struct upipe", {
     end,
 })
 
+-- iterates over the block segments of a uref, mapping each one in turn;
+-- the loop must not be left early, or the last segment stays mapped
+local function block_segments(ref, write, offset)
+    local map = write and C.uref_block_write or C.uref_block_read
+    local size_p = ffi.new("size_t[1]")
+    assert(C.ubase_check(C.uref_block_size(ref, size_p)))
+    local size = tonumber(size_p[0])
+    local seg_p = ffi.new("int[1]")
+    local buffer_p = ffi.new(write and "uint8_t *[1]" or "const uint8_t *[1]")
+    local pos = offset or 0
+    local mapped
+    return function ()
+        if mapped then
+            C.uref_block_unmap(ref, mapped)
+            pos = pos + seg_p[0]
+            mapped = nil
+        end
+        if pos >= size then return nil end
+        seg_p[0] = size - pos
+        assert(C.ubase_check(map(ref, pos, seg_p, buffer_p)))
+        mapped = pos
+        return buffer_p[0], seg_p[0], pos
+    end
+end
+
 ffi.metatype("struct uref", {
     __index = function (_, key)
+        if key == 'block_segments' then
+            return block_segments
+        end
         local f = C[fmt("uref_%s", key)]
         return getter(uref_getters, f, key) or f
     end
 })
 
+ffi.metatype("struct upipe_helper_batch", {
+    __index = function (_, key)
+        return C[fmt("upipe_helper_batch_%s", key)]
+    end
+})
+
 ffi.metatype("struct ubuf", {
     __index = function (_, key)
         return C[fmt("ubuf_%s", key)]
@@ -372,6 +406,10 @@ local function upipe_helper_alloc(cb)
         h_mgr.output = cb.input_output
     end
 
+    local errh = function (msg)
+        io.stderr:write(debug.traceback(msg, 2), "\n")
+    end
+
     local mgr = h_mgr.mgr
     mgr.upipe_alloc = cb.alloc or
         function (mgr, probe, signature, args)
@@ -393,6 +431,7 @@ local function upipe_helper_alloc(cb)
             pipe:helper_init_uref_stream()
             pipe:helper_init_flow_def()
             pipe:helper_init_upump()
+            pipe:helper_init_batch()
             pipe:throw_ready()
             pipe.props.helper = h_pipe
             if cb.init then cb.init(pipe, args) end
@@ -402,11 +441,21 @@ local function upipe_helper_alloc(cb)
 
 --     mgr.upipe_input = cb.input
 
-    mgr.upipe_input = function (pipe, ref, pump_p)
-        local errh = function (msg)
-            io.stderr:write(debug.traceback(msg, 2), "\n")
+    if cb.input_batch then
+        -- urefs are queued by C and handed over in a single call with their
+        -- first block segment mapped; when the call returns, the urefs which
+        -- were not dropped are unmapped and sent to the output
+        h_mgr.input_batch = function (pipe, batch, pump_p)
+            xpcall(cb.input_batch, errh, pipe, batch, pump_p)
+        end
+        h_mgr.batch_size = cb.batch_size or 64
+        h_mgr.batch_write = cb.batch_write or false
+        h_mgr.batch_timeout = cb.batch_timeout or UCLOCK_FREQ / 1000
+        mgr.upipe_input = C.upipe_helper_batch_input
+    else
+        mgr.upipe_input = function (pipe, ref, pump_p)
+            xpcall(cb.input, errh, pipe, ref, pump_p)
         end
-        xpcall(cb.input, errh, pipe, ref, pump_p)
     end
 
     if type(cb.control) == "function" then
@@ -436,6 +485,9 @@ local function upipe_helper_alloc(cb)
         end
 
         mgr.upipe_control = function (pipe, cmd, args)
+            if cb.input_batch and cmd == C.UPIPE_SET_FLOW_DEF then
+                C.upipe_helper_flush_batch(pipe, nil)
+            end
             local f = control[cmd] or function () return "unhandled" end
             local ret = ubase_err(f(pipe, control_args(cmd, args)))
             if ret == C.UBASE_ERR_UNHANDLED and cb.bin_input then
@@ -452,6 +504,7 @@ local function upipe_helper_alloc(cb)
         local h_pipe = container_of(refcount, "struct upipe_helper", "urefcount")
         local pipe = h_pipe.upipe
         local k = tostring(pipe):match(": 0x(.*)")
+        pipe:helper_clean_batch()
         if props[k] and props[k].clean then props[k].clean(pipe) end
         pipe:throw_dead()
         props[k] = nil
@@ -479,7 +532,9 @@ local function upipe_helper_alloc(cb)
         local mgr = h_mgr.mgr
         mgr.upipe_alloc:free()
         mgr.upipe_control:free()
-        if mgr.upipe_input ~= nil then
+        if cb.input_batch then
+            h_mgr.input_batch:free()
+        elseif mgr.upipe_input ~= nil then
             mgr.upipe_input:free()
         end
         h_mgr.refcount_cb:free()
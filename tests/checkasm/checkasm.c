@@ -77,6 +77,9 @@ static const struct {
 #ifdef HAVE_SDI
     { "sdidec", checkasm_check_sdidec },
     { "sdienc", checkasm_check_sdienc },
+#endif
+#ifdef HAVE_TS_CRC
+    { "ts_crc", checkasm_check_ts_crc },
 #endif
     { "v210dec", checkasm_check_v210dec },
     { "v210enc", checkasm_check_v210enc },
@@ -53,6 +53,12 @@ void checkasm_check_sdidec(void)
         s.uyvy = upipe_sdi_to_uyvy_avx2;
     }
 #endif
+#if defined(UPIPE_HBRMT_AVX512) && defined(AV_CPU_FLAG_AVX512)
+    if ((cpu_flags & AV_CPU_FLAG_AVX512) &&
+        __builtin_cpu_supports("avx512vbmi")) {
+        s.uyvy = upipe_sdi_to_uyvy_avx512;
+    }
+#endif
 
     if (check_func(s.uyvy, "sdi_to_uyvy")) {
         uint8_t  src0[NUM_SAMPLES * 10 / 8];
@@ -56,6 +56,12 @@ void checkasm_check_sdienc(void)
         s.uyvy = upipe_uyvy_to_sdi_avx2;
     }
 #endif
+#if defined(UPIPE_HBRMT_AVX512) && defined(AV_CPU_FLAG_AVX512)
+    if ((cpu_flags & AV_CPU_FLAG_AVX512) &&
+        __builtin_cpu_supports("avx512vbmi")) {
+        s.uyvy = upipe_uyvy_to_sdi_avx512;
+    }
+#endif
 
     if (check_func(s.uyvy, "uyvy_to_sdi")) {
         DECLARE_ALIGNED(16, uint16_t, src0)[NUM_SAMPLES];
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2018 Open Broadcast Systems Ltd.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "checkasm.h"
+#include "lib/upipe-ts/upipe_ts_crc.h"
+
+#define BUF_SIZE 4096
+
+void checkasm_check_ts_crc(void)
+{
+    struct {
+        uint32_t (*crc)(uint32_t crc, const uint8_t *buf, size_t size);
+    } s = {
+        .crc = upipe_ts_crc_c,
+    };
+
+#ifdef UPIPE_TS_CRC_PCLMUL
+    int cpu_flags = av_get_cpu_flags();
+
+    if ((cpu_flags & AV_CPU_FLAG_SSSE3) && __builtin_cpu_supports("pclmul")) {
+        s.crc = upipe_ts_crc_pclmul;
+    }
+#endif
+
+    if (check_func(s.crc, "crc32_mpeg2")) {
+        uint8_t buf[BUF_SIZE];
+        declare_func(uint32_t, uint32_t crc, const uint8_t *buf, size_t size);
+
+        for (int i = 0; i < BUF_SIZE; i++)
+            buf[i] = rnd();
+
+        /* every size up to a few blocks, then typical section sizes */
+        for (size_t size = 0; size < BUF_SIZE; size += size < 256 ? 1 : 253) {
+            uint32_t init = rnd();
+            size_t offset = rnd() % 16;
+            if (size + offset > BUF_SIZE)
+                offset = 0;
+            if (call_ref(init, buf + offset, size) !=
+                call_new(init, buf + offset, size))
+                fail();
+        }
+        bench_new(UINT32_MAX, buf, 1021);
+    }
+    report("crc32_mpeg2");
+}
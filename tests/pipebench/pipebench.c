@@ -0,0 +1,1356 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short pipeline throughput and latency benchmark
+ *
+ * This program runs canonical pipelines on synthetic input, feeding each
+ * graph from the main thread without an event loop, and reports for each
+ * of them the number of urefs and octets reaching the end of the graph per
+ * second of processing, the number of buffer allocations per second, and
+ * the 99th percentile of the time taken by a single upipe_input() call.
+ * Input urefs are dated with a fake clock advanced by their duration, so
+ * that the results do not depend on the wall clock.
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uclock.h>
+#include <upipe/umem.h>
+#include <upipe/umem_pool.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_void_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_sound.h>
+#include <upipe/uref_sound_flow.h>
+#include <upipe/upipe.h>
+#include <upipe-filters/upipe_zoneplate.h>
+#include <upipe-v210/upipe_v210enc.h>
+#ifdef HAVE_SWSCALE
+#include <upipe-swscale/upipe_sws.h>
+#endif
+#ifdef HAVE_SWRESAMPLE
+#include <upipe-swresample/upipe_swr.h>
+#include <upipe-modules/upipe_audiocont.h>
+#endif
+#ifdef HAVE_BITSTREAM
+#include <upipe/uprobe_select_flows.h>
+#include <upipe/uprobe_uclock.h>
+#include <upipe-modules/upipe_udp_sink.h>
+#include <upipe-filters/upipe_rtcp_fb_receiver.h>
+#include <upipe-ts/upipe_ts_sync.h>
+#include <upipe-ts/upipe_ts_demux.h>
+#include <upipe-ts/upipe_ts_analyzer.h>
+#include <upipe-ts/upipe_ts_mux.h>
+#include <upipe-ts/uref_ts_flow.h>
+#include <upipe-framers/upipe_auto_framer.h>
+#include "lib/upipe-ts/upipe_ts_crc.h"
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/ietf/rtp.h>
+#include <bitstream/ietf/rtcp.h>
+#include <bitstream/ietf/rtcp_fb.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define UMEM_POOL           512
+#define UDICT_POOL_DEPTH    500
+#define UREF_POOL_DEPTH     500
+#define UBUF_POOL_DEPTH     50
+#define UBUF_SHARED_POOL_DEPTH 50
+#define BENCH_ITERATIONS    1000
+/** size of the blocks read from the TS stream */
+#define BENCH_READ_SIZE     4096
+/** number of elementary streams in the TS graphs */
+#define BENCH_TS_STREAMS    4
+/** number of times the TS is replayed in the analyzer graph */
+#define BENCH_TS_ANALYZER_PASSES 16
+/** size of the datagrams of the TS graphs */
+#define BENCH_TS_MTU        (7 * 188)
+/** number of buffers in the dedicated output pool of the TS mux */
+#define BENCH_TS_POOL       64
+/** number of PSI sections per iteration of the CRC graph */
+#define BENCH_PSI_SECTIONS  16
+/** size of the PSI sections of the CRC graph, typical of EIT schedule */
+#define BENCH_PSI_SIZE      1024
+/** number of unicast receivers of the ARQ graph */
+#define BENCH_ARQ_RECEIVERS 200
+/** one packet in BENCH_ARQ_LOSS is lost on the way to each receiver */
+#define BENCH_ARQ_LOSS      100
+/** delay between two RTP packets of the ARQ graph (about 10 Mbits/s) */
+#define BENCH_ARQ_INTERVAL  (UINT64_C(27000000) / 1000)
+/** delay between the loss of a packet and the reception of its NACK */
+#define BENCH_ARQ_DELAY     (UINT64_C(27000000) / 50)
+/** size of the RTP packets of the ARQ graph */
+#define BENCH_ARQ_SIZE      (RTP_HEADER_SIZE + BENCH_TS_MTU)
+/** MPEG-1 layer II, 384 kbits/s, 48 kHz, stereo */
+#define BENCH_MP2_HEADER    0xff, 0xfd, 0xe4, 0x00
+#define BENCH_MP2_SIZE      1152
+#define BENCH_MP2_SAMPLES   1152
+#define BENCH_MP2_RATE      48000
+#define BENCH_MP2_DURATION  (UINT64_C(27000000) * BENCH_MP2_SAMPLES / \
+                             BENCH_MP2_RATE)
+#define BENCH_PIC_HSIZE     1920
+#define BENCH_PIC_VSIZE     1080
+#define BENCH_PIC_DURATION  (UINT64_C(27000000) / 25)
+#define BENCH_SOUND_SAMPLES 1024
+#define BENCH_SOUND_IN_RATE 32000
+#define BENCH_SOUND_OUT_RATE 48000
+#define BENCH_SOUND_DURATION (UINT64_C(27000000) * BENCH_SOUND_SAMPLES / \
+                              BENCH_SOUND_IN_RATE)
+
+/** @This is a memory manager counting the allocations it forwards. */
+struct bench_umem_mgr {
+    /** counter of allocations */
+    uint64_t allocs;
+    /** memory manager doing the actual work */
+    struct umem_mgr *umem_mgr;
+    /** public umem_mgr structure */
+    struct umem_mgr mgr;
+};
+
+/** @This is a fake clock driven by the benchmark. */
+struct bench_clock {
+    /** current date */
+    uint64_t now;
+    /** public uclock structure */
+    struct uclock uclock;
+};
+
+/** @This holds the state of the benchmark. */
+struct bench {
+    /** counting memory manager */
+    struct bench_umem_mgr umem;
+    /** fake clock */
+    struct bench_clock clock;
+    /** uref manager */
+    struct uref_mgr *uref_mgr;
+    /** probe hierarchy shared by all pipes */
+    struct uprobe *logger;
+    /** log level of the pipes */
+    enum uprobe_log_level loglevel;
+    /** number of iterations of each graph */
+    unsigned int iterations;
+    /** TS file replayed by the analyzer graph, or NULL */
+    const char *ts_file;
+
+    /** probe connecting split outputs to the sink */
+    struct uprobe output_probe;
+    /** sink at the end of the current graph */
+    struct upipe *sink;
+    /** true if the sink captures its input */
+    bool capturing;
+    /** buffer receiving the input of the sink */
+    uint8_t *capture;
+    /** size of the captured output */
+    size_t capture_size;
+
+    /** latencies of the upipe_input() calls of the current graph */
+    uint64_t *latencies;
+    /** number of recorded latencies */
+    unsigned int nb_latencies;
+    /** maximum number of recorded latencies */
+    unsigned int max_latencies;
+    /** time spent in upipe_input() calls, in nanoseconds */
+    uint64_t busy;
+    /** number of allocations during upipe_input() calls */
+    uint64_t allocs;
+    /** number of urefs that reached the end of the graph */
+    uint64_t packets;
+    /** number of octets that reached the end of the graph */
+    uint64_t bytes;
+};
+
+UBASE_FROM_TO(bench_umem_mgr, umem_mgr, umem_mgr, mgr)
+UBASE_FROM_TO(bench_clock, uclock, uclock, uclock)
+UBASE_FROM_TO(bench, uprobe, output_probe, output_probe)
+
+/** @internal @This counts and forwards an allocation.
+ *
+ * @param mgr pointer to umem_mgr
+ * @param umem caller-allocated structure
+ * @param size requested size of the buffer
+ * @return false if the allocation failed
+ */
+static bool bench_umem_alloc(struct umem_mgr *mgr, struct umem *umem,
+                             size_t size)
+{
+    struct bench_umem_mgr *bench_umem_mgr = bench_umem_mgr_from_umem_mgr(mgr);
+    bench_umem_mgr->allocs++;
+    return umem_alloc(bench_umem_mgr->umem_mgr, umem, size);
+}
+
+/** @internal @This releases the buffers kept in the pools.
+ *
+ * @param mgr pointer to umem_mgr
+ */
+static void bench_umem_vacuum(struct umem_mgr *mgr)
+{
+    struct bench_umem_mgr *bench_umem_mgr = bench_umem_mgr_from_umem_mgr(mgr);
+    umem_mgr_vacuum(bench_umem_mgr->umem_mgr);
+}
+
+/** @internal @This returns the date of the fake clock.
+ *
+ * @param uclock pointer to uclock
+ * @return current date
+ */
+static uint64_t bench_clock_now(struct uclock *uclock)
+{
+    return bench_clock_from_uclock(uclock)->now;
+}
+
+/** @internal @This returns a monotonic date in nanoseconds.
+ *
+ * @return current date
+ */
+static uint64_t bench_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/** @internal @This returns the number of octets carried by a uref.
+ *
+ * @param uref uref structure
+ * @return number of octets
+ */
+static size_t bench_uref_size(struct uref *uref)
+{
+    size_t size, hsize, vsize;
+    uint8_t sample_size;
+    if (ubase_check(uref_block_size(uref, &size)))
+        return size;
+
+    if (ubase_check(uref_sound_size(uref, &size, &sample_size))) {
+        size_t total = 0;
+        const char *channel;
+        uref_sound_foreach_plane(uref, channel)
+            total += size * sample_size;
+        return total;
+    }
+
+    if (ubase_check(uref_pic_size(uref, &hsize, &vsize, NULL))) {
+        size_t total = 0;
+        const char *chroma;
+        uref_pic_foreach_plane(uref, chroma) {
+            size_t stride;
+            uint8_t vsub;
+            if (ubase_check(uref_pic_plane_size(uref, chroma, &stride,
+                                                NULL, &vsub, NULL)))
+                total += stride * vsize / vsub;
+        }
+        return total;
+    }
+    return 0;
+}
+
+/** @This is the sink at the end of the benchmarked graphs. */
+struct bench_sink {
+    /** benchmark state */
+    struct bench *bench;
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UBASE_FROM_TO(bench_sink, upipe, upipe, upipe)
+
+/** @internal @This counts and frees a uref, optionally capturing it.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void bench_sink_input(struct upipe *upipe, struct uref *uref,
+                             struct upump **upump_p)
+{
+    struct bench *bench = bench_sink_from_upipe(upipe)->bench;
+    size_t size = bench_uref_size(uref);
+    bench->packets++;
+    bench->bytes += size;
+
+    if (bench->capturing) {
+        uint8_t *capture = realloc(bench->capture,
+                                   bench->capture_size + size);
+        assert(capture != NULL);
+        ubase_assert(uref_block_extract(uref, 0, size,
+                                        capture + bench->capture_size));
+        bench->capture = capture;
+        bench->capture_size += size;
+    }
+    uref_free(uref);
+}
+
+/** @internal @This accepts everything.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int bench_sink_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This is the manager of the sink. */
+static struct upipe_mgr bench_sink_mgr = {
+    .refcount = NULL,
+    .signature = UBASE_FOURCC('b','n','c','h'),
+    .upipe_alloc = NULL,
+    .upipe_input = bench_sink_input,
+    .upipe_control = bench_sink_control
+};
+
+/** @internal @This allocates the sink of a graph and resets the counters.
+ *
+ * @param bench benchmark state
+ * @param nb_inputs number of timed inputs of the graph
+ * @return pointer to the sink
+ */
+static struct upipe *bench_start(struct bench *bench, unsigned int nb_inputs)
+{
+    struct bench_sink *sink = malloc(sizeof(struct bench_sink));
+    assert(sink != NULL);
+    sink->bench = bench;
+    upipe_init(&sink->upipe, &bench_sink_mgr,
+               uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                                "sink"));
+    upipe_throw_ready(&sink->upipe);
+    bench->sink = &sink->upipe;
+
+    bench->latencies = malloc(nb_inputs * sizeof(uint64_t));
+    assert(bench->latencies != NULL || !nb_inputs);
+    bench->nb_latencies = 0;
+    bench->max_latencies = nb_inputs;
+    bench->busy = 0;
+    bench->allocs = 0;
+    bench->packets = 0;
+    bench->bytes = 0;
+    bench->clock.now = UINT32_MAX;
+    return bench->sink;
+}
+
+/** @internal @This sends a uref to a pipe and records the cost of the call.
+ *
+ * @param bench benchmark state
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ */
+static void bench_input(struct bench *bench, struct upipe *upipe,
+                        struct uref *uref)
+{
+    uint64_t allocs = bench->umem.allocs;
+    uint64_t start = bench_ns();
+    upipe_input(upipe, uref, NULL);
+    uint64_t latency = bench_ns() - start;
+
+    bench->busy += latency;
+    bench->allocs += bench->umem.allocs - allocs;
+    if (bench->nb_latencies < bench->max_latencies)
+        bench->latencies[bench->nb_latencies++] = latency;
+}
+
+/** @internal @This compares two latencies.
+ *
+ * @param a pointer to the first latency
+ * @param b pointer to the second latency
+ * @return an integer less than, equal to or greater than zero
+ */
+static int bench_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/** @internal @This prints the results of a graph and frees the sink.
+ *
+ * @param bench benchmark state
+ * @param name name of the graph, or NULL to discard the results
+ */
+static void bench_stop(struct bench *bench, const char *name)
+{
+    double seconds = (double)bench->busy / 1000000000.;
+    if (seconds <= 0.)
+        seconds = 1e-9;
+    uint64_t p99 = 0;
+    if (bench->nb_latencies) {
+        qsort(bench->latencies, bench->nb_latencies, sizeof(uint64_t),
+              bench_cmp);
+        p99 = bench->latencies[(bench->nb_latencies - 1) * 99 / 100];
+    }
+
+    if (name != NULL)
+        printf("%-12s %12.0f pkt/s %10.2f MB/s %12.0f alloc/s "
+               "%10.1f us p99\n",
+               name, bench->packets / seconds,
+               bench->bytes / seconds / 1000000., bench->allocs / seconds,
+               (double)p99 / 1000.);
+
+    free(bench->latencies);
+    bench->latencies = NULL;
+    struct upipe *sink = bench->sink;
+    bench->sink = NULL;
+    upipe_throw_dead(sink);
+    upipe_clean(sink);
+    free(bench_sink_from_upipe(sink));
+}
+
+/** @internal @This measures the cost of the harness itself, by sending
+ * blocks directly to the sink.
+ *
+ * @param bench benchmark state
+ */
+static void bench_baseline(struct bench *bench)
+{
+    struct upipe *sink = bench_start(bench, bench->iterations);
+    struct uref *flow_def = uref_block_flow_alloc_def(bench->uref_mgr, NULL);
+    assert(flow_def != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_mem_mgr_alloc_from_flow_def(
+            UBUF_POOL_DEPTH, UBUF_SHARED_POOL_DEPTH, &bench->umem.mgr,
+            flow_def);
+    assert(ubuf_mgr != NULL);
+    uref_free(flow_def);
+
+    for (unsigned int i = 0; i < bench->iterations; i++) {
+        struct uref *uref = uref_block_alloc(bench->uref_mgr, ubuf_mgr,
+                                             BENCH_TS_MTU);
+        assert(uref != NULL);
+        uref_clock_set_cr_sys(uref, uclock_now(&bench->clock.uclock));
+        bench_input(bench, sink, uref);
+        bench->clock.now += BENCH_MP2_DURATION;
+    }
+
+    ubuf_mgr_release(ubuf_mgr);
+    bench_stop(bench, "baseline");
+}
+
+/** @internal @This draws zoneplate pictures and packs them to v210.
+ *
+ * @param bench benchmark state
+ */
+static void bench_zoneplate(struct bench *bench)
+{
+    struct upipe *sink = bench_start(bench, bench->iterations);
+
+    /* with swscale, convert from the common 4:2:0 8 bits to 4:2:2 10 bits,
+     * otherwise feed v210enc with 4:2:2 8 bits */
+    struct uref *flow_def = uref_pic_flow_alloc_def(bench->uref_mgr, 1);
+    assert(flow_def != NULL);
+    ubase_assert(uref_pic_flow_set_hsize(flow_def, BENCH_PIC_HSIZE));
+    ubase_assert(uref_pic_flow_set_vsize(flow_def, BENCH_PIC_VSIZE));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"));
+#ifdef HAVE_SWSCALE
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "v8"));
+#else
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 1, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 1, 1, "v8"));
+#endif
+
+    struct upipe_mgr *upipe_zp_mgr = upipe_zp_mgr_alloc();
+    assert(upipe_zp_mgr != NULL);
+    struct upipe *zp = upipe_flow_alloc(upipe_zp_mgr,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "zoneplate"), flow_def);
+    assert(zp != NULL);
+    upipe_mgr_release(upipe_zp_mgr);
+    uref_free(flow_def);
+
+    flow_def = uref_void_flow_alloc_def(bench->uref_mgr);
+    assert(flow_def != NULL);
+    ubase_assert(uref_clock_set_duration(flow_def, BENCH_PIC_DURATION));
+    ubase_assert(upipe_set_flow_def(zp, flow_def));
+    uref_free(flow_def);
+
+    struct upipe_mgr *upipe_v210enc_mgr = upipe_v210enc_mgr_alloc();
+    assert(upipe_v210enc_mgr != NULL);
+#ifdef HAVE_SWSCALE
+    flow_def = uref_pic_flow_alloc_def(bench->uref_mgr, 1);
+    assert(flow_def != NULL);
+    ubase_assert(uref_pic_flow_set_hsize(flow_def, BENCH_PIC_HSIZE));
+    ubase_assert(uref_pic_flow_set_vsize(flow_def, BENCH_PIC_VSIZE));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 2, "y10l"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 1, 2, "u10l"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 1, 2, "v10l"));
+
+    struct upipe_mgr *upipe_sws_mgr = upipe_sws_mgr_alloc();
+    assert(upipe_sws_mgr != NULL);
+    struct upipe *output = upipe_flow_alloc_output(zp, upipe_sws_mgr,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "sws"), flow_def);
+    assert(output != NULL);
+    upipe_mgr_release(upipe_sws_mgr);
+    uref_free(flow_def);
+
+    output = upipe_void_chain_output(output, upipe_v210enc_mgr,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "v210enc"));
+#else
+    struct upipe *output = upipe_void_alloc_output(zp, upipe_v210enc_mgr,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "v210enc"));
+#endif
+    assert(output != NULL);
+    upipe_mgr_release(upipe_v210enc_mgr);
+    ubase_assert(upipe_set_output(output, sink));
+    upipe_release(output);
+
+    for (unsigned int i = 0; i < bench->iterations; i++) {
+        struct uref *uref = uref_alloc(bench->uref_mgr);
+        assert(uref != NULL);
+        uref_clock_set_pts_sys(uref, uclock_now(&bench->clock.uclock));
+        uref_clock_set_duration(uref, BENCH_PIC_DURATION);
+        bench_input(bench, zp, uref);
+        bench->clock.now += BENCH_PIC_DURATION;
+    }
+
+    upipe_release(zp);
+    bench_stop(bench, "zoneplate");
+}
+
+#ifdef HAVE_SWRESAMPLE
+/** @internal @This resamples a sine wave and mixes it with audiocont.
+ *
+ * @param bench benchmark state
+ */
+static void bench_audiocont(struct bench *bench)
+{
+    struct upipe *sink = bench_start(bench, 2 * bench->iterations);
+
+    struct uref *in_flow = uref_sound_flow_alloc_def(bench->uref_mgr, "s16.",
+                                                     1, 2);
+    assert(in_flow != NULL);
+    ubase_assert(uref_sound_flow_add_plane(in_flow, "c"));
+    ubase_assert(uref_sound_flow_set_rate(in_flow, BENCH_SOUND_IN_RATE));
+    struct uref *out_flow = uref_sound_flow_alloc_def(bench->uref_mgr, "f32.",
+                                                      1, 4);
+    assert(out_flow != NULL);
+    ubase_assert(uref_sound_flow_add_plane(out_flow, "c"));
+    ubase_assert(uref_sound_flow_set_rate(out_flow, BENCH_SOUND_OUT_RATE));
+
+    struct upipe_mgr *upipe_audiocont_mgr = upipe_audiocont_mgr_alloc();
+    assert(upipe_audiocont_mgr != NULL);
+    struct upipe *audiocont = upipe_flow_alloc(upipe_audiocont_mgr,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "audiocont"), out_flow);
+    assert(audiocont != NULL);
+    upipe_mgr_release(upipe_audiocont_mgr);
+    ubase_assert(upipe_set_flow_def(audiocont, out_flow));
+    ubase_assert(upipe_set_output(audiocont, sink));
+
+    struct upipe *input = upipe_void_alloc_sub(audiocont,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "audiocont input"));
+    assert(input != NULL);
+    ubase_assert(upipe_audiocont_sub_set_input(input));
+
+    struct upipe_mgr *upipe_swr_mgr = upipe_swr_mgr_alloc();
+    assert(upipe_swr_mgr != NULL);
+    struct upipe *swr = upipe_flow_alloc(upipe_swr_mgr,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "swr"), out_flow);
+    assert(swr != NULL);
+    upipe_mgr_release(upipe_swr_mgr);
+    ubase_assert(upipe_set_flow_def(swr, in_flow));
+    ubase_assert(upipe_set_output(swr, input));
+    upipe_release(input);
+
+    struct ubuf_mgr *in_ubuf_mgr = ubuf_mem_mgr_alloc_from_flow_def(
+            UBUF_POOL_DEPTH, UBUF_SHARED_POOL_DEPTH, &bench->umem.mgr,
+            in_flow);
+    assert(in_ubuf_mgr != NULL);
+    struct ubuf_mgr *out_ubuf_mgr = ubuf_mem_mgr_alloc_from_flow_def(
+            UBUF_POOL_DEPTH, UBUF_SHARED_POOL_DEPTH, &bench->umem.mgr,
+            out_flow);
+    assert(out_ubuf_mgr != NULL);
+    uref_free(in_flow);
+    uref_free(out_flow);
+
+    for (unsigned int i = 0; i < bench->iterations; i++) {
+        uint64_t pts = uclock_now(&bench->clock.uclock);
+        struct uref *uref = uref_sound_alloc(bench->uref_mgr, in_ubuf_mgr,
+                                             BENCH_SOUND_SAMPLES);
+        assert(uref != NULL);
+        int16_t *buf;
+        ubase_assert(uref_sound_plane_write_int16_t(uref, "c", 0, -1, &buf));
+        for (int j = 0; j < BENCH_SOUND_SAMPLES; j++)
+            buf[j] = 16383. * sin(2. * M_PI * 440. *
+                    (i * BENCH_SOUND_SAMPLES + j) / BENCH_SOUND_IN_RATE);
+        uref_sound_plane_unmap(uref, "c", 0, -1);
+        uref_clock_set_pts_sys(uref, pts);
+        uref_clock_set_duration(uref, BENCH_SOUND_DURATION);
+        bench_input(bench, swr, uref);
+
+        uref = uref_sound_alloc(bench->uref_mgr, out_ubuf_mgr,
+                                BENCH_SOUND_SAMPLES * BENCH_SOUND_OUT_RATE /
+                                BENCH_SOUND_IN_RATE);
+        assert(uref != NULL);
+        uref_clock_set_pts_sys(uref, pts);
+        uref_clock_set_duration(uref, BENCH_SOUND_DURATION);
+        bench_input(bench, audiocont, uref);
+        bench->clock.now += BENCH_SOUND_DURATION;
+    }
+
+    ubuf_mgr_release(in_ubuf_mgr);
+    ubuf_mgr_release(out_ubuf_mgr);
+    upipe_release(swr);
+    upipe_release(audiocont);
+    bench_stop(bench, "audiocont");
+}
+#endif
+
+#ifdef HAVE_BITSTREAM
+/** @internal @This allocates a TS mux with MPEG-1 layer II inputs.
+ *
+ * @param bench benchmark state
+ * @param output output of the mux
+ * @param inputs filled in with the inputs of the mux
+ * @return pointer to the mux
+ */
+static struct upipe *bench_ts_mux_alloc(struct bench *bench,
+                                        struct upipe *output,
+                                        struct upipe **inputs)
+{
+    struct upipe_mgr *upipe_ts_mux_mgr = upipe_ts_mux_mgr_alloc();
+    assert(upipe_ts_mux_mgr != NULL);
+    struct upipe *mux = upipe_void_alloc(upipe_ts_mux_mgr,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "ts mux"));
+    assert(mux != NULL);
+    upipe_mgr_release(upipe_ts_mux_mgr);
+    ubase_assert(upipe_ts_mux_set_mode(mux, UPIPE_TS_MUX_MODE_CAPPED));
+    ubase_assert(upipe_set_output_size(mux, BENCH_TS_MTU));
+
+    struct uref *flow_def = uref_void_flow_alloc_def(bench->uref_mgr);
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(mux, flow_def));
+    ubase_assert(upipe_set_output(mux, output));
+
+    ubase_assert(uref_flow_set_id(flow_def, 1));
+    ubase_assert(uref_ts_flow_set_pid(flow_def, 256));
+    struct upipe *program = upipe_void_alloc_sub(mux,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "ts mux program"));
+    assert(program != NULL);
+    ubase_assert(upipe_set_flow_def(program, flow_def));
+    uref_free(flow_def);
+
+    flow_def = uref_block_flow_alloc_def(bench->uref_mgr, "mp2.sound.");
+    assert(flow_def != NULL);
+    ubase_assert(uref_block_flow_set_octetrate(flow_def,
+                BENCH_MP2_SIZE * BENCH_MP2_RATE / BENCH_MP2_SAMPLES));
+    ubase_assert(uref_sound_flow_set_rate(flow_def, BENCH_MP2_RATE));
+    ubase_assert(uref_sound_flow_set_samples(flow_def, BENCH_MP2_SAMPLES));
+    for (int i = 0; i < BENCH_TS_STREAMS; i++) {
+        inputs[i] = upipe_void_alloc_sub(program,
+                uprobe_pfx_alloc_va(uprobe_use(bench->logger),
+                                    bench->loglevel, "ts mux input %d", i));
+        assert(inputs[i] != NULL);
+        ubase_assert(upipe_set_flow_def(inputs[i], flow_def));
+    }
+    uref_free(flow_def);
+    upipe_release(program);
+    return mux;
+}
+
+/** @internal @This allocates a dated MPEG-1 layer II frame.
+ *
+ * @param bench benchmark state
+ * @param ubuf_mgr block buffer manager
+ * @return pointer to uref
+ */
+static struct uref *bench_mp2_alloc(struct bench *bench,
+                                    struct ubuf_mgr *ubuf_mgr)
+{
+    static const uint8_t header[] = { BENCH_MP2_HEADER };
+    struct uref *uref = uref_block_alloc(bench->uref_mgr, ubuf_mgr,
+                                         BENCH_MP2_SIZE);
+    assert(uref != NULL);
+    uint8_t *buf;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    memset(buf, 0, size);
+    memcpy(buf, header, sizeof(header));
+    uref_block_unmap(uref, 0);
+
+    uint64_t date = uclock_now(&bench->clock.uclock);
+    uref_clock_set_dts_sys(uref, date);
+    uref_clock_set_dts_prog(uref, date);
+    uref_clock_set_dts_pts_delay(uref, 0);
+    uref_clock_set_duration(uref, BENCH_MP2_DURATION);
+    return uref;
+}
+
+/** @internal @This allocates a block buffer manager for the TS graphs.
+ *
+ * @param bench benchmark state
+ * @return pointer to ubuf manager
+ */
+static struct ubuf_mgr *bench_block_mgr_alloc(struct bench *bench)
+{
+    struct uref *flow_def = uref_block_flow_alloc_def(bench->uref_mgr, NULL);
+    assert(flow_def != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_mem_mgr_alloc_from_flow_def(
+            UBUF_POOL_DEPTH, UBUF_SHARED_POOL_DEPTH, &bench->umem.mgr,
+            flow_def);
+    assert(ubuf_mgr != NULL);
+    uref_free(flow_def);
+    return ubuf_mgr;
+}
+
+/** @internal @This catches the outputs of the TS demux.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int bench_catch_output(struct uprobe *uprobe, struct upipe *upipe,
+                              int event, va_list args)
+{
+    if (event != UPROBE_NEED_OUTPUT)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    struct bench *bench = bench_from_output_probe(uprobe);
+    return upipe_set_output(upipe, bench->sink);
+}
+
+/** @internal @This muxes MPEG-1 layer II frames and sends the TS to a
+ * loopback UDP socket.
+ *
+ * @param bench benchmark state
+ * @param pool number of buffers in the dedicated output pool of the mux
+ * @param name name of the graph
+ */
+static void bench_ts_mux_run(struct bench *bench, unsigned int pool,
+                             const char *name)
+{
+    bench_start(bench, BENCH_TS_STREAMS * bench->iterations);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd != -1);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(getsockname(fd, (struct sockaddr *)&addr, &addr_len) == 0);
+    assert(fcntl(fd, F_SETFL, O_NONBLOCK) == 0);
+    char uri[32];
+    snprintf(uri, sizeof(uri), "127.0.0.1:%u", ntohs(addr.sin_port));
+
+    struct upipe_mgr *upipe_udpsink_mgr = upipe_udpsink_mgr_alloc();
+    assert(upipe_udpsink_mgr != NULL);
+    struct upipe *udpsink = upipe_void_alloc(upipe_udpsink_mgr,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "udp sink"));
+    assert(udpsink != NULL);
+    upipe_mgr_release(upipe_udpsink_mgr);
+    ubase_assert(upipe_set_uri(udpsink, uri));
+
+    struct upipe *inputs[BENCH_TS_STREAMS];
+    struct upipe *mux = bench_ts_mux_alloc(bench, udpsink, inputs);
+    upipe_release(udpsink);
+    ubase_assert(upipe_ts_mux_set_output_pool(mux, pool));
+    struct ubuf_mgr *ubuf_mgr = bench_block_mgr_alloc(bench);
+
+    uint8_t buffer[BENCH_TS_MTU];
+    for (unsigned int i = 0; i <= bench->iterations; i++) {
+        /* the datagrams are counted out of the timed section */
+        ssize_t ret;
+        while ((ret = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            bench->packets++;
+            bench->bytes += ret;
+        }
+        assert(ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK));
+        if (i == bench->iterations)
+            break;
+
+        for (int j = 0; j < BENCH_TS_STREAMS; j++)
+            bench_input(bench, inputs[j], bench_mp2_alloc(bench, ubuf_mgr));
+        bench->clock.now += BENCH_MP2_DURATION;
+    }
+
+    for (int j = 0; j < BENCH_TS_STREAMS; j++)
+        upipe_release(inputs[j]);
+    upipe_release(mux);
+    ubuf_mgr_release(ubuf_mgr);
+    close(fd);
+    bench_stop(bench, name);
+}
+
+/** @internal @This muxes MPEG-1 layer II frames into output buffers from
+ * the ubuf manager of the pipeline.
+ *
+ * @param bench benchmark state
+ */
+static void bench_ts_mux(struct bench *bench)
+{
+    bench_ts_mux_run(bench, 0, "ts_mux");
+}
+
+/** @internal @This muxes MPEG-1 layer II frames into output buffers from
+ * the dedicated pool of the mux.
+ *
+ * @param bench benchmark state
+ */
+static void bench_ts_mux_pool(struct bench *bench)
+{
+    bench_ts_mux_run(bench, BENCH_TS_POOL, "ts_mux_pool");
+}
+
+/** @internal @This generates a TS with MPEG-1 layer II streams, out of
+ * the timed section.
+ *
+ * @param bench benchmark state
+ * @param ts_size_p filled in with the size of the TS
+ * @return pointer to the TS, to free by the caller
+ */
+static uint8_t *bench_ts_capture(struct bench *bench, size_t *ts_size_p)
+{
+    struct upipe *sink = bench_start(bench, 0);
+    bench->capturing = true;
+    struct upipe *inputs[BENCH_TS_STREAMS];
+    struct upipe *mux = bench_ts_mux_alloc(bench, sink, inputs);
+    struct ubuf_mgr *ubuf_mgr = bench_block_mgr_alloc(bench);
+    for (unsigned int i = 0; i < bench->iterations; i++) {
+        for (int j = 0; j < BENCH_TS_STREAMS; j++)
+            upipe_input(inputs[j], bench_mp2_alloc(bench, ubuf_mgr), NULL);
+        bench->clock.now += BENCH_MP2_DURATION;
+    }
+    for (int j = 0; j < BENCH_TS_STREAMS; j++)
+        upipe_release(inputs[j]);
+    upipe_release(mux);
+    ubuf_mgr_release(ubuf_mgr);
+    uint8_t *ts = bench->capture;
+    *ts_size_p = bench->capture_size;
+    bench->capturing = false;
+    bench->capture = NULL;
+    bench->capture_size = 0;
+    bench_stop(bench, NULL);
+    return ts;
+}
+
+/** @internal @This generates a TS with MPEG-1 layer II streams, and
+ * replays it through ts_sync, ts_demux and the framers.
+ *
+ * @param bench benchmark state
+ */
+static void bench_ts_demux(struct bench *bench)
+{
+    size_t ts_size;
+    uint8_t *ts = bench_ts_capture(bench, &ts_size);
+    bench_start(bench, (ts_size + BENCH_READ_SIZE - 1) / BENCH_READ_SIZE);
+    struct ubuf_mgr *ubuf_mgr = bench_block_mgr_alloc(bench);
+
+    struct upipe_mgr *upipe_ts_sync_mgr = upipe_ts_sync_mgr_alloc();
+    assert(upipe_ts_sync_mgr != NULL);
+    struct upipe *ts_sync = upipe_void_alloc(upipe_ts_sync_mgr,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "ts sync"));
+    assert(ts_sync != NULL);
+    upipe_mgr_release(upipe_ts_sync_mgr);
+    struct uref *flow_def = uref_block_flow_alloc_def(bench->uref_mgr,
+                                                      "mpegts.");
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(ts_sync, flow_def));
+    uref_free(flow_def);
+
+    uprobe_init(&bench->output_probe, bench_catch_output,
+                uprobe_use(bench->logger));
+    struct upipe_mgr *upipe_autof_mgr = upipe_autof_mgr_alloc();
+    assert(upipe_autof_mgr != NULL);
+    struct upipe_mgr *upipe_ts_demux_mgr = upipe_ts_demux_mgr_alloc();
+    assert(upipe_ts_demux_mgr != NULL);
+    ubase_assert(upipe_ts_demux_mgr_set_autof_mgr(upipe_ts_demux_mgr,
+                                                  upipe_autof_mgr));
+    upipe_mgr_release(upipe_autof_mgr);
+    struct upipe *ts_demux = upipe_void_alloc_output(ts_sync,
+            upipe_ts_demux_mgr,
+            uprobe_pfx_alloc(
+                uprobe_selflow_alloc(uprobe_use(bench->logger),
+                    uprobe_selflow_alloc(uprobe_use(bench->logger),
+                                         uprobe_use(&bench->output_probe),
+                                         UPROBE_SELFLOW_SOUND, "all"),
+                    UPROBE_SELFLOW_VOID, "all"),
+                bench->loglevel, "ts demux"));
+    assert(ts_demux != NULL);
+    upipe_mgr_release(upipe_ts_demux_mgr);
+    upipe_release(ts_demux);
+
+    for (size_t offset = 0; offset < ts_size; offset += BENCH_READ_SIZE) {
+        int size = ts_size - offset < BENCH_READ_SIZE ?
+                   ts_size - offset : BENCH_READ_SIZE;
+        struct uref *uref = uref_block_alloc(bench->uref_mgr, ubuf_mgr, size);
+        assert(uref != NULL);
+        uint8_t *buf;
+        ubase_assert(uref_block_write(uref, 0, &size, &buf));
+        memcpy(buf, ts + offset, size);
+        uref_block_unmap(uref, 0);
+        uref_clock_set_cr_sys(uref, uclock_now(&bench->clock.uclock));
+        bench_input(bench, ts_sync, uref);
+        bench->clock.now += BENCH_MP2_DURATION;
+    }
+
+    upipe_release(ts_sync);
+    uprobe_clean(&bench->output_probe);
+    ubuf_mgr_release(ubuf_mgr);
+    free(ts);
+    bench_stop(bench, "ts_demux");
+}
+
+/** @internal @This reads a TS file.
+ *
+ * @param path path of the file
+ * @param ts_size_p filled in with the size of the TS
+ * @return pointer to the TS, to free by the caller
+ */
+static uint8_t *bench_ts_read(const char *path, size_t *ts_size_p)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "unable to open %s: %m\n", path);
+        exit(EXIT_FAILURE);
+    }
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        size = ftell(file);
+    uint8_t *ts = size > 0 ? malloc(size) : NULL;
+    if (ts == NULL || fseek(file, 0, SEEK_SET) != 0 ||
+        fread(ts, 1, size, file) != size) {
+        fprintf(stderr, "unable to read %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    *ts_size_p = size;
+    return ts;
+}
+
+/** @internal @This replays a TS through ts_analyzer. The TS is either
+ * read from the file given with -f and replayed once per iteration, or
+ * generated with MPEG-1 layer II streams and replayed
+ * BENCH_TS_ANALYZER_PASSES times.
+ *
+ * @param bench benchmark state
+ */
+static void bench_ts_analyzer(struct bench *bench)
+{
+    size_t ts_size;
+    uint8_t *ts;
+    unsigned int passes;
+    if (bench->ts_file != NULL) {
+        ts = bench_ts_read(bench->ts_file, &ts_size);
+        passes = bench->iterations;
+    } else {
+        ts = bench_ts_capture(bench, &ts_size);
+        passes = BENCH_TS_ANALYZER_PASSES;
+    }
+    bench_start(bench, passes *
+                       ((ts_size + BENCH_READ_SIZE - 1) / BENCH_READ_SIZE));
+    struct ubuf_mgr *ubuf_mgr = bench_block_mgr_alloc(bench);
+
+    struct upipe_mgr *upipe_ts_analyzer_mgr = upipe_ts_analyzer_mgr_alloc();
+    assert(upipe_ts_analyzer_mgr != NULL);
+    struct upipe *ts_analyzer = upipe_void_alloc(upipe_ts_analyzer_mgr,
+            uprobe_pfx_alloc(uprobe_use(bench->logger), bench->loglevel,
+                             "ts analyzer"));
+    assert(ts_analyzer != NULL);
+    upipe_mgr_release(upipe_ts_analyzer_mgr);
+    struct uref *flow_def = uref_block_flow_alloc_def(bench->uref_mgr,
+                                                      "mpegts.");
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(ts_analyzer, flow_def));
+    uref_free(flow_def);
+
+    /* the analyzer is a sink, so the input is counted */
+    for (unsigned int i = 0; i < passes; i++) {
+        for (size_t offset = 0; offset < ts_size; offset += BENCH_READ_SIZE) {
+            int size = ts_size - offset < BENCH_READ_SIZE ?
+                       ts_size - offset : BENCH_READ_SIZE;
+            struct uref *uref = uref_block_alloc(bench->uref_mgr, ubuf_mgr,
+                                                 size);
+            assert(uref != NULL);
+            uint8_t *buf;
+            ubase_assert(uref_block_write(uref, 0, &size, &buf));
+            memcpy(buf, ts + offset, size);
+            uref_block_unmap(uref, 0);
+            uref_clock_set_cr_sys(uref, uclock_now(&bench->clock.uclock));
+            bench->packets += size / TS_SIZE;
+            bench->bytes += size;
+            bench_input(bench, ts_analyzer, uref);
+            bench->clock.now += BENCH_MP2_DURATION;
+        }
+    }
+
+    struct upipe_ts_analyzer_stats stats;
+    ubase_assert(upipe_ts_analyzer_get_stats(ts_analyzer, &stats));
+    upipe_dbg_va(ts_analyzer, "%"PRIu64" packets, %"PRIu64" CC errors",
+                 stats.packets, stats.indicators[UPIPE_TS_ANALYZER_CC]);
+    upipe_release(ts_analyzer);
+    ubuf_mgr_release(ubuf_mgr);
+    free(ts);
+    bench_stop(bench, "ts_analyzer");
+}
+
+/** @internal @This computes and checks the CRC of PSI sections, as the
+ * generators and the PSI decoders do for every section.
+ *
+ * @param bench benchmark state
+ */
+static void bench_psi_crc(struct bench *bench)
+{
+    static uint8_t sections[BENCH_PSI_SECTIONS][BENCH_PSI_SIZE];
+    for (int i = 0; i < BENCH_PSI_SECTIONS; i++) {
+        for (int j = 0; j < BENCH_PSI_SIZE; j++)
+            sections[i][j] = rand();
+        sections[i][1] = 0xb0 | ((BENCH_PSI_SIZE - 3) >> 8);
+        sections[i][2] = (BENCH_PSI_SIZE - 3) & 0xff;
+    }
+
+    bench_start(bench, bench->iterations);
+    for (unsigned int i = 0; i < bench->iterations; i++) {
+        bool valid = true;
+        uint64_t start = bench_ns();
+        for (int j = 0; j < BENCH_PSI_SECTIONS; j++) {
+            upipe_ts_psi_set_crc(sections[j]);
+            valid = valid && upipe_ts_psi_check_crc(sections[j]);
+        }
+        uint64_t latency = bench_ns() - start;
+        assert(valid);
+
+        bench->busy += latency;
+        bench->latencies[bench->nb_latencies++] = latency;
+        bench->packets += BENCH_PSI_SECTIONS;
+        bench->bytes += BENCH_PSI_SECTIONS * BENCH_PSI_SIZE;
+    }
+    bench_stop(bench, "psi_crc");
+}
+
+/** @This is a NACK waiting to be sent by a receiver of the ARQ graph. */
+struct bench_nack {
+    /** index of the receiver */
+    unsigned int receiver;
+    /** lost sequence number */
+    uint16_t seqnum;
+    /** date of reception by the gateway */
+    uint64_t date;
+};
+
+/** @internal @This allocates a generic NACK for a single packet.
+ *
+ * @param bench benchmark state
+ * @param ubuf_mgr block buffer manager
+ * @param receiver index of the receiver
+ * @param seqnum lost sequence number
+ * @return pointer to uref
+ */
+static struct uref *bench_nack_alloc(struct bench *bench,
+                                     struct ubuf_mgr *ubuf_mgr,
+                                     unsigned int receiver, uint16_t seqnum)
+{
+    int size = RTCP_FB_HEADER_SIZE + RTCP_FB_FCI_GENERIC_NACK_SIZE;
+    struct uref *uref = uref_block_alloc(bench->uref_mgr, ubuf_mgr, size);
+    assert(uref != NULL);
+    uint8_t *buf;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    memset(buf, 0, size);
+    rtcp_set_rtp_version(buf);
+    rtcp_fb_set_fmt(buf, RTCP_PT_RTPFB_GENERIC_NACK);
+    rtcp_set_pt(buf, RTCP_PT_RTPFB);
+    uint8_t ssrc_sender[4] = { 0, 0, receiver >> 8, receiver };
+    uint8_t ssrc_media[4] = { 0x1, 0x2, 0x3, 0x4 };
+    rtcp_fb_set_ssrc_pkt_sender(buf, ssrc_sender);
+    rtcp_fb_set_ssrc_media_src(buf, ssrc_media);
+    uint8_t *fci = &buf[RTCP_FB_HEADER_SIZE];
+    rtcp_fb_nack_set_packet_id(fci, seqnum);
+    rtcp_fb_nack_set_bitmask_lost(fci, 0);
+    rtcp_set_length(buf, size / 4 - 1);
+    uref_block_unmap(uref, 0);
+    uref_clock_set_cr_sys(uref, uclock_now(&bench->clock.uclock));
+    return uref;
+}
+
+/** @internal @This serves many unicast receivers from the retransmission
+ * buffer of rtcpfb, with a simulated loss on each receiver. Only the
+ * NACKs are timed, and only the retransmissions reach the sink.
+ *
+ * @param bench benchmark state
+ */
+static void bench_arq(struct bench *bench)
+{
+    unsigned int max_nacks = bench->iterations * BENCH_ARQ_RECEIVERS;
+    struct upipe *sink = bench_start(bench, max_nacks);
+    struct bench_nack *nacks = malloc(max_nacks * sizeof(struct bench_nack));
+    assert(nacks != NULL);
+    unsigned int nacks_in = 0, nacks_out = 0;
+
+    struct upipe_mgr *upipe_rtcpfb_mgr = upipe_rtcpfb_mgr_alloc();
+    assert(upipe_rtcpfb_mgr != NULL);
+    struct upipe *rtcpfb = upipe_void_alloc(upipe_rtcpfb_mgr,
+            uprobe_pfx_alloc(
+                uprobe_uclock_alloc(uprobe_use(bench->logger),
+                                    &bench->clock.uclock),
+                bench->loglevel, "rtcpfb"));
+    assert(rtcpfb != NULL);
+    upipe_mgr_release(upipe_rtcpfb_mgr);
+    struct uref *flow_def = uref_block_flow_alloc_def(bench->uref_mgr, NULL);
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(rtcpfb, flow_def));
+    ubase_assert(upipe_set_output(rtcpfb, sink));
+
+    struct upipe *receivers[BENCH_ARQ_RECEIVERS];
+    for (int i = 0; i < BENCH_ARQ_RECEIVERS; i++) {
+        receivers[i] = upipe_void_alloc_sub(rtcpfb,
+                uprobe_pfx_alloc_va(uprobe_use(bench->logger),
+                                    bench->loglevel, "receiver %d", i));
+        assert(receivers[i] != NULL);
+        ubase_assert(upipe_set_flow_def(receivers[i], flow_def));
+        ubase_assert(upipe_set_output(receivers[i], sink));
+    }
+    uref_free(flow_def);
+    struct ubuf_mgr *ubuf_mgr = bench_block_mgr_alloc(bench);
+
+    uint32_t seed = 1;
+    for (unsigned int i = 0; i < bench->iterations || nacks_out < nacks_in;
+         i++) {
+        uint64_t now = uclock_now(&bench->clock.uclock);
+        while (nacks_out < nacks_in && nacks[nacks_out].date <= now) {
+            struct bench_nack *nack = &nacks[nacks_out++];
+            bench_input(bench, receivers[nack->receiver],
+                        bench_nack_alloc(bench, ubuf_mgr, nack->receiver,
+                                         nack->seqnum));
+        }
+
+        if (i < bench->iterations) {
+            int size = BENCH_ARQ_SIZE;
+            struct uref *uref = uref_block_alloc(bench->uref_mgr, ubuf_mgr,
+                                                 size);
+            assert(uref != NULL);
+            uint8_t *buf;
+            ubase_assert(uref_block_write(uref, 0, &size, &buf));
+            memset(buf, 0, size);
+            rtp_set_hdr(buf);
+            rtp_set_type(buf, 33); /* MP2T */
+            rtp_set_seqnum(buf, i);
+            rtp_set_timestamp(buf, now / 300);
+            uref_block_unmap(uref, 0);
+            uref_clock_set_cr_sys(uref, now);
+
+            /* the multicast output is not counted */
+            uint64_t packets = bench->packets, bytes = bench->bytes;
+            upipe_input(rtcpfb, uref, NULL);
+            bench->packets = packets;
+            bench->bytes = bytes;
+
+            for (unsigned int j = 0; j < BENCH_ARQ_RECEIVERS; j++) {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                if (seed % BENCH_ARQ_LOSS)
+                    continue;
+                assert(nacks_in < max_nacks);
+                nacks[nacks_in].receiver = j;
+                nacks[nacks_in].seqnum = i;
+                nacks[nacks_in].date = now + BENCH_ARQ_DELAY;
+                nacks_in++;
+            }
+        }
+        bench->clock.now += BENCH_ARQ_INTERVAL;
+    }
+
+    struct upipe_rtcpfb_stats stats;
+    ubase_assert(upipe_rtcpfb_get_stats(rtcpfb, &stats));
+    double seconds = (double)bench->iterations * BENCH_ARQ_INTERVAL /
+                     UCLOCK_FREQ;
+    printf("%-12s %12.1f us/s/rcv %9.2f%% recovered %10"PRIu64" nacks\n",
+           "arq", (double)bench->busy / 1000. / seconds / BENCH_ARQ_RECEIVERS,
+           stats.nacks ? 100. * stats.retransmitted / stats.nacks : 100.,
+           stats.nacks);
+
+    for (int i = 0; i < BENCH_ARQ_RECEIVERS; i++)
+        upipe_release(receivers[i]);
+    upipe_release(rtcpfb);
+    ubuf_mgr_release(ubuf_mgr);
+    free(nacks);
+    bench_stop(bench, "arq");
+}
+#endif
+
+/** @This describes a benchmarked graph. */
+struct bench_graph {
+    /** name of the graph */
+    const char *name;
+    /** function running the graph */
+    void (*run)(struct bench *);
+};
+
+/** @internal @This lists the graphs. */
+static const struct bench_graph bench_graphs[] = {
+    { "baseline", bench_baseline },
+#ifdef HAVE_BITSTREAM
+    { "ts_demux", bench_ts_demux },
+    { "ts_analyzer", bench_ts_analyzer },
+    { "ts_mux", bench_ts_mux },
+    { "ts_mux_pool", bench_ts_mux_pool },
+    { "psi_crc", bench_psi_crc },
+    { "arq", bench_arq },
+#endif
+    { "zoneplate", bench_zoneplate },
+#ifdef HAVE_SWRESAMPLE
+    { "audiocont", bench_audiocont },
+#endif
+};
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-d] [-n <iterations>] [-g <graph>] "
+            "[-f <ts file>]\n", argv0);
+    fprintf(stderr, "Graphs:");
+    for (unsigned int i = 0; i < UBASE_ARRAY_SIZE(bench_graphs); i++)
+        fprintf(stderr, " %s", bench_graphs[i].name);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    struct bench bench;
+    const char *graph = NULL;
+    int opt;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.loglevel = UPROBE_LOG_WARNING;
+    bench.iterations = BENCH_ITERATIONS;
+    while ((opt = getopt(argc, argv, "dn:g:f:")) != -1) {
+        switch (opt) {
+            case 'd':
+                if (bench.loglevel > 0)
+                    bench.loglevel--;
+                break;
+            case 'n':
+                bench.iterations = strtoul(optarg, NULL, 10);
+                break;
+            case 'g':
+                graph = optarg;
+                break;
+            case 'f':
+                bench.ts_file = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc || !bench.iterations)
+        usage(argv[0]);
+
+    bench.umem.umem_mgr = umem_pool_mgr_alloc_simple(UMEM_POOL);
+    assert(bench.umem.umem_mgr != NULL);
+    bench.umem.mgr.refcount = NULL;
+    bench.umem.mgr.umem_alloc = bench_umem_alloc;
+    bench.umem.mgr.umem_realloc = NULL;
+    bench.umem.mgr.umem_free = NULL;
+    bench.umem.mgr.umem_mgr_vacuum = bench_umem_vacuum;
+
+    bench.clock.uclock.refcount = NULL;
+    bench.clock.uclock.uclock_now = bench_clock_now;
+    bench.clock.uclock.uclock_to_real = NULL;
+    bench.clock.uclock.uclock_from_real = NULL;
+
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+            &bench.umem.mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    bench.uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(bench.uref_mgr != NULL);
+    udict_mgr_release(udict_mgr);
+
+    bench.logger = uprobe_stdio_alloc(NULL, stderr, bench.loglevel);
+    assert(bench.logger != NULL);
+    bench.logger = uprobe_uref_mgr_alloc(bench.logger, bench.uref_mgr);
+    assert(bench.logger != NULL);
+    bench.logger = uprobe_ubuf_mem_alloc(bench.logger, &bench.umem.mgr,
+                                         UBUF_POOL_DEPTH,
+                                         UBUF_SHARED_POOL_DEPTH);
+    assert(bench.logger != NULL);
+
+    bool found = false;
+    for (unsigned int i = 0; i < UBASE_ARRAY_SIZE(bench_graphs); i++) {
+        if (graph != NULL && strcmp(graph, bench_graphs[i].name))
+            continue;
+        found = true;
+        bench_graphs[i].run(&bench);
+    }
+
+    uprobe_release(bench.logger);
+    uref_mgr_release(bench.uref_mgr);
+    umem_mgr_release(bench.umem.umem_mgr);
+
+    if (!found)
+        usage(argv[0]);
+    return 0;
+}
@@ -37,7 +37,9 @@
 #include <upipe/ubuf_block_mem.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 
 #define UBUF_POOL_DEPTH     1
@@ -46,6 +48,135 @@
 #define UBUF_ALIGN          16
 #define UBUF_ALIGN_OFFSET   0
 #define UBUF_SIZE           188
+/* 1 MB access unit made of TS payloads */
+#define AU_SEGMENT          184
+#define AU_SEGMENTS         5700
+#define AU_SIZE             (AU_SEGMENT * AU_SEGMENTS)
+#define AU_PEEKS            10000
+#define AU_FRAMES           50
+
+/** reference contents of the long chain */
+static uint8_t au[AU_SIZE];
+
+/** builds a chain of AU_SEGMENTS segments from au */
+static struct ubuf *build_au(struct ubuf_mgr *mgr)
+{
+    struct ubuf *head = NULL;
+    for (int i = 0; i < AU_SEGMENTS; i++) {
+        struct ubuf *ubuf = ubuf_block_alloc(mgr, AU_SEGMENT);
+        assert(ubuf != NULL);
+        int size = -1;
+        uint8_t *w;
+        ubase_assert(ubuf_block_write(ubuf, 0, &size, &w));
+        assert(size == AU_SEGMENT);
+        memcpy(w, au + i * AU_SEGMENT, AU_SEGMENT);
+        ubase_assert(ubuf_block_unmap(ubuf, 0));
+        if (head == NULL)
+            head = ubuf;
+        else
+            ubase_assert(ubuf_block_append(head, ubuf));
+    }
+    return head;
+}
+
+/** checks a chain against a reference buffer */
+static void check_au(struct ubuf *ubuf, const uint8_t *ref, size_t ref_size)
+{
+    size_t size;
+    ubase_assert(ubuf_block_size(ubuf, &size));
+    assert(size == ref_size);
+    for (int i = 0; i < 1000; i++) {
+        uint8_t buf[16];
+        int offset = rand() % (ref_size - sizeof(buf));
+        const uint8_t *r = ubuf_block_peek(ubuf, offset, sizeof(buf), buf);
+        assert(r != NULL);
+        assert(!memcmp(r, ref + offset, sizeof(buf)));
+        ubase_assert(ubuf_block_peek_unmap(ubuf, offset, buf, r));
+    }
+}
+
+/** tests the offset index and measures random access in access units */
+static void test_index(struct ubuf_mgr *mgr)
+{
+    srand(0);
+    for (int i = 0; i < AU_SIZE; i++)
+        au[i] = rand();
+
+    struct ubuf *ubuf = build_au(mgr);
+    check_au(ubuf, au, AU_SIZE);
+    struct ubuf_block *block = ubuf_block_from_ubuf(ubuf);
+    assert(block->index_count == AU_SEGMENTS);
+
+    /* dup carries no index but shares the segments */
+    struct ubuf *dup = ubuf_dup(ubuf);
+    assert(dup != NULL);
+    check_au(dup, au, AU_SIZE);
+
+    /* modifications keep the valid part of the index */
+    static uint8_t ref[AU_SIZE + AU_SEGMENT];
+    memcpy(ref, au, AU_SIZE);
+    size_t ref_size = AU_SIZE;
+
+    ubase_assert(ubuf_block_delete(ubuf, AU_SIZE / 2 + 10, 1000));
+    memmove(ref + AU_SIZE / 2 + 10, ref + AU_SIZE / 2 + 1010,
+            ref_size - AU_SIZE / 2 - 1010);
+    ref_size -= 1000;
+    check_au(ubuf, ref, ref_size);
+
+    struct ubuf *insert = ubuf_block_alloc(mgr, AU_SEGMENT);
+    assert(insert != NULL);
+    int size = -1;
+    uint8_t *w;
+    ubase_assert(ubuf_block_write(insert, 0, &size, &w));
+    memset(w, 0x47, size);
+    ubase_assert(ubuf_block_unmap(insert, 0));
+    ubase_assert(ubuf_block_insert(ubuf, AU_SIZE / 4 + 3, insert));
+    memmove(ref + AU_SIZE / 4 + 3 + AU_SEGMENT, ref + AU_SIZE / 4 + 3,
+            ref_size - AU_SIZE / 4 - 3);
+    memset(ref + AU_SIZE / 4 + 3, 0x47, AU_SEGMENT);
+    ref_size += AU_SEGMENT;
+    check_au(ubuf, ref, ref_size);
+
+    struct ubuf *tail = ubuf_block_split(ubuf, AU_SIZE / 8 + 5);
+    assert(tail != NULL);
+    check_au(tail, ref + AU_SIZE / 8 + 5, ref_size - AU_SIZE / 8 - 5);
+    ref_size = AU_SIZE / 8 + 5;
+    check_au(ubuf, ref, ref_size);
+    ubuf_free(tail);
+
+    ubase_assert(ubuf_block_resize(ubuf, 0, AU_SIZE / 16));
+    ref_size = AU_SIZE / 16;
+    check_au(ubuf, ref, ref_size);
+    ubuf_free(ubuf);
+    check_au(dup, au, AU_SIZE);
+    ubuf_free(dup);
+
+    /* reassemble access units, then scan them from the end and at random
+     * positions as a framer would */
+    clock_t build = 0, access = 0;
+    for (int frame = 0; frame < AU_FRAMES; frame++) {
+        clock_t start = clock();
+        ubuf = build_au(mgr);
+        build += clock() - start;
+
+        start = clock();
+        for (int i = 0; i < AU_PEEKS; i++) {
+            uint8_t buf[4];
+            int offset = rand() % (AU_SIZE - sizeof(buf));
+            if (i % 2)
+                offset = -offset - (int)sizeof(buf);
+            const uint8_t *r = ubuf_block_peek(ubuf, offset, sizeof(buf),
+                                               buf);
+            assert(r != NULL);
+            ubuf_block_peek_unmap(ubuf, offset, buf, r);
+        }
+        access += clock() - start;
+        ubuf_free(ubuf);
+    }
+    printf("%d access units of %d segments: build %f s, %d peeks %f s\n",
+           AU_FRAMES, AU_SEGMENTS, (double)build / CLOCKS_PER_SEC,
+           AU_FRAMES * AU_PEEKS, (double)access / CLOCKS_PER_SEC);
+}
 
 int main(int argc, char **argv)
 {
@@ -312,6 +443,8 @@ int main(int argc, char **argv)
     ubuf_free(ubuf1);
     ubuf_free(ubuf2);
 
+    test_index(mgr);
+
     ubuf_mgr_release(mgr);
     umem_mgr_release(umem_mgr);
     return 0;
@@ -31,12 +31,86 @@
 #include <upipe/uclock_std.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <inttypes.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 #include <assert.h>
 
 #define UREF_POOL_DEPTH 1
 #define TIME_SAMPLE 1429627742
+/** number of calls of the benchmark */
+#define BENCH_CALLS 10000000
+/** number of threads of the monotonicity test */
+#define MONOTONIC_THREADS 4
+/** duration of the monotonicity test, spanning several TSC re-syncs */
+#define MONOTONIC_DURATION (UCLOCK_FREQ / 2)
+
+/** clock shared by the monotonicity threads */
+static struct uclock *monotonic_uclock;
+/** lock serializing the cross-thread checks */
+static pthread_mutex_t monotonic_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** last date returned to any thread */
+static uint64_t monotonic_last = 0;
+
+/** checks that dates never go backwards, within a thread and between
+ * threads */
+static void *monotonic_thread(void *arg)
+{
+    uint64_t start = uclock_now(monotonic_uclock);
+    uint64_t prev = start;
+    uint64_t calls = 0;
+
+    while (prev < start + MONOTONIC_DURATION) {
+        for (int i = 0; i < 1000; i++) {
+            uint64_t now = uclock_now(monotonic_uclock);
+            assert(now >= prev);
+            prev = now;
+        }
+        calls += 1000;
+
+        assert(!pthread_mutex_lock(&monotonic_mutex));
+        uint64_t now = uclock_now(monotonic_uclock);
+        assert(now >= monotonic_last);
+        monotonic_last = now;
+        assert(!pthread_mutex_unlock(&monotonic_mutex));
+        prev = now;
+    }
+    return (void *)(uintptr_t)calls;
+}
+
+/** checks monotonicity of a clock over several threads */
+static void test_monotonic(struct uclock *uclock)
+{
+    pthread_t threads[MONOTONIC_THREADS];
+    monotonic_uclock = uclock;
+    monotonic_last = 0;
+    for (int i = 0; i < MONOTONIC_THREADS; i++)
+        assert(!pthread_create(&threads[i], NULL, monotonic_thread, NULL));
+    uint64_t calls = 0;
+    for (int i = 0; i < MONOTONIC_THREADS; i++) {
+        void *ret;
+        assert(!pthread_join(threads[i], &ret));
+        calls += (uintptr_t)ret;
+    }
+    printf("%"PRIu64" monotonic calls in %d threads\n", calls,
+           MONOTONIC_THREADS);
+}
+
+/** measures the cost of a call */
+static void bench(struct uclock *uclock, const char *name)
+{
+    uint64_t sum = 0;
+    clock_t start = clock();
+    for (int i = 0; i < BENCH_CALLS; i++)
+        sum += uclock_now(uclock);
+    clock_t end = clock();
+    assert(sum);
+    printf("%s: %.1f ns per call\n", name,
+           (double)(end - start) * 1000000000. / CLOCKS_PER_SEC /
+           BENCH_CALLS);
+}
 
 int main(int argc, char **argv)
 {
@@ -55,6 +129,31 @@ int main(int argc, char **argv)
            TIME_SAMPLE * UCLOCK_FREQ);
     assert(uclock_from_real(uclock_cal, (uint64_t)TIME_SAMPLE * UCLOCK_FREQ) ==
            TIME_SAMPLE * UCLOCK_FREQ);
+
+    struct uclock *uclock_tsc = uclock_std_alloc(UCLOCK_FLAG_TSC);
+    assert(uclock_tsc);
+    uint64_t now_tsc = uclock_now(uclock_tsc);
+    now = uclock_now(uclock);
+    printf("TSC: %"PRIu64"\n", now_tsc);
+    assert(now_tsc <= now + UCLOCK_FREQ / 1000 &&
+           now_tsc + UCLOCK_FREQ / 1000 >= now);
+    uint64_t real = uclock_to_real(uclock_tsc, now_tsc);
+    assert(real >= now_cal);
+    assert(uclock_from_real(uclock_tsc, real) <= now_tsc + UCLOCK_FREQ / 1000);
+
+    bench(uclock, "std");
+    bench(uclock_tsc, "TSC");
+    test_monotonic(uclock);
+    test_monotonic(uclock_tsc);
+
+    /* the TSC stays in sync with the system clock */
+    now_tsc = uclock_now(uclock_tsc);
+    now = uclock_now(uclock);
+    printf("TSC drift: %"PRId64" ticks\n", (int64_t)(now_tsc - now));
+    assert(now_tsc <= now + UCLOCK_FREQ / 1000 &&
+           now_tsc + UCLOCK_FREQ / 1000 >= now);
+
     uclock_release(uclock);
     uclock_release(uclock_cal);
+    uclock_release(uclock_tsc);
 }
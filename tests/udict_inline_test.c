@@ -41,12 +41,199 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
 #include <assert.h>
 
 #define UDICT_POOL_DEPTH 1
 
+/** number of named attributes of the indexed udict */
+#define LOOKUP_ATTRS 48
+/** number of numbered attributes, as set by the _VA accessors */
+#define NUMBERED_ATTRS 8192
+/** number of lookups of the benchmark */
+#define LOOKUP_BENCH 4000000
+/** number of outputs of the fan-out benchmark */
+#define FANOUT_OUTPUTS 16
+/** number of input packets of the fan-out benchmark */
+#define FANOUT_BENCH 200000
+
 #define SALUTATION "Hello everyone, this is just some padding to make the structure bigger, if you don't mind."
 
+/** checks lookups on a udict large enough to be indexed, then times them */
+static void test_lookup(struct udict_mgr *mgr)
+{
+    struct udict *udict = udict_alloc(mgr, 0);
+    assert(udict != NULL);
+    char names[LOOKUP_ATTRS][16];
+    for (int i = 0; i < LOOKUP_ATTRS; i++) {
+        snprintf(names[i], sizeof(names[i]), "x.attr%d", i);
+        ubase_assert(udict_set_unsigned(udict, i, UDICT_TYPE_UNSIGNED,
+                                        names[i]));
+    }
+    ubase_assert(udict_set_unsigned(udict, 42, UDICT_TYPE_CLOCK_DURATION,
+                                    NULL));
+    ubase_assert(udict_set_void(udict, NULL, UDICT_TYPE_VOID, names[0]));
+
+    uint64_t u;
+    for (int i = 0; i < LOOKUP_ATTRS; i++) {
+        ubase_assert(udict_get_unsigned(udict, &u, UDICT_TYPE_UNSIGNED,
+                                        names[i]));
+        assert(u == i);
+    }
+    ubase_assert(udict_get_unsigned(udict, &u, UDICT_TYPE_CLOCK_DURATION,
+                                    NULL));
+    assert(u == 42);
+    ubase_assert(udict_get_void(udict, NULL, UDICT_TYPE_VOID, names[0]));
+    ubase_nassert(udict_get_void(udict, NULL, UDICT_TYPE_VOID, names[1]));
+    ubase_nassert(udict_get_unsigned(udict, &u, UDICT_TYPE_UNSIGNED,
+                                     "x.missing"));
+
+    /* deletions and replacements move attributes around */
+    ubase_assert(udict_delete(udict, UDICT_TYPE_UNSIGNED, names[3]));
+    ubase_nassert(udict_get_unsigned(udict, &u, UDICT_TYPE_UNSIGNED,
+                                     names[3]));
+    ubase_assert(udict_set_string(udict, "short", UDICT_TYPE_STRING,
+                                  names[3]));
+    ubase_assert(udict_set_string(udict, SALUTATION, UDICT_TYPE_STRING,
+                                  names[3]));
+    const char *string;
+    ubase_assert(udict_get_string(udict, &string, UDICT_TYPE_STRING,
+                                  names[3]));
+    assert(!strcmp(string, SALUTATION));
+    for (int i = 4; i < LOOKUP_ATTRS; i++) {
+        ubase_assert(udict_get_unsigned(udict, &u, UDICT_TYPE_UNSIGNED,
+                                        names[i]));
+        assert(u == i);
+    }
+
+    struct udict *dup = udict_dup(udict);
+    assert(dup != NULL);
+    ubase_assert(udict_get_unsigned(dup, &u, UDICT_TYPE_UNSIGNED,
+                                    names[LOOKUP_ATTRS - 1]));
+    assert(u == LOOKUP_ATTRS - 1);
+    udict_free(dup);
+
+    /* numbered names are not limited in number */
+    struct udict *numbered = udict_alloc(mgr, 0);
+    assert(numbered != NULL);
+    char name[32];
+    for (int i = 0; i < NUMBERED_ATTRS; i++) {
+        snprintf(name, sizeof(name), "e.start[%d]", i);
+        ubase_assert(udict_set_unsigned(numbered, i, UDICT_TYPE_UNSIGNED,
+                                        name));
+    }
+    for (int i = 0; i < NUMBERED_ATTRS; i++) {
+        snprintf(name, sizeof(name), "e.start[%d]", i);
+        ubase_assert(udict_get_unsigned(numbered, &u, UDICT_TYPE_UNSIGNED,
+                                        name));
+        assert(u == i);
+    }
+    ubase_nassert(udict_get_unsigned(numbered, &u, UDICT_TYPE_UNSIGNED,
+                                     "e.start[-1]"));
+    udict_free(numbered);
+
+    clock_t start = clock();
+    for (int i = 0; i < LOOKUP_BENCH; i++) {
+        ubase_assert(udict_get_unsigned(udict, &u, UDICT_TYPE_UNSIGNED,
+                                        names[LOOKUP_ATTRS - 1 -
+                                              i % (LOOKUP_ATTRS - 4)]));
+    }
+    fprintf(stderr, "%d lookups in %d attributes: %f s\n",
+            LOOKUP_BENCH, LOOKUP_ATTRS,
+            (double)(clock() - start) / CLOCKS_PER_SEC);
+    udict_free(udict);
+}
+
+/** checks copy-on-write duplication, then times a 1 to 16 fan-out of
+ * TS-like packets whose outputs only read their attributes */
+static void test_fanout(struct udict_mgr *mgr)
+{
+    uint32_t shared, detached;
+    ubase_assert(udict_inline_mgr_get_stats(mgr, &shared, &detached));
+    uint32_t start_shared = shared, start_detached = detached;
+
+    struct udict *udict = udict_alloc(mgr, 0);
+    assert(udict != NULL);
+    ubase_assert(udict_set_unsigned(udict, 27000000, UDICT_TYPE_CLOCK_DURATION,
+                                    NULL));
+    ubase_assert(udict_set_unsigned(udict, 12, UDICT_TYPE_UNSIGNED, "x.a"));
+    struct udict *dup1 = udict_dup(udict);
+    assert(dup1 != NULL);
+    struct udict *dup2 = udict_dup(dup1);
+    assert(dup2 != NULL);
+    ubase_assert(udict_inline_mgr_get_stats(mgr, &shared, &detached));
+    assert(shared == start_shared + 2);
+    assert(detached == start_detached);
+
+    /* deleting a missing attribute does not detach */
+    ubase_nassert(udict_delete(dup1, UDICT_TYPE_UNSIGNED, "x.b"));
+    ubase_assert(udict_set_unsigned(dup1, 13, UDICT_TYPE_UNSIGNED, "x.a"));
+    ubase_assert(udict_delete(dup2, UDICT_TYPE_CLOCK_DURATION, NULL));
+    ubase_assert(udict_inline_mgr_get_stats(mgr, &shared, &detached));
+    assert(detached == start_detached + 2);
+
+    uint64_t u;
+    ubase_assert(udict_get_unsigned(udict, &u, UDICT_TYPE_UNSIGNED, "x.a"));
+    assert(u == 12);
+    ubase_assert(udict_get_unsigned(udict, &u, UDICT_TYPE_CLOCK_DURATION,
+                                    NULL));
+    ubase_assert(udict_get_unsigned(dup1, &u, UDICT_TYPE_UNSIGNED, "x.a"));
+    assert(u == 13);
+    ubase_assert(udict_get_unsigned(dup2, &u, UDICT_TYPE_UNSIGNED, "x.a"));
+    assert(u == 12);
+    ubase_nassert(udict_get_unsigned(dup2, &u, UDICT_TYPE_CLOCK_DURATION,
+                                     NULL));
+    udict_free(dup1);
+    udict_free(dup2);
+
+    /* the last reference is written in place */
+    ubase_assert(udict_set_unsigned(udict, 14, UDICT_TYPE_UNSIGNED, "x.a"));
+    ubase_assert(udict_inline_mgr_get_stats(mgr, &shared, &detached));
+    assert(detached == start_detached + 2);
+    udict_free(udict);
+
+    clock_t start = clock();
+    for (int i = 0; i < FANOUT_BENCH; i++) {
+        udict = udict_alloc(mgr, 0);
+        assert(udict != NULL);
+        ubase_assert(udict_set_unsigned(udict, i, UDICT_TYPE_UNSIGNED,
+                                        "k.cr.sys"));
+        ubase_assert(udict_set_unsigned(udict, i, UDICT_TYPE_UNSIGNED,
+                                        "k.cr.prog"));
+        ubase_assert(udict_set_unsigned(udict, i, UDICT_TYPE_UNSIGNED,
+                                        "k.dts.prog"));
+        ubase_assert(udict_set_unsigned(udict, i, UDICT_TYPE_UNSIGNED,
+                                        "k.dts.orig"));
+        ubase_assert(udict_set_unsigned(udict, 0, UDICT_TYPE_UNSIGNED,
+                                        "k.dts_pts"));
+        ubase_assert(udict_set_void(udict, NULL, UDICT_TYPE_VOID,
+                                    "b.start"));
+        ubase_assert(udict_set_string(udict, SALUTATION, UDICT_TYPE_STRING,
+                                      "x.salutation"));
+
+        struct udict *outputs[FANOUT_OUTPUTS];
+        for (int j = 0; j < FANOUT_OUTPUTS; j++) {
+            outputs[j] = udict_dup(udict);
+            assert(outputs[j] != NULL);
+        }
+        udict_free(udict);
+        for (int j = 0; j < FANOUT_OUTPUTS; j++) {
+            ubase_assert(udict_get_unsigned(outputs[j], &u,
+                                            UDICT_TYPE_UNSIGNED, "k.cr.sys"));
+            assert(u == i);
+            udict_free(outputs[j]);
+        }
+    }
+    ubase_assert(udict_inline_mgr_get_stats(mgr, &shared, &detached));
+    fprintf(stderr, "%d packets fanned out to %d outputs: %f s "
+            "(%"PRIu32" shared, %"PRIu32" detached)\n",
+            FANOUT_BENCH, FANOUT_OUTPUTS,
+            (double)(clock() - start) / CLOCKS_PER_SEC,
+            shared - start_shared, detached - start_detached);
+}
+
 int main(int argc, char **argv)
 {
     struct uprobe *uprobe = uprobe_stdio_alloc(NULL, stdout, UPROBE_LOG_DEBUG);
@@ -131,6 +318,14 @@ int main(int argc, char **argv)
     udict_free(udict2);
 
     udict_free(udict1);
+
+    test_lookup(mgr);
+    udict_mgr_release(mgr);
+
+    /* use deeper pools for the fan-out, as a real pipeline would */
+    mgr = udict_inline_mgr_alloc(FANOUT_OUTPUTS + 1, umem_mgr, -1, -1);
+    assert(mgr != NULL);
+    test_fanout(mgr);
     udict_mgr_release(mgr);
 
     umem_mgr_release(umem_mgr);
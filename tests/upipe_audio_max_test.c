@@ -57,9 +57,11 @@
 #define SAMPLES             1024
 #define UPROBE_LOG_LEVEL    UPROBE_LOG_VERBOSE
 #define ALIGN               0
+#define SINE_AMPLITUDE      0.5
 
 static bool got_urequest = false;
 static bool got_input = false;
+static bool sine = false;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -94,12 +96,39 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     assert(uref != NULL);
     upipe_dbg(upipe, "===> received input uref");
     uref_dump(uref, upipe->uprobe);
-    double amplitude;
+    double amplitude, true_peak;
+
+    if (sine) {
+        /* the samples of a sine at fs/4 taken at +-45 degrees are at
+         * 1/sqrt(2) of its amplitude, the peaks fall between samples */
+        for (uint8_t i = 0; i < 2; i++) {
+            ubase_assert(uref_amax_get_amplitude(uref, &amplitude, i));
+            assert(fabs(amplitude - SINE_AMPLITUDE * M_SQRT1_2) < 1e-3);
+            ubase_assert(uref_amax_get_true_peak(uref, &true_peak, i));
+            assert(true_peak > amplitude * 1.3);
+            assert(fabs(true_peak - SINE_AMPLITUDE) < SINE_AMPLITUDE * 0.03);
+        }
+        uref_free(uref);
+        got_input = true;
+        return;
+    }
+
     ubase_assert(uref_amax_get_amplitude(uref, &amplitude, 0));
     assert(amplitude == (SAMPLES - 1) * 1.0f / INT16_MAX);
     ubase_assert(uref_amax_get_amplitude(uref, &amplitude, 1));
     assert(amplitude == (SAMPLES * 2 - 1) * 1.0f / INT16_MAX);
 
+    /* samples of channel 0 are a ramp from 0 to SAMPLES - 1 */
+    double rms, expected = 0.;
+    for (int i = 0; i < SAMPLES; i++)
+        expected += (double)i * i;
+    expected = sqrt(expected / SAMPLES) / INT16_MAX;
+    ubase_assert(uref_amax_get_rms(uref, &rms, 0));
+    assert(fabs(rms - expected) < 1e-9);
+
+    ubase_assert(uref_amax_get_true_peak(uref, &true_peak, 1));
+    assert(true_peak >= amplitude);
+
     uref_free(uref);
     got_input = true;
 }
@@ -170,6 +199,25 @@ static void fill_in(struct ubuf *ubuf)
     }
 }
 
+static void fill_in_sine(struct ubuf *ubuf)
+{
+    size_t size;
+    uint8_t sample_size;
+    ubase_assert(ubuf_sound_size(ubuf, &size, &sample_size));
+
+    const char *channel;
+    ubuf_sound_foreach_plane(ubuf, channel) {
+        int16_t *buffer;
+        ubase_assert(ubuf_sound_plane_write_int16_t(ubuf, channel, 0, -1,
+                                                    &buffer));
+
+        for (int x = 0; x < size; x++)
+            buffer[x] = lrint(SINE_AMPLITUDE * INT16_MAX *
+                              sin(M_PI / 2 * x + M_PI / 4));
+        ubase_assert(ubuf_sound_plane_unmap(ubuf, channel, 0, -1));
+    }
+}
+
 int main(int argc, char **argv)
 {
     printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
@@ -232,12 +280,20 @@ int main(int argc, char **argv)
     ubase_assert(uref_sound_flow_add_plane(flow_def, "r"));
     ubase_assert(upipe_set_flow_def(amax, flow_def));
     uref_free(flow_def);
+    ubase_assert(upipe_amax_set_true_peak(amax, true));
 
     struct uref *uref = uref_sound_alloc(uref_mgr, sound_mgr, SAMPLES);
     fill_in(uref->ubuf);
     upipe_input(amax, uref, NULL);
     assert(got_input);
 
+    got_input = false;
+    sine = true;
+    uref = uref_sound_alloc(uref_mgr, sound_mgr, SAMPLES);
+    fill_in_sine(uref->ubuf);
+    upipe_input(amax, uref, NULL);
+    assert(got_input);
+
     /* release pipe */
     upipe_release(amax);
     test_free(test);
@@ -49,6 +49,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <time.h>
+#include <math.h>
 #include <assert.h>
 
 #define UDICT_POOL_DEPTH    5
@@ -60,6 +62,12 @@
 #define SAMPLES             1024
 #define DURATION            SAMPLES * UCLOCK_FREQ / INPUT_RATE
 #define UPROBE_LOG_LEVEL    UPROBE_LOG_VERBOSE
+#define BENCH_CHANNELS      16
+#define BENCH_DURATION      60
+#define BENCH_ITERATIONS    (BENCH_DURATION * INPUT_RATE / SAMPLES)
+#define BENCH_SWITCH        20
+
+static unsigned int bench_outputs = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -77,6 +85,140 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe checking that crossblended gains sum to one */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    const float *buf;
+    size_t size;
+    uint8_t sample_size;
+    ubase_assert(uref_sound_size(uref, &size, &sample_size));
+    ubase_assert(uref_sound_plane_read_float(uref, "l", 0, -1, &buf));
+    /* the first input fades in from silence */
+    bool warm = bench_outputs >= BENCH_SWITCH;
+    for (size_t i = 0; i < size * sample_size / sizeof(float); i++) {
+        assert(buf[i] <= 1.0001);
+        assert(!warm || fabsf(buf[i] - 1.f) < 0.0001);
+    }
+    uref_sound_plane_unmap(uref, "l", 0, -1);
+    uref_free(uref);
+    bench_outputs++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_REGISTER_REQUEST:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** switches between two interleaved 16-channel inputs and reports the
+ * mixing cost */
+static void bench(struct uref_mgr *uref_mgr, struct umem_mgr *umem_mgr,
+                  struct uprobe *logger)
+{
+    struct uref *flow = uref_sound_flow_alloc_def(uref_mgr, "f32.",
+            BENCH_CHANNELS, BENCH_CHANNELS * sizeof(float));
+    ubase_assert(uref_sound_flow_add_plane(flow, "l"));
+    ubase_assert(uref_sound_flow_set_rate(flow, INPUT_RATE));
+
+    struct upipe *audiocont = upipe_flow_alloc(upipe_audiocont_mgr_alloc(),
+        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_NOTICE, "bench"),
+        flow);
+    assert(audiocont);
+    ubase_assert(upipe_set_flow_def(audiocont, flow));
+    struct upipe *test = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(test);
+    ubase_assert(upipe_set_output(audiocont, test));
+
+    struct upipe *inputs[2];
+    for (int i = 0; i < 2; i++) {
+        inputs[i] = upipe_void_alloc_sub(audiocont,
+            uprobe_pfx_alloc_va(uprobe_use(logger), UPROBE_LOG_NOTICE,
+                                "bench%d", i));
+        assert(inputs[i]);
+        ubase_assert(upipe_set_flow_def(inputs[i], flow));
+    }
+
+    struct ubuf_mgr *ubuf_mgr = ubuf_mem_mgr_alloc_from_flow_def(
+            UBUF_POOL_DEPTH, UBUF_POOL_DEPTH, umem_mgr, flow);
+    assert(ubuf_mgr);
+    uref_free(flow);
+
+    clock_t total = 0;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        if (i % BENCH_SWITCH == 0)
+            ubase_assert(upipe_audiocont_sub_set_input(
+                        inputs[(i / BENCH_SWITCH) % 2]));
+
+        for (int j = 0; j < 2; j++) {
+            struct uref *uref = uref_sound_alloc(uref_mgr, ubuf_mgr, SAMPLES);
+            assert(uref);
+            float *buf;
+            ubase_assert(uref_sound_plane_write_float(uref, "l", 0, -1,
+                                                      &buf));
+            for (int k = 0; k < SAMPLES * BENCH_CHANNELS; k++)
+                buf[k] = 1.;
+            uref_sound_plane_unmap(uref, "l", 0, -1);
+            uref_clock_set_pts_sys(uref, UCLOCK_FREQ + i * DURATION);
+            uref_clock_set_duration(uref, DURATION);
+            upipe_input(inputs[j], uref, NULL);
+        }
+
+        struct uref *uref = uref_sound_alloc(uref_mgr, ubuf_mgr, SAMPLES);
+        assert(uref);
+        uref_clock_set_pts_sys(uref, UCLOCK_FREQ + i * DURATION);
+        uref_clock_set_duration(uref, DURATION);
+        clock_t start = clock();
+        upipe_input(audiocont, uref, NULL);
+        total += clock() - start;
+    }
+    assert(bench_outputs == BENCH_ITERATIONS);
+
+    printf("%d channels, %d s of audio: %f s CPU\n", BENCH_CHANNELS,
+           BENCH_DURATION, (double)total / CLOCKS_PER_SEC);
+
+    ubuf_mgr_release(ubuf_mgr);
+    upipe_release(inputs[0]);
+    upipe_release(inputs[1]);
+    upipe_release(audiocont);
+    test_free(test);
+}
+
 int main(int argc, char **argv)
 {
     printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
@@ -215,6 +357,8 @@ int main(int argc, char **argv)
     /* release pipe */
     upipe_release(audiocont);
 
+    bench(uref_mgr, umem_mgr, logger);
+
     /* release managers */
     upipe_mgr_release(upipe_audiocont_mgr); // no-op
     uref_mgr_release(uref_mgr);
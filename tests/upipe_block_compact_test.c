@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for block_compact pipe
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/umem_pool.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/ubuf_block_stream.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_block_compact.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 10
+#define UREF_POOL_DEPTH 10
+#define UBUF_POOL_DEPTH 10
+#define UMEM_POOL_DEPTH 32
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+#define THRESHOLD 8
+/* 1 MB access unit made of TS payloads */
+#define SEGMENT 184
+#define SEGMENTS 5700
+#define FRAMES 20
+
+static unsigned int expected_segments = 0;
+static struct uref *received = NULL;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    int count = uref_block_iovec_count(uref, 0, -1);
+    assert(count == expected_segments);
+    if (count == 1) {
+        const uint8_t *buffer;
+        int size = -1;
+        ubase_assert(uref_block_read(uref, 0, &size, &buffer));
+        assert(!((uintptr_t)buffer % 64));
+        uref_block_unmap(uref, 0);
+    }
+    assert(received == NULL);
+    received = uref;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_REGISTER_REQUEST:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** builds a block of the given number of segments */
+static struct uref *build(struct uref_mgr *uref_mgr, struct ubuf_mgr *ubuf_mgr,
+                          int segments)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, SEGMENT);
+    assert(uref != NULL);
+    for (int i = 0; i < segments; i++) {
+        struct ubuf *ubuf = i ? ubuf_block_alloc(ubuf_mgr, SEGMENT) :
+                                uref->ubuf;
+        assert(ubuf != NULL);
+        uint8_t *buffer;
+        int size = -1;
+        ubase_assert(ubuf_block_write(ubuf, 0, &size, &buffer));
+        for (int j = 0; j < size; j++)
+            buffer[j] = i + j;
+        ubuf_block_unmap(ubuf, 0);
+        if (i)
+            ubase_assert(uref_block_append(uref, ubuf));
+    }
+    return uref;
+}
+
+/** reads a block byte per byte as a bitstream parser would */
+static uint32_t parse(struct uref *uref)
+{
+    struct ubuf_block_stream s;
+    uint32_t sum = 0;
+    ubase_assert(ubuf_block_stream_init(&s, uref->ubuf, 0));
+    for (int i = 0; i < SEGMENT * SEGMENTS; i++) {
+        ubuf_block_stream_fill_bits(&s, 8);
+        sum += ubuf_block_stream_show_bits(&s, 8);
+        ubuf_block_stream_skip_bits(&s, 8);
+    }
+    ubuf_block_stream_clean(&s);
+    return sum;
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_pool_mgr_alloc_simple(UMEM_POOL_DEPTH);
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "mpeg2video.");
+    assert(flow_def != NULL);
+
+    struct upipe *sink = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(sink != NULL);
+
+    struct upipe_mgr *upipe_block_compact_mgr =
+        upipe_block_compact_mgr_alloc();
+    assert(upipe_block_compact_mgr != NULL);
+    struct upipe *upipe = upipe_void_alloc(upipe_block_compact_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "compact"));
+    assert(upipe != NULL);
+    ubase_assert(upipe_set_flow_def(upipe, flow_def));
+    ubase_assert(upipe_set_output(upipe, sink));
+    uref_free(flow_def);
+
+    unsigned int threshold;
+    ubase_assert(upipe_block_compact_set_threshold(upipe, THRESHOLD));
+    ubase_assert(upipe_block_compact_get_threshold(upipe, &threshold));
+    assert(threshold == THRESHOLD);
+
+    /* few segments are passed through */
+    expected_segments = THRESHOLD;
+    upipe_input(upipe, build(uref_mgr, ubuf_mgr, THRESHOLD), NULL);
+    assert(received != NULL);
+    uref_free(received);
+    received = NULL;
+
+    /* many segments are coalesced */
+    expected_segments = 1;
+    struct uref *uref = build(uref_mgr, ubuf_mgr, SEGMENTS);
+    uint32_t sum = parse(uref);
+    upipe_input(upipe, uref, NULL);
+    assert(received != NULL);
+    assert(parse(received) == sum);
+    uref_free(received);
+    received = NULL;
+
+    /* parsing cost with and without compaction */
+    clock_t segmented = 0, compaction = 0, linear = 0;
+    for (int i = 0; i < FRAMES; i++) {
+        uref = build(uref_mgr, ubuf_mgr, SEGMENTS);
+        clock_t start = clock();
+        parse(uref);
+        segmented += clock() - start;
+
+        start = clock();
+        upipe_input(upipe, uref, NULL);
+        compaction += clock() - start;
+
+        start = clock();
+        parse(received);
+        linear += clock() - start;
+        uref_free(received);
+        received = NULL;
+    }
+    printf("%d access units of %d segments: parse %f s, compact %f s, "
+           "parse compacted %f s\n", FRAMES, SEGMENTS,
+           (double)segmented / CLOCKS_PER_SEC,
+           (double)compaction / CLOCKS_PER_SEC,
+           (double)linear / CLOCKS_PER_SEC);
+
+    upipe_release(upipe);
+    upipe_mgr_release(upipe_block_compact_mgr); // nop
+    test_free(sink);
+
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -49,6 +49,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <math.h>
+#include <time.h>
 #include <assert.h>
 
 #define UDICT_POOL_DEPTH    5
@@ -63,6 +64,10 @@
 #define STEP                (2. * M_PI * FREQ / RATE)
 #define UPROBE_LOG_LEVEL    UPROBE_LOG_VERBOSE
 #define ALIGN               0
+#define BENCH_ITERATIONS    (2 * 60 * RATE / SAMPLES)
+#define BENCH_INTERVAL      UCLOCK_FREQ
+#define CHECK_INTERVAL      UCLOCK_FREQ
+#define CHECK_BUFFERS       ((RATE + SAMPLES - 1) / SAMPLES)
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -80,10 +85,144 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** number of buffers received by the phony pipe since the last reset */
+static unsigned int nb_buffers = 0;
+/** number of times the integrated loudness was recomputed */
+static unsigned int nb_changes = 0;
+/** last loudness range received */
+static double last_lra;
+/** last integrated loudness received */
+static double last_global;
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    double lra, global;
+    ubase_assert(uref_ebur128_get_lra(uref, &lra));
+    ubase_assert(uref_ebur128_get_global(uref, &global));
+
+    /* cached values are reused until the next report */
+    if (nb_buffers % CHECK_BUFFERS) {
+        assert(lra == last_lra);
+        assert(global == last_global);
+    } else if (nb_buffers && global != last_global)
+        nb_changes++;
+    last_lra = lra;
+    last_global = global;
+    nb_buffers++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** sends sine wave buffers to the pipe, optionally with a rising level */
+static void send_sine(struct upipe *r128, struct uref_mgr *uref_mgr,
+                      struct ubuf_mgr *sound_mgr, int iterations, bool ramp)
+{
+    double phase = 0;
+    int i, j, k;
+    for (i=0; i < iterations; i++) {
+        struct uref *uref = uref_sound_alloc(uref_mgr, sound_mgr, SAMPLES);
+        assert(uref);
+        double gain = ramp ? (double)(i + 1) / iterations : 1.;
+        const char *channel;
+        int16_t *sample = NULL;
+        uref_sound_foreach_plane(uref, channel) {
+            uref_sound_plane_write_int16_t(uref, channel, 0, -1, &sample);
+            memset(sample, 0, 2 * CHANNELS * SAMPLES);
+            #if 1
+            for (j=0; j < SAMPLES; j++) {
+                int16_t val = sin(phase) * gain * INT16_MAX;
+                for (k=0; k < CHANNELS; k++) {
+                    sample[CHANNELS*j+k] = val;
+                }
+                phase += STEP;
+                if (phase >= 2. * M_PI) {
+                    phase = 0;
+                }
+            }
+            #endif
+            uref_sound_plane_unmap(uref, channel, 0, -1);
+        }
+
+        uref_clock_set_pts_sys(uref, UCLOCK_FREQ + i * DURATION);
+        uref_clock_set_duration(uref, DURATION);
+        upipe_input(r128, uref, NULL);
+    }
+}
+
+/** measures the CPU time used per hour of audio */
+static void bench(struct upipe_mgr *upipe_ebur128_mgr, struct uprobe *logger,
+                  struct uref_mgr *uref_mgr, struct ubuf_mgr *sound_mgr,
+                  struct uref *flow, uint64_t interval)
+{
+    struct upipe *r128 = upipe_void_alloc(upipe_ebur128_mgr,
+        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_WARNING, "bench"));
+    assert(r128);
+    ubase_assert(upipe_set_flow_def(r128, flow));
+    ubase_assert(upipe_ebur128_set_interval(r128, interval));
+    uint64_t check;
+    ubase_assert(upipe_ebur128_get_interval(r128, &check));
+    assert(check == interval);
+
+    struct upipe *null = upipe_void_alloc_output(r128,
+        upipe_null_mgr_alloc(),
+        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_WARNING, "null"));
+    assert(null);
+    upipe_release(null);
+
+    clock_t start = clock();
+    send_sine(r128, uref_mgr, sound_mgr, BENCH_ITERATIONS, false);
+    clock_t end = clock();
+    double audio = (double)BENCH_ITERATIONS * SAMPLES / RATE;
+    printf("interval %"PRIu64": %f s CPU per hour of audio\n", interval,
+           (double)(end - start) / CLOCKS_PER_SEC * 3600. / audio);
+
+    upipe_release(r128);
+}
+
 int main(int argc, char **argv)
 {
     printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
-    int i, j, k;
 
     /* uref and mem management */
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
@@ -131,43 +270,47 @@ int main(int argc, char **argv)
     upipe_release(null);
     upipe_null_dump_dict(null, true);
 
-    uref_free(flow);
-
     printf("packets duration : %"PRIu64"\n", DURATION);
 
     /* now send reference urefs */
-    double phase = 0;
-    for (i=0; i < ITERATIONS; i++) {
-        struct uref *uref = uref_sound_alloc(uref_mgr, sound_mgr, SAMPLES);
-        assert(uref);
-        const char *channel;
-        int16_t *sample = NULL;
-        uref_sound_foreach_plane(uref, channel) {
-            uref_sound_plane_write_int16_t(uref, channel, 0, -1, &sample);
-            memset(sample, 0, 2 * CHANNELS * SAMPLES);
-            #if 1
-            for (j=0; j < SAMPLES; j++) {
-                int16_t val = sin(phase) * INT16_MAX;
-                for (k=0; k < CHANNELS; k++) {
-                    sample[CHANNELS*j+k] = val;
-                }
-                phase += STEP;
-                if (phase >= 2. * M_PI) {
-                    phase = 0;
-                }
-            }
-            #endif
-            uref_sound_plane_unmap(uref, channel, 0, -1);
-        }
-
-        uref_clock_set_pts_sys(uref, UCLOCK_FREQ + i * DURATION);
-        uref_clock_set_duration(uref, DURATION);
-        upipe_input(r128, uref, NULL);
-    }
+    send_sine(r128, uref_mgr, sound_mgr, ITERATIONS, false);
+    ubase_assert(upipe_ebur128_reset(r128));
 
     /* release pipe */
     upipe_release(r128);
 
+    /* range and integrated loudness are only computed once per interval */
+    r128 = upipe_void_alloc(upipe_ebur128_mgr,
+        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "check"));
+    assert(r128);
+    ubase_assert(upipe_set_flow_def(r128, flow));
+    ubase_assert(upipe_ebur128_set_interval(r128, CHECK_INTERVAL));
+    struct upipe *test = upipe_void_alloc(&test_mgr,
+        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "test"));
+    assert(test);
+    ubase_assert(upipe_set_output(r128, test));
+
+    send_sine(r128, uref_mgr, sound_mgr, ITERATIONS, true);
+    assert(nb_buffers == ITERATIONS);
+    assert(nb_changes >= ITERATIONS / CHECK_BUFFERS - 1);
+
+    /* a reset reports again on the next buffer */
+    ubase_assert(upipe_ebur128_reset(r128));
+    nb_buffers = 0;
+    nb_changes = 0;
+    send_sine(r128, uref_mgr, sound_mgr, ITERATIONS, true);
+    assert(nb_buffers == ITERATIONS);
+    assert(nb_changes >= ITERATIONS / CHECK_BUFFERS - 1);
+
+    upipe_release(r128);
+    test_free(test);
+
+    /* compare per-buffer and rate-limited statistics */
+    bench(upipe_ebur128_mgr, logger, uref_mgr, sound_mgr, flow, 0);
+    bench(upipe_ebur128_mgr, logger, uref_mgr, sound_mgr, flow,
+          BENCH_INTERVAL);
+    uref_free(flow);
+
     /* release managers */
     upipe_mgr_release(upipe_ebur128_mgr); // no-op
     ubuf_mgr_release(sound_mgr);
@@ -66,8 +66,11 @@
 #define WIDTH               720
 #define HEIGHT              576
 #define LIMIT               120
+/* odd sinks receive planar yuv 4:2:0, converted by the GPU */
+#define SINK_YUV(i)         ((i) % 2)
 
 static struct ubuf_mgr *ubuf_mgr;
+static struct ubuf_mgr *yuv_mgr;
 static struct uref_mgr *uref_mgr;
 static struct upipe *glx_sink[SINK_NUM];
 static struct upump *idlerpump;
@@ -126,6 +129,28 @@ static void idler_cb(struct upump *upump)
     printf("(idler) Sending pic %d\n", counter);
 
     for (i=0; i < SINK_NUM; i++) {
+        if (SINK_YUV(i)) {
+            static const char *chromas[3] = { "y8", "u8", "v8" };
+            pic = uref_pic_alloc(uref_mgr, yuv_mgr, WIDTH, HEIGHT);
+            assert(pic);
+            for (int j = 0; j < 3; j++) {
+                uint8_t hsub, vsub;
+                ubase_assert(uref_pic_plane_write(pic, chromas[j], 0, 0, -1, -1,
+                                                  &buf));
+                ubase_assert(uref_pic_plane_size(pic, chromas[j], &stride,
+                                                 &hsub, &vsub, NULL));
+                for (y=0; y < HEIGHT / vsub; y++) {
+                    for (x=0; x < WIDTH / hsub; x++)
+                        buf[x] = j ? 128 + 50 * (j - 1) + i * 10 - counter :
+                                 16 + (x + y + counter * 3) % 220;
+                    buf += stride;
+                }
+                uref_pic_plane_unmap(pic, chromas[j], 0, 0, -1, -1);
+            }
+            upipe_input(glx_sink[i], pic, NULL);
+            continue;
+        }
+
         pic = uref_pic_alloc(uref_mgr, ubuf_mgr, WIDTH, HEIGHT);
         assert(pic);
         uref_pic_plane_write(pic, "r8g8b8", 0, 0, -1, -1, &buf);
@@ -174,6 +199,15 @@ int main(int argc, char **argv)
                                       UBUF_ALIGN, UBUF_ALIGN_HOFFSET);
     assert(ubuf_mgr);
     ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "r8g8b8", 1, 1, 3));
+    /* yuv420p */
+    yuv_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH, umem_mgr, 1,
+                                     UBUF_PREPEND, UBUF_APPEND,
+                                     UBUF_PREPEND, UBUF_APPEND,
+                                     UBUF_ALIGN, UBUF_ALIGN_HOFFSET);
+    assert(yuv_mgr);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(yuv_mgr, "y8", 1, 1, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(yuv_mgr, "u8", 2, 2, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(yuv_mgr, "v8", 2, 2, 1));
 
     /* ev loop */
     struct upump_mgr *upump_mgr = upump_ev_mgr_alloc_default(UPUMP_POOL,
@@ -183,6 +217,11 @@ int main(int argc, char **argv)
     struct uref *flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
     assert(flow_def != NULL);
     ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 3, "r8g8b8"));
+    struct uref *yuv_flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(yuv_flow_def != NULL);
+    ubase_assert(uref_pic_flow_add_plane(yuv_flow_def, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(yuv_flow_def, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(yuv_flow_def, 2, 2, 1, "v8"));
 
     /* glx sink */
     struct upipe_mgr *glx_mgr = upipe_glx_sink_mgr_alloc();
@@ -191,10 +230,12 @@ int main(int argc, char **argv)
                 uprobe_pfx_alloc_va(uprobe_use(logger), UPROBE_LOG_LEVEL,
                                     "glx %d", i)));
         assert(glx_sink[i]);
-        ubase_assert(upipe_set_flow_def(glx_sink[i], flow_def));
+        ubase_assert(upipe_set_flow_def(glx_sink[i],
+                    SINK_YUV(i) ? yuv_flow_def : flow_def));
         upipe_glx_sink_init(glx_sink[i], 0, 0, 640, 480);
     }
     uref_free(flow_def);
+    uref_free(yuv_flow_def);
 
     /* idler */
     idlerpump = upump_alloc_idler(upump_mgr, idler_cb, NULL, NULL);
@@ -219,6 +260,7 @@ int main(int argc, char **argv)
     upump_mgr_release(upump_mgr);
     upipe_mgr_release(glx_mgr); // noop
     ubuf_mgr_release(ubuf_mgr);
+    ubuf_mgr_release(yuv_mgr);
     uref_mgr_release(uref_mgr);
     uprobe_release(logger);
     uprobe_clean(&uprobe);
@@ -49,6 +49,10 @@
 #include <upipe/upipe.h>
 #include <upipe-hbrmt/upipe_pack10bit.h>
 
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
 #define UDICT_POOL_DEPTH 0
 #define UREF_POOL_DEPTH 0
 #define UBUF_POOL_DEPTH 0
@@ -58,7 +62,13 @@
 
 #define WIDTH 1024
 
+/* UHD frames, two samples per pixel */
+#define BENCH_WIDTH 3840
+#define BENCH_LINES 2160
+#define BENCH_FRAMES 10
+
 static bool received_block = false;
+static bool benchmarking = false;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -91,6 +101,10 @@ static void test_input(struct upipe *upipe, struct uref *uref,
                        struct upump **upump_p)
 {
     assert(uref != NULL);
+    if (benchmarking) {
+        uref_free(uref);
+        return;
+    }
     size_t size;
     ubase_assert(uref_block_size(uref, &size));
     assert(size == WIDTH * 10 / 8);
@@ -200,6 +214,26 @@ int main(int argc, char *argv[])
     upipe_input(upipe_pack10, uref, NULL);
     assert(received_block);
 
+    /* throughput on whole frames */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, BENCH_WIDTH * 2 * 2);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    memset(buffer, 0x5a, size);
+    uref_block_unmap(uref, 0);
+
+    benchmarking = true;
+    clock_t start = clock();
+    for (int i = 0; i < BENCH_FRAMES * BENCH_LINES; i++) {
+        struct uref *line = uref_dup(uref);
+        assert(line != NULL);
+        upipe_input(upipe_pack10, line, NULL);
+    }
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    uref_free(uref);
+    printf("%d %dx%d frames in %f s (%f fps)\n", BENCH_FRAMES,
+           BENCH_WIDTH, BENCH_LINES, elapsed, BENCH_FRAMES / elapsed);
+
     upipe_release(upipe_pack10);
     upipe_mgr_release(upipe_pack10bit_mgr); // nop
 
@@ -228,6 +228,8 @@ int main(int argc, char *argv[])
     unsigned int length;
     ubase_assert(upipe_qsrc_get_length(upipe_qsrc, &length));
     assert(length == 3);
+    ubase_assert(upipe_qsink_get_length(upipe_qsink, &length));
+    assert(length == 3);
 
     urequest_init_uref_mgr(&request, provide_request, NULL);
     upipe_register_request(upipe_qsink, &request);
@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for rtcp_fb_receiver pipe
+ */
+
+#undef NDEBUG
+
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uprobe_uclock.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/upipe.h>
+#include <upipe-filters/upipe_rtcp_fb_receiver.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+#include <bitstream/ietf/rtcp.h>
+#include <bitstream/ietf/rtcp_rr.h>
+#include <bitstream/ietf/rtcp_fb.h>
+
+#define UDICT_POOL_DEPTH    0
+#define UREF_POOL_DEPTH     0
+#define UBUF_POOL_DEPTH     0
+#define UBUF_SHARED_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+/** first sequence number, so that the sequence numbers wrap */
+#define FIRST_SEQ           64000
+/** number of buffered packets, more than the initial size of the cache */
+#define NB_PACKETS          3000
+
+/** current date of the test clock */
+static uint64_t now = UINT32_MAX;
+/** number of packets received by the sink */
+static unsigned int nb_packets = 0;
+/** number of times each sequence number was received by the sink */
+static unsigned int received[UINT16_MAX + 1];
+/** sink of the receiver with its own output */
+static struct upipe *unicast_sink = NULL;
+/** number of packets received by the sink of the receiver */
+static unsigned int nb_unicast = 0;
+
+/** helper uclock returning the test date */
+static uint64_t test_now(struct uclock *uclock)
+{
+    return now;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    const uint8_t *buf;
+    int size = RTP_HEADER_SIZE;
+    ubase_assert(uref_block_read(uref, 0, &size, &buf));
+    assert(size == RTP_HEADER_SIZE);
+    if (upipe == unicast_sink)
+        nb_unicast++;
+    else {
+        received[rtp_get_seqnum(buf)]++;
+        nb_packets++;
+    }
+    uref_block_unmap(uref, 0);
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_SOURCE_END:
+        case UPROBE_NEED_UPUMP_MGR:
+        case UPROBE_NEED_OUTPUT:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** sends a RTP packet to the pipe */
+static void send_rtp(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                     struct ubuf_mgr *ubuf_mgr, uint16_t seq)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, RTP_HEADER_SIZE);
+    assert(uref != NULL);
+    uint8_t *buf;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    memset(buf, 0, size);
+    rtp_set_hdr(buf);
+    rtp_set_type(buf, RTP_TYPE_TS);
+    rtp_set_seqnum(buf, seq);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe, uref, NULL);
+}
+
+/** sends a generic NACK with several FCI entries to an input subpipe */
+static void send_nack(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                      struct ubuf_mgr *ubuf_mgr, const uint16_t *seqs,
+                      const uint16_t *masks, unsigned int nb)
+{
+    int len = RTCP_FB_HEADER_SIZE + nb * RTCP_FB_FCI_GENERIC_NACK_SIZE;
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, len);
+    assert(uref != NULL);
+    uint8_t *buf;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    memset(buf, 0, size);
+    static const uint8_t ssrc[4] = { 1, 2, 3, 4 };
+    rtcp_set_rtp_version(buf);
+    rtcp_fb_set_fmt(buf, RTCP_PT_RTPFB_GENERIC_NACK);
+    rtcp_set_pt(buf, RTCP_PT_RTPFB);
+    rtcp_set_length(buf, len / 4 - 1);
+    rtcp_fb_set_ssrc_pkt_sender(buf, ssrc);
+    rtcp_fb_set_ssrc_media_src(buf, ssrc);
+    for (unsigned int i = 0; i < nb; i++) {
+        uint8_t *fci = &buf[RTCP_FB_HEADER_SIZE +
+                            i * RTCP_FB_FCI_GENERIC_NACK_SIZE];
+        rtcp_fb_nack_set_packet_id(fci, seqs[i]);
+        rtcp_fb_nack_set_bitmask_lost(fci, masks[i]);
+    }
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe, uref, NULL);
+}
+
+/** sends a receiver report to an input subpipe, so that the round-trip time
+ * computed from the current date is rtt (in 1/65536 seconds) */
+static void send_rr(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                    struct ubuf_mgr *ubuf_mgr, uint32_t rtt)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, RTCP_RR_SIZE);
+    assert(uref != NULL);
+    uint8_t *buf;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    memset(buf, 0, size);
+    rtcp_set_rtp_version(buf);
+    rtcp_set_rc(buf, 1);
+    rtcp_rr_set_pt(buf);
+    rtcp_set_length(buf, RTCP_RR_SIZE / 4 - 1);
+
+    /* the report block is sent one second after the sender report */
+    uint64_t ntp_time = ((now / UCLOCK_FREQ) << 32) +
+        ((now % UCLOCK_FREQ) << 32) / UCLOCK_FREQ;
+    uint32_t delay = 65536;
+    rtcp_rr_set_last_sr(buf, (uint32_t)(ntp_time >> 16) - delay - rtt);
+    rtcp_rr_set_delay_since_last_sr(buf, delay);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe, uref, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+
+    struct uclock uclock;
+    uclock.refcount = NULL;
+    uclock.uclock_now = test_now;
+    uclock.uclock_to_real = NULL;
+    uclock.uclock_from_real = NULL;
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_SHARED_POOL_DEPTH);
+    assert(logger != NULL);
+    logger = uprobe_uclock_alloc(logger, &uclock);
+    assert(logger != NULL);
+
+    struct upipe *sink = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(sink != NULL);
+
+    struct upipe_mgr *upipe_rtcpfb_mgr = upipe_rtcpfb_mgr_alloc();
+    assert(upipe_rtcpfb_mgr != NULL);
+    struct upipe *upipe_rtcpfb = upipe_void_alloc(upipe_rtcpfb_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "rtcpfb"));
+    assert(upipe_rtcpfb != NULL);
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "mpegtsaligned.");
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_rtcpfb, flow_def));
+    ubase_assert(upipe_set_output(upipe_rtcpfb, sink));
+
+    struct upipe *receiver = upipe_void_alloc_sub(upipe_rtcpfb,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "receiver"));
+    assert(receiver != NULL);
+    ubase_assert(upipe_set_flow_def(receiver, flow_def));
+    uref_free(flow_def);
+
+    /* buffer more packets than the initial size of the cache, across the
+     * wrap-around of sequence numbers */
+    for (unsigned int i = 0; i < NB_PACKETS; i++)
+        send_rtp(upipe_rtcpfb, uref_mgr, ubuf_mgr, FIRST_SEQ + i);
+    assert(nb_packets == NB_PACKETS);
+    struct upipe_rtcpfb_stats stats;
+    ubase_assert(upipe_rtcpfb_get_stats(upipe_rtcpfb, &stats));
+    assert(stats.buffered == NB_PACKETS);
+
+    /* several FCI entries in one packet, with bitmasks, find packets
+     * anywhere in the cache */
+    uint16_t first = FIRST_SEQ;
+    uint16_t wrap = UINT16_MAX;
+    uint16_t last = (uint16_t)(FIRST_SEQ + NB_PACKETS - 1);
+    uint16_t seqs[] = { first, wrap, last };
+    uint16_t masks[] = { 0x0003, 0x0001, 0 };
+    memset(received, 0, sizeof(received));
+    nb_packets = 0;
+    send_nack(receiver, uref_mgr, ubuf_mgr, seqs, masks, 3);
+    assert(nb_packets == 6);
+    assert(received[first] == 1);
+    assert(received[(uint16_t)(first + 1)] == 1);
+    assert(received[(uint16_t)(first + 2)] == 1);
+    assert(received[wrap] == 1);
+    assert(received[0] == 1);
+    assert(received[last] == 1);
+    ubase_assert(upipe_rtcpfb_get_stats(upipe_rtcpfb, &stats));
+    assert(stats.nacks == 6);
+    assert(stats.retransmitted == 6);
+    assert(!stats.missing);
+
+    /* a packet that was never buffered */
+    uint16_t missing = last + 1;
+    uint16_t no_mask = 0;
+    send_nack(receiver, uref_mgr, ubuf_mgr, &missing, &no_mask, 1);
+    assert(nb_packets == 6);
+    ubase_assert(upipe_rtcpfb_get_stats(upipe_rtcpfb, &stats));
+    assert(stats.missing == 1);
+
+    /* requests within the holdoff delay are coalesced */
+    now += UCLOCK_FREQ / 100;
+    send_nack(receiver, uref_mgr, ubuf_mgr, seqs, masks, 3);
+    assert(nb_packets == 6);
+    ubase_assert(upipe_rtcpfb_get_stats(upipe_rtcpfb, &stats));
+    assert(stats.coalesced == 6);
+    assert(stats.retransmitted == 6);
+
+    /* and retransmitted again after it */
+    now += UCLOCK_FREQ / 50;
+    send_nack(receiver, uref_mgr, ubuf_mgr, seqs, masks, 3);
+    assert(nb_packets == 12);
+    assert(received[wrap] == 2);
+    ubase_assert(upipe_rtcpfb_get_stats(upipe_rtcpfb, &stats));
+    assert(stats.coalesced == 6);
+    assert(stats.retransmitted == 12);
+
+    struct upipe_rtcpfb_receiver_stats receiver_stats;
+    ubase_assert(upipe_rtcpfb_input_get_stats(receiver, &receiver_stats));
+    assert(receiver_stats.ssrc == 0x01020304);
+    assert(receiver_stats.nacks == 19);
+    assert(receiver_stats.retransmitted == 12);
+    assert(receiver_stats.coalesced == 6);
+    assert(receiver_stats.missing == 1);
+
+    /* a receiver with its own output gets its retransmissions there */
+    unicast_sink = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(unicast_sink != NULL);
+    struct upipe *unicast = upipe_void_alloc_sub(upipe_rtcpfb,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "unicast"));
+    assert(unicast != NULL);
+    ubase_assert(upipe_set_output(unicast, unicast_sink));
+
+    /* the round-trip time is estimated from receiver reports */
+    uint32_t rtt = 65536 / 10; /* 100 ms */
+    send_rr(unicast, uref_mgr, ubuf_mgr, rtt);
+    ubase_assert(upipe_rtcpfb_input_get_stats(unicast, &receiver_stats));
+    assert(receiver_stats.rtt == (uint64_t)rtt * UCLOCK_FREQ / 65536);
+    assert(!receiver_stats.nacks);
+
+    send_nack(unicast, uref_mgr, ubuf_mgr, &first, &no_mask, 1);
+    assert(nb_unicast == 1);
+    assert(nb_packets == 12);
+
+    /* requests are coalesced over max(holdoff, RTT) */
+    now += UCLOCK_FREQ / 20;
+    send_nack(unicast, uref_mgr, ubuf_mgr, &first, &no_mask, 1);
+    assert(nb_unicast == 1);
+    ubase_assert(upipe_rtcpfb_input_get_stats(unicast, &receiver_stats));
+    assert(receiver_stats.coalesced == 1);
+    now += UCLOCK_FREQ / 15;
+    send_nack(unicast, uref_mgr, ubuf_mgr, &first, &no_mask, 1);
+    assert(nb_unicast == 2);
+    ubase_assert(upipe_rtcpfb_input_get_stats(unicast, &receiver_stats));
+    assert(receiver_stats.coalesced == 1);
+    assert(receiver_stats.retransmitted == 2);
+
+    /* retransmissions are capped to 120 bytes, that is 10 packets, per
+     * second */
+    ubase_assert(upipe_set_option(unicast, "rate", "960"));
+    uint16_t burst = first + 100;
+    uint16_t burst_mask = 0x7fff;
+    ubase_assert(upipe_rtcpfb_get_stats(upipe_rtcpfb, &stats));
+    uint64_t capped = stats.capped;
+    send_nack(unicast, uref_mgr, ubuf_mgr, &burst, &burst_mask, 1);
+    assert(nb_unicast == 12);
+    ubase_assert(upipe_rtcpfb_input_get_stats(unicast, &receiver_stats));
+    assert(receiver_stats.capped == 6);
+    ubase_assert(upipe_rtcpfb_get_stats(upipe_rtcpfb, &stats));
+    assert(stats.capped == capped + 6);
+
+    /* and the bucket refills over time */
+    now += UCLOCK_FREQ / 10;
+    uint16_t capped_seq = burst + 15;
+    send_nack(unicast, uref_mgr, ubuf_mgr, &capped_seq, &no_mask, 1);
+    assert(nb_unicast == 13);
+    send_nack(unicast, uref_mgr, ubuf_mgr, &capped_seq, &no_mask, 1);
+    assert(nb_unicast == 13);
+    ubase_assert(upipe_rtcpfb_input_get_stats(unicast, &receiver_stats));
+    assert(receiver_stats.capped == 6);
+    assert(receiver_stats.coalesced == 2);
+    assert(nb_packets == 12);
+
+    /* packets expire after the latency */
+    now += 2 * UCLOCK_FREQ;
+    send_rtp(upipe_rtcpfb, uref_mgr, ubuf_mgr, last + 1);
+    ubase_assert(upipe_rtcpfb_get_stats(upipe_rtcpfb, &stats));
+    assert(stats.buffered == 1);
+    assert(stats.expired == NB_PACKETS);
+    send_nack(receiver, uref_mgr, ubuf_mgr, &missing, &no_mask, 1);
+    assert(received[missing] == 2);
+
+    upipe_release(unicast);
+    upipe_release(receiver);
+    upipe_release(upipe_rtcpfb);
+    upipe_mgr_release(upipe_rtcpfb_mgr); // nop
+    test_free(unicast_sink);
+    test_free(sink);
+
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -46,6 +46,7 @@
 #include <upipe/uref_std.h>
 #include <upipe/uref_dump.h>
 #include <upipe-swscale/upipe_sws.h>
+#include <upipe-swscale/upipe_sws_thumbs.h>
 
 #include <upipe/upipe_helper_upipe.h>
 
@@ -69,6 +70,7 @@
 
 #define SRCSIZE             32
 #define DSTSIZE             16
+#define THUMBSIZE           8
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -143,6 +145,34 @@ static void fill_in(struct uref *uref,
     uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
 }
 
+/* fill a chroma with a constant value */
+static void fill_flat(struct uref *uref, const char *chroma, uint8_t value)
+{
+    size_t hsize, vsize, stride;
+    uint8_t hsub, vsub, macropixel_size;
+    uint8_t *buffer = NULL;
+    uref_pic_plane_write(uref, chroma, 0, 0, -1, -1, &buffer);
+    uref_pic_plane_size(uref, chroma, &stride, &hsub, &vsub, &macropixel_size);
+    assert(buffer != NULL);
+    uref_pic_size(uref, &hsize, &vsize, NULL);
+    for (int y = 0; y < vsize / vsub; y++) {
+        memset(buffer, value, hsize / hsub * macropixel_size);
+        buffer += stride;
+    }
+    uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+}
+
+/* read a single luma value */
+static uint8_t read_luma(struct uref *uref, int x, int y)
+{
+    const uint8_t *buffer = NULL;
+    ubase_assert(uref_pic_plane_read(uref, "y8", x, y, 1, 1, &buffer));
+    assert(buffer != NULL);
+    uint8_t value = *buffer;
+    ubase_assert(uref_pic_plane_unmap(uref, "y8", x, y, 1, 1));
+    return value;
+}
+
 /* compare a chroma of two pictures */
 static bool compare_chroma(struct uref **urefs, const char *chroma, uint8_t hsub, uint8_t vsub, uint8_t macropixel_size, struct uprobe *uprobe)
 {
@@ -201,6 +231,7 @@ static bool compare_chroma(struct uref **urefs, const char *chroma, uint8_t hsub
 /** helper phony pipe */
 struct sws_test {
     struct uref *pic;
+    unsigned int nb_pics;
     struct upipe upipe;
 };
 
@@ -214,6 +245,7 @@ static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
     struct sws_test *sws_test = malloc(sizeof(struct sws_test));
     assert(sws_test != NULL);
     sws_test->pic = NULL;
+    sws_test->nb_pics = 0;
     upipe_init(&sws_test->upipe, mgr, uprobe);
     upipe_throw_ready(&sws_test->upipe);
     return &sws_test->upipe;
@@ -232,6 +264,7 @@ static void test_input(struct upipe *upipe, struct uref *uref,
         sws_test->pic = NULL;
     }
     sws_test->pic = uref;
+    sws_test->nb_pics++;
     upipe_dbg(upipe, "received pic");
 }
 
@@ -402,7 +435,6 @@ int main(int argc, char **argv)
     assert(sws != NULL);
     ubase_assert(upipe_set_flow_def(sws, pic_flow));
     uref_free(output_flow);
-    uref_free(pic_flow);
 
     /* build phony pipe */
     struct upipe *sws_test = upipe_void_alloc(&sws_test_mgr,
@@ -432,6 +464,96 @@ int main(int argc, char **argv)
     upipe_release(sws);
     test_free(sws_test);
 
+    /*
+     * now test upipe_sws_thumbs module: 2x2 gallery of 8x8 thumbs
+     */
+    struct upipe_mgr *upipe_sws_thumbs_mgr = upipe_sws_thumbs_mgr_alloc();
+    assert(upipe_sws_thumbs_mgr != NULL);
+
+    output_flow = uref_dup(pic_flow);
+    assert(output_flow != NULL);
+    struct upipe *thumbs = upipe_flow_alloc(upipe_sws_thumbs_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "thumbs"),
+            output_flow);
+    assert(thumbs != NULL);
+    uref_free(output_flow);
+    ubase_assert(upipe_sws_thumbs_set_size(thumbs, THUMBSIZE, THUMBSIZE,
+                                           2, 2));
+    ubase_assert(upipe_set_flow_def(thumbs, pic_flow));
+
+    sws_test = upipe_void_alloc(&sws_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "thumbs_test"));
+    assert(sws_test != NULL);
+    ubase_assert(upipe_set_output(thumbs, sws_test));
+    struct sws_test *thumbs_test = sws_test_from_upipe(sws_test);
+
+    /* flat input picture, so that scaled tiles differ from the background */
+    uref1 = uref_pic_alloc(uref_mgr, ubuf_mgr, SRCSIZE, SRCSIZE);
+    assert(uref1 != NULL);
+    ubase_assert(uref_pic_set_progressive(uref1));
+    fill_flat(uref1, "y8", 200);
+    fill_flat(uref1, "u8", 128);
+    fill_flat(uref1, "v8", 128);
+
+    /* interval: only one picture out of two fills a tile */
+    unsigned int interval = 0;
+    ubase_assert(upipe_sws_thumbs_get_interval(thumbs, &interval));
+    assert(interval == 1);
+    ubase_nassert(upipe_sws_thumbs_set_interval(thumbs, 0));
+    ubase_assert(upipe_sws_thumbs_set_interval(thumbs, 2));
+    ubase_assert(upipe_sws_thumbs_get_interval(thumbs, &interval));
+    assert(interval == 2);
+
+    for (int i = 0; i < 7; i++)
+        upipe_input(thumbs, uref_dup(uref1), NULL);
+    assert(thumbs_test->nb_pics == 0);
+    upipe_input(thumbs, uref_dup(uref1), NULL);
+    assert(thumbs_test->nb_pics == 1);
+    size_t hsize, vsize;
+    ubase_assert(uref_pic_size(thumbs_test->pic, &hsize, &vsize, NULL));
+    assert(hsize == 2 * THUMBSIZE && vsize == 2 * THUMBSIZE);
+    assert(read_luma(thumbs_test->pic, 0, 0) > 128);
+    assert(read_luma(thumbs_test->pic,
+                     2 * THUMBSIZE - 1, 2 * THUMBSIZE - 1) > 128);
+
+    /* fast scaling: every picture fills a tile, on decimated input */
+    ubase_assert(upipe_sws_thumbs_set_interval(thumbs, 1));
+    ubase_assert(upipe_sws_thumbs_set_fast(thumbs, true));
+    for (int i = 0; i < 4; i++)
+        upipe_input(thumbs, uref_dup(uref1), NULL);
+    assert(thumbs_test->nb_pics == 2);
+    assert(read_luma(thumbs_test->pic, 0, 0) > 128);
+    assert(read_luma(thumbs_test->pic,
+                     2 * THUMBSIZE - 1, 2 * THUMBSIZE - 1) > 128);
+    ubase_assert(upipe_sws_thumbs_set_fast(thumbs, false));
+
+    /* persistent: the gallery is output on each tile update and kept */
+    ubase_assert(upipe_sws_thumbs_set_persistent(thumbs, true));
+    upipe_input(thumbs, uref_dup(uref1), NULL);
+    assert(thumbs_test->nb_pics == 3);
+    assert(read_luma(thumbs_test->pic, 0, 0) > 128);
+    assert(read_luma(thumbs_test->pic,
+                     2 * THUMBSIZE - 1, 2 * THUMBSIZE - 1) < 128);
+    for (int i = 0; i < 3; i++)
+        upipe_input(thumbs, uref_dup(uref1), NULL);
+    assert(thumbs_test->nb_pics == 6);
+    assert(read_luma(thumbs_test->pic, 0, 0) > 128);
+    assert(read_luma(thumbs_test->pic,
+                     2 * THUMBSIZE - 1, 2 * THUMBSIZE - 1) > 128);
+
+    /* tiles wrap around in the same gallery */
+    upipe_input(thumbs, uref_dup(uref1), NULL);
+    assert(thumbs_test->nb_pics == 7);
+    assert(read_luma(thumbs_test->pic,
+                     2 * THUMBSIZE - 1, 2 * THUMBSIZE - 1) > 128);
+
+    uref_free(uref1);
+    upipe_release(thumbs);
+    test_free(sws_test);
+    upipe_mgr_release(upipe_sws_thumbs_mgr);
+    uref_free(pic_flow);
+
     /* release managers */
     ubuf_mgr_release(ubuf_mgr);
     uref_mgr_release(uref_mgr);
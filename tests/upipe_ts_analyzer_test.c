@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/** @file
+ * @short unit tests for TS analyzer module
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-ts/upipe_ts_analyzer.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/psi.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+/** PMT PID */
+#define PMT_PID 66
+/** PCR PID */
+#define PCR_PID 67
+/** data PID */
+#define DATA_PID 68
+/** number of packets per step */
+#define STEP_PACKETS 5
+/** duration of a step */
+#define STEP_DURATION (UCLOCK_FREQ / 50)
+/** number of steps */
+#define NB_STEPS 100
+
+static unsigned int nb_stats = 0;
+static uint64_t stats_packets = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+            break;
+        case UPROBE_TS_ANALYZER_STATS: {
+            assert(va_arg(args, unsigned int) == UPIPE_TS_ANALYZER_SIGNATURE);
+            const struct upipe_ts_analyzer_stats *stats =
+                va_arg(args, const struct upipe_ts_analyzer_stats *);
+            assert(stats->packets > stats_packets);
+            stats_packets = stats->packets;
+            nb_stats++;
+            break;
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** continuity counters */
+static uint8_t cc[PCR_PID + 2];
+
+/** writes a packet */
+static void write_packet(uint8_t *buffer, uint16_t pid, bool next_cc)
+{
+    ts_init(buffer);
+    ts_set_pid(buffer, pid);
+    ts_set_cc(buffer, cc[pid]);
+    ts_set_payload(buffer);
+    memset(ts_payload(buffer), 0xff, TS_SIZE - TS_HEADER_SIZE);
+    if (next_cc)
+        cc[pid] = (cc[pid] + 1) & 0xf;
+}
+
+/** writes a PAT */
+static void write_pat(uint8_t *buffer)
+{
+    write_packet(buffer, PAT_PID, true);
+    ts_set_unitstart(buffer);
+    uint8_t *payload = ts_payload(buffer);
+    *payload++ = 0; /* pointer_field */
+    pat_init(payload);
+    pat_set_length(payload, PAT_PROGRAM_SIZE);
+    pat_set_tsid(payload, 42);
+    psi_set_version(payload, 0);
+    psi_set_current(payload);
+    psi_set_section(payload, 0);
+    psi_set_lastsection(payload, 0);
+    uint8_t *pat_program = pat_get_program(payload, 0);
+    patn_init(pat_program);
+    patn_set_program(pat_program, 12);
+    patn_set_pid(pat_program, PMT_PID);
+    psi_set_crc(payload);
+}
+
+/** writes a PMT */
+static void write_pmt(uint8_t *buffer)
+{
+    write_packet(buffer, PMT_PID, true);
+    ts_set_unitstart(buffer);
+    uint8_t *payload = ts_payload(buffer);
+    *payload++ = 0; /* pointer_field */
+    pmt_init(payload);
+    pmt_set_length(payload, 0);
+    pmt_set_program(payload, 12);
+    psi_set_version(payload, 0);
+    psi_set_current(payload);
+    psi_set_section(payload, 0);
+    psi_set_lastsection(payload, 0);
+    pmt_set_pcrpid(payload, PCR_PID);
+    pmt_set_desclength(payload, 0);
+    psi_set_crc(payload);
+}
+
+/** writes a packet with a PCR */
+static void write_pcr(uint8_t *buffer, uint64_t pcr, bool discontinuity)
+{
+    write_packet(buffer, PCR_PID, true);
+    ts_set_adaptation(buffer, 7);
+    tsaf_set_pcr(buffer, (pcr / 300) % (UINT64_C(1) << 33));
+    tsaf_set_pcrext(buffer, pcr % 300);
+    if (discontinuity)
+        tsaf_set_discontinuity(buffer);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct uref *uref;
+    uref = uref_block_flow_alloc_def(uref_mgr, NULL);
+    assert(uref != NULL);
+
+    struct upipe_mgr *upipe_ts_analyzer_mgr = upipe_ts_analyzer_mgr_alloc();
+    assert(upipe_ts_analyzer_mgr != NULL);
+    struct upipe *upipe_ts_analyzer = upipe_void_alloc(upipe_ts_analyzer_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "ts analyzer"));
+    assert(upipe_ts_analyzer != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_analyzer, uref));
+    uref_free(uref);
+    ubase_nassert(upipe_set_output_size(upipe_ts_analyzer, 100));
+    ubase_nassert(upipe_set_output_size(upipe_ts_analyzer, 300));
+
+    uint64_t pcr_offset = 0;
+    for (unsigned int step = 0; step < NB_STEPS; step++) {
+        uint64_t date = UCLOCK_FREQ + step * STEP_DURATION;
+        uint8_t stream[STEP_PACKETS * TS_SIZE];
+        uint8_t *data1 = stream + 3 * TS_SIZE;
+        uint8_t *data2 = stream + 4 * TS_SIZE;
+
+        /* no PAT for 620 ms */
+        if (step >= 30 && step <= 60)
+            write_packet(stream, DATA_PID, true);
+        else
+            write_pat(stream);
+        write_pmt(stream + TS_SIZE);
+        if (step == 70)
+            /* jump without discontinuity indicator */
+            pcr_offset += UCLOCK_FREQ;
+        else if (step == 75)
+            pcr_offset += UCLOCK_FREQ;
+        if (step == 20 || step == 21)
+            /* 60 ms without PCR */
+            write_packet(stream + 2 * TS_SIZE, PCR_PID, true);
+        else
+            write_pcr(stream + 2 * TS_SIZE,
+                      date + pcr_offset + (step == 80 ? 27 : 0), step == 75);
+        write_packet(data1, DATA_PID,
+                     step != 12 && step != 14 && step != 16 && step != 90);
+        write_packet(data2, DATA_PID, step != 16);
+
+        switch (step) {
+            case 10:
+                /* skipped packet */
+                ts_set_cc(data2, (ts_get_cc(data2) + 1) & 0xf);
+                cc[DATA_PID] = (cc[DATA_PID] + 1) & 0xf;
+                break;
+            case 12:
+                ts_set_transporterror(data1);
+                break;
+            case 14:
+                data1[0] = 0x48;
+                break;
+            case 16:
+                data1[0] = 0x48;
+                data2[0] = 0x48;
+                break;
+            case 18:
+                ts_set_scrambling(data2, 2);
+                break;
+            case 90:
+                /* duplicate packet carrying the same PCR */
+                memcpy(data1, stream + 2 * TS_SIZE, TS_SIZE);
+                break;
+            default:
+                break;
+        }
+
+        /* split the packets across two urefs */
+        for (unsigned int part = 0; part < 2; part++) {
+            size_t offset = part ? 300 : 0;
+            size_t length = part ? sizeof(stream) - 300 : 300;
+            uref = uref_block_alloc(uref_mgr, ubuf_mgr, length);
+            assert(uref != NULL);
+            uint8_t *buffer;
+            int size = -1;
+            ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+            assert(size == length);
+            memcpy(buffer, stream + offset, length);
+            uref_block_unmap(uref, 0);
+            uref_clock_set_cr_sys(uref, date);
+            upipe_input(upipe_ts_analyzer, uref, NULL);
+        }
+    }
+
+    struct upipe_ts_analyzer_stats stats;
+    ubase_assert(upipe_ts_analyzer_get_stats(upipe_ts_analyzer, &stats));
+    for (int i = 0; i < UPIPE_TS_ANALYZER_INDICATORS; i++)
+        printf("%s: %"PRIu64"\n", upipe_ts_analyzer_indicator_print(i),
+               stats.indicators[i]);
+    assert(stats.packets == NB_STEPS * STEP_PACKETS);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_SYNC_BYTE] == 3);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_SYNC_LOSS] == 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_TRANSPORT] == 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_CC] == 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_SCRAMBLED] == 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_PAT] == 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_PMT] == 0);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_PCR_REPETITION] == 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_PCR_DISCONTINUITY] == 1);
+    /* a late PCR also skews the rates of the two following intervals */
+    assert(stats.indicators[UPIPE_TS_ANALYZER_PCR_ACCURACY] == 3);
+    assert(nb_stats == 1);
+
+    ubase_assert(upipe_ts_analyzer_get_pid_stats(upipe_ts_analyzer,
+                                                 DATA_PID, &stats));
+    assert(stats.packets == NB_STEPS * 2 + 31 - 3 - 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_CC] == 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_TRANSPORT] == 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_SCRAMBLED] == 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_PCR_REPETITION] == 0);
+    ubase_assert(upipe_ts_analyzer_get_pid_stats(upipe_ts_analyzer,
+                                                 PCR_PID, &stats));
+    assert(stats.packets == NB_STEPS + 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_CC] == 0);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_PCR_REPETITION] == 1);
+    assert(stats.indicators[UPIPE_TS_ANALYZER_PCR_ACCURACY] == 3);
+    ubase_assert(upipe_ts_analyzer_get_pid_stats(upipe_ts_analyzer,
+                                                 PAT_PID, &stats));
+    assert(stats.indicators[UPIPE_TS_ANALYZER_PAT] == 1);
+    ubase_nassert(upipe_ts_analyzer_get_pid_stats(upipe_ts_analyzer,
+                                                  8192, &stats));
+
+    ubase_assert(upipe_flush(upipe_ts_analyzer));
+    ubase_assert(upipe_ts_analyzer_get_stats(upipe_ts_analyzer, &stats));
+    assert(stats.packets == 0);
+
+    upipe_release(upipe_ts_analyzer);
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
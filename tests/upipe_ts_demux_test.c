@@ -253,6 +253,10 @@ int main(int argc, char *argv[])
     expect_new_flow_def = 1;
     upipe_input(upipe_ts_demux, uref, NULL);
     assert(!expect_new_flow_def);
+    /* no worker was added */
+    assert(upipe_ts_demux_program_get_queue_lengths(upipe_ts_demux_output_pmt,
+                                                    NULL, NULL) ==
+           UBASE_ERR_INVALID);
 
     uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
     assert(uref != NULL);
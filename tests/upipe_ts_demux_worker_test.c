@@ -0,0 +1,484 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for TS demux module with worker threads (using upump_ev)
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe-pthread/uprobe_pthread_upump_mgr.h>
+#include <upipe-pthread/uprobe_pthread_assert.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_std.h>
+#include <upipe/upump.h>
+#include <upump-ev/upump_ev.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_worker_linear.h>
+#include <upipe-modules/upipe_transfer.h>
+#include <upipe-ts/upipe_ts_demux.h>
+#include <upipe-framers/upipe_auto_framer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/psi.h>
+#include <bitstream/mpeg/pes.h>
+#include <bitstream/mpeg/mp2v.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPUMP_POOL 0
+#define UPUMP_BLOCKER_POOL 0
+#define XFER_QUEUE 255
+#define XFER_POOL 1
+#define WLIN_QUEUE 4
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+static struct uprobe *logger;
+static struct uprobe *uprobe_main;
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+static struct upipe *upipe_ts_demux;
+static struct upipe *upipe_ts_demux_program = NULL;
+static struct upipe *upipe_ts_demux_output_video = NULL;
+static struct upipe *sink = NULL;
+static pthread_t main_thread_id;
+static bool sink_flow_def = false;
+static unsigned int nb_frames = 0;
+
+/** helper phony pipe */
+static struct upipe *sink_alloc(struct upipe_mgr *mgr,
+                                struct uprobe *uprobe, uint32_t signature,
+                                va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void sink_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    /* framed pictures come back in the thread of the demux */
+    assert(pthread_equal(pthread_self(), main_thread_id));
+    assert(sink_flow_def);
+    upipe_dbg(upipe, "frame received");
+    nb_frames++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int sink_control(struct upipe *upipe, int command, va_list args)
+{
+    assert(pthread_equal(pthread_self(), main_thread_id));
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            if (urequest->type == UREQUEST_FLOW_FORMAT) {
+                struct uref *uref = uref_dup(urequest->uref);
+                assert(uref != NULL);
+                return urequest_provide_flow_format(urequest, uref);
+            }
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            ubase_assert(uref_flow_match_def(flow_def,
+                                             "block.mpeg2video.pic."));
+            sink_flow_def = true;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void sink_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr sink_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = sink_alloc,
+    .upipe_input = sink_input,
+    .upipe_control = sink_control
+};
+
+/** worker thread */
+static void *thread(void *_upipe_xfer_mgr)
+{
+    struct upipe_mgr *upipe_xfer_mgr = (struct upipe_mgr *)_upipe_xfer_mgr;
+
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc_loop(UPUMP_POOL,
+                                                          UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+    uprobe_pthread_upump_mgr_set(logger, upump_mgr);
+
+    ubase_assert(upipe_xfer_mgr_attach(upipe_xfer_mgr, upump_mgr));
+    upipe_mgr_release(upipe_xfer_mgr);
+
+    upump_mgr_run(upump_mgr, NULL);
+
+    upump_mgr_release(upump_mgr);
+
+    return NULL;
+}
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    if (event != UPROBE_SPLIT_UPDATE)
+        return UBASE_ERR_NONE;
+
+    struct uref *flow_def = NULL;
+    while (ubase_check(upipe_split_iterate(upipe, &flow_def)) &&
+           flow_def != NULL) {
+        const char *def;
+        ubase_assert(uref_flow_get_def(flow_def, &def));
+        if (!ubase_ncmp(def, "void.") && upipe_ts_demux_program == NULL) {
+            upipe_ts_demux_program =
+                upipe_flow_alloc_sub(upipe_ts_demux,
+                    uprobe_pfx_alloc(uprobe_use(uprobe_main),
+                                     UPROBE_LOG_LEVEL, "ts demux program"),
+                    flow_def);
+            assert(upipe_ts_demux_program != NULL);
+        } else if (!ubase_ncmp(def, "block.mpeg2video") &&
+                   upipe_ts_demux_output_video == NULL) {
+            upipe_ts_demux_output_video =
+                upipe_flow_alloc_sub(upipe_ts_demux_program,
+                    uprobe_pfx_alloc(uprobe_use(uprobe_main),
+                                     UPROBE_LOG_LEVEL, "ts demux video"),
+                    flow_def);
+            assert(upipe_ts_demux_output_video != NULL);
+            ubase_assert(upipe_set_output(upipe_ts_demux_output_video,
+                                          sink));
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** sends a PAT with program 12 on PMT PID 42 */
+static void input_pat(void)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    ts_init(buffer);
+    ts_set_unitstart(buffer);
+    ts_set_pid(buffer, 0);
+    ts_set_cc(buffer, 0);
+    ts_set_payload(buffer);
+    uint8_t *payload = ts_payload(buffer);
+    *payload++ = 0; /* pointer_field */
+    pat_init(payload);
+    pat_set_length(payload, PAT_PROGRAM_SIZE);
+    pat_set_tsid(payload, 42);
+    psi_set_version(payload, 0);
+    psi_set_current(payload);
+    psi_set_section(payload, 0);
+    psi_set_lastsection(payload, 0);
+    uint8_t *pat_program = pat_get_program(payload, 0);
+    patn_init(pat_program);
+    patn_set_program(pat_program, 12);
+    patn_set_pid(pat_program, 42);
+    psi_set_crc(payload);
+    payload += PAT_HEADER_SIZE + PAT_PROGRAM_SIZE + PSI_CRC_SIZE;
+    *payload = 0xff;
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe_ts_demux, uref, NULL);
+}
+
+/** sends a PMT with an MPEG-2 video elementary stream on PID 43 */
+static void input_pmt(void)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    ts_init(buffer);
+    ts_set_unitstart(buffer);
+    ts_set_pid(buffer, 42);
+    ts_set_cc(buffer, 0);
+    ts_set_payload(buffer);
+    uint8_t *payload = ts_payload(buffer);
+    *payload++ = 0; /* pointer_field */
+    pmt_init(payload);
+    pmt_set_length(payload, PMT_ES_SIZE);
+    pmt_set_program(payload, 12);
+    psi_set_version(payload, 0);
+    psi_set_current(payload);
+    psi_set_section(payload, 0);
+    psi_set_lastsection(payload, 0);
+    pmt_set_pcrpid(payload, 43);
+    pmt_set_desclength(payload, 0);
+    uint8_t *pmt_es = pmt_get_es(payload, 0);
+    pmtn_init(pmt_es);
+    pmtn_set_pid(pmt_es, 43);
+    pmtn_set_streamtype(pmt_es, 2);
+    pmtn_set_desclength(pmt_es, 0);
+    psi_set_crc(payload);
+    payload += PMT_HEADER_SIZE + PMT_ES_SIZE + PSI_CRC_SIZE;
+    *payload = 0xff;
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe_ts_demux, uref, NULL);
+}
+
+/** sends a PES with a complete MPEG-2 I picture followed by a sequence end */
+static void input_pes(void)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    ts_init(buffer);
+    ts_set_unitstart(buffer);
+    ts_set_pid(buffer, 43);
+    ts_set_cc(buffer, 0);
+    ts_set_adaptation(buffer, TS_SIZE - TS_HEADER_SIZE -
+            PES_HEADER_SIZE_PTSDTS - MP2VSEQ_HEADER_SIZE -
+            MP2VSEQX_HEADER_SIZE - MP2VPIC_HEADER_SIZE -
+            MP2VPICX_HEADER_SIZE - 4 - MP2VEND_HEADER_SIZE - 1);
+    ts_set_payload(buffer);
+    tsaf_set_discontinuity(buffer);
+    tsaf_set_randomaccess(buffer);
+    tsaf_set_pcr(buffer, 27000000 / 300);
+    tsaf_set_pcrext(buffer, 27000000 % 300);
+    uint8_t *payload = ts_payload(buffer);
+    pes_init(payload);
+    pes_set_streamid(payload, PES_STREAM_ID_VIDEO_MPEG);
+    pes_set_headerlength(payload, 0);
+    pes_set_length(payload, MP2VSEQ_HEADER_SIZE + MP2VSEQX_HEADER_SIZE +
+            MP2VPIC_HEADER_SIZE + MP2VPICX_HEADER_SIZE + 4 +
+            MP2VEND_HEADER_SIZE + PES_HEADER_SIZE_PTSDTS - PES_HEADER_SIZE);
+    pes_set_dataalignment(payload);
+    pes_set_pts(payload, 27000000 / 300 * 3);
+    pes_set_dts(payload, 27000000 / 300 * 2);
+    payload = pes_payload(payload);
+    mp2vseq_init(payload);
+    mp2vseq_set_horizontal(payload, 720);
+    mp2vseq_set_vertical(payload, 576);
+    mp2vseq_set_aspect(payload, MP2VSEQ_ASPECT_16_9);
+    mp2vseq_set_framerate(payload, MP2VSEQ_FRAMERATE_25);
+    mp2vseq_set_bitrate(payload, 2000000/400);
+    mp2vseq_set_vbvbuffer(payload, 1835008/16/1024);
+    payload += MP2VSEQ_HEADER_SIZE;
+
+    mp2vseqx_init(payload);
+    mp2vseqx_set_profilelevel(payload,
+                              MP2VSEQX_PROFILE_MAIN | MP2VSEQX_LEVEL_MAIN);
+    mp2vseqx_set_chroma(payload, MP2VSEQX_CHROMA_420);
+    mp2vseqx_set_horizontal(payload, 0);
+    mp2vseqx_set_vertical(payload, 0);
+    mp2vseqx_set_bitrate(payload, 0);
+    mp2vseqx_set_vbvbuffer(payload, 0);
+    payload += MP2VSEQX_HEADER_SIZE;
+
+    mp2vpic_init(payload);
+    mp2vpic_set_temporalreference(payload, 0);
+    mp2vpic_set_codingtype(payload, MP2VPIC_TYPE_I);
+    mp2vpic_set_vbvdelay(payload, UINT16_MAX);
+    payload += MP2VPIC_HEADER_SIZE;
+
+    mp2vpicx_init(payload);
+    mp2vpicx_set_fcode00(payload, 0);
+    mp2vpicx_set_fcode01(payload, 0);
+    mp2vpicx_set_fcode10(payload, 0);
+    mp2vpicx_set_fcode11(payload, 0);
+    mp2vpicx_set_intradc(payload, 0);
+    mp2vpicx_set_structure(payload, MP2VPICX_FRAME_PICTURE);
+    mp2vpicx_set_tff(payload);
+    payload += MP2VPICX_HEADER_SIZE;
+
+    mp2vstart_init(payload, 1);
+    payload += 4;
+
+    mp2vend_init(payload);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe_ts_demux, uref, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    main_thread_id = pthread_self();
+    struct upump_mgr *upump_mgr =
+        upump_ev_mgr_alloc_default(UPUMP_POOL, UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    logger = uprobe_stdio_alloc(&uprobe, stdout, UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr,
+                                   UBUF_POOL_DEPTH, UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+    logger = uprobe_pthread_upump_mgr_alloc(logger);
+    assert(logger != NULL);
+    uprobe_pthread_upump_mgr_set(logger, upump_mgr);
+    uprobe_main = uprobe_pthread_assert_alloc(uprobe_use(logger));
+    assert(uprobe_main != NULL);
+    uprobe_pthread_assert_set(uprobe_main, main_thread_id);
+    struct uprobe *uprobe_remote =
+        uprobe_pthread_assert_alloc(uprobe_use(logger));
+    assert(uprobe_remote != NULL);
+
+    sink = upipe_void_alloc(&sink_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_main), UPROBE_LOG_LEVEL,
+                             "sink"));
+    assert(sink != NULL);
+
+    struct upipe_mgr *upipe_xfer_mgr =
+        upipe_xfer_mgr_alloc(XFER_QUEUE, XFER_POOL, NULL);
+    assert(upipe_xfer_mgr != NULL);
+    struct upipe_mgr *upipe_wlin_mgr = upipe_wlin_mgr_alloc(upipe_xfer_mgr);
+    assert(upipe_wlin_mgr != NULL);
+
+    struct upipe_mgr *upipe_autof_mgr = upipe_autof_mgr_alloc();
+    assert(upipe_autof_mgr != NULL);
+    struct upipe_mgr *upipe_ts_demux_mgr = upipe_ts_demux_mgr_alloc();
+    assert(upipe_ts_demux_mgr != NULL);
+    ubase_assert(upipe_ts_demux_mgr_set_autof_mgr(upipe_ts_demux_mgr,
+                                                  upipe_autof_mgr));
+
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+    upipe_ts_demux = upipe_void_alloc(upipe_ts_demux_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_main), UPROBE_LOG_LEVEL,
+                             "ts demux"));
+    assert(upipe_ts_demux != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_demux, uref));
+    uref_free(uref);
+
+    assert(upipe_ts_demux_add_worker(upipe_ts_demux, NULL,
+                                     uprobe_use(uprobe_remote),
+                                     WLIN_QUEUE, WLIN_QUEUE) ==
+           UBASE_ERR_INVALID);
+    ubase_assert(upipe_ts_demux_add_worker(upipe_ts_demux, upipe_wlin_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_remote), UPROBE_LOG_LEVEL,
+                             "worker"),
+            WLIN_QUEUE, WLIN_QUEUE));
+    upipe_mgr_release(upipe_wlin_mgr);
+
+    input_pat();
+    assert(upipe_ts_demux_program != NULL);
+    input_pmt();
+    assert(upipe_ts_demux_output_video != NULL);
+
+    unsigned int input, output;
+    ubase_assert(upipe_ts_demux_program_get_queue_lengths(
+                upipe_ts_demux_program, &input, &output));
+    assert(input == 0);
+    assert(output == 0);
+
+    /* the worker thread is not started yet, so the PES stays queued */
+    input_pes();
+    ubase_assert(upipe_ts_demux_program_get_queue_lengths(
+                upipe_ts_demux_program, &input, &output));
+    assert(input >= 1);
+    assert(output == 0);
+    assert(!sink_flow_def);
+
+    upipe_release(upipe_ts_demux_output_video);
+    upipe_release(upipe_ts_demux_program);
+    upipe_release(upipe_ts_demux);
+
+    pthread_t worker_thread_id;
+    upipe_mgr_use(upipe_xfer_mgr);
+    assert(pthread_create(&worker_thread_id, NULL, thread,
+                          upipe_xfer_mgr) == 0);
+    uprobe_pthread_assert_set(uprobe_remote, worker_thread_id);
+    upipe_mgr_release(upipe_xfer_mgr);
+
+    upump_mgr_run(upump_mgr, NULL);
+
+    assert(!pthread_join(worker_thread_id, NULL));
+    assert(sink_flow_def);
+    assert(nb_frames == 1);
+
+    sink_free(sink);
+    upipe_mgr_release(upipe_ts_demux_mgr);
+    upipe_mgr_release(upipe_autof_mgr);
+
+    uprobe_release(uprobe_remote);
+    uprobe_release(uprobe_main);
+    upump_mgr_release(upump_mgr);
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
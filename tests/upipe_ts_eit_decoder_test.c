@@ -71,6 +71,10 @@ static uint64_t sid = 41;
 static uint64_t tsid = 42;
 static uint64_t onid = 43;
 static bool complete = false;
+static bool event_attrs = true;
+static size_t inserted = 0;
+static size_t updated = 0;
+static size_t removed = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -84,6 +88,22 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
         case UPROBE_DEAD:
         case UPROBE_NEED_OUTPUT:
             break;
+        case UPROBE_TS_EITD_EPG_CHANGE: {
+            assert(va_arg(args, unsigned int) == UPIPE_TS_EITD_SIGNATURE);
+            struct upipe_ts_epg *epg = va_arg(args, struct upipe_ts_epg *);
+            const struct upipe_ts_epg_change *change =
+                va_arg(args, const struct upipe_ts_epg_change *);
+            assert(epg != NULL);
+            for (size_t i = 0; i < change->inserted_nb; i++)
+                assert(change->inserted[i]->sid == sid);
+            for (size_t i = 0; i < change->updated_nb; i++)
+                assert(change->updated[i]->event_id ==
+                       change->previous[i]->event_id);
+            inserted += change->inserted_nb;
+            updated += change->updated_nb;
+            removed += change->removed_nb;
+            break;
+        }
         case UPROBE_NEW_FLOW_DEF: {
             assert(complete);
             struct uref *uref = va_arg(args, struct uref *);
@@ -96,11 +116,26 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
             ubase_assert(uref_ts_flow_get_tsid(uref, &eitd_tsid));
             ubase_assert(uref_ts_flow_get_onid(uref, &eitd_onid));
             ubase_assert(uref_ts_flow_get_last_table_id(uref, &last_table_id));
-            ubase_assert(uref_event_get_events(uref, &events));
             assert(eitd_sid == sid);
             assert(eitd_tsid == tsid);
             assert(eitd_onid == onid);
             assert(last_table_id == EIT_TABLE_ID_PF_ACTUAL);
+            if (!event_attrs) {
+                ubase_nassert(uref_event_get_events(uref, &events));
+                ubase_nassert(uref_event_get_id(uref, &events, 0));
+                complete = false;
+                break;
+            }
+            ubase_assert(uref_event_get_events(uref, &events));
+            if (events == 1) {
+                /* second version of the table */
+                uint8_t running_status;
+                ubase_assert(uref_ts_event_get_running_status(uref,
+                            &running_status, 0));
+                assert(running_status == 4);
+                complete = false;
+                break;
+            }
             assert(events == 2);
 
             uint64_t event_id, start, duration;
@@ -189,6 +224,9 @@ int main(int argc, char *argv[])
             uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
                              "ts eitd"));
     assert(upipe_ts_eitd != NULL);
+    int enabled;
+    ubase_assert(upipe_ts_eitd_get_event_attrs(upipe_ts_eitd, &enabled));
+    assert(enabled);
     ubase_assert(upipe_set_flow_def(upipe_ts_eitd, uref));
     uref_free(uref);
 
@@ -265,6 +303,188 @@ int main(int argc, char *argv[])
     complete = true;
     upipe_input(upipe_ts_eitd, uref, NULL);
     assert(!complete);
+    assert(inserted == 2);
+    assert(!updated);
+    assert(!removed);
+
+    struct upipe_ts_epg *epg;
+    struct upipe_ts_epg_event **events;
+    size_t events_nb;
+    ubase_assert(upipe_ts_eitd_get_epg(upipe_ts_eitd, &epg));
+    upipe_ts_epg_get_service(epg, sid, &events, &events_nb);
+    assert(events_nb == 2);
+    assert(events[0]->event_id == 0);
+    assert(events[1]->event_id == 1);
+    assert(events[1]->scrambled);
+    assert(upipe_ts_epg_find(epg, sid, events[0]->start + UCLOCK_FREQ) ==
+           events[0]);
+
+    /* new version of the first section, with a new running status and
+     * without the second event of the sub-table */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                            EIT_HEADER_SIZE + EIT_EVENT_SIZE + PSI_CRC_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    eit_init(buffer, true);
+    eit_set_length(buffer, EIT_EVENT_SIZE);
+    eit_set_sid(buffer, sid);
+    eit_set_tsid(buffer, tsid);
+    eit_set_onid(buffer, onid);
+    eit_set_segment_last_sec_number(buffer, 0);
+    eit_set_last_table_id(buffer, EIT_TABLE_ID_PF_ACTUAL);
+    psi_set_version(buffer, 1);
+    psi_set_current(buffer);
+    psi_set_section(buffer, 0);
+    psi_set_lastsection(buffer, 0);
+    eit_event = eit_get_event(buffer, 0);
+    eitn_init(eit_event);
+    eitn_set_event_id(eit_event, 0);
+    eitn_set_start_time(eit_event, 0xC079124500); /* 1993-10-13T12:45:00Z */
+    eitn_set_duration_bcd(eit_event, 0x014530); /* 01:45:30 */
+    eitn_set_running(eit_event, 4);
+    eitn_set_desclength(eit_event, 0);
+    psi_set_crc(buffer);
+    uref_block_unmap(uref, 0);
+    complete = true;
+    upipe_input(upipe_ts_eitd, uref, NULL);
+    assert(!complete);
+    assert(inserted == 2);
+    assert(updated == 1);
+    assert(removed == 1);
+    upipe_ts_epg_get_service(epg, sid, &events, &events_nb);
+    assert(events_nb == 1);
+    assert(events[0]->running_status == 4);
+
+    /* without event attributes, only the store carries the events */
+    ubase_assert(upipe_ts_eitd_set_event_attrs(upipe_ts_eitd, false));
+    event_attrs = false;
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                            EIT_HEADER_SIZE + EIT_EVENT_SIZE + PSI_CRC_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    eit_init(buffer, true);
+    eit_set_length(buffer, EIT_EVENT_SIZE);
+    eit_set_sid(buffer, sid);
+    eit_set_tsid(buffer, tsid);
+    eit_set_onid(buffer, onid);
+    eit_set_segment_last_sec_number(buffer, 0);
+    eit_set_last_table_id(buffer, EIT_TABLE_ID_PF_ACTUAL);
+    psi_set_version(buffer, 2);
+    psi_set_current(buffer);
+    psi_set_section(buffer, 0);
+    psi_set_lastsection(buffer, 0);
+    eit_event = eit_get_event(buffer, 0);
+    eitn_init(eit_event);
+    eitn_set_event_id(eit_event, 0);
+    eitn_set_start_time(eit_event, 0xC079124500); /* 1993-10-13T12:45:00Z */
+    eitn_set_duration_bcd(eit_event, 0x014530); /* 01:45:30 */
+    eitn_set_running(eit_event, 2);
+    eitn_set_desclength(eit_event, 0);
+    psi_set_crc(buffer);
+    uref_block_unmap(uref, 0);
+    complete = true;
+    upipe_input(upipe_ts_eitd, uref, NULL);
+    assert(!complete);
+    assert(updated == 2);
+    struct upipe_ts_epg_event *epg_event = upipe_ts_epg_find(epg, sid, 0);
+    assert(epg_event != NULL);
+    assert(epg_event->event_id == 0);
+    assert(epg_event->running_status == 2);
+
+    /* a section with an invalid CRC does not update the store */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                            EIT_HEADER_SIZE + EIT_EVENT_SIZE + PSI_CRC_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    eit_init(buffer, true);
+    eit_set_length(buffer, EIT_EVENT_SIZE);
+    eit_set_sid(buffer, sid);
+    eit_set_tsid(buffer, tsid);
+    eit_set_onid(buffer, onid);
+    eit_set_segment_last_sec_number(buffer, 0);
+    eit_set_last_table_id(buffer, EIT_TABLE_ID_PF_ACTUAL);
+    psi_set_version(buffer, 3);
+    psi_set_current(buffer);
+    psi_set_section(buffer, 0);
+    psi_set_lastsection(buffer, 0);
+    eit_event = eit_get_event(buffer, 0);
+    eitn_init(eit_event);
+    eitn_set_event_id(eit_event, 0);
+    eitn_set_start_time(eit_event, 0xC079124500); /* 1993-10-13T12:45:00Z */
+    eitn_set_duration_bcd(eit_event, 0x014530); /* 01:45:30 */
+    eitn_set_running(eit_event, 1);
+    eitn_set_desclength(eit_event, 0);
+    psi_set_crc(buffer);
+    buffer[size - 1] ^= 0xff;
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe_ts_eitd, uref, NULL);
+    assert(updated == 2);
+    assert(epg_event->running_status == 2);
+
+    /* a section of another transport stream does not update the store
+     * while a table is being gathered */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                            EIT_HEADER_SIZE + EIT_EVENT_SIZE + PSI_CRC_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    eit_init(buffer, true);
+    eit_set_length(buffer, EIT_EVENT_SIZE);
+    eit_set_sid(buffer, sid);
+    eit_set_tsid(buffer, tsid);
+    eit_set_onid(buffer, onid);
+    eit_set_segment_last_sec_number(buffer, 1);
+    eit_set_last_table_id(buffer, EIT_TABLE_ID_PF_ACTUAL);
+    psi_set_version(buffer, 4);
+    psi_set_current(buffer);
+    psi_set_section(buffer, 0);
+    psi_set_lastsection(buffer, 1);
+    eit_event = eit_get_event(buffer, 0);
+    eitn_init(eit_event);
+    eitn_set_event_id(eit_event, 0);
+    eitn_set_start_time(eit_event, 0xC079124500); /* 1993-10-13T12:45:00Z */
+    eitn_set_duration_bcd(eit_event, 0x014530); /* 01:45:30 */
+    eitn_set_running(eit_event, 1);
+    eitn_set_desclength(eit_event, 0);
+    psi_set_crc(buffer);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe_ts_eitd, uref, NULL);
+    assert(updated == 3);
+    assert(epg_event->running_status == 1);
+
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                            EIT_HEADER_SIZE + EIT_EVENT_SIZE + PSI_CRC_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    eit_init(buffer, true);
+    eit_set_length(buffer, EIT_EVENT_SIZE);
+    eit_set_sid(buffer, sid);
+    eit_set_tsid(buffer, tsid + 1);
+    eit_set_onid(buffer, onid);
+    eit_set_segment_last_sec_number(buffer, 1);
+    eit_set_last_table_id(buffer, EIT_TABLE_ID_PF_ACTUAL);
+    psi_set_version(buffer, 4);
+    psi_set_current(buffer);
+    psi_set_section(buffer, 1);
+    psi_set_lastsection(buffer, 1);
+    eit_event = eit_get_event(buffer, 0);
+    eitn_init(eit_event);
+    eitn_set_event_id(eit_event, 2);
+    eitn_set_start_time(eit_event, 0xC079143030); /* 1993-10-13T14:30:30Z */
+    eitn_set_duration_bcd(eit_event, 0x000100); /* 00:01:00 */
+    eitn_set_running(eit_event, 1);
+    eitn_set_desclength(eit_event, 0);
+    psi_set_crc(buffer);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe_ts_eitd, uref, NULL);
+    assert(inserted == 2);
+    assert(updated == 3);
+    upipe_ts_epg_get_service(epg, sid, &events, &events_nb);
+    assert(events_nb == 1);
 
     upipe_release(upipe_ts_eitd);
 
@@ -57,6 +57,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <assert.h>
@@ -626,6 +627,79 @@ int main(int argc, char *argv[])
 
     upipe_release(upipe_ts_encaps);
 
+    /* check continuity counter wrap-around and unit start when writing
+     * packets directly into a buffer */
+    flow_def = uref_block_flow_alloc_def(uref_mgr, "mpegtspsi.");
+    assert(flow_def != NULL);
+    ubase_assert(uref_block_flow_set_octetrate(flow_def, 1024));
+    ubase_assert(uref_ts_flow_set_tb_rate(flow_def, 2050));
+    ubase_assert(uref_ts_flow_set_pid(flow_def, 68));
+
+    upipe_ts_encaps = upipe_void_alloc(upipe_ts_encaps_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "ts encaps"));
+    assert(upipe_ts_encaps != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_encaps, flow_def));
+    uref_free(flow_def);
+
+    /* a section of two packets, followed by a section of one packet */
+    const size_t section_sizes[] = { 300, 100 };
+    for (i = 0; i < 2; i++) {
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, section_sizes[i]);
+        assert(uref != NULL);
+        size = -1;
+        ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+        assert(size == section_sizes[i]);
+        int j;
+        for (j = 0; j < size; j++)
+            buffer[j] = (section_sizes[i] - j) % 256;
+        uref_block_unmap(uref, 0);
+        uref_clock_set_cr_sys(uref, UINT32_MAX);
+        uref_block_set_start(uref);
+        upipe_input(upipe_ts_encaps, uref, NULL);
+    }
+    last_cc = 14;
+    ubase_assert(upipe_ts_mux_set_cc(upipe_ts_encaps, last_cc));
+
+    const bool unitstarts[] = { true, false, true };
+    const size_t payload_sizes[] = { 1 + 183, 117, 1 + 100 };
+    size_t section_size = 0;
+    for (i = 0; i < 3; i++) {
+        uint64_t mux_sys = UINT32_MAX + i * UCLOCK_FREQ / 3;
+        uint8_t packet[TS_SIZE];
+        memset(packet, 0, TS_SIZE);
+        ubase_assert(upipe_ts_encaps_splice_buffer(upipe_ts_encaps,
+                    mux_sys, mux_sys, packet, &dts_sys));
+
+        assert(ts_validate(packet));
+        assert(ts_get_pid(packet) == 68);
+        assert(ts_has_payload(packet));
+        assert(!ts_has_adaptation(packet));
+        last_cc = (last_cc + 1) & 0xf;
+        assert(ts_get_cc(packet) == last_cc);
+        assert(ts_get_unitstart(packet) == unitstarts[i]);
+
+        const uint8_t *payload = packet + TS_HEADER_SIZE;
+        size_t payload_size = payload_sizes[i];
+        if (unitstarts[i]) {
+            /* pointer_field */
+            assert(payload[0] == 0);
+            payload++;
+            payload_size--;
+            section_size = section_sizes[i ? 1 : 0];
+        }
+        int j;
+        for (j = 0; j < payload_size; j++)
+            assert(payload[j] == section_size-- % 256);
+        for (j += payload - packet; j < TS_SIZE; j++)
+            assert(packet[j] == 0xff);
+    }
+    /* the continuity counter wrapped around */
+    assert(last_cc == 1);
+    assert(section_size == 0);
+
+    upipe_release(upipe_ts_encaps);
+
     upipe_mgr_release(upipe_ts_encaps_mgr); // nop
 
     uref_mgr_release(uref_mgr);
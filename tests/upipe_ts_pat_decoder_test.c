@@ -115,6 +115,35 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** sends a PAT section with a single program */
+static void send_section(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                         struct ubuf_mgr *ubuf_mgr, uint8_t version,
+                         uint8_t section, uint8_t last_section,
+                         uint16_t program, uint16_t pid)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+            PAT_HEADER_SIZE + PAT_PROGRAM_SIZE + PSI_CRC_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == PAT_HEADER_SIZE + PAT_PROGRAM_SIZE + PSI_CRC_SIZE);
+    pat_init(buffer);
+    pat_set_length(buffer, PAT_PROGRAM_SIZE);
+    pat_set_tsid(buffer, tsid);
+    psi_set_version(buffer, version);
+    psi_set_current(buffer);
+    psi_set_section(buffer, section);
+    psi_set_lastsection(buffer, last_section);
+    uint8_t *pat_program = pat_get_program(buffer, 0);
+    patn_init(pat_program);
+    patn_set_program(pat_program, program);
+    patn_set_pid(pat_program, pid);
+    psi_set_crc(buffer);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe, uref, NULL);
+}
+
 int main(int argc, char *argv[])
 {
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
@@ -180,6 +209,34 @@ int main(int argc, char *argv[])
     assert(!program_sum);
     assert(!pid_sum);
 
+    /* repetition of the same section, recognized from its CRC */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                            PAT_HEADER_SIZE + PAT_PROGRAM_SIZE + PSI_CRC_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == PAT_HEADER_SIZE + PAT_PROGRAM_SIZE + PSI_CRC_SIZE);
+    pat_init(buffer);
+    pat_set_length(buffer, PAT_PROGRAM_SIZE);
+    pat_set_tsid(buffer, tsid);
+    psi_set_version(buffer, 0);
+    psi_set_current(buffer);
+    psi_set_section(buffer, 0);
+    psi_set_lastsection(buffer, 0);
+    pat_program = pat_get_program(buffer, 0);
+    patn_init(pat_program);
+    patn_set_program(pat_program, 12);
+    patn_set_pid(pat_program, 42);
+    psi_set_crc(buffer);
+    uref_block_unmap(uref, 0);
+    systime = 2 * UINT32_MAX;
+    uref_clock_set_cr_sys(uref, systime);
+    upipe_input(upipe_ts_patd, uref, NULL);
+    assert(!systime);
+    uint64_t skipped;
+    ubase_assert(upipe_ts_patd_get_skipped(upipe_ts_patd, &skipped));
+    assert(skipped == 1);
+
     uref = uref_block_alloc(uref_mgr, ubuf_mgr,
                             PAT_HEADER_SIZE + PAT_PROGRAM_SIZE + PSI_CRC_SIZE);
     assert(uref != NULL);
@@ -368,6 +425,39 @@ int main(int argc, char *argv[])
     assert(!program_sum);
     assert(!pid_sum);
 
+    /* two-section table */
+    program_sum = 13 + 14;
+    pid_sum = 43 + 44;
+    send_section(upipe_ts_patd, uref_mgr, ubuf_mgr, 6, 0, 1, 13, 43);
+    send_section(upipe_ts_patd, uref_mgr, ubuf_mgr, 6, 1, 1, 14, 44);
+    assert(!program_sum);
+    assert(!pid_sum);
+
+    /* unchanged sections of a table changed without a version bump are
+     * still gathered */
+    program_sum = 13 + 15;
+    pid_sum = 43 + 45;
+    ubase_assert(upipe_ts_patd_get_skipped(upipe_ts_patd, &skipped));
+    send_section(upipe_ts_patd, uref_mgr, ubuf_mgr, 6, 0, 1, 13, 43);
+    uint64_t skipped2;
+    ubase_assert(upipe_ts_patd_get_skipped(upipe_ts_patd, &skipped2));
+    assert(skipped2 == skipped + 1);
+    send_section(upipe_ts_patd, uref_mgr, ubuf_mgr, 6, 1, 1, 15, 45);
+    assert(program_sum);
+    send_section(upipe_ts_patd, uref_mgr, ubuf_mgr, 6, 0, 1, 13, 43);
+    assert(!program_sum);
+    assert(!pid_sum);
+
+    /* a section changing again while the table is gathered restarts it */
+    program_sum = 18 + 15;
+    pid_sum = 48 + 45;
+    send_section(upipe_ts_patd, uref_mgr, ubuf_mgr, 6, 0, 1, 16, 46);
+    send_section(upipe_ts_patd, uref_mgr, ubuf_mgr, 6, 0, 1, 18, 48);
+    assert(program_sum);
+    send_section(upipe_ts_patd, uref_mgr, ubuf_mgr, 6, 1, 1, 15, 45);
+    assert(!program_sum);
+    assert(!pid_sum);
+
     upipe_release(upipe_ts_patd);
     assert(!program_sum);
     assert(!pid_sum);
@@ -66,6 +66,7 @@
 #include <upipe-modules/upipe_queue_sink.h>
 #include <upipe-modules/upipe_noclock.h>
 #include <upipe-modules/upipe_even.h>
+#include <upipe-modules/upipe_probe_uref.h>
 
 #include <stdbool.h>
 #include <stdlib.h>
@@ -74,6 +75,8 @@
 #include <inttypes.h>
 #include <assert.h>
 
+#include <bitstream/mpeg/ts.h>
+
 #define UDICT_POOL_DEPTH 0
 #define UREF_POOL_DEPTH 0
 #define UBUF_POOL_DEPTH 0
@@ -84,6 +87,9 @@
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
 
 static const char *src_file, *sink_file;
+static unsigned int mtu = TS_SIZE;
+static unsigned int pool = 0;
+static unsigned int nb_outputs = 0;
 static struct uref_mgr *uref_mgr;
 static struct upump_mgr *upump_mgr;
 
@@ -292,8 +298,46 @@ static int catch_src(struct uprobe *uprobe, struct upipe *upipe,
     return uprobe_throw_next(uprobe, upipe, event, args);
 }
 
+/** probe to check the buffers output by the TS mux */
+static int catch_output(struct uprobe *uprobe, struct upipe *upipe,
+                        int event, va_list args)
+{
+    if (event != UPROBE_PROBE_UREF)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    UBASE_SIGNATURE_CHECK(args, UPIPE_PROBE_UREF_SIGNATURE)
+    struct uref *uref = va_arg(args, struct uref *);
+    size_t uref_size;
+    ubase_assert(uref_block_size(uref, &uref_size));
+    assert(uref_size == mtu);
+
+    /* one segment per datagram */
+    int iovec_count = uref_block_iovec_count(uref, 0, -1);
+    assert(iovec_count == 1);
+    const uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_read(uref, 0, &size, &buffer));
+    assert(size == uref_size);
+
+    for (int offset = 0; offset < size; offset += TS_SIZE) {
+        const uint8_t *ts = buffer + offset;
+        assert(ts_validate(ts));
+        if (ts_get_pid(ts) == 8191) {
+            /* padding packets are copies of the padding template */
+            assert(ts_has_payload(ts));
+            assert(!ts_has_adaptation(ts));
+            for (int i = TS_HEADER_SIZE; i < TS_SIZE; i++)
+                assert(ts[i] == 0xff);
+        }
+    }
+    uref_block_unmap(uref, 0);
+    nb_outputs++;
+    return UBASE_ERR_NONE;
+}
+
 static void usage(const char *argv0) {
-    fprintf(stdout, "Usage: %s <source file> <sink file>\n", argv0);
+    fprintf(stdout, "Usage: %s <source file> <sink file> [<mtu> [<pool>]]\n",
+            argv0);
     exit(EXIT_FAILURE);
 }
 
@@ -301,10 +345,14 @@ int main(int argc, char *argv[])
 {
     setvbuf(stdout, NULL, _IOLBF, 0);
 
-    if (argc != 3)
+    if (argc < 3 || argc > 5)
         usage(argv[0]);
     src_file = argv[1];
     sink_file = argv[2];
+    if (argc >= 4)
+        mtu = atoi(argv[3]);
+    if (argc == 5)
+        pool = atoi(argv[4]);
 
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
     assert(umem_mgr != NULL);
@@ -395,6 +443,24 @@ int main(int argc, char *argv[])
     ubase_assert(upipe_ts_mux_set_version(upipe_ts, 1));
     ubase_assert(upipe_ts_mux_set_cr_prog(upipe_ts, 0));
 
+    ubase_assert(upipe_set_output_size(upipe_ts, mtu));
+    ubase_assert(upipe_ts_mux_set_output_pool(upipe_ts, pool));
+    unsigned int pool_depth;
+    ubase_assert(upipe_ts_mux_get_output_pool(upipe_ts, &pool_depth));
+    assert(pool_depth == pool);
+
+    /* output check */
+    struct uprobe uprobe_output_s;
+    uprobe_init(&uprobe_output_s, catch_output, uprobe_use(logger));
+    struct upipe_mgr *upipe_probe_uref_mgr = upipe_probe_uref_mgr_alloc();
+    assert(upipe_probe_uref_mgr != NULL);
+    upipe_ts = upipe_void_chain_output(upipe_ts,
+            upipe_probe_uref_mgr,
+            uprobe_pfx_alloc(uprobe_use(&uprobe_output_s),
+                             UPROBE_LOG_LEVEL, "output check"));
+    assert(upipe_ts != NULL);
+    upipe_mgr_release(upipe_probe_uref_mgr);
+
     /* file sink */
     struct upipe_mgr *upipe_fsink_mgr = upipe_fsink_mgr_alloc();
     assert(upipe_fsink_mgr != NULL);
@@ -411,11 +477,13 @@ int main(int argc, char *argv[])
     upump_mgr_run(upump_mgr, NULL);
 
     upipe_release(upipe_even);
+    assert(nb_outputs);
     uprobe_release(logger);
     uprobe_clean(&uprobe_demux_output_s);
     uprobe_clean(&uprobe_demux_program_s);
     uprobe_clean(&uprobe_ts_demux_s);
     uprobe_clean(&uprobe_src_s);
+    uprobe_clean(&uprobe_output_s);
     uprobe_clean(&uprobe_s);
 
     return 0;
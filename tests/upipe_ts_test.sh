@@ -10,3 +10,10 @@ trap cleanup EXIT
 
 "$srcdir"/valgrind_wrapper.sh "$srcdir" ./upipe_ts_test "$srcdir"/upipe_ts_test.ts "$TMP"/test.ts
 cmp --quiet "$TMP"/test.ts "$srcdir"/upipe_ts_test.ts
+
+# output buffers of seven packets are checked by the test itself
+"$srcdir"/valgrind_wrapper.sh "$srcdir" ./upipe_ts_test "$srcdir"/upipe_ts_test.ts "$TMP"/test7.ts 1316
+
+# same with buffers from the dedicated output pool of the mux
+"$srcdir"/valgrind_wrapper.sh "$srcdir" ./upipe_ts_test "$srcdir"/upipe_ts_test.ts "$TMP"/pool.ts 1316 4
+cmp --quiet "$TMP"/pool.ts "$TMP"/test7.ts
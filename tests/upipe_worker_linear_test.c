@@ -47,6 +47,8 @@
 #include <upipe/upipe.h>
 #include <upipe-modules/upipe_worker_linear.h>
 #include <upipe-modules/upipe_transfer.h>
+#include <upipe-modules/upipe_queue_sink.h>
+#include <upipe-modules/upipe_queue_source.h>
 #include <upipe-modules/upipe_null.h>
 #include <upipe-modules/upipe_idem.h>
 
@@ -261,6 +263,15 @@ int main(int argc, char **argv)
     uprobe_throw(uprobe_main, NULL, UPROBE_THAW_UPUMP_MGR);
     upipe_attach_upump_mgr(upipe_handle);
 
+    /* queue controls reach the input queue sink and the output queue source */
+    unsigned int length;
+    ubase_assert(upipe_qsink_get_length(upipe_handle, &length));
+    assert(length == 0);
+    ubase_assert(upipe_qsrc_get_max_length(upipe_handle, &length));
+    assert(length == WLIN_QUEUE);
+    ubase_assert(upipe_qsrc_get_length(upipe_handle, &length));
+    assert(length == 0);
+
     struct upipe_mgr *upipe_null_mgr = upipe_null_mgr_alloc();
     assert(upipe_null_mgr != NULL);
     struct upipe *null = upipe_void_alloc(upipe_null_mgr,
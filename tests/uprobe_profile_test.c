@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for uprobe_profile implementation
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_profile.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_dump.h>
+#include <upipe/upipe_profile.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 10
+#define UREF_POOL_DEPTH 10
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define PIPES 4
+#define UREFS 1000
+#define BENCH_UREFS 1000000
+/** latency given to test urefs */
+#define LATENCY (UCLOCK_FREQ / 1000)
+
+/** helper phony pipe */
+struct test_pipe {
+    /** output pipe */
+    struct upipe *output;
+    /** number of received urefs */
+    unsigned int count;
+    /** public structure */
+    struct upipe upipe;
+};
+
+UBASE_FROM_TO(test_pipe, upipe, upipe, upipe)
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct test_pipe *test_pipe = malloc(sizeof(struct test_pipe));
+    assert(test_pipe != NULL);
+    test_pipe->output = NULL;
+    test_pipe->count = 0;
+    upipe_init(&test_pipe->upipe, mgr, uprobe);
+    upipe_throw_ready(&test_pipe->upipe);
+    return &test_pipe->upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct test_pipe *test_pipe = test_pipe_from_upipe(upipe);
+    test_pipe->count++;
+    if (test_pipe->output != NULL)
+        upipe_input(test_pipe->output, uref, upump_p);
+    else
+        uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    struct test_pipe *test_pipe = test_pipe_from_upipe(upipe);
+    switch (command) {
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            *p = test_pipe->output;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    struct test_pipe *test_pipe = test_pipe_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(test_pipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = UBASE_FOURCC('t','e','s','t'),
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** uref sent by the test pump */
+static struct uref *pump_uref = NULL;
+
+/** helper pump callback, sending a uref to the pipe in opaque */
+static void test_pump(struct upump *upump)
+{
+    upipe_input(upump->opaque, pump_uref, NULL);
+    pump_uref = NULL;
+}
+
+/** sends urefs through a chain of pipes and returns the elapsed time */
+static double run(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                  struct uclock *uclock, unsigned int nb)
+{
+    clock_t start = clock();
+    for (unsigned int i = 0; i < nb; i++) {
+        struct uref *uref = uref_alloc(uref_mgr);
+        assert(uref != NULL);
+        uref_clock_set_cr_sys(uref, uclock_now(uclock) - LATENCY);
+        upipe_input(upipe, uref, NULL);
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct uclock *uclock = uclock_std_alloc(0);
+    assert(uclock != NULL);
+
+    struct uprobe *logger = uprobe_stdio_alloc(NULL, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    struct uprobe *uprobe = uprobe_profile_alloc(uprobe_use(logger), uclock,
+                                                 NULL);
+    assert(uprobe != NULL);
+
+    /* profiled chain */
+    struct upipe *pipes[PIPES];
+    for (int i = PIPES - 1; i >= 0; i--) {
+        char name[16];
+        snprintf(name, sizeof(name), "test %d", i);
+        pipes[i] = upipe_void_alloc(&test_mgr,
+                uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_LEVEL, name));
+        assert(pipes[i] != NULL);
+        assert(pipes[i]->profile != NULL);
+        if (i < PIPES - 1)
+            test_pipe_from_upipe(pipes[i])->output = pipes[i + 1];
+    }
+
+    run(pipes[0], uref_mgr, uclock, UREFS);
+    for (int i = 0; i < PIPES; i++) {
+        struct upipe_profile *profile = pipes[i]->profile;
+        assert(test_pipe_from_upipe(pipes[i])->count == UREFS);
+        assert(profile->inputs == UREFS);
+        assert(profile->outputs == (i < PIPES - 1 ? UREFS : 0));
+        assert(profile->total_cycles >= profile->cycles);
+        if (i < PIPES - 1)
+            assert(profile->total_cycles >=
+                   pipes[i + 1]->profile->total_cycles);
+        assert(profile->latency_count ==
+               UREFS / UPIPE_PROFILE_LATENCY_SAMPLING +
+               !!(UREFS % UPIPE_PROFILE_LATENCY_SAMPLING));
+        assert(profile->latency_max >= LATENCY);
+        assert(profile->latency_sum >= LATENCY * profile->latency_count);
+    }
+    upipe_profile_queue(pipes[1]->profile, 3);
+    upipe_profile_queue(pipes[1]->profile, 1);
+    assert(pipes[1]->profile->queue == 1);
+    assert(pipes[1]->profile->queue_max == 3);
+
+    /* pumps are accounted to the pipe owning them */
+    struct upump upump;
+    memset(&upump, 0, sizeof(upump));
+    upump.cb = test_pump;
+    upump.opaque = pipes[PIPES - 1];
+    upump.profile_p = &pipes[PIPES - 2]->profile;
+    pump_uref = uref_alloc(uref_mgr);
+    assert(pump_uref != NULL);
+    upipe_profile_dispatch(&upump);
+    assert(pump_uref == NULL);
+    assert(pipes[PIPES - 2]->profile->pumps == 1);
+    assert(pipes[PIPES - 2]->profile->outputs == UREFS + 1);
+    assert(pipes[PIPES - 1]->profile->inputs == UREFS + 1);
+
+    ubase_assert(uprobe_profile_snapshot(uprobe, stdout));
+    char *label = uprobe_profile_upipe_label(pipes[0]);
+    assert(label != NULL);
+    assert(strstr(label, "test 0 (test)") == label);
+    printf("%s\n", label);
+    free(label);
+    upipe_dump(uprobe_profile_upipe_label, upipe_dump_flow_def_label_default,
+               stdout, NULL, pipes[0], NULL);
+
+    /* overhead compared to an unprofiled chain */
+    double profiled = run(pipes[0], uref_mgr, uclock, BENCH_UREFS);
+    for (int i = 0; i < PIPES; i++)
+        test_free(pipes[i]);
+
+    struct upipe *plain[PIPES];
+    for (int i = PIPES - 1; i >= 0; i--) {
+        plain[i] = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+        assert(plain[i] != NULL);
+        assert(plain[i]->profile == NULL);
+        if (i < PIPES - 1)
+            test_pipe_from_upipe(plain[i])->output = plain[i + 1];
+    }
+    double unprofiled = run(plain[0], uref_mgr, uclock, BENCH_UREFS);
+    for (int i = 0; i < PIPES; i++)
+        test_free(plain[i]);
+    fprintf(stderr, "%d urefs through %d pipes: %f s profiled, "
+            "%f s unprofiled\n", BENCH_UREFS, PIPES, profiled, unprofiled);
+
+    uprobe_release(uprobe);
+    uprobe_release(logger);
+    uclock_release(uclock);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for uprobe_trace implementation
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_trace.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_trace.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/upipe.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#define UDICT_POOL_DEPTH 10
+#define UREF_POOL_DEPTH 10
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define PIPES 3
+#define UREFS 1000
+#define SAMPLING 10
+/** urefs tagged by the first pipe */
+#define TAGGED (UREFS / SAMPLING)
+/** urefs tagged by the last pipe, which runs in another thread */
+#define RETAGGED ((UREFS - TAGGED) / SAMPLING)
+#define BENCH_UREFS 1000000
+
+/** helper phony pipe */
+struct test_pipe {
+    /** output pipe */
+    struct upipe *output;
+    /** urefs held for another thread, if there is no output */
+    struct uref *held[UREFS];
+    /** number of received urefs */
+    unsigned int count;
+    /** number of received tagged urefs */
+    unsigned int tagged;
+    /** public structure */
+    struct upipe upipe;
+};
+
+UBASE_FROM_TO(test_pipe, upipe, upipe, upipe)
+
+/** true to hold urefs in pipes without output */
+static bool hold = false;
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct test_pipe *test_pipe = malloc(sizeof(struct test_pipe));
+    assert(test_pipe != NULL);
+    test_pipe->output = NULL;
+    test_pipe->count = 0;
+    test_pipe->tagged = 0;
+    upipe_init(&test_pipe->upipe, mgr, uprobe);
+    upipe_throw_ready(&test_pipe->upipe);
+    return &test_pipe->upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct test_pipe *test_pipe = test_pipe_from_upipe(upipe);
+    uint64_t id;
+    if (ubase_check(uref_trace_get_id(uref, &id)))
+        test_pipe->tagged++;
+    if (test_pipe->output != NULL)
+        upipe_input(test_pipe->output, uref, upump_p);
+    else if (hold)
+        test_pipe->held[test_pipe->count] = uref;
+    else
+        uref_free(uref);
+    test_pipe->count++;
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    struct test_pipe *test_pipe = test_pipe_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(test_pipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = UBASE_FOURCC('t','e','s','t'),
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = NULL
+};
+
+/** pipes of the traced chain */
+static struct upipe *pipes[PIPES];
+
+/** sends the urefs held by the second pipe into the last one */
+static void *thread(void *unused)
+{
+    struct test_pipe *test_pipe = test_pipe_from_upipe(pipes[PIPES - 2]);
+    for (unsigned int i = 0; i < test_pipe->count; i++)
+        upipe_input(pipes[PIPES - 1], test_pipe->held[i], NULL);
+    return NULL;
+}
+
+/** sends urefs through a chain of pipes and returns the elapsed time */
+static double run(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                  unsigned int nb)
+{
+    clock_t start = clock();
+    for (unsigned int i = 0; i < nb; i++) {
+        struct uref *uref = uref_alloc(uref_mgr);
+        assert(uref != NULL);
+        upipe_input(upipe, uref, NULL);
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/** counts the occurrences of a string */
+static unsigned int count(const char *haystack, const char *needle)
+{
+    unsigned int nb = 0;
+    while ((haystack = strstr(haystack, needle)) != NULL) {
+        haystack++;
+        nb++;
+    }
+    return nb;
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct uclock *uclock = uclock_std_alloc(0);
+    assert(uclock != NULL);
+
+    struct uprobe *logger = uprobe_stdio_alloc(NULL, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    struct uprobe *uprobe = uprobe_trace_alloc(uprobe_use(logger), uclock,
+                                               SAMPLING, NULL);
+    assert(uprobe != NULL);
+
+    /* traced chain, the last pipe running in another thread */
+    for (int i = PIPES - 1; i >= 0; i--) {
+        char name[16];
+        snprintf(name, sizeof(name), "test %d", i);
+        pipes[i] = upipe_void_alloc(&test_mgr,
+                uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_LEVEL, name));
+        assert(pipes[i] != NULL);
+        assert(pipes[i]->trace != NULL);
+        if (i < PIPES - 2)
+            test_pipe_from_upipe(pipes[i])->output = pipes[i + 1];
+    }
+
+    hold = true;
+    run(pipes[0], uref_mgr, UREFS);
+    pthread_t id;
+    assert(pthread_create(&id, NULL, thread, NULL) == 0);
+    assert(pthread_join(id, NULL) == 0);
+    hold = false;
+    for (int i = 0; i < PIPES; i++) {
+        assert(test_pipe_from_upipe(pipes[i])->count == UREFS);
+        assert(test_pipe_from_upipe(pipes[i])->tagged ==
+               TAGGED + (i == PIPES - 1 ? RETAGGED : 0));
+    }
+
+    FILE *file = tmpfile();
+    assert(file != NULL);
+    ubase_assert(uprobe_trace_write(uprobe, file));
+    long size = ftell(file);
+    assert(size > 0);
+    char *json = malloc(size + 1);
+    assert(json != NULL);
+    rewind(file);
+    assert(fread(json, 1, size, file) == size);
+    json[size] = '\0';
+    fclose(file);
+    assert(count(json, "\"ph\":\"M\"") == 2);
+    assert(count(json, "\"ph\":\"X\"") == PIPES * TAGGED + RETAGGED);
+    assert(count(json, "\"ph\":\"s\"") == TAGGED + RETAGGED);
+    assert(count(json, "\"ph\":\"t\"") == (PIPES - 1) * TAGGED);
+    assert(count(json, "\"name\":\"test 2\"") == TAGGED + RETAGGED);
+    assert(strstr(json, "\"cat\":\"test\"") != NULL);
+    free(json);
+
+    /* overhead compared to an untraced chain */
+    test_pipe_from_upipe(pipes[PIPES - 2])->output = pipes[PIPES - 1];
+    double traced = run(pipes[0], uref_mgr, BENCH_UREFS);
+    for (int i = 0; i < PIPES; i++)
+        test_free(pipes[i]);
+
+    struct upipe *plain[PIPES];
+    for (int i = PIPES - 1; i >= 0; i--) {
+        plain[i] = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+        assert(plain[i] != NULL);
+        assert(plain[i]->trace == NULL);
+        if (i < PIPES - 1)
+            test_pipe_from_upipe(plain[i])->output = plain[i + 1];
+    }
+    double untraced = run(plain[0], uref_mgr, BENCH_UREFS);
+    for (int i = 0; i < PIPES; i++)
+        test_free(plain[i]);
+    fprintf(stderr, "%d urefs through %d pipes: %f s traced (1/%d), "
+            "%f s untraced\n", BENCH_UREFS, PIPES, traced, SAMPLING,
+            untraced);
+
+    uprobe_release(uprobe);
+    uprobe_release(logger);
+    uclock_release(uclock);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}